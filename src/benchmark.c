@@ -0,0 +1,347 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "benchmark.h"
+#include "dither.h"
+#include <direct/clock.h>
+#include <direct/memcpy.h>
+
+/**********************************************************************************************************************/
+
+void
+BenchmarkInit( Benchmark  *bench,
+               const char *output,
+               const char *baseline,
+               float       threshold )
+{
+     memset( bench, 0, sizeof(Benchmark) );
+
+     bench->output    = output;
+     bench->baseline  = baseline;
+     bench->threshold = threshold;
+}
+
+void
+BenchmarkReport( Benchmark  *bench,
+                 const char *name,
+                 double      value,
+                 const char *unit,
+                 bool        higher_is_better )
+{
+     BenchmarkResult *result;
+
+     if (bench->num_results == BENCHMARK_MAX_RESULTS) {
+          D_WARN( "too many benchmark results" );
+          return;
+     }
+
+     result = &bench->results[bench->num_results++];
+
+     snprintf( result->name, sizeof(result->name), "%s", name );
+
+     result->value            = value;
+     result->unit             = unit;
+     result->higher_is_better = higher_is_better;
+}
+
+DFBResult
+BenchmarkRender( Benchmark             *bench,
+                 DocumentProvider      *provider,
+                 const char            *filename,
+                 IDirectFB             *idirectfb,
+                 float                  zoom,
+                 DFBSurfacePixelFormat  format )
+{
+     DFBResult            ret;
+     DocumentDescription  desc;
+     int                  pageno;
+     int                  width, height;
+     int                  pages   = 0;
+     long long            pixels  = 0;
+     long long            slowest = 0;
+     long long            start, stop, time;
+     char                 name[64];
+     IDirectFBSurface    *surface;
+
+     ret = provider->Init( provider, filename, idirectfb, format );
+     if (ret)
+          return ret;
+
+     provider->GetDescription( provider, &desc );
+
+     if (desc.num_pages < 1) {
+          ret = DFB_INVARG;
+          goto out;
+     }
+
+     start = direct_clock_get_micros();
+
+     /* Render the document at least once, and again until the minimum duration is reached. */
+     for (pageno = 1; ; pageno = pageno % desc.num_pages + 1) {
+          time = direct_clock_get_micros();
+
+          ret = provider->RenderPage( provider, pageno, zoom, &surface );
+          if (ret)
+               goto out;
+
+          stop = direct_clock_get_micros();
+
+          if (stop - time > slowest)
+               slowest = stop - time;
+
+          surface->GetSize( surface, &width, &height );
+          surface->Release( surface );
+
+          pixels += width * height;
+          pages++;
+
+          if (pages >= desc.num_pages && stop - start >= BENCHMARK_MIN_MICROS)
+               break;
+     }
+
+     snprintf( name, sizeof(name), "render.%s.page", provider->impl );
+     BenchmarkReport( bench, name, (stop - start) / 1000.0 / pages, "ms", false );
+
+     /* Rank the provider for the document format. */
+     DocumentProviderSetRenderTime( filename, provider->impl, (stop - start) / 1000.0 / pages );
+
+     snprintf( name, sizeof(name), "render.%s.slowest", provider->impl );
+     BenchmarkReport( bench, name, slowest / 1000.0, "ms", false );
+
+     snprintf( name, sizeof(name), "render.%s.throughput", provider->impl );
+     BenchmarkReport( bench, name, (double) pixels / (stop - start), "Mpixel/s", true );
+
+out:
+     provider->Term( provider );
+
+     return ret;
+}
+
+DFBResult
+BenchmarkConvert( Benchmark *bench,
+                  int        width,
+                  int        height )
+{
+     int        x, y;
+     int        runs;
+     long long  start, stop;
+     u32       *src;
+     u8        *dst;
+     u32       *pixel;
+
+     src = D_MALLOC( width * height * 4 );
+     if (!src)
+          return D_OOM();
+
+     dst = D_MALLOC( width * height * 4 );
+     if (!dst) {
+          D_FREE( src );
+          return D_OOM();
+     }
+
+     /* Smooth contents, as produced by the providers. */
+     for (y = 0, pixel = src; y < height; y++) {
+          for (x = 0; x < width; x++)
+               *pixel++ = 0xff000000 | (x & 0xff) << 16 | (y & 0xff) << 8 | ((x + y) & 0xff);
+     }
+
+     start = direct_clock_get_micros();
+
+     for (runs = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; runs++) {
+          for (y = 0; y < height; y++)
+               direct_memcpy( dst + y * width * 4, src + y * width, width * 4 );
+
+          stop = direct_clock_get_micros();
+     }
+
+     BenchmarkReport( bench, "convert.copy", (double) runs * width * height * 4 / (stop - start), "MB/s", true );
+
+     start = direct_clock_get_micros();
+
+     for (runs = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; runs++) {
+          Dither_RGB16( src, width * 4, DSPF_ARGB, dst, width * 2, width, height );
+
+          stop = direct_clock_get_micros();
+     }
+
+     BenchmarkReport( bench, "convert.rgb16", (double) runs * width * height * 4 / (stop - start), "MB/s", true );
+
+     D_FREE( dst );
+     D_FREE( src );
+
+     return DFB_OK;
+}
+
+DFBResult
+BenchmarkScroll( Benchmark        *bench,
+                 IDirectFB        *idirectfb,
+                 IDirectFBSurface *page,
+                 int               width,
+                 int               height )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     int                    page_width, page_height;
+     int                    x = 0, y = 0;
+     int                    dx = 4, dy = 16;
+     int                    frames;
+     long long              start, stop;
+     IDirectFBSurface      *view;
+
+     page->GetSize( page, &page_width, &page_height );
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = width;
+     desc.height      = height;
+     page->GetPixelFormat( page, &desc.pixelformat );
+
+     ret = idirectfb->CreateSurface( idirectfb, &desc, &view );
+     if (ret)
+          return ret;
+
+     start = direct_clock_get_micros();
+
+     for (frames = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; frames++) {
+          /* Bounce the view across the page. */
+          if (x + dx < 0 || x + dx > page_width - width)
+               dx = -dx;
+
+          if (y + dy < 0 || y + dy > page_height - height)
+               dy = -dy;
+
+          if (page_width > width)
+               x += dx;
+
+          if (page_height > height)
+               y += dy;
+
+          view->Clear( view, 0x00, 0x00, 0x23, 0xff );
+          view->Blit( view, page, NULL, -x, -y );
+
+          idirectfb->WaitIdle( idirectfb );
+
+          stop = direct_clock_get_micros();
+     }
+
+     BenchmarkReport( bench, "scroll.frame", (stop - start) / 1000.0 / frames, "ms", false );
+
+     view->Release( view );
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
+static bool
+Benchmark_ReadBaseline( const char      *filename,
+                        const char      *name,
+                        BenchmarkResult *ret_result )
+{
+     FILE *file;
+     char  line[256];
+     char  key[64];
+     char  better[8];
+     bool  found = false;
+
+     file = fopen( filename, "r" );
+     if (!file)
+          return false;
+
+     /* One result per line, as written by BenchmarkFinish(). */
+     while (fgets( line, sizeof(line), file )) {
+          if (sscanf( line, " { \"name\": \"%63[^\"]\", \"value\": %lf, \"unit\": \"%*[^\"]\", "
+                            "\"higher_is_better\": %7[a-z] }", key, &ret_result->value, better ) != 3)
+               continue;
+
+          if (!strcmp( key, name )) {
+               ret_result->higher_is_better = !strcmp( better, "true" );
+               found = true;
+               break;
+          }
+     }
+
+     fclose( file );
+
+     return found;
+}
+
+DFBResult
+BenchmarkFinish( Benchmark *bench )
+{
+     int              i;
+     FILE            *file;
+     BenchmarkResult  base;
+     int              regressions = 0;
+
+     if (bench->baseline && access( bench->baseline, R_OK )) {
+          D_ERROR( "Projektor/Benchmark: Cannot read baseline '%s'!\n", bench->baseline );
+          return DFB_FILENOTFOUND;
+     }
+
+     for (i = 0; i < bench->num_results; i++) {
+          BenchmarkResult *result = &bench->results[i];
+          float            change;
+
+          if (!bench->baseline || !Benchmark_ReadBaseline( bench->baseline, result->name, &base ) || !base.value) {
+               printf( "%-32s %12.3f %s\n", result->name, result->value, result->unit );
+               continue;
+          }
+
+          /* Positive changes are regressions. */
+          change = 100 * (result->value - base.value) / base.value;
+          if (result->higher_is_better)
+               change = -change;
+
+          printf( "%-32s %12.3f %-8s %+7.1f%%%s\n", result->name, result->value, result->unit, change,
+                  change > bench->threshold ? "  REGRESSION" : "" );
+
+          if (change > bench->threshold)
+               regressions++;
+     }
+
+     if (bench->output) {
+          file = fopen( bench->output, "w" );
+          if (!file) {
+               D_ERROR( "Projektor/Benchmark: Cannot write results to '%s'!\n", bench->output );
+               return DFB_IO;
+          }
+
+          fprintf( file, "{\n  \"results\": [\n" );
+
+          for (i = 0; i < bench->num_results; i++) {
+               BenchmarkResult *result = &bench->results[i];
+
+               fprintf( file,
+                        "    { \"name\": \"%s\", \"value\": %.6f, \"unit\": \"%s\", \"higher_is_better\": %s }%s\n",
+                        result->name, result->value, result->unit, result->higher_is_better ? "true" : "false",
+                        i < bench->num_results - 1 ? "," : "" );
+          }
+
+          fprintf( file, "  ]\n}\n" );
+
+          fclose( file );
+     }
+
+     if (regressions) {
+          D_ERROR( "Projektor/Benchmark: %d metric%s regressed by more than %.1f%%!\n", regressions,
+                   regressions > 1 ? "s" : "", bench->threshold );
+          return DFB_FAILURE;
+     }
+
+     return DFB_OK;
+}
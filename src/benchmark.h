@@ -0,0 +1,88 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "documentprovider.h"
+
+#define BENCHMARK_MAX_RESULTS 64
+
+/* Minimum duration of a measurement. */
+#define BENCHMARK_MIN_MICROS  1000000
+
+typedef struct {
+     char         name[64];
+     double       value;
+     const char  *unit;
+     bool         higher_is_better;
+} BenchmarkResult;
+
+typedef struct {
+     const char       *output;                    /* JSON results file, NULL for none */
+     const char       *baseline;                  /* JSON baseline file, NULL for none */
+     float             threshold;                 /* tolerated regression in percent */
+
+     BenchmarkResult   results[BENCHMARK_MAX_RESULTS];
+     int               num_results;
+} Benchmark;
+
+void      BenchmarkInit   ( Benchmark              *bench,
+                            const char             *output,
+                            const char             *baseline,
+                            float                   threshold );
+
+void      BenchmarkReport ( Benchmark              *bench,
+                            const char             *name,
+                            double                  value,
+                            const char             *unit,
+                            bool                    higher_is_better );
+
+/*
+ * RenderPage throughput of a document provider over the pages of a document.
+ */
+DFBResult BenchmarkRender ( Benchmark              *bench,
+                            DocumentProvider       *provider,
+                            const char             *filename,
+                            IDirectFB              *idirectfb,
+                            float                   zoom,
+                            DFBSurfacePixelFormat   format );
+
+/*
+ * Copy and RGB16 conversion of rendered pixels to surfaces.
+ */
+DFBResult BenchmarkConvert( Benchmark              *bench,
+                            int                     width,
+                            int                     height );
+
+/*
+ * Page blits while scrolling a page larger than the view, as done by the page view.
+ */
+DFBResult BenchmarkScroll ( Benchmark              *bench,
+                            IDirectFB              *idirectfb,
+                            IDirectFBSurface       *page,
+                            int                     width,
+                            int                     height );
+
+/*
+ * Print the results, write them to the output file, and compare them with the baseline. Returns DFB_FAILURE if a
+ * metric regressed past the threshold.
+ */
+DFBResult BenchmarkFinish ( Benchmark              *bench );
+
+#endif
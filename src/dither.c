@@ -0,0 +1,117 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "dither.h"
+#include <direct/messages.h>
+
+/**********************************************************************************************************************/
+
+static const u8 bayer4x4[4][4] = {
+     {  0,  8,  2, 10 },
+     { 12,  4, 14,  6 },
+     {  3, 11,  1,  9 },
+     { 15,  7, 13,  5 }
+};
+
+/*
+ * Per row thresholds, pre-shifted for the 5 bit (red, blue) and 6 bit (green) channels, and saturation table for the
+ * biased 8 bit values (at most 255 + 7).
+ */
+
+typedef struct {
+     u8 rb[4];
+     u8 g[4];
+} DitherRow;
+
+static u8 sat5[256 + 8];
+static u8 sat6[256 + 4];
+
+__attribute__((constructor))
+static void
+Dither_ctor()
+{
+     int i;
+
+     for (i = 0; i < 256 + 8; i++)
+          sat5[i] = (i >> 3) > 31 ? 31 : i >> 3;
+
+     for (i = 0; i < 256 + 4; i++)
+          sat6[i] = (i >> 2) > 63 ? 63 : i >> 2;
+}
+
+static inline u16
+dither_pixel( const DitherRow *row,
+              int              x,
+              unsigned int     r,
+              unsigned int     g,
+              unsigned int     b )
+{
+     const unsigned int rb = row->rb[x & 3];
+
+     return (sat5[r + rb] << 11) | (sat6[g + row->g[x & 3]] << 5) | sat5[b + rb];
+}
+
+void
+Dither_RGB16( const void            *src,
+              int                    src_pitch,
+              DFBSurfacePixelFormat  src_format,
+              void                  *dst,
+              int                    dst_pitch,
+              int                    width,
+              int                    height )
+{
+     int x, y, i;
+
+     for (y = 0; y < height; y++) {
+          DitherRow  row;
+          const u8  *s = (const u8*) src + y * src_pitch;
+          u16       *d = (u16*) ((u8*) dst + y * dst_pitch);
+
+          for (i = 0; i < 4; i++) {
+               row.rb[i] = bayer4x4[y & 3][i] >> 1;
+               row.g[i]  = bayer4x4[y & 3][i] >> 2;
+          }
+
+          switch (src_format) {
+               case DSPF_ARGB:
+                    for (x = 0; x < width; x++) {
+                         const u32 p = ((const u32*) s)[x];
+
+                         d[x] = dither_pixel( &row, x, (p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff );
+                    }
+                    break;
+
+               case DSPF_ABGR:
+                    for (x = 0; x < width; x++) {
+                         const u32 p = ((const u32*) s)[x];
+
+                         d[x] = dither_pixel( &row, x, p & 0xff, (p >> 8) & 0xff, (p >> 16) & 0xff );
+                    }
+                    break;
+
+               case DSPF_RGB24:
+                    for (x = 0; x < width; x++, s += 3)
+                         d[x] = dither_pixel( &row, x, s[2], s[1], s[0] );
+                    break;
+
+               default:
+                    D_BUG( "unexpected pixelformat" );
+                    return;
+          }
+     }
+}
@@ -0,0 +1,36 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __DITHER_H__
+#define __DITHER_H__
+
+#include <directfb.h>
+
+/*
+ * Convert a rendered page from one of the provider native formats (DSPF_ARGB, DSPF_ABGR or DSPF_RGB24) to DSPF_RGB16,
+ * using a 4x4 ordered dither matrix.
+ */
+void Dither_RGB16( const void            *src,
+                   int                    src_pitch,
+                   DFBSurfacePixelFormat  src_format,
+                   void                  *dst,
+                   int                    dst_pitch,
+                   int                    width,
+                   int                    height );
+
+#endif
@@ -16,29 +16,81 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#include "dither.h"
 #include "documentprovider.h"
+#include <ctype.h>
+#include <direct/clock.h>
 #include <direct/memcpy.h>
 #include <libdjvu/ddjvuapi.h>
+#include <limits.h>
 
 extern DirectLink *documentproviders;
 
+/*
+ * Backgrounds of scanned pages are usually encoded at a third of the page resolution.
+ */
+#define DJVU_BACKGROUND_SUBSAMPLE  3
+#define DJVU_BACKGROUND_CACHE_SIZE (16 << 20)
+
+/*
+ * Pages decoded progressively are rendered again at most every 100 milliseconds.
+ */
+#define DJVU_PROGRESS_INTERVAL     100
+
 /**********************************************************************************************************************/
 
+/*
+ * Background layer of a page at its encoded resolution, without pixmap if the page has no separate layers.
+ */
+typedef struct {
+     DirectLink  link;
+
+     int         pageno;
+     int         width;
+     int         height;
+     char       *pixmap;
+} DjVuBackground;
+
 typedef struct {
-     IDirectFB           *idirectfb;
+     IDirectFB             *idirectfb;
+     DFBSurfacePixelFormat  format;
+
+     ddjvu_context_t       *ctx;
+     ddjvu_document_t      *doc;
+     char                   dir[PATH_MAX];           /* of the components of indirect documents */
+
+     DirectLink            *backgrounds;             /* most recently used first */
+     unsigned long          backgrounds_size;
+     unsigned long          backgrounds_limit;
 
-     ddjvu_context_t     *ctx;
-     ddjvu_document_t    *doc;
+     DocumentProgressFunc   progress;
+     void                  *progress_ctx;
 
-     DocumentDescription  desc;
+     DocumentDescription    desc;
 } DocumentProvider_DjVu_data;
 
 /**********************************************************************************************************************/
 
+static int
+DocumentProvider_DjVu_Probe( DocumentProvider *thiz,
+                             const u8         *header,
+                             unsigned int      length )
+{
+     if (length < 16 || memcmp( header, "AT&TFORM", 8 ))
+          return 0;
+
+     /* Single page or multi page document. */
+     if (!memcmp( header + 12, "DJVU", 4 ) || !memcmp( header + 12, "DJVM", 4 ))
+          return 100;
+
+     return 25;
+}
+
 static DFBResult
-DocumentProvider_DjVu_Init( DocumentProvider *thiz,
-                            const char       *filename,
-                            IDirectFB        *idirectfb )
+DocumentProvider_DjVu_Init( DocumentProvider      *thiz,
+                            const char            *filename,
+                            IDirectFB             *idirectfb,
+                            DFBSurfacePixelFormat  format )
 {
      DFBResult                    ret = DFB_FAILURE;
      DocumentProvider_DjVu_data *data;
@@ -47,7 +99,9 @@ DocumentProvider_DjVu_Init( DocumentProvider *thiz,
      if (!data)
           return D_OOM();;
 
-     data->idirectfb = idirectfb;
+     data->idirectfb         = idirectfb;
+     data->format            = format;
+     data->backgrounds_limit = DJVU_BACKGROUND_CACHE_SIZE;
 
      data->ctx = ddjvu_context_create( "DjVu" );
      if (!data->ctx)
@@ -60,10 +114,14 @@ DocumentProvider_DjVu_Init( DocumentProvider *thiz,
      ddjvu_message_wait( data->ctx );
      ddjvu_message_pop( data->ctx );
 
-     if (strrchr( filename, '/' ))
+     if (strrchr( filename, '/' )) {
           snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, strrchr( filename, '/' ) + 1 );
-     else
+          snprintf( data->dir, sizeof(data->dir), "%.*s", (int) (strrchr( filename, '/' ) - filename), filename );
+     }
+     else {
           snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, filename );
+          snprintf( data->dir, sizeof(data->dir), "." );
+     }
 
      data->desc.num_pages = ddjvu_document_get_pagenum( data->doc );
 
@@ -80,11 +138,37 @@ error:
      return ret;
 }
 
+static void
+DocumentProvider_DjVu_TrimBackgrounds( DocumentProvider_DjVu_data *data,
+                                       unsigned long               limit )
+{
+     while (data->backgrounds_size > limit) {
+          DjVuBackground *background = (DjVuBackground*) direct_list_get_last( data->backgrounds );
+
+          if (!background)
+               break;
+
+          direct_list_remove( &data->backgrounds, &background->link );
+
+          data->backgrounds_size -= sizeof(DjVuBackground);
+
+          if (background->pixmap) {
+               data->backgrounds_size -= background->width * background->height * 3;
+
+               D_FREE( background->pixmap );
+          }
+
+          D_FREE( background );
+     }
+}
+
 static DFBResult
 DocumentProvider_DjVu_Term( DocumentProvider *thiz )
 {
      DocumentProvider_DjVu_data *data = thiz->priv;
 
+     DocumentProvider_DjVu_TrimBackgrounds( data, 0 );
+
      ddjvu_document_release( data->doc );
 
      ddjvu_context_release( data->ctx );
@@ -108,45 +192,374 @@ DocumentProvider_DjVu_GetDescription( DocumentProvider    *thiz,
      return DFB_OK;
 }
 
+/*
+ * Size of the background layer, from the page size.
+ */
+static inline int
+DocumentProvider_DjVu_Subsample( int size )
+{
+     return (size + DJVU_BACKGROUND_SUBSAMPLE - 1) / DJVU_BACKGROUND_SUBSAMPLE;
+}
+
+/*
+ * Background layer of a page, decoded once at its encoded resolution and kept across zoom changes.
+ */
+static DjVuBackground *
+DocumentProvider_DjVu_GetBackground( DocumentProvider_DjVu_data *data,
+                                     ddjvu_page_t               *page,
+                                     int                         pageno,
+                                     ddjvu_format_t             *format )
+{
+     DjVuBackground *background;
+     ddjvu_rect_t    rect;
+     ddjvu_rect_t    probe = { 0, 0, 1, 1 };
+     char            pixel[3];
+     unsigned long   size;
+
+     direct_list_foreach (background, data->backgrounds) {
+          if (background->pageno == pageno) {
+               direct_list_move_to_front( &data->backgrounds, &background->link );
+               return background;
+          }
+     }
+
+     background = D_CALLOC( 1, sizeof(DjVuBackground) );
+     if (!background) {
+          D_OOM();
+          return NULL;
+     }
+
+     background->pageno = pageno;
+     background->width  = DocumentProvider_DjVu_Subsample( ddjvu_page_get_width( page ) );
+     background->height = DocumentProvider_DjVu_Subsample( ddjvu_page_get_height( page ) );
+
+     rect.x = 0;
+     rect.y = 0;
+     rect.w = background->width;
+     rect.h = background->height;
+
+     size = sizeof(DjVuBackground);
+
+     /* Bitonal pages have no background and photos have no mask, they are rendered in one pass. */
+     if (ddjvu_page_render( page, DDJVU_RENDER_MASKONLY, &rect, &probe, format, sizeof(pixel), pixel )) {
+          background->pixmap = D_MALLOC( background->width * background->height * 3 );
+          if (!background->pixmap) {
+               D_OOM();
+               D_FREE( background );
+               return NULL;
+          }
+
+          if (ddjvu_page_render( page, DDJVU_RENDER_BACKGROUND, &rect, &rect, format, background->width * 3,
+                                 background->pixmap ))
+               size += background->width * background->height * 3;
+          else {
+               D_FREE( background->pixmap );
+               background->pixmap = NULL;
+          }
+     }
+
+     DocumentProvider_DjVu_TrimBackgrounds( data, data->backgrounds_limit > size ?
+                                                  data->backgrounds_limit - size : 0 );
+
+     direct_list_prepend( &data->backgrounds, &background->link );
+
+     data->backgrounds_size += size;
+
+     return background;
+}
+
+/*
+ * Bilinear upscale of a background to the page size, within the render rectangle.
+ */
 static DFBResult
-DocumentProvider_DjVu_RenderPage( DocumentProvider  *thiz,
-                                  int                pageno,
-                                  float              zoom,
-                                  IDirectFBSurface **ret_surface )
+DocumentProvider_DjVu_Upscale( const DjVuBackground *background,
+                               char                 *pixmap,
+                               const ddjvu_rect_t   *pagerect,
+                               const ddjvu_rect_t   *rect )
 {
-     DFBResult                   ret = DFB_FAILURE;
-     DFBSurfaceDescription       desc;
-     int                         y;
-     int                         dpi;
-     ddjvu_rect_t                rect;
-     int                         pitch;
-     void                       *ptr;
-     unsigned char              *src;
-     IDirectFBSurface           *surface;
-     ddjvu_format_t             *format = NULL;
-     ddjvu_page_t               *page   = NULL;
-     char                       *pixmap = NULL;
-     DocumentProvider_DjVu_data *data   = thiz->priv;
+     int  x, y, c;
+     int *offsets;
+     int *weights;
+     int  width  = pagerect->w;
+     int  height = pagerect->h;
+
+     offsets = D_MALLOC( rect->w * 2 * sizeof(int) );
+     if (!offsets)
+          return D_OOM();
+
+     weights = offsets + rect->w;
+
+     /* Source positions of pixel centers, in 24.8 fixed point. */
+     for (x = 0; x < rect->w; x++) {
+          int sx = MAX( 0, (int) (((rect->x + x + 0.5f) * background->width / width - 0.5f) * 256) );
+
+          offsets[x] = MIN( sx >> 8, background->width - 2 ) * 3;
+          weights[x] = (sx >> 8) < background->width - 1 ? sx & 0xff : 0x100;
+     }
+
+     for (y = 0; y < rect->h; y++) {
+          int       sy  = MAX( 0, (int) (((rect->y + y + 0.5f) * background->height / height - 0.5f) * 256) );
+          int       row = MIN( sy >> 8, background->height - 2 );
+          int       wy  = (sy >> 8) < background->height - 1 ? sy & 0xff : 0x100;
+          const u8 *s0  = (const u8*) background->pixmap + row * background->width * 3;
+          const u8 *s1  = s0 + background->width * 3;
+          u8       *dst = (u8*) pixmap + y * rect->w * 3;
+
+          for (x = 0; x < rect->w; x++) {
+               int wx = weights[x];
+
+               for (c = 0; c < 3; c++) {
+                    int o      = offsets[x] + c;
+                    int top    = s0[o] * (0x100 - wx) + s0[o + 3] * wx;
+                    int bottom = s1[o] * (0x100 - wx) + s1[o + 3] * wx;
+
+                    *dst++ = (top * (0x100 - wy) + bottom * wy) >> 16;
+               }
+          }
+     }
+
+     D_FREE( offsets );
+
+     return DFB_OK;
+}
+
+/*
+ * Composite the foreground of a page through its mask over the upscaled background. Only the mask and the foreground
+ * colors are rendered at the page size, the background is decoded once per page.
+ */
+static bool
+DocumentProvider_DjVu_RenderLayers( DocumentProvider_DjVu_data *data,
+                                    ddjvu_page_t               *page,
+                                    int                         pageno,
+                                    ddjvu_rect_t               *pagerect,
+                                    ddjvu_rect_t               *rect,
+                                    ddjvu_format_t             *format,
+                                    char                       *pixmap )
+{
+     DjVuBackground *background;
+     ddjvu_format_t *grey;
+     int             i;
+     bool            done       = false;
+     u8             *foreground = NULL;
+     u8             *mask       = NULL;
+     int             size       = rect->w * rect->h;
+
+     /* Smaller renders are cheap, and would lose detail from the downscaled background, it is not decoded for them. */
+     if (pagerect->w <= DocumentProvider_DjVu_Subsample( ddjvu_page_get_width( page ) ) ||
+         pagerect->h <= DocumentProvider_DjVu_Subsample( ddjvu_page_get_height( page ) ))
+          return false;
+
+     background = DocumentProvider_DjVu_GetBackground( data, page, pageno, format );
+     if (!background || !background->pixmap || background->width < 2 || background->height < 2)
+          return false;
+
+     grey = ddjvu_format_create( DDJVU_FORMAT_GREY8, 0, NULL );
+     if (!grey)
+          return false;
+
+     ddjvu_format_set_row_order( grey, 1 );
+
+     foreground = D_MALLOC( size * 3 );
+     mask       = D_MALLOC( size );
+     if (!foreground || !mask)
+          goto out;
+
+     if (!ddjvu_page_render( page, DDJVU_RENDER_MASKONLY, pagerect, rect, grey, rect->w, (char*) mask ) ||
+         !ddjvu_page_render( page, DDJVU_RENDER_FOREGROUND, pagerect, rect, format, rect->w * 3, (char*) foreground ))
+          goto out;
+
+     if (DocumentProvider_DjVu_Upscale( background, pixmap, pagerect, rect ))
+          goto out;
+
+     /* The mask is black where the foreground is shown, and grey at its anti-aliased edges. */
+     for (i = 0; i < size; i++) {
+          int       m   = mask[i];
+          u8       *dst = (u8*) pixmap + i * 3;
+          const u8 *src = foreground + i * 3;
+
+          if (m == 0xff)
+               continue;
+
+          dst[0] = (dst[0] * m + src[0] * (0xff - m) + 0x7f) / 0xff;
+          dst[1] = (dst[1] * m + src[1] * (0xff - m) + 0x7f) / 0xff;
+          dst[2] = (dst[2] * m + src[2] * (0xff - m) + 0x7f) / 0xff;
+     }
+
+     done = true;
+
+out:
+     if (mask)
+          D_FREE( mask );
+
+     if (foreground)
+          D_FREE( foreground );
+
+     ddjvu_format_release( grey );
+
+     return done;
+}
+
+/*
+ * Open a page and wait for it to be decoded, or only for its size to be known.
+ */
+static ddjvu_page_t *
+DocumentProvider_DjVu_LoadPage( DocumentProvider_DjVu_data *data,
+                                int                         pageno,
+                                bool                        decoded )
+{
+     ddjvu_page_t *page;
 
      page = ddjvu_page_create_by_pageno( data->doc, pageno - 1 );
      if (!page)
-          goto out;
+          return NULL;
 
-     while (!ddjvu_page_decoding_done( page )) {
+     while (!ddjvu_page_decoding_done( page ) && (decoded || !ddjvu_page_get_width( page ))) {
           ddjvu_message_wait( data->ctx );
           ddjvu_message_pop( data->ctx );
      }
 
-     dpi = ddjvu_page_get_resolution( page );
+     return page;
+}
+
+/*
+ * Page rectangle at a zoom factor, 100 dpi at zoom factor 1.
+ */
+static void
+DocumentProvider_DjVu_PageRect( ddjvu_page_t *page,
+                                float         zoom,
+                                ddjvu_rect_t *ret_rect )
+{
+     int dpi = ddjvu_page_get_resolution( page );
+
+     ret_rect->x = 0;
+     ret_rect->y = 0;
+     ret_rect->w = ddjvu_page_get_width( page )  * 100 * zoom / dpi;
+     ret_rect->h = ddjvu_page_get_height( page ) * 100 * zoom / dpi;
+}
+
+/*
+ * Copy a render to the page surface.
+ */
+static void
+DocumentProvider_DjVu_Copy( IDirectFBSurface      *surface,
+                            DFBSurfacePixelFormat  format,
+                            const char            *pixmap,
+                            int                    width,
+                            int                    height )
+{
+     int       y;
+     int       pitch;
+     u8       *ptr;
+     const u8 *src = (const u8*) pixmap;
+
+     surface->Lock( surface, DSLF_WRITE, (void**) &ptr, &pitch );
+
+     if (format == DSPF_RGB16) {
+          Dither_RGB16( src, width * 3, DSPF_RGB24, ptr, pitch, width, height );
+     }
+     else {
+          for (y = 0; y < height; y++) {
+               direct_memcpy( ptr, src, width * 3 );
+
+               src += width * 3;
+               ptr += pitch;
+          }
+     }
+
+     surface->Unlock( surface );
+}
+
+/*
+ * Wait for a page to be decoded, rendering it again as its chunks arrive, and reporting the progress.
+ */
+static void
+DocumentProvider_DjVu_Decode( DocumentProvider_DjVu_data *data,
+                              ddjvu_page_t               *page,
+                              ddjvu_rect_t               *pagerect,
+                              ddjvu_rect_t               *rect,
+                              ddjvu_format_t             *format,
+                              char                       *pixmap,
+                              IDirectFBSurface           *surface,
+                              DFBSurfacePixelFormat       pixelformat )
+{
+     ddjvu_message_t *message;
+     bool             redisplay;
+     DFBRectangle     all  = { 0, 0, rect->w, rect->h };
+     long long        last = direct_clock_get_millis();
+
+     while (!ddjvu_page_decoding_done( page )) {
+          message   = ddjvu_message_wait( data->ctx );
+          redisplay = message->m_any.tag == DDJVU_REDISPLAY && message->m_any.page == page;
+
+          ddjvu_message_pop( data->ctx );
+
+          if (!redisplay || direct_clock_get_millis() - last < DJVU_PROGRESS_INTERVAL)
+               continue;
+
+          if (ddjvu_page_render( page, DDJVU_RENDER_COLOR, pagerect, rect, format, rect->w * 3, pixmap )) {
+               DocumentProvider_DjVu_Copy( surface, pixelformat, pixmap, rect->w, rect->h );
+
+               data->progress( data->progress_ctx, surface, &all );
+          }
+
+          last = direct_clock_get_millis();
+     }
+}
+
+/*
+ * Render a page, or the part of it within a region. With a progress function, the page is rendered as it is decoded.
+ */
+static DFBResult
+DocumentProvider_DjVu_Render( DocumentProvider   *thiz,
+                              int                 pageno,
+                              float               zoom,
+                              const DocumentBox  *region,
+                              IDirectFBSurface  **ret_surface )
+{
+     DFBResult                   ret = DFB_FAILURE;
+     DFBSurfaceDescription       desc;
+     ddjvu_rect_t                pagerect;
+     ddjvu_rect_t                rect;
+     IDirectFBSurface           *surface = NULL;
+     ddjvu_format_t             *format  = NULL;
+     ddjvu_page_t               *page    = NULL;
+     char                       *pixmap  = NULL;
+     DocumentProvider_DjVu_data *data    = thiz->priv;
+
+     page = DocumentProvider_DjVu_LoadPage( data, pageno, !data->progress );
+     if (!page)
+          goto out;
+
+     DocumentProvider_DjVu_PageRect( page, zoom, &pagerect );
+
+     rect = pagerect;
+
+     if (region) {
+          DFBRectangle crop;
+
+          DocumentBoxToRectangle( region, zoom, pagerect.w, pagerect.h, &crop );
+
+          if (crop.w < 1 || crop.h < 1) {
+               ret = DFB_INVARG;
+               goto out;
+          }
+
+          rect.x = crop.x;
+          rect.y = crop.y;
+          rect.w = crop.w;
+          rect.h = crop.h;
+     }
 
      desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
-     desc.width       = ddjvu_page_get_width( page )  * 100 * zoom / dpi;
-     desc.height      = ddjvu_page_get_height( page ) * 100 * zoom / dpi;
-     desc.pixelformat = DSPF_RGB24;
+     desc.width       = rect.w;
+     desc.height      = rect.h;
+     desc.pixelformat = data->format == DSPF_RGB16 ? DSPF_RGB16 : DSPF_RGB24;
 
      pixmap = D_MALLOC( desc.width * desc.height * 4 );
-     if (!pixmap)
+     if (!pixmap) {
+          ret = D_OOM();
           goto out;
+     }
 
      format = ddjvu_format_create( DDJVU_FORMAT_BGR24, 0, NULL );
      if (!format)
@@ -154,33 +567,28 @@ DocumentProvider_DjVu_RenderPage( DocumentProvider  *thiz,
 
      ddjvu_format_set_row_order( format, 1 );
 
-     rect.x = 0;
-     rect.y = 0;
-     rect.w = desc.width;
-     rect.h = desc.height;
-
-     ddjvu_page_render( page, DDJVU_RENDER_COLOR, &rect, &rect, format, desc.width * 3, pixmap );
-
      ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
-     if (ret)
+     if (ret) {
+          surface = NULL;
           goto out;
+     }
 
-     surface->Lock( surface, DSLF_WRITE, &ptr, &pitch );
-
-     src = (unsigned char*) pixmap;
+     if (data->progress)
+          DocumentProvider_DjVu_Decode( data, page, &pagerect, &rect, format, pixmap, surface, desc.pixelformat );
 
-     for (y = 0; y < desc.height; y++) {
-          direct_memcpy( ptr, src, desc.width * 3 );
+     if (!DocumentProvider_DjVu_RenderLayers( data, page, pageno, &pagerect, &rect, format, pixmap ))
+          ddjvu_page_render( page, DDJVU_RENDER_COLOR, &pagerect, &rect, format, desc.width * 3, pixmap );
 
-          src += desc.width * 3;
-          ptr += pitch;
-     }
-
-     surface->Unlock( surface );
+     DocumentProvider_DjVu_Copy( surface, desc.pixelformat, pixmap, desc.width, desc.height );
 
      *ret_surface = surface;
 
+     surface = NULL;
+
 out:
+     if (surface)
+          surface->Release( surface );
+
      if (format)
           ddjvu_format_release( format );
 
@@ -193,12 +601,368 @@ out:
      return ret;
 }
 
+static DFBResult
+DocumentProvider_DjVu_RenderPage( DocumentProvider  *thiz,
+                                  int                pageno,
+                                  float              zoom,
+                                  IDirectFBSurface **ret_surface )
+{
+     return DocumentProvider_DjVu_Render( thiz, pageno, zoom, NULL, ret_surface );
+}
+
+static DFBResult
+DocumentProvider_DjVu_RenderRegion( DocumentProvider   *thiz,
+                                    int                 pageno,
+                                    float               zoom,
+                                    const DocumentBox  *region,
+                                    IDirectFBSurface  **ret_surface )
+{
+     return DocumentProvider_DjVu_Render( thiz, pageno, zoom, region, ret_surface );
+}
+
+/*
+ * Scan the page rendered in grey at a low resolution.
+ */
+static DFBResult
+DocumentProvider_DjVu_GetContentBox( DocumentProvider *thiz,
+                                     int               pageno,
+                                     DocumentBox      *ret_box )
+{
+     DFBResult                   ret    = DFB_FAILURE;
+     ddjvu_rect_t                rect;
+     DFBRegion                   region;
+     ddjvu_format_t             *grey   = NULL;
+     ddjvu_page_t               *page   = NULL;
+     char                       *pixmap = NULL;
+     DocumentProvider_DjVu_data *data   = thiz->priv;
+
+     page = DocumentProvider_DjVu_LoadPage( data, pageno, true );
+     if (!page)
+          goto out;
+
+     DocumentProvider_DjVu_PageRect( page, DOCUMENT_CONTENT_ZOOM, &rect );
+
+     if (rect.w < 1 || rect.h < 1)
+          goto out;
+
+     pixmap = D_MALLOC( rect.w * rect.h );
+     if (!pixmap) {
+          ret = D_OOM();
+          goto out;
+     }
+
+     grey = ddjvu_format_create( DDJVU_FORMAT_GREY8, 0, NULL );
+     if (!grey)
+          goto out;
+
+     ddjvu_format_set_row_order( grey, 1 );
+
+     if (!ddjvu_page_render( page, DDJVU_RENDER_COLOR, &rect, &rect, grey, rect.w, pixmap ))
+          goto out;
+
+     ret = DFB_ITEMNOTFOUND;
+
+     if (DocumentScanContent( pixmap, rect.w, rect.w, rect.h, 1, &region )) {
+          ret_box->x1 = region.x1 / DOCUMENT_CONTENT_ZOOM;
+          ret_box->y1 = region.y1 / DOCUMENT_CONTENT_ZOOM;
+          ret_box->x2 = (region.x2 + 1) / DOCUMENT_CONTENT_ZOOM;
+          ret_box->y2 = (region.y2 + 1) / DOCUMENT_CONTENT_ZOOM;
+
+          ret = DFB_OK;
+     }
+
+out:
+     if (grey)
+          ddjvu_format_release( grey );
+
+     if (pixmap)
+          D_FREE( pixmap );
+
+     if (page)
+          ddjvu_page_release( page );
+
+     return ret;
+}
+
+/*
+ * Page number of an internal link, 0 for a page name or an external link.
+ */
+static int
+DocumentProvider_DjVu_PageNumber( const char *url )
+{
+     if (url[0] != '#' || !isdigit( url[1] ))
+          return 0;
+
+     return atoi( url + 1 );
+}
+
+/*
+ * Outline entries are lists of a title, a link and the sub entries.
+ */
+static DFBResult
+DocumentProvider_DjVu_AddOutline( miniexp_t              list,
+                                  int                    level,
+                                  DocumentOutlineEntry **entries,
+                                  int                   *num )
+{
+     DFBResult ret = DFB_OK;
+
+     for (; miniexp_consp( list ) && !ret; list = miniexp_cdr( list )) {
+          miniexp_t entry = miniexp_car( list );
+
+          if (!miniexp_consp( entry ) || !miniexp_stringp( miniexp_car( entry ) ) ||
+              !miniexp_stringp( miniexp_nth( 1, entry ) ))
+               continue;
+
+          ret = DocumentOutlineAppend( entries, num, level,
+                                       DocumentProvider_DjVu_PageNumber( miniexp_to_str( miniexp_nth( 1, entry ) ) ),
+                                       miniexp_to_str( miniexp_car( entry ) ) );
+          if (ret)
+               break;
+
+          ret = DocumentProvider_DjVu_AddOutline( miniexp_cdr( miniexp_cdr( entry ) ), level + 1, entries, num );
+     }
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_DjVu_GetOutline( DocumentProvider      *thiz,
+                                  DocumentOutlineEntry **ret_entries,
+                                  int                   *ret_num )
+{
+     DFBResult                   ret;
+     miniexp_t                   outline;
+     DocumentOutlineEntry       *entries = NULL;
+     int                         num     = 0;
+     DocumentProvider_DjVu_data *data    = thiz->priv;
+
+     while ((outline = ddjvu_document_get_outline( data->doc )) == miniexp_dummy) {
+          ddjvu_message_wait( data->ctx );
+          ddjvu_message_pop( data->ctx );
+     }
+
+     /* (bookmarks entries...) */
+     ret = DocumentProvider_DjVu_AddOutline( miniexp_cdr( outline ), 0, &entries, &num );
+
+     ddjvu_miniexp_release( data->doc, outline );
+
+     if (ret) {
+          if (entries)
+               D_FREE( entries );
+
+          return ret;
+     }
+
+     *ret_entries = entries;
+     *ret_num     = num;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_DjVu_GetLinks( DocumentProvider  *thiz,
+                                int                pageno,
+                                DocumentLink     **ret_links,
+                                int               *ret_num )
+{
+     DFBResult                   ret = DFB_OK;
+     ddjvu_status_t              status;
+     ddjvu_pageinfo_t            info;
+     miniexp_t                   anno;
+     miniexp_t                   list;
+     float                       scale;
+     DocumentLink               *links = NULL;
+     int                         num   = 0;
+     DocumentProvider_DjVu_data *data  = thiz->priv;
+
+     while ((status = ddjvu_document_get_pageinfo( data->doc, pageno - 1, &info )) < DDJVU_JOB_OK) {
+          ddjvu_message_wait( data->ctx );
+          ddjvu_message_pop( data->ctx );
+     }
+
+     if (status != DDJVU_JOB_OK)
+          return DFB_FAILURE;
+
+     while ((anno = ddjvu_document_get_pageanno( data->doc, pageno - 1 )) == miniexp_dummy) {
+          ddjvu_message_wait( data->ctx );
+          ddjvu_message_pop( data->ctx );
+     }
+
+     /* Page coordinates at 100 dpi, DjVu coordinates start at the bottom. */
+     scale = 100.0f / info.dpi;
+
+     /* (maparea url comment (rect x y w h) ...) */
+     for (list = anno; miniexp_consp( list ) && !ret; list = miniexp_cdr( list )) {
+          miniexp_t   area = miniexp_car( list );
+          miniexp_t   shape;
+          int         target;
+          int         x, y, w, h;
+          const char *name;
+
+          if (!miniexp_consp( area ) || miniexp_car( area ) != miniexp_symbol( "maparea" ) ||
+              !miniexp_stringp( miniexp_nth( 1, area ) ))
+               continue;
+
+          target = DocumentProvider_DjVu_PageNumber( miniexp_to_str( miniexp_nth( 1, area ) ) );
+          if (!target)
+               continue;
+
+          shape = miniexp_nth( 3, area );
+          if (!miniexp_consp( shape ) || !miniexp_symbolp( miniexp_car( shape ) ) || miniexp_length( shape ) != 5)
+               continue;
+
+          name = miniexp_to_name( miniexp_car( shape ) );
+          if (strcmp( name, "rect" ) && strcmp( name, "oval" ) && strcmp( name, "text" ))
+               continue;
+
+          x = miniexp_to_int( miniexp_nth( 1, shape ) );
+          y = miniexp_to_int( miniexp_nth( 2, shape ) );
+          w = miniexp_to_int( miniexp_nth( 3, shape ) );
+          h = miniexp_to_int( miniexp_nth( 4, shape ) );
+
+          ret = DocumentLinkAppend( &links, &num, x * scale, (info.height - y - h) * scale,
+                                    (x + w) * scale, (info.height - y) * scale, target );
+     }
+
+     ddjvu_miniexp_release( data->doc, anno );
+
+     if (ret) {
+          if (links)
+               D_FREE( links );
+
+          return ret;
+     }
+
+     *ret_links = links;
+     *ret_num   = num;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_DjVu_SetMemoryLimit( DocumentProvider *thiz,
+                                      unsigned long     size )
+{
+     DocumentProvider_DjVu_data *data = thiz->priv;
+
+     /* Decoded pages are kept in the context cache, a quarter of the limit goes to the backgrounds. */
+     data->backgrounds_limit = size / 4;
+
+     DocumentProvider_DjVu_TrimBackgrounds( data, data->backgrounds_limit );
+
+     ddjvu_cache_set_size( data->ctx, size - data->backgrounds_limit );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_DjVu_HashFile( const char *filename,
+                                u64        *ret_hash )
+{
+     FILE   *file;
+     size_t  length;
+     u8      buffer[4096];
+     u64     hash = DOCUMENT_FINGERPRINT_INIT;
+
+     file = fopen( filename, "r" );
+     if (!file)
+          return DFB_FILENOTFOUND;
+
+     while ((length = fread( buffer, 1, sizeof(buffer), file )) > 0)
+          hash = DocumentFingerprint( hash, buffer, length );
+
+     fclose( file );
+
+     *ret_hash = hash;
+
+     return DFB_OK;
+}
+
+/*
+ * The components of indirect documents are files of their own: a page is unchanged if its component and the shared
+ * components it may include are.
+ */
+static DFBResult
+DocumentProvider_DjVu_GetFingerprints( DocumentProvider *thiz,
+                                       u64              *ret_fingerprints )
+{
+     DFBResult                   ret;
+     int                         i;
+     int                         num_files;
+     ddjvu_status_t              status;
+     ddjvu_fileinfo_t            info;
+     char                        path[PATH_MAX];
+     u64                         hash;
+     u64                         shared = DOCUMENT_FINGERPRINT_INIT;
+     DocumentProvider_DjVu_data *data   = thiz->priv;
+
+     if (ddjvu_document_get_type( data->doc ) != DDJVU_DOCTYPE_INDIRECT)
+          return DFB_UNSUPPORTED;
+
+     for (i = 0; i < data->desc.num_pages; i++)
+          ret_fingerprints[i] = DOCUMENT_FINGERPRINT_INIT;
+
+     num_files = ddjvu_document_get_filenum( data->doc );
+
+     for (i = 0; i < num_files; i++) {
+          while ((status = ddjvu_document_get_fileinfo( data->doc, i, &info )) < DDJVU_JOB_OK) {
+               ddjvu_message_wait( data->ctx );
+               ddjvu_message_pop( data->ctx );
+          }
+
+          if (status != DDJVU_JOB_OK)
+               return DFB_FAILURE;
+
+          /* Thumbnails are not shown. */
+          if (info.type == 'T')
+               continue;
+
+          snprintf( path, sizeof(path), "%s/%s", data->dir, info.id );
+
+          ret = DocumentProvider_DjVu_HashFile( path, &hash );
+          if (ret)
+               return ret;
+
+          if (info.type == 'P' && info.pageno >= 0 && info.pageno < data->desc.num_pages)
+               ret_fingerprints[info.pageno] = hash;
+          else
+               shared = DocumentFingerprint( shared, &hash, sizeof(hash) );
+     }
+
+     for (i = 0; i < data->desc.num_pages; i++)
+          ret_fingerprints[i] = DocumentFingerprint( ret_fingerprints[i], &shared, sizeof(shared) );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_DjVu_SetProgressFunc( DocumentProvider     *thiz,
+                                       DocumentProgressFunc  func,
+                                       void                 *ctx )
+{
+     DocumentProvider_DjVu_data *data = thiz->priv;
+
+     data->progress     = func;
+     data->progress_ctx = ctx;
+
+     return DFB_OK;
+}
+
 static DocumentProvider djvu_provider = {
-     .impl           = "DjVu",
-     .Init           = DocumentProvider_DjVu_Init,
-     .Term           = DocumentProvider_DjVu_Term,
-     .GetDescription = DocumentProvider_DjVu_GetDescription,
-     .RenderPage     = DocumentProvider_DjVu_RenderPage,
+     .impl            = "DjVu",
+     .Probe           = DocumentProvider_DjVu_Probe,
+     .Init            = DocumentProvider_DjVu_Init,
+     .Term            = DocumentProvider_DjVu_Term,
+     .GetDescription  = DocumentProvider_DjVu_GetDescription,
+     .RenderPage      = DocumentProvider_DjVu_RenderPage,
+     .SetMemoryLimit  = DocumentProvider_DjVu_SetMemoryLimit,
+     .GetOutline      = DocumentProvider_DjVu_GetOutline,
+     .GetLinks        = DocumentProvider_DjVu_GetLinks,
+     .GetFingerprints = DocumentProvider_DjVu_GetFingerprints,
+     .GetContentBox   = DocumentProvider_DjVu_GetContentBox,
+     .RenderRegion    = DocumentProvider_DjVu_RenderRegion,
+     .SetProgressFunc = DocumentProvider_DjVu_SetProgressFunc,
 };
 
 __attribute__((constructor))
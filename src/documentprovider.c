@@ -0,0 +1,735 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "documentprovider.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+extern DirectLink *documentproviders;
+
+/* Document formats by file signature, with the modules to load first when probing. */
+static const struct {
+     const char *format;
+     const char *signature;
+     const char *modules[3];
+} signatures[] = {
+     { "pdf",  "%PDF-",        { "mupdf", "poppler" } },
+     { "djvu", "AT&TFORM",     { "djvu" } },
+     { "zip",  "PK\003\004",   { "image", "mupdf" } },
+     { "jpeg", "\377\330\377", { "image", "mupdf" } },
+     { "png",  "\211PNG",      { "image", "mupdf" } },
+     { "gif",  "GIF8",         { "image" } },
+};
+
+#define PROBE_HEADER_SIZE 1024
+
+/**********************************************************************************************************************/
+
+static const char *
+DocumentProvider_ModuleDir()
+{
+     const char *dir = getenv( "PROJEKTOR_MODULEDIR" );
+
+     return dir ?: MODULEDIR;
+}
+
+static DocumentProvider *
+DocumentProvider_Find( const char *impl )
+{
+     DocumentProvider *provider;
+
+     direct_list_foreach (provider, documentproviders) {
+          if (!strcasecmp( provider->impl, impl ))
+               return provider;
+     }
+
+     return NULL;
+}
+
+static DFBResult
+DocumentProvider_LoadModule( const char *name )
+{
+     char  path[PATH_MAX];
+     char *p;
+     void *handle;
+
+     snprintf( path, sizeof(path), "%s/%s.so", DocumentProvider_ModuleDir(), name );
+
+     /* Module file names are lower case provider names. */
+     for (p = strrchr( path, '/' ) + 1; *p; p++)
+          *p = tolower( *p );
+
+     if (access( path, R_OK ))
+          return DFB_NOIMPL;
+
+     /* The module registers its provider from its constructor, and stays loaded. */
+     handle = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+     if (!handle) {
+          D_ERROR( "Projektor/DocumentProvider: %s!\n", dlerror() );
+          return DFB_NOIMPL;
+     }
+
+     return DFB_OK;
+}
+
+DFBResult
+DocumentProviderNewInstance( const DocumentProvider  *provider,
+                             DocumentProvider       **ret_instance )
+{
+     DocumentProvider *instance;
+
+     instance = D_MALLOC( sizeof(DocumentProvider) );
+     if (!instance)
+          return D_OOM();
+
+     /* Same implementation, not linked in the list of providers and not initialized yet. */
+     *instance = *provider;
+
+     memset( &instance->link, 0, sizeof(DirectLink) );
+
+     instance->priv = NULL;
+
+     *ret_instance = instance;
+
+     return DFB_OK;
+}
+
+void
+DocumentProviderDestroyInstance( DocumentProvider *instance )
+{
+     D_FREE( instance );
+}
+
+DFBResult
+DocumentProviderLoad( const char        *impl,
+                      DocumentProvider **ret_provider )
+{
+     DocumentProvider *provider;
+
+     provider = DocumentProvider_Find( impl );
+     if (!provider) {
+          if (DocumentProvider_LoadModule( impl ))
+               return DFB_NOIMPL;
+
+          provider = DocumentProvider_Find( impl );
+          if (!provider)
+               return DFB_NOIMPL;
+     }
+
+     *ret_provider = provider;
+
+     return DFB_OK;
+}
+
+static const char *
+DocumentProvider_Format( const u8     *header,
+                         unsigned int  length )
+{
+     int i;
+
+     for (i = 0; i < D_ARRAY_SIZE(signatures); i++) {
+          if (length >= strlen( signatures[i].signature ) &&
+              !memcmp( header, signatures[i].signature, strlen( signatures[i].signature ) ))
+               return signatures[i].format;
+     }
+
+     return "unknown";
+}
+
+static unsigned int
+DocumentProvider_ReadHeader( const char *filename,
+                             u8         *header )
+{
+     FILE         *file;
+     unsigned int  length;
+
+     file = fopen( filename, "r" );
+     if (!file)
+          return 0;
+
+     length = fread( header, 1, PROBE_HEADER_SIZE, file );
+
+     fclose( file );
+
+     return length;
+}
+
+static void
+DocumentProvider_RankingFile( char   *path,
+                              size_t  size )
+{
+     const char *cache = getenv( "XDG_CACHE_HOME" );
+
+     if (cache)
+          snprintf( path, size, "%s/projektor/ranking", cache );
+     else
+          snprintf( path, size, "%s/.cache/projektor/ranking", getenv( "HOME" ) ?: "." );
+}
+
+/*
+ * Render time measured by the benchmark mode for a format, 0 if the provider has not been measured.
+ */
+static double
+DocumentProvider_RenderTime( const char *format,
+                             const char *impl )
+{
+     FILE   *file;
+     char    path[PATH_MAX];
+     char    line[128];
+     char    entry_format[32];
+     char    entry_impl[32];
+     double  time;
+     double  ret = 0;
+
+     DocumentProvider_RankingFile( path, sizeof(path) );
+
+     file = fopen( path, "r" );
+     if (!file)
+          return 0;
+
+     while (fgets( line, sizeof(line), file )) {
+          if (sscanf( line, "%31s %31s %lf", entry_format, entry_impl, &time ) != 3)
+               continue;
+
+          if (!strcmp( entry_format, format ) && !strcasecmp( entry_impl, impl )) {
+               ret = time;
+               break;
+          }
+     }
+
+     fclose( file );
+
+     return ret;
+}
+
+static int
+DocumentProvider_Probe( const u8          *header,
+                        unsigned int       length,
+                        const char        *format,
+                        DocumentProvider **ret_candidates,
+                        int                max_candidates )
+{
+     int               i;
+     int               num = 0;
+     int               confidence[DOCUMENT_PROVIDER_MAX_CANDIDATES];
+     double            time[DOCUMENT_PROVIDER_MAX_CANDIDATES];
+     DocumentProvider *provider;
+
+     direct_list_foreach (provider, documentproviders) {
+          int    c;
+          double t;
+
+          if (!provider->Probe || num == max_candidates)
+               continue;
+
+          c = provider->Probe( provider, header, length );
+          if (c <= 0)
+               continue;
+
+          t = DocumentProvider_RenderTime( format, provider->impl );
+
+          /* Most confident first, then fastest measured, then unmeasured in registration order. */
+          for (i = num; i > 0; i--) {
+               if (confidence[i-1] > c || (confidence[i-1] == c && (!t || (time[i-1] && time[i-1] <= t))))
+                    break;
+
+               ret_candidates[i] = ret_candidates[i-1];
+               confidence[i]     = confidence[i-1];
+               time[i]           = time[i-1];
+          }
+
+          ret_candidates[i] = provider;
+          confidence[i]     = c;
+          time[i]           = t;
+
+          num++;
+     }
+
+     return num;
+}
+
+DFBResult
+DocumentProviderRank( const char        *filename,
+                      DocumentProvider **ret_candidates,
+                      int               *ret_num )
+{
+     int           i, n;
+     int           num;
+     u8            header[PROBE_HEADER_SIZE];
+     unsigned int  length;
+     const char   *format;
+
+     if (access( filename, R_OK ))
+          return DFB_FILENOTFOUND;
+
+     length = DocumentProvider_ReadHeader( filename, header );
+     format = DocumentProvider_Format( header, length );
+
+     /* Load the modules expected to handle the format, instead of loading all of them. */
+     for (i = 0; i < D_ARRAY_SIZE(signatures); i++) {
+          if (strcmp( format, signatures[i].format ))
+               continue;
+
+          for (n = 0; n < D_ARRAY_SIZE(signatures[i].modules) && signatures[i].modules[n]; n++) {
+               DocumentProvider *provider;
+
+               DocumentProviderLoad( signatures[i].modules[n], &provider );
+          }
+     }
+
+     num = DocumentProvider_Probe( header, length, format, ret_candidates, DOCUMENT_PROVIDER_MAX_CANDIDATES );
+     if (!num) {
+          DocumentProviderLoadAll();
+
+          num = DocumentProvider_Probe( header, length, format, ret_candidates, DOCUMENT_PROVIDER_MAX_CANDIDATES );
+          if (!num)
+               return DFB_NOIMPL;
+     }
+
+     *ret_num = num;
+
+     return DFB_OK;
+}
+
+void
+DocumentProviderSetRenderTime( const char *filename,
+                               const char *impl,
+                               double      time )
+{
+     FILE         *file;
+     char          path[PATH_MAX];
+     char          line[128];
+     char          entry_format[32];
+     char          entry_impl[32];
+     char         *dir;
+     char         *parent;
+     char         *entries = NULL;
+     size_t        size    = 0;
+     u8            header[PROBE_HEADER_SIZE];
+     unsigned int  length;
+     const char   *format;
+
+     length = DocumentProvider_ReadHeader( filename, header );
+     format = DocumentProvider_Format( header, length );
+
+     DocumentProvider_RankingFile( path, sizeof(path) );
+
+     /* Keep the other entries. */
+     file = fopen( path, "r" );
+     if (file) {
+          while (fgets( line, sizeof(line), file )) {
+               if (sscanf( line, "%31s %31s", entry_format, entry_impl ) != 2 ||
+                   (!strcmp( entry_format, format ) && !strcasecmp( entry_impl, impl )))
+                    continue;
+
+               entries = D_REALLOC( entries, size + strlen( line ) + 1 );
+               if (!entries) {
+                    fclose( file );
+                    return;
+               }
+
+               strcpy( entries + size, line );
+               size += strlen( line );
+          }
+
+          fclose( file );
+     }
+
+     /* Create the cache directory and its projektor directory. */
+     dir = strrchr( path, '/' );
+     *dir = 0;
+     parent = strrchr( path, '/' );
+     *parent = 0;
+     mkdir( path, 0755 );
+     *parent = '/';
+     mkdir( path, 0755 );
+     *dir = '/';
+
+     file = fopen( path, "w" );
+     if (file) {
+          if (entries)
+               fputs( entries, file );
+
+          fprintf( file, "%s %s %.3f\n", format, impl, time );
+
+          fclose( file );
+     }
+
+     if (entries)
+          D_FREE( entries );
+}
+
+void
+DocumentProviderLoadAll()
+{
+     DIR           *dir;
+     struct dirent *entry;
+
+     dir = opendir( DocumentProvider_ModuleDir() );
+     if (!dir)
+          return;
+
+     while ((entry = readdir( dir )) != NULL) {
+          char   name[NAME_MAX + 1];
+          size_t length = strlen( entry->d_name );
+
+          if (length < 4 || strcmp( entry->d_name + length - 3, ".so" ))
+               continue;
+
+          snprintf( name, sizeof(name), "%.*s", (int) length - 3, entry->d_name );
+
+          DocumentProvider_LoadModule( name );
+     }
+
+     closedir( dir );
+}
+
+/**********************************************************************************************************************/
+
+#define DOCUMENT_ARRAY_STEP 64
+
+DFBResult
+DocumentOutlineAppend( DocumentOutlineEntry **entries,
+                       int                   *num,
+                       int                    level,
+                       int                    pageno,
+                       const char            *title )
+{
+     DocumentOutlineEntry *entry;
+
+     if (*num % DOCUMENT_ARRAY_STEP == 0) {
+          DocumentOutlineEntry *array;
+
+          array = D_REALLOC( *entries, (*num + DOCUMENT_ARRAY_STEP) * sizeof(DocumentOutlineEntry) );
+          if (!array)
+               return D_OOM();
+
+          *entries = array;
+     }
+
+     entry = &(*entries)[(*num)++];
+
+     entry->level  = level;
+     entry->pageno = pageno;
+
+     snprintf( entry->title, DOCUMENT_OUTLINE_TITLE_LENGTH, "%s", title ?: "" );
+
+     return DFB_OK;
+}
+
+DFBResult
+DocumentLinkAppend( DocumentLink **links,
+                    int           *num,
+                    float          x1,
+                    float          y1,
+                    float          x2,
+                    float          y2,
+                    int            pageno )
+{
+     DocumentLink *link;
+
+     if (*num % DOCUMENT_ARRAY_STEP == 0) {
+          DocumentLink *array = D_REALLOC( *links, (*num + DOCUMENT_ARRAY_STEP) * sizeof(DocumentLink) );
+          if (!array)
+               return D_OOM();
+
+          *links = array;
+     }
+
+     link = &(*links)[(*num)++];
+
+     link->x1     = MIN( x1, x2 );
+     link->y1     = MIN( y1, y2 );
+     link->x2     = MAX( x1, x2 );
+     link->y2     = MAX( y1, y2 );
+     link->pageno = pageno;
+
+     return DFB_OK;
+}
+
+u64
+DocumentFingerprint( u64         hash,
+                     const void *data,
+                     size_t      length )
+{
+     size_t    i;
+     const u8 *bytes = data;
+
+     /* FNV-1a */
+     for (i = 0; i < length; i++) {
+          hash ^= bytes[i];
+          hash *= 0x100000001b3ULL;
+     }
+
+     return hash;
+}
+
+bool
+DocumentLayerHidden( const char *layers,
+                     const char *name )
+{
+     size_t length = strlen( name );
+
+     if (!layers)
+          return true;
+
+     while (*layers) {
+          size_t n = strcspn( layers, "," );
+
+          if (n == length && !strncmp( layers, name, n ))
+               return true;
+
+          layers += n;
+
+          if (*layers)
+               layers++;
+     }
+
+     return false;
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Ink is any byte below 0xf0, found eight bytes at a time: a word without ink has the high nibble of each byte set.
+ */
+#define DOCUMENT_INK_MASK 0xf0f0f0f0f0f0f0f0ULL
+
+static int
+Document_FirstInk( const u8 *row,
+                   int       length )
+{
+     int x;
+     u64 word;
+
+     for (x = 0; x + 8 <= length; x += 8) {
+          memcpy( &word, row + x, 8 );
+
+          if (~word & DOCUMENT_INK_MASK)
+               break;
+     }
+
+     for (; x < length; x++) {
+          if (row[x] < 0xf0)
+               return x;
+     }
+
+     return -1;
+}
+
+static int
+Document_LastInk( const u8 *row,
+                  int       length )
+{
+     int x;
+     u64 word;
+
+     for (x = length; x >= 8; x -= 8) {
+          memcpy( &word, row + x - 8, 8 );
+
+          if (~word & DOCUMENT_INK_MASK)
+               break;
+     }
+
+     while (x-- > 0) {
+          if (row[x] < 0xf0)
+               return x;
+     }
+
+     return -1;
+}
+
+bool
+DocumentScanContent( const void *data,
+                     int         pitch,
+                     int         width,
+                     int         height,
+                     int         bpp,
+                     DFBRegion  *ret_region )
+{
+     int y;
+     int length = width * bpp;
+     int left   = length;
+     int right  = -1;
+     int top    = -1;
+     int bottom = -1;
+
+     for (y = 0; y < height; y++) {
+          const u8 *row   = (const u8*) data + y * pitch;
+          int       first = Document_FirstInk( row, length );
+
+          /* Blank rows are scanned once, the others from both ends up to their first ink. */
+          if (first < 0)
+               continue;
+
+          if (top < 0)
+               top = y;
+
+          bottom = y;
+          left   = MIN( left, first );
+          right  = MAX( right, Document_LastInk( row, length ) );
+     }
+
+     if (top < 0)
+          return false;
+
+     ret_region->x1 = left  / bpp;
+     ret_region->y1 = top;
+     ret_region->x2 = right / bpp;
+     ret_region->y2 = bottom;
+
+     return true;
+}
+
+DFBResult
+DocumentContentBox( DocumentProvider *provider,
+                    int               pageno,
+                    DocumentBox      *ret_box )
+{
+     DFBResult              ret;
+     int                    width, height;
+     int                    pitch;
+     void                  *ptr;
+     bool                   found;
+     DFBRegion              region;
+     DFBSurfacePixelFormat  format;
+     IDirectFBSurface      *surface;
+
+     if (provider->GetContentBox) {
+          ret = provider->GetContentBox( provider, pageno, ret_box );
+          if (ret != DFB_UNSUPPORTED)
+               return ret;
+     }
+
+     ret = provider->RenderPage( provider, pageno, DOCUMENT_CONTENT_ZOOM, &surface );
+     if (ret)
+          return ret;
+
+     surface->GetSize( surface, &width, &height );
+     surface->GetPixelFormat( surface, &format );
+
+     ret = surface->Lock( surface, DSLF_READ, &ptr, &pitch );
+     if (ret) {
+          surface->Release( surface );
+          return ret;
+     }
+
+     found = DocumentScanContent( ptr, pitch, width, height, DFB_BYTES_PER_PIXEL( format ), &region );
+
+     surface->Unlock( surface );
+     surface->Release( surface );
+
+     if (!found)
+          return DFB_ITEMNOTFOUND;
+
+     ret_box->x1 = region.x1 / DOCUMENT_CONTENT_ZOOM;
+     ret_box->y1 = region.y1 / DOCUMENT_CONTENT_ZOOM;
+     ret_box->x2 = (region.x2 + 1) / DOCUMENT_CONTENT_ZOOM;
+     ret_box->y2 = (region.y2 + 1) / DOCUMENT_CONTENT_ZOOM;
+
+     return DFB_OK;
+}
+
+static inline int
+Document_Ceil( float value )
+{
+     int n = value;
+
+     return n < value ? n + 1 : n;
+}
+
+void
+DocumentBoxToRectangle( const DocumentBox *box,
+                        float              zoom,
+                        int                width,
+                        int                height,
+                        DFBRectangle      *ret_rect )
+{
+     /* Boxes are within the page, truncation rounds them down. */
+     int x1 = CLAMP( (int) (box->x1 * zoom), 0, width );
+     int y1 = CLAMP( (int) (box->y1 * zoom), 0, height );
+     int x2 = CLAMP( Document_Ceil( box->x2 * zoom ), 0, width );
+     int y2 = CLAMP( Document_Ceil( box->y2 * zoom ), 0, height );
+
+     ret_rect->x = x1;
+     ret_rect->y = y1;
+     ret_rect->w = MAX( x2 - x1, 0 );
+     ret_rect->h = MAX( y2 - y1, 0 );
+}
+
+DFBResult
+DocumentRenderRegion( DocumentProvider   *provider,
+                      IDirectFB          *idirectfb,
+                      int                 pageno,
+                      float               zoom,
+                      const DocumentBox  *region,
+                      IDirectFBSurface  **ret_surface )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     DFBRectangle           rect;
+     IDirectFBSurface      *page;
+     IDirectFBSurface      *surface;
+
+     if (provider->RenderRegion) {
+          ret = provider->RenderRegion( provider, pageno, zoom, region, ret_surface );
+          if (ret != DFB_UNSUPPORTED)
+               return ret;
+     }
+
+     ret = provider->RenderPage( provider, pageno, zoom, &page );
+     if (ret)
+          return ret;
+
+     page->GetSize( page, &desc.width, &desc.height );
+     page->GetPixelFormat( page, &desc.pixelformat );
+
+     DocumentBoxToRectangle( region, zoom, desc.width, desc.height, &rect );
+
+     if (rect.w < 1 || rect.h < 1) {
+          page->Release( page );
+          return DFB_INVARG;
+     }
+
+     desc.flags  = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width  = rect.w;
+     desc.height = rect.h;
+
+     ret = idirectfb->CreateSurface( idirectfb, &desc, &surface );
+     if (ret) {
+          page->Release( page );
+          return ret;
+     }
+
+     surface->Blit( surface, page, &rect, 0, 0 );
+
+     page->Release( page );
+
+     *ret_surface = surface;
+
+     return DFB_OK;
+}
+
+int
+DocumentProgressBand( int y,
+                      int height )
+{
+     return MIN( MAX( y, DOCUMENT_PROGRESS_BAND ), height - y );
+}
@@ -16,6 +16,9 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#ifndef __DOCUMENTPROVIDER_H__
+#define __DOCUMENTPROVIDER_H__
+
 #include <direct/list.h>
 #include <directfb.h>
 
@@ -30,8 +33,83 @@ typedef struct {
      int  num_pages;
 } DocumentDescription;
 
+/*
+ * Outline entry, with its depth in the outline tree, and a zero page number if it has no target. Entries are listed in
+ * document order.
+ */
+
+#define DOCUMENT_OUTLINE_TITLE_LENGTH 128
+
+typedef struct {
+     int  level;
+     int  pageno;
+     char title[DOCUMENT_OUTLINE_TITLE_LENGTH];
+} DocumentOutlineEntry;
+
+/*
+ * Link to a page of the document, the area is in page coordinates at zoom factor 1.
+ */
+
+typedef struct {
+     float x1, y1;
+     float x2, y2;
+     int   pageno;
+} DocumentLink;
+
+/*
+ * Area of a page, in page coordinates at zoom factor 1, empty if x2 <= x1 or y2 <= y1.
+ */
+
+typedef struct {
+     float x1, y1;
+     float x2, y2;
+} DocumentBox;
+
+/*
+ * Parts of the pages left out when rendering, as they are slow to render and often not needed. Images are left blank.
+ */
+
+typedef enum {
+     DOCUMENT_RENDER_DEFAULT        = 0x00000000,
+     DOCUMENT_RENDER_NO_ANNOTATIONS = 0x00000001,   /* annotations and form widgets */
+     DOCUMENT_RENDER_NO_IMAGES      = 0x00000002,
+     DOCUMENT_RENDER_HIDE_LAYERS    = 0x00000004,   /* optional content layers */
+} DocumentRenderFlags;
+
+/*
+ * Progress of a render, with the part of the surface rendered so far. It is called from the rendering thread, with the
+ * surface unlocked, before the surface is returned.
+ */
+
+typedef void (*DocumentProgressFunc)( void *ctx, IDirectFBSurface *surface, const DFBRectangle *rect );
+
 /*
  * Document provider interface.
+ *
+ * Pages are rendered in the pixel format given at initialization, or in the provider native format if DSPF_UNKNOWN.
+ *
+ * Probe returns the confidence, from 0 to 100, that the provider can open a file starting with the header bytes. It
+ * is called on the registered provider, without initialization.
+ *
+ * SetMemoryLimit is optional, it limits the memory kept by the provider for its caches, in bytes. Cached resources are
+ * released when the limit is lowered.
+ *
+ * GetOutline and GetLinks are optional, the arrays returned are freed by the caller with D_FREE. Links to other
+ * documents or to URIs are not returned.
+ *
+ * GetFingerprints is optional, it fills an array of num_pages fingerprints of the page contents. Pages keeping their
+ * fingerprint across a reload of a modified document look the same, their renders can be kept.
+ *
+ * SetRenderFlags is optional, it applies to the pages rendered next. The layers hidden are given by their names,
+ * separated by commas, or NULL for all of them. Flags not supported by the provider are ignored.
+ *
+ * GetContentBox is optional, it returns the bounding box of the page contents, or DFB_ITEMNOTFOUND for a blank page.
+ * RenderRegion is optional, it renders the part of a page within a box, as cropped from the page rendered at the same
+ * zoom factor. Without them, or if they return DFB_UNSUPPORTED, DocumentContentBox() and DocumentRenderRegion() work
+ * on whole pages.
+ *
+ * SetProgressFunc is optional, it reports the progress of the pages rendered next, band by band or as the page is
+ * decoded, until it is set to NULL.
  */
 
 typedef struct _DocumentProvider DocumentProvider;
@@ -41,8 +119,111 @@ struct _DocumentProvider {
      const char  *impl;
      void        *priv;
 
-     DFBResult  (*Init)          ( DocumentProvider *thiz, const char *filename, IDirectFB *idirectfb );
-     DFBResult  (*Term)          ( DocumentProvider *thiz );
-     DFBResult  (*GetDescription)( DocumentProvider *thiz, DocumentDescription *ret_desc );
-     DFBResult  (*RenderPage)    ( DocumentProvider *thiz, int pageno, float zoom, IDirectFBSurface **ret_surface );
+     int        (*Probe)          ( DocumentProvider *thiz, const u8 *header, unsigned int length );
+
+     DFBResult  (*Init)           ( DocumentProvider *thiz, const char *filename, IDirectFB *idirectfb,
+                                    DFBSurfacePixelFormat format );
+     DFBResult  (*Term)           ( DocumentProvider *thiz );
+     DFBResult  (*GetDescription) ( DocumentProvider *thiz, DocumentDescription *ret_desc );
+     DFBResult  (*RenderPage)     ( DocumentProvider *thiz, int pageno, float zoom, IDirectFBSurface **ret_surface );
+     DFBResult  (*SetMemoryLimit) ( DocumentProvider *thiz, unsigned long size );
+     DFBResult  (*GetOutline)     ( DocumentProvider *thiz, DocumentOutlineEntry **ret_entries, int *ret_num );
+     DFBResult  (*GetLinks)       ( DocumentProvider *thiz, int pageno, DocumentLink **ret_links, int *ret_num );
+     DFBResult  (*GetFingerprints)( DocumentProvider *thiz, u64 *ret_fingerprints );
+     DFBResult  (*SetRenderFlags) ( DocumentProvider *thiz, DocumentRenderFlags flags, const char *layers );
+     DFBResult  (*GetContentBox)  ( DocumentProvider *thiz, int pageno, DocumentBox *ret_box );
+     DFBResult  (*RenderRegion)   ( DocumentProvider *thiz, int pageno, float zoom, const DocumentBox *region,
+                                    IDirectFBSurface **ret_surface );
+     DFBResult  (*SetProgressFunc)( DocumentProvider *thiz, DocumentProgressFunc func, void *ctx );
 };
+
+/*
+ * Create an instance of a document provider, with its own private data, for concurrent use of several documents, or
+ * of the same document from several threads.
+ */
+
+DFBResult DocumentProviderNewInstance    ( const DocumentProvider *provider, DocumentProvider **ret_instance );
+
+void      DocumentProviderDestroyInstance( DocumentProvider *instance );
+
+/*
+ * Providers are built as modules and loaded on demand. A provider is looked up by name among the registered providers,
+ * and loaded from its module if not found.
+ */
+
+DFBResult DocumentProviderLoad           ( const char *impl, DocumentProvider **ret_provider );
+
+/*
+ * Rank the providers able to open a file, most confident first. Providers of equal confidence are ranked by their
+ * render time for the format, as measured in benchmark mode.
+ */
+
+#define DOCUMENT_PROVIDER_MAX_CANDIDATES 8
+
+DFBResult DocumentProviderRank           ( const char *filename, DocumentProvider **ret_candidates, int *ret_num );
+
+void      DocumentProviderSetRenderTime  ( const char *filename, const char *impl, double time );
+
+void      DocumentProviderLoadAll        ( void );
+
+/*
+ * Append to the arrays returned by GetOutline and GetLinks, the title is truncated if too long.
+ */
+
+DFBResult DocumentOutlineAppend          ( DocumentOutlineEntry **entries, int *num, int level, int pageno,
+                                           const char *title );
+
+DFBResult DocumentLinkAppend             ( DocumentLink **links, int *num, float x1, float y1, float x2, float y2,
+                                           int pageno );
+
+/*
+ * Whether a layer is among the hidden layers given to SetRenderFlags.
+ */
+
+bool      DocumentLayerHidden            ( const char *layers, const char *name );
+
+/*
+ * Content boxes are found on pages rendered at DOCUMENT_CONTENT_ZOOM. DocumentScanContent() returns the region of the
+ * pixels that are not white, or near white, and false if there are none.
+ */
+
+#define DOCUMENT_CONTENT_ZOOM 0.5f
+
+bool      DocumentScanContent            ( const void *data, int pitch, int width, int height, int bpp,
+                                           DFBRegion *ret_region );
+
+DFBResult DocumentContentBox             ( DocumentProvider *provider, int pageno, DocumentBox *ret_box );
+
+/*
+ * Pixel rectangle of a box at a zoom factor, within a page of the given size in pixels.
+ */
+
+void      DocumentBoxToRectangle         ( const DocumentBox *box, float zoom, int width, int height,
+                                           DFBRectangle *ret_rect );
+
+/*
+ * Render the part of a page within a box, cropped from the whole page if the provider cannot render regions.
+ */
+
+DFBResult DocumentRenderRegion           ( DocumentProvider *provider, IDirectFB *idirectfb, int pageno, float zoom,
+                                           const DocumentBox *region, IDirectFBSurface **ret_surface );
+
+/*
+ * Height of the band rendered next from a row, for progressive renders. Bands double in height from
+ * DOCUMENT_PROGRESS_BAND rows, the first one is shown early and the page is rendered in few passes. Band rows are
+ * multiples of four, as the dither pattern.
+ */
+
+#define DOCUMENT_PROGRESS_BAND 64
+
+int       DocumentProgressBand           ( int y, int height );
+
+/*
+ * Fingerprint of page contents, hashing data into a fingerprint started with DOCUMENT_FINGERPRINT_INIT.
+ */
+
+#define DOCUMENT_FINGERPRINT_INIT 0xcbf29ce484222325ULL
+
+u64       DocumentFingerprint            ( u64 hash, const void *data, size_t length );
+
+#endif
@@ -0,0 +1,411 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "eventloop.h"
+#include <direct/clock.h>
+#include <direct/list.h>
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/mutex.h>
+#include <direct/util.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define EVENT_LOOP_MAX_FDS 8                         /* including the window events and the posted calls */
+
+typedef struct {
+     EventLoopFunc      func;
+     void              *ctx;
+} EventLoopHandler;
+
+typedef struct {
+     DirectLink         link;
+
+     EventLoopFunc      func;
+     void              *ctx;
+} EventLoopCall;
+
+typedef struct {
+     DirectLink         link;
+
+     EventLoopIdleFunc  func;
+     void              *ctx;
+     int                budget;
+     bool               removed;                     /* while running */
+} EventLoopIdle;
+
+struct _EventLoop {
+     LiteWindow           *window;
+     IDirectFBEventBuffer *buffer;                   /* NULL if window events are not read from a file descriptor */
+
+     struct pollfd         fds[EVENT_LOOP_MAX_FDS];
+     EventLoopHandler      handlers[EVENT_LOOP_MAX_FDS];
+     int                   num_fds;
+
+     DirectMutex           lock;                     /* of the posted calls */
+     DirectLink           *calls;
+
+     DirectLink           *idle;
+     EventLoopIdle        *running;
+};
+
+/**********************************************************************************************************************/
+
+static bool
+EventLoop_Pending( EventLoop *loop )
+{
+     struct pollfd fds[EVENT_LOOP_MAX_FDS];
+
+     memcpy( fds, loop->fds, loop->num_fds * sizeof(struct pollfd) );
+
+     return poll( fds, loop->num_fds, 0 ) > 0;
+}
+
+static void
+EventLoop_DispatchWindow( EventLoop *loop )
+{
+     char buffer[4096];
+
+     /* The events are copies of the ones queued for LiTE, already in its event buffer. */
+     while (read( loop->fds[0].fd, buffer, sizeof(buffer) ) > 0);
+
+     lite_window_event_loop( loop->window, 1 );
+}
+
+static void
+EventLoop_RunCalls( EventLoop *loop )
+{
+     u64            count;
+     EventLoopCall *call;
+
+     if (read( loop->fds[1].fd, &count, sizeof(count) ) < 0 && errno != EAGAIN)
+          D_WARN( "cannot read eventfd" );
+
+     /* One at a time, a call may cancel the following ones. */
+     while (true) {
+          direct_mutex_lock( &loop->lock );
+
+          call = (EventLoopCall*) loop->calls;
+          if (call)
+               direct_list_remove( &loop->calls, &call->link );
+
+          direct_mutex_unlock( &loop->lock );
+
+          if (!call)
+               break;
+
+          call->func( call->ctx );
+
+          D_FREE( call );
+     }
+}
+
+static void
+EventLoop_RunIdle( EventLoop *loop )
+{
+     bool           more;
+     EventLoopIdle *task  = (EventLoopIdle*) loop->idle;
+     long long      start = direct_clock_get_micros();
+
+     loop->running = task;
+
+     /* A step at least, more within the budget unless an event has arrived during the previous one. */
+     do {
+          more = task->func( task->ctx );
+     } while (more && !task->removed && direct_clock_get_micros() - start < task->budget &&
+              !EventLoop_Pending( loop ));
+
+     loop->running = NULL;
+
+     direct_list_remove( &loop->idle, &task->link );
+
+     /* Next turn for the next task. */
+     if (more && !task->removed)
+          direct_list_append( &loop->idle, &task->link );
+     else
+          D_FREE( task );
+}
+
+/**********************************************************************************************************************/
+
+DFBResult
+EventLoopCreate( LiteWindow  *window,
+                 EventLoop  **ret_loop )
+{
+     EventLoop *loop;
+     int        fd = -1;
+
+     loop = D_CALLOC( 1, sizeof(EventLoop) );
+     if (!loop)
+          return D_OOM();
+
+     loop->window = window;
+
+     loop->fds[1].fd     = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+     loop->fds[1].events = POLLIN;
+
+     if (loop->fds[1].fd < 0) {
+          D_ERROR( "Projektor/EventLoop: Cannot create eventfd!\n" );
+          D_FREE( loop );
+          return DFB_FAILURE;
+     }
+
+     /* A second event buffer gets the window events too, its file descriptor is readable once LiTE has them. */
+     if (window->window->CreateEventBuffer( window->window, &loop->buffer ) == DFB_OK) {
+          if (loop->buffer->CreateFileDescriptor( loop->buffer, &fd ) == DFB_OK)
+               fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+          else {
+               loop->buffer->Release( loop->buffer );
+               loop->buffer = NULL;
+          }
+     }
+
+     if (!loop->buffer)
+          D_WARN( "window events are checked periodically" );
+
+     /* Ignored by poll() if negative. */
+     loop->fds[0].fd     = fd;
+     loop->fds[0].events = POLLIN;
+
+     loop->num_fds = 2;
+
+     direct_mutex_init( &loop->lock );
+
+     *ret_loop = loop;
+
+     return DFB_OK;
+}
+
+void
+EventLoopDestroy( EventLoop *loop )
+{
+     EventLoopCall *call, *next_call;
+     EventLoopIdle *task, *next_task;
+
+     direct_list_foreach_safe (call, next_call, loop->calls)
+          D_FREE( call );
+
+     direct_list_foreach_safe (task, next_task, loop->idle)
+          D_FREE( task );
+
+     if (loop->buffer) {
+          close( loop->fds[0].fd );
+
+          loop->buffer->Release( loop->buffer );
+     }
+
+     close( loop->fds[1].fd );
+
+     direct_mutex_deinit( &loop->lock );
+
+     D_FREE( loop );
+}
+
+DFBResult
+EventLoopAddFd( EventLoop     *loop,
+                int            fd,
+                short          events,
+                EventLoopFunc  func,
+                void          *ctx )
+{
+     if (loop->num_fds == EVENT_LOOP_MAX_FDS)
+          return DFB_LIMITEXCEEDED;
+
+     loop->fds[loop->num_fds].fd      = fd;
+     loop->fds[loop->num_fds].events  = events;
+     loop->fds[loop->num_fds].revents = 0;
+
+     loop->handlers[loop->num_fds].func = func;
+     loop->handlers[loop->num_fds].ctx  = ctx;
+
+     loop->num_fds++;
+
+     return DFB_OK;
+}
+
+void
+EventLoopRemoveFd( EventLoop *loop,
+                   int        fd )
+{
+     int i;
+
+     for (i = 2; i < loop->num_fds; i++) {
+          if (loop->fds[i].fd != fd)
+               continue;
+
+          loop->num_fds--;
+
+          memmove( &loop->fds[i], &loop->fds[i+1], (loop->num_fds - i) * sizeof(struct pollfd) );
+          memmove( &loop->handlers[i], &loop->handlers[i+1], (loop->num_fds - i) * sizeof(EventLoopHandler) );
+
+          return;
+     }
+}
+
+DFBResult
+EventLoopPost( EventLoop     *loop,
+               EventLoopFunc  func,
+               void          *ctx )
+{
+     EventLoopCall *call;
+     u64            one = 1;
+
+     call = D_CALLOC( 1, sizeof(EventLoopCall) );
+     if (!call)
+          return D_OOM();
+
+     call->func = func;
+     call->ctx  = ctx;
+
+     direct_mutex_lock( &loop->lock );
+
+     direct_list_append( &loop->calls, &call->link );
+
+     direct_mutex_unlock( &loop->lock );
+
+     if (write( loop->fds[1].fd, &one, sizeof(one) ) < 0)
+          D_WARN( "cannot write eventfd" );
+
+     return DFB_OK;
+}
+
+void
+EventLoopCancel( EventLoop     *loop,
+                 EventLoopFunc  func,
+                 void          *ctx )
+{
+     EventLoopCall *call, *next;
+
+     direct_mutex_lock( &loop->lock );
+
+     direct_list_foreach_safe (call, next, loop->calls) {
+          if (call->func == func && call->ctx == ctx) {
+               direct_list_remove( &loop->calls, &call->link );
+               D_FREE( call );
+          }
+     }
+
+     direct_mutex_unlock( &loop->lock );
+}
+
+DFBResult
+EventLoopAddIdle( EventLoop         *loop,
+                  EventLoopIdleFunc  func,
+                  void              *ctx,
+                  int                budget )
+{
+     EventLoopIdle *task;
+
+     direct_list_foreach (task, loop->idle) {
+          if (task->func == func && task->ctx == ctx && !task->removed)
+               return DFB_OK;
+     }
+
+     task = D_CALLOC( 1, sizeof(EventLoopIdle) );
+     if (!task)
+          return D_OOM();
+
+     task->func   = func;
+     task->ctx    = ctx;
+     task->budget = budget;
+
+     direct_list_append( &loop->idle, &task->link );
+
+     return DFB_OK;
+}
+
+void
+EventLoopRemoveIdle( EventLoop         *loop,
+                     EventLoopIdleFunc  func,
+                     void              *ctx )
+{
+     EventLoopIdle *task, *next;
+
+     direct_list_foreach_safe (task, next, loop->idle) {
+          if (task->func != func || task->ctx != ctx)
+               continue;
+
+          /* Freed once its step returns. */
+          if (task == loop->running) {
+               task->removed = true;
+               continue;
+          }
+
+          direct_list_remove( &loop->idle, &task->link );
+          D_FREE( task );
+     }
+}
+
+DFBResult
+EventLoopIterate( EventLoop *loop,
+                  long long  deadline )
+{
+     int       i;
+     int       timeout    = -1;
+     bool      dispatched = false;
+     long long now        = direct_clock_get_micros();
+
+     if (loop->idle)
+          timeout = 0;
+     else if (deadline)
+          timeout = deadline > now ? (deadline - now + 999) / 1000 : 0;
+
+     if (!loop->buffer && (timeout < 0 || timeout > 20))
+          timeout = 20;
+
+     if (poll( loop->fds, loop->num_fds, timeout ) < 0)
+          return errno == EINTR ? DFB_OK : DFB_IO;
+
+     if (!loop->buffer)
+          lite_window_event_loop( loop->window, 1 );
+
+     /* Scan again after each handler, it may add or remove file descriptors. */
+     for (i = 0; i < loop->num_fds; i++) {
+          short revents = loop->fds[i].revents;
+
+          if (!revents)
+               continue;
+
+          loop->fds[i].revents = 0;
+
+          if (i == 0)
+               EventLoop_DispatchWindow( loop );
+          else if (i == 1)
+               EventLoop_RunCalls( loop );
+          else
+               loop->handlers[i].func( loop->handlers[i].ctx );
+
+          i = -1;
+
+          dispatched = true;
+     }
+
+     if (!dispatched && loop->idle)
+          EventLoop_RunIdle( loop );
+
+     return DFB_OK;
+}
+
+void
+EventLoopFlush( EventLoop *loop )
+{
+     lite_window_event_loop( loop->window, 1 );
+}
@@ -0,0 +1,99 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include <lite/window.h>
+#include <poll.h>
+
+/*
+ * Main loop multiplexing window events, file descriptors and calls posted by other threads with poll(), up to a
+ * deadline. Idle tasks run while nothing else is pending, in steps. They yield between steps when an event arrives, a
+ * step is never interrupted: events wait for the step running, such as the render of a whole page, to end.
+ *
+ * Window events are dispatched by LiTE, they are seen through a second event buffer attached to the window and read
+ * from a file descriptor.
+ */
+
+typedef struct _EventLoop EventLoop;
+
+typedef void (*EventLoopFunc)    ( void *ctx );
+
+/*
+ * Run a step of an idle task, returning whether there is work left.
+ */
+typedef bool (*EventLoopIdleFunc)( void *ctx );
+
+DFBResult EventLoopCreate    ( LiteWindow         *window,
+                               EventLoop         **ret_loop );
+
+void      EventLoopDestroy   ( EventLoop          *loop );
+
+/*
+ * Call a function when a file descriptor has one of the poll() events.
+ */
+DFBResult EventLoopAddFd     ( EventLoop          *loop,
+                               int                 fd,
+                               short               events,
+                               EventLoopFunc       func,
+                               void               *ctx );
+
+void      EventLoopRemoveFd  ( EventLoop          *loop,
+                               int                 fd );
+
+/*
+ * Call a function from the loop, as soon as possible. Thread safe, for the completion of work done in other threads.
+ */
+DFBResult EventLoopPost      ( EventLoop          *loop,
+                               EventLoopFunc       func,
+                               void               *ctx );
+
+/*
+ * Drop the calls posted with a function and context that have not been made yet.
+ */
+void      EventLoopCancel    ( EventLoop          *loop,
+                               EventLoopFunc       func,
+                               void               *ctx );
+
+/*
+ * Queue an idle task, if not queued yet, until it has no work left. Queued tasks take turns, running steps for their
+ * budget in microseconds at least once per turn.
+ */
+DFBResult EventLoopAddIdle   ( EventLoop          *loop,
+                               EventLoopIdleFunc   func,
+                               void               *ctx,
+                               int                 budget );
+
+void      EventLoopRemoveIdle( EventLoop          *loop,
+                               EventLoopIdleFunc   func,
+                               void               *ctx );
+
+/*
+ * Wait for events until a deadline of direct_clock_get_micros(), forever with 0, and dispatch them, or run a turn of
+ * the idle tasks if there is nothing to wait for. Returns after the first events dispatched.
+ */
+DFBResult EventLoopIterate   ( EventLoop          *loop,
+                               long long           deadline );
+
+/*
+ * Let LiTE draw the updates pending after work done outside of the window event handlers.
+ */
+void      EventLoopFlush     ( EventLoop          *loop );
+
+#endif
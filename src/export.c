@@ -0,0 +1,570 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "export.h"
+#include <direct/thread.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/**********************************************************************************************************************/
+
+/*
+ * An encoded page waiting to be written, pages are written in order from a ring of slots.
+ */
+typedef struct {
+     bool       done;
+     DFBResult  result;
+     u8        *data;
+     size_t     size;
+} ExportSlot;
+
+typedef struct {
+     const ExportOptions    *options;
+     const DocumentProvider *provider;
+     const char             *filename;
+     IDirectFB              *idirectfb;
+
+     int                     first;
+     int                     num_jobs;
+     int                     next_job;
+     int                     written;
+
+     ExportSlot             *slots;
+     int                     num_slots;
+
+     DFBResult               ret;
+
+     DirectMutex             lock;
+     DirectWaitQueue         cond;
+} ExportContext;
+
+typedef struct {
+     ExportContext          *context;
+     DocumentProvider       *provider;
+     DirectThread           *thread;
+} ExportWorker;
+
+/**********************************************************************************************************************/
+
+static DFBResult
+Export_EncodeDFIFF( IDirectFBSurface  *surface,
+                    u8               **ret_data,
+                    size_t            *ret_size )
+{
+     DFBResult              ret;
+     int                    width, height;
+     DFBSurfacePixelFormat  format;
+     int                    y;
+     int                    pitch;
+     void                  *ptr;
+     u8                    *data;
+     u32                    header[4];
+     int                    bpl;
+
+     surface->GetSize( surface, &width, &height );
+     surface->GetPixelFormat( surface, &format );
+
+     bpl = DFB_BYTES_PER_LINE( format, width );
+
+     data = D_MALLOC( 8 + sizeof(header) + height * bpl );
+     if (!data)
+          return D_OOM();
+
+     /* Magic, major and minor version, flags. */
+     memcpy( data, "DFIFF\0\0", 7 );
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+     data[7] = 0x01;
+#else
+     data[7] = 0x00;
+#endif
+
+     header[0] = width;
+     header[1] = height;
+     header[2] = format;
+     header[3] = bpl;
+
+     memcpy( data + 8, header, sizeof(header) );
+
+     ret = surface->Lock( surface, DSLF_READ, &ptr, &pitch );
+     if (ret) {
+          D_FREE( data );
+          return ret;
+     }
+
+     for (y = 0; y < height; y++)
+          memcpy( data + 8 + sizeof(header) + y * bpl, (u8*) ptr + y * pitch, bpl );
+
+     surface->Unlock( surface );
+
+     *ret_data = data;
+     *ret_size = 8 + sizeof(header) + height * bpl;
+
+     return DFB_OK;
+}
+
+#ifdef HAVE_ZLIB
+static u8 *
+Export_PutChunk( u8         *dst,
+                 const char *type,
+                 const u8   *chunk,
+                 u32         length )
+{
+     u32 crc;
+
+     dst[0] = length >> 24;
+     dst[1] = length >> 16;
+     dst[2] = length >>  8;
+     dst[3] = length;
+
+     memcpy( dst + 4, type, 4 );
+
+     if (length && chunk != dst + 8)
+          memcpy( dst + 8, chunk, length );
+
+     crc = crc32( 0, dst + 4, length + 4 );
+
+     dst += 8 + length;
+
+     dst[0] = crc >> 24;
+     dst[1] = crc >> 16;
+     dst[2] = crc >>  8;
+     dst[3] = crc;
+
+     return dst + 4;
+}
+
+static void
+Export_ConvertRow( u8                    *dst,
+                   const u8              *src,
+                   DFBSurfacePixelFormat  format,
+                   int                    width )
+{
+     int x;
+
+     switch (format) {
+          case DSPF_ARGB:
+               /* Cairo data is premultiplied. */
+               for (x = 0; x < width; x++, dst += 4) {
+                    const u32 p = ((const u32*) src)[x];
+                    const u32 a = p >> 24;
+
+                    dst[0] = (p >> 16) & 0xff;
+                    dst[1] = (p >>  8) & 0xff;
+                    dst[2] =  p        & 0xff;
+                    dst[3] = a;
+
+                    if (a && a != 0xff) {
+                         dst[0] = dst[0] * 0xff / a;
+                         dst[1] = dst[1] * 0xff / a;
+                         dst[2] = dst[2] * 0xff / a;
+                    }
+               }
+               break;
+
+          case DSPF_ABGR:
+               for (x = 0; x < width; x++, dst += 4) {
+                    const u32 p = ((const u32*) src)[x];
+
+                    dst[0] =  p        & 0xff;
+                    dst[1] = (p >>  8) & 0xff;
+                    dst[2] = (p >> 16) & 0xff;
+                    dst[3] =  p >> 24;
+               }
+               break;
+
+          case DSPF_RGB24:
+               for (x = 0; x < width; x++, dst += 3, src += 3) {
+                    dst[0] = src[2];
+                    dst[1] = src[1];
+                    dst[2] = src[0];
+               }
+               break;
+
+          case DSPF_RGB16:
+               for (x = 0; x < width; x++, dst += 3) {
+                    const u16 p = ((const u16*) src)[x];
+
+                    dst[0] = ((p >> 8) & 0xf8) | (p >> 13);
+                    dst[1] = ((p >> 3) & 0xfc) | ((p >> 9) & 0x03);
+                    dst[2] = ((p << 3) & 0xf8) | ((p >> 2) & 0x07);
+               }
+               break;
+
+          default:
+               break;
+     }
+}
+#endif
+
+static DFBResult
+Export_EncodePNG( IDirectFBSurface  *surface,
+                  u8               **ret_data,
+                  size_t            *ret_size )
+{
+#ifdef HAVE_ZLIB
+     DFBResult              ret;
+     int                    width, height;
+     DFBSurfacePixelFormat  format;
+     int                    y;
+     int                    pitch;
+     void                  *ptr;
+     int                    channels;
+     uLongf                 length;
+     u8                     ihdr[13];
+     u8                    *raw;
+     u8                    *data;
+     u8                    *dst;
+     size_t                 raw_size;
+
+     surface->GetSize( surface, &width, &height );
+     surface->GetPixelFormat( surface, &format );
+
+     switch (format) {
+          case DSPF_ARGB:
+          case DSPF_ABGR:
+               channels = 4;
+               break;
+
+          case DSPF_RGB24:
+          case DSPF_RGB16:
+               channels = 3;
+               break;
+
+          default:
+               return DFB_UNSUPPORTED;
+     }
+
+     /* Unfiltered scanlines. */
+     raw_size = height * (1 + width * channels);
+
+     raw = D_MALLOC( raw_size );
+     if (!raw)
+          return D_OOM();
+
+     ret = surface->Lock( surface, DSLF_READ, &ptr, &pitch );
+     if (ret) {
+          D_FREE( raw );
+          return ret;
+     }
+
+     for (y = 0; y < height; y++) {
+          raw[y * (1 + width * channels)] = 0;
+
+          Export_ConvertRow( raw + y * (1 + width * channels) + 1, (u8*) ptr + y * pitch, format, width );
+     }
+
+     surface->Unlock( surface );
+
+     /* Signature, IHDR, IDAT and IEND. */
+     length = compressBound( raw_size );
+
+     data = D_MALLOC( 8 + 25 + 12 + length + 12 );
+     if (!data) {
+          D_FREE( raw );
+          return D_OOM();
+     }
+
+     if (compress2( data + 8 + 25 + 8, &length, raw, raw_size, Z_BEST_SPEED ) != Z_OK) {
+          D_FREE( data );
+          D_FREE( raw );
+          return DFB_FAILURE;
+     }
+
+     D_FREE( raw );
+
+     memcpy( data, "\x89PNG\r\n\x1a\n", 8 );
+
+     ihdr[0]  = width >> 24;
+     ihdr[1]  = width >> 16;
+     ihdr[2]  = width >>  8;
+     ihdr[3]  = width;
+     ihdr[4]  = height >> 24;
+     ihdr[5]  = height >> 16;
+     ihdr[6]  = height >>  8;
+     ihdr[7]  = height;
+     ihdr[8]  = 8;
+     ihdr[9]  = channels == 4 ? 6 : 2;
+     ihdr[10] = 0;
+     ihdr[11] = 0;
+     ihdr[12] = 0;
+
+     dst = Export_PutChunk( data + 8, "IHDR", ihdr, sizeof(ihdr) );
+     dst = Export_PutChunk( dst, "IDAT", dst + 8, length );
+     dst = Export_PutChunk( dst, "IEND", NULL, 0 );
+
+     *ret_data = data;
+     *ret_size = dst - data;
+
+     return DFB_OK;
+#else
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+Export_RenderJob( ExportContext    *context,
+                  DocumentProvider *provider,
+                  int               job,
+                  ExportSlot       *slot )
+{
+     DFBResult            ret;
+     IDirectFBSurface    *surface;
+     const ExportOptions *options = context->options;
+
+     ret = provider->RenderPage( provider, context->first + job / options->num_zooms,
+                                 options->zooms[job % options->num_zooms], &surface );
+     if (ret)
+          return ret;
+
+     if (options->format == EXPORT_FORMAT_PNG)
+          ret = Export_EncodePNG( surface, &slot->data, &slot->size );
+     else
+          ret = Export_EncodeDFIFF( surface, &slot->data, &slot->size );
+
+     surface->Release( surface );
+
+     return ret;
+}
+
+static void *
+Export_Worker( DirectThread *thread,
+               void         *arg )
+{
+     DFBResult      ret;
+     int            job;
+     ExportWorker  *worker  = arg;
+     ExportContext *context = worker->context;
+
+     while (true) {
+          ExportSlot slot = { .done = true };
+
+          /* Take the next page, without getting more than the number of slots ahead of the writer. */
+          direct_mutex_lock( &context->lock );
+
+          while (context->next_job < context->num_jobs && context->next_job >= context->written + context->num_slots)
+               direct_waitqueue_wait( &context->cond, &context->lock );
+
+          if (context->next_job == context->num_jobs) {
+               direct_mutex_unlock( &context->lock );
+               break;
+          }
+
+          job = context->next_job++;
+
+          direct_mutex_unlock( &context->lock );
+
+          ret = Export_RenderJob( context, worker->provider, job, &slot );
+
+          slot.result = ret;
+
+          direct_mutex_lock( &context->lock );
+
+          context->slots[job % context->num_slots] = slot;
+
+          direct_waitqueue_broadcast( &context->cond );
+
+          direct_mutex_unlock( &context->lock );
+     }
+
+     return NULL;
+}
+
+static DFBResult
+Export_WriteJob( ExportContext *context,
+                 int            job,
+                 ExportSlot    *slot )
+{
+     char                 path[PATH_MAX];
+     FILE                *file;
+     int                  digits;
+     const ExportOptions *options = context->options;
+     int                  pageno  = context->first + job / options->num_zooms;
+     const char          *suffix  = options->format == EXPORT_FORMAT_PNG ? "png" : "dfiff";
+
+     if (slot->result) {
+          fprintf( stderr, "Cannot render page %d: %s\n", pageno, DirectFBErrorString( slot->result ) );
+          return slot->result;
+     }
+
+     digits = snprintf( NULL, 0, "%d", context->first + (context->num_jobs - 1) / options->num_zooms );
+
+     if (options->num_zooms > 1)
+          snprintf( path, sizeof(path), "%s/page-%0*d-%d.%s", options->directory, digits, pageno,
+                    (int) (100 * options->zooms[job % options->num_zooms] + 0.5f), suffix );
+     else
+          snprintf( path, sizeof(path), "%s/page-%0*d.%s", options->directory, digits, pageno, suffix );
+
+     file = fopen( path, "wb" );
+     if (!file) {
+          perror( path );
+          return DFB_IO;
+     }
+
+     if (fwrite( slot->data, slot->size, 1, file ) != 1) {
+          perror( path );
+          fclose( file );
+          return DFB_IO;
+     }
+
+     fclose( file );
+
+     return DFB_OK;
+}
+
+DFBResult
+ProjektorExport( const DocumentProvider *provider,
+                 const char             *filename,
+                 IDirectFB              *idirectfb,
+                 const ExportOptions    *options )
+{
+     DFBResult            ret;
+     DocumentDescription  desc;
+     int                  i;
+     int                  last;
+     int                  num_workers;
+     int                  num_threads = 0;
+     ExportContext        context;
+     ExportWorker        *workers;
+
+#ifndef HAVE_ZLIB
+     if (options->format == EXPORT_FORMAT_PNG)
+          return DFB_UNSUPPORTED;
+#endif
+
+     num_workers = options->jobs ?: sysconf( _SC_NPROCESSORS_ONLN );
+     if (num_workers < 1)
+          num_workers = 1;
+
+     workers = D_CALLOC( num_workers, sizeof(ExportWorker) );
+     if (!workers)
+          return D_OOM();
+
+     memset( &context, 0, sizeof(context) );
+
+     context.options   = options;
+     context.provider  = provider;
+     context.filename  = filename;
+     context.idirectfb = idirectfb;
+
+     /* Open one document instance per worker, a library is never used on the same document from two threads. */
+     for (i = 0; i < num_workers; i++) {
+          workers[i].context = &context;
+
+          ret = DocumentProviderNewInstance( provider, &workers[i].provider );
+          if (ret)
+               goto out;
+
+          ret = workers[i].provider->Init( workers[i].provider, filename, idirectfb, options->pixelformat );
+          if (ret) {
+               DocumentProviderDestroyInstance( workers[i].provider );
+               workers[i].provider = NULL;
+               goto out;
+          }
+
+          if (options->flags && workers[i].provider->SetRenderFlags)
+               workers[i].provider->SetRenderFlags( workers[i].provider, options->flags, options->layers );
+     }
+
+     workers[0].provider->GetDescription( workers[0].provider, &desc );
+
+     context.first = options->first > 0 ? options->first : 1;
+     last          = options->last > 0 && options->last < desc.num_pages ? options->last : desc.num_pages;
+
+     if (context.first > last) {
+          ret = DFB_INVARG;
+          goto out;
+     }
+
+     context.num_jobs  = (last - context.first + 1) * options->num_zooms;
+     context.num_slots = 2 * num_workers;
+
+     context.slots = D_CALLOC( context.num_slots, sizeof(ExportSlot) );
+     if (!context.slots) {
+          ret = D_OOM();
+          goto out;
+     }
+
+     direct_mutex_init( &context.lock );
+     direct_waitqueue_init( &context.cond );
+
+     for (i = 0; i < num_workers; i++) {
+          workers[i].thread = direct_thread_create( DTT_DEFAULT, Export_Worker, &workers[i], "Export" );
+          if (workers[i].thread)
+               num_threads++;
+     }
+
+     if (!num_threads)
+          context.ret = DFB_FAILURE;
+
+     /* Write the pages in order as they complete. */
+     for (i = 0; i < context.num_jobs && num_threads; i++) {
+          ExportSlot *slot = &context.slots[i % context.num_slots];
+
+          direct_mutex_lock( &context.lock );
+
+          while (!slot->done)
+               direct_waitqueue_wait( &context.cond, &context.lock );
+
+          direct_mutex_unlock( &context.lock );
+
+          if (Export_WriteJob( &context, i, slot ))
+               context.ret = DFB_FAILURE;
+
+          if (slot->data)
+               D_FREE( slot->data );
+
+          direct_mutex_lock( &context.lock );
+
+          memset( slot, 0, sizeof(ExportSlot) );
+
+          context.written++;
+
+          direct_waitqueue_broadcast( &context.cond );
+
+          direct_mutex_unlock( &context.lock );
+     }
+
+     for (i = 0; i < num_workers; i++) {
+          if (workers[i].thread) {
+               direct_thread_join( workers[i].thread );
+               direct_thread_destroy( workers[i].thread );
+          }
+     }
+
+     direct_waitqueue_deinit( &context.cond );
+     direct_mutex_deinit( &context.lock );
+
+     D_FREE( context.slots );
+
+     ret = context.ret;
+
+out:
+     for (i = 0; i < num_workers; i++) {
+          if (workers[i].provider) {
+               workers[i].provider->Term( workers[i].provider );
+               DocumentProviderDestroyInstance( workers[i].provider );
+          }
+     }
+
+     D_FREE( workers );
+
+     return ret;
+}
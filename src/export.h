@@ -0,0 +1,57 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __EXPORT_H__
+#define __EXPORT_H__
+
+#include "documentprovider.h"
+
+#define EXPORT_MAX_ZOOMS 16
+
+typedef enum {
+     EXPORT_FORMAT_PNG,
+     EXPORT_FORMAT_DFIFF
+} ExportFormat;
+
+typedef struct {
+     const char            *directory;
+     ExportFormat           format;
+     DFBSurfacePixelFormat  pixelformat;
+
+     int                    first;                   /* first page, 1 by default */
+     int                    last;                    /* last page, 0 for the last page of the document */
+
+     float                  zooms[EXPORT_MAX_ZOOMS];
+     int                    num_zooms;
+
+     int                    jobs;                    /* number of worker threads, 0 for one per CPU */
+
+     DocumentRenderFlags    flags;
+     const char            *layers;                  /* hidden with DOCUMENT_RENDER_HIDE_LAYERS, NULL for all */
+} ExportOptions;
+
+/*
+ * Render a page range of a document at each zoom factor and write the pages in order to the export directory.
+ * Pages are spread across worker threads, each of them using its own document provider instance.
+ */
+DFBResult ProjektorExport( const DocumentProvider *provider,
+                           const char             *filename,
+                           IDirectFB              *idirectfb,
+                           const ExportOptions    *options );
+
+#endif
@@ -0,0 +1,167 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#include "filter.h"
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <math.h>
+
+struct _Filter {
+     u8  r[256];
+     u8  g[256];
+     u8  b[256];
+     u16 rgb16[65536];                        /* whole pixels, as the channels are packed */
+};
+
+/**********************************************************************************************************************/
+
+static void
+Filter_Table( const FilterOptions *options,
+              u8                   tint,
+              u8                  *table )
+{
+     int   i;
+     float v;
+
+     for (i = 0; i < 256; i++) {
+          v = i / 255.0f;
+
+          if (options->invert)
+               v = 1.0f - v;
+
+          v = (v - 0.5f) * options->contrast + 0.5f;
+
+          if (v < 0.0f)
+               v = 0.0f;
+          else if (v > 1.0f)
+               v = 1.0f;
+
+          if (options->gamma != 1.0f)
+               v = powf( v, options->gamma );
+
+          table[i] = (u8) (v * tint + 0.5f);
+     }
+}
+
+DFBResult
+FilterCreate( const FilterOptions  *options,
+              Filter              **ret_filter )
+{
+     Filter *filter;
+     int     i;
+
+     filter = D_MALLOC( sizeof(Filter) );
+     if (!filter)
+          return D_OOM();
+
+     Filter_Table( options, options->tint.r, filter->r );
+     Filter_Table( options, options->tint.g, filter->g );
+     Filter_Table( options, options->tint.b, filter->b );
+
+     /* Expanded to 8 bits with the high bits replicated, as DirectFB does. */
+     for (i = 0; i < 65536; i++) {
+          const unsigned int r = (i >> 11) & 0x1f;
+          const unsigned int g = (i >>  5) & 0x3f;
+          const unsigned int b =  i        & 0x1f;
+
+          filter->rgb16[i] = ((filter->r[(r << 3) | (r >> 2)] >> 3) << 11) |
+                             ((filter->g[(g << 2) | (g >> 4)] >> 2) <<  5) |
+                              (filter->b[(b << 3) | (b >> 2)] >> 3);
+     }
+
+     *ret_filter = filter;
+
+     return DFB_OK;
+}
+
+void
+FilterDestroy( Filter *filter )
+{
+     D_FREE( filter );
+}
+
+bool
+FilterSupports( DFBSurfacePixelFormat format )
+{
+     switch (format) {
+          case DSPF_ARGB:
+          case DSPF_RGB32:
+          case DSPF_ABGR:
+          case DSPF_RGB24:
+          case DSPF_RGB16:
+               return true;
+
+          default:
+               return false;
+     }
+}
+
+void
+FilterApply( const Filter          *filter,
+             const void            *src,
+             int                    src_pitch,
+             void                  *dst,
+             int                    dst_pitch,
+             DFBSurfacePixelFormat  format,
+             int                    width,
+             int                    height )
+{
+     int x, y;
+
+     for (y = 0; y < height; y++) {
+          const u8 *s = (const u8*) src + y * src_pitch;
+          u8       *d = (u8*) dst + y * dst_pitch;
+
+          switch (format) {
+               case DSPF_ARGB:
+               case DSPF_RGB32:
+                    for (x = 0; x < width; x++) {
+                         const u32 p = ((const u32*) s)[x];
+
+                         ((u32*) d)[x] = (p & 0xff000000) | (filter->r[(p >> 16) & 0xff] << 16) |
+                                         (filter->g[(p >> 8) & 0xff] << 8) | filter->b[p & 0xff];
+                    }
+                    break;
+
+               case DSPF_ABGR:
+                    for (x = 0; x < width; x++) {
+                         const u32 p = ((const u32*) s)[x];
+
+                         ((u32*) d)[x] = (p & 0xff000000) | (filter->b[(p >> 16) & 0xff] << 16) |
+                                         (filter->g[(p >> 8) & 0xff] << 8) | filter->r[p & 0xff];
+                    }
+                    break;
+
+               case DSPF_RGB24:
+                    for (x = 0; x < width; x++, s += 3, d += 3) {
+                         d[0] = filter->b[s[0]];
+                         d[1] = filter->g[s[1]];
+                         d[2] = filter->r[s[2]];
+                    }
+                    break;
+
+               case DSPF_RGB16:
+                    for (x = 0; x < width; x++)
+                         ((u16*) d)[x] = filter->rgb16[((const u16*) s)[x]];
+                    break;
+
+               default:
+                    D_BUG( "unexpected pixel format" );
+                    return;
+          }
+     }
+}
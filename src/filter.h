@@ -0,0 +1,59 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <directfb.h>
+
+/*
+ * Display filter, applied to rendered pages when they are drawn: inversion, contrast and gamma, then a colour tint,
+ * folded into per channel lookup tables. The pages rendered and cached are left as they are.
+ */
+
+typedef struct {
+     bool      invert;
+     float     contrast;                      /* around the middle grey, 1 for none */
+     float     gamma;                         /* exponent, above 1 to darken, 1 for none */
+     DFBColor  tint;                          /* multiplied, white for none */
+} FilterOptions;
+
+typedef struct _Filter Filter;
+
+DFBResult FilterCreate  ( const FilterOptions    *options,
+                          Filter                **ret_filter );
+
+void      FilterDestroy ( Filter                 *filter );
+
+/*
+ * Return whether pages of a pixel format can be filtered, DSPF_ARGB, DSPF_RGB32, DSPF_ABGR, DSPF_RGB24 or DSPF_RGB16.
+ */
+bool      FilterSupports( DFBSurfacePixelFormat   format );
+
+/*
+ * Filter pixels into a buffer of the same format, alpha is kept.
+ */
+void      FilterApply   ( const Filter           *filter,
+                          const void             *src,
+                          int                     src_pitch,
+                          void                   *dst,
+                          int                     dst_pitch,
+                          DFBSurfacePixelFormat   format,
+                          int                     width,
+                          int                     height );
+
+#endif
@@ -0,0 +1,1200 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "dither.h"
+#include "documentprovider.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <direct/thread.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+extern DirectLink *documentproviders;
+
+/*
+ * Images are shown at 300 dpi, pages are sized for 72 dpi at zoom factor 1.
+ */
+#define IMAGE_DPI        300
+
+#define IMAGE_WORKERS    2
+#define IMAGE_AHEAD      2
+#define IMAGE_SLOTS      (IMAGE_AHEAD + 1 + IMAGE_WORKERS)
+
+#define IMAGE_MAX_LENGTH (256 << 20)
+
+/**********************************************************************************************************************/
+
+/*
+ * An image of the archive or of the directory. Images of an archive are either stored or deflated, they are read from
+ * the mapped archive at the offset of their data.
+ */
+typedef struct {
+     char          *name;
+     int            method;
+     u32            crc;
+     unsigned long  offset;
+     unsigned long  size;
+     unsigned long  length;
+     time_t         mtime;
+} ImageEntry;
+
+/*
+ * Decode ahead: a free slot is scheduled by RenderPage for a neighbour page, decoded by a worker, and taken over by
+ * the next RenderPage for the page.
+ */
+typedef enum {
+     IMAGE_SLOT_FREE,
+     IMAGE_SLOT_PENDING,
+     IMAGE_SLOT_DECODING,
+     IMAGE_SLOT_DONE
+} ImageSlotState;
+
+typedef struct {
+     ImageSlotState    state;
+     int               pageno;
+     float             zoom;
+     DFBResult         result;
+     IDirectFBSurface *surface;
+} ImageSlot;
+
+typedef struct {
+     IDirectFB             *idirectfb;
+     DFBSurfacePixelFormat  format;
+
+     char                   path[PATH_MAX];
+     bool                   directory;
+     u8                    *map;
+     size_t                 map_size;
+
+     ImageEntry            *entries;
+     int                    num_entries;
+
+     DirectMutex            lock;
+     DirectWaitQueue        cond;
+     DirectThread          *workers[IMAGE_WORKERS];
+     bool                   quit;
+     ImageSlot              slots[IMAGE_SLOTS];
+     int                    last_pageno;
+     unsigned long          page_size;               /* of the last decoded page */
+     unsigned long          limit;
+
+     DocumentDescription    desc;
+} DocumentProvider_Image_data;
+
+/*
+ * Encoded data of an image, pointing into the archive, or into a mapped file or an inflated buffer released with it.
+ */
+typedef struct {
+     const u8 *ptr;
+     size_t    length;
+     void     *map;
+     u8       *buffer;
+} ImageBytes;
+
+/**********************************************************************************************************************/
+
+static inline u16
+DocumentProvider_Image_Get16( const u8 *p )
+{
+     return p[0] | (p[1] << 8);
+}
+
+static inline u32
+DocumentProvider_Image_Get32( const u8 *p )
+{
+     return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32) p[3] << 24);
+}
+
+static bool
+DocumentProvider_Image_IsImage( const char *name )
+{
+     const char *base = strrchr( name, '/' ) ? strrchr( name, '/' ) + 1 : name;
+     const char *ext  = strrchr( base, '.' );
+
+     /* Resource forks and hidden files. */
+     if (!strncmp( name, "__MACOSX/", 9 ) || base[0] == '.' || !ext)
+          return false;
+
+     return !strcasecmp( ext, ".jpg" ) || !strcasecmp( ext, ".jpeg" ) ||
+            !strcasecmp( ext, ".png" ) || !strcasecmp( ext, ".gif" );
+}
+
+static bool
+DocumentProvider_Image_IsSignature( const u8     *header,
+                                    unsigned int  length )
+{
+     return (length >= 3 && !memcmp( header, "\xff\xd8\xff", 3 )) ||
+            (length >= 4 && !memcmp( header, "\x89PNG", 4 )) ||
+            (length >= 4 && !memcmp( header, "GIF8", 4 ));
+}
+
+/*
+ * Natural order of names, runs of digits are compared by value so that "page2" comes before "page10".
+ */
+static int
+DocumentProvider_Image_Compare( const void *a,
+                                const void *b )
+{
+     const char *s = ((const ImageEntry*) a)->name;
+     const char *t = ((const ImageEntry*) b)->name;
+
+     while (*s && *t) {
+          int diff;
+
+          if (isdigit( (unsigned char) *s ) && isdigit( (unsigned char) *t )) {
+               size_t s_len = 0;
+               size_t t_len = 0;
+
+               while (*s == '0' && isdigit( (unsigned char) s[1] ))
+                    s++;
+
+               while (*t == '0' && isdigit( (unsigned char) t[1] ))
+                    t++;
+
+               while (isdigit( (unsigned char) s[s_len] ))
+                    s_len++;
+
+               while (isdigit( (unsigned char) t[t_len] ))
+                    t_len++;
+
+               if (s_len != t_len)
+                    return s_len < t_len ? -1 : 1;
+
+               diff = strncmp( s, t, s_len );
+               if (diff)
+                    return diff;
+
+               s += s_len;
+               t += t_len;
+               continue;
+          }
+
+          diff = tolower( (unsigned char) *s ) - tolower( (unsigned char) *t );
+          if (diff)
+               return diff;
+
+          s++;
+          t++;
+     }
+
+     return (unsigned char) *s - (unsigned char) *t;
+}
+
+static DFBResult
+DocumentProvider_Image_AddEntry( DocumentProvider_Image_data *data,
+                                 const ImageEntry            *entry,
+                                 const char                  *name,
+                                 int                          name_length )
+{
+     ImageEntry *entries;
+
+     entries = D_REALLOC( data->entries, (data->num_entries + 1) * sizeof(ImageEntry) );
+     if (!entries)
+          return D_OOM();
+
+     data->entries = entries;
+
+     entries[data->num_entries] = *entry;
+
+     entries[data->num_entries].name = D_MALLOC( name_length + 1 );
+     if (!entries[data->num_entries].name)
+          return D_OOM();
+
+     memcpy( entries[data->num_entries].name, name, name_length );
+     entries[data->num_entries].name[name_length] = 0;
+
+     data->num_entries++;
+
+     return DFB_OK;
+}
+
+/*
+ * Images of a zip archive are listed from its central directory, found through the end of central directory record
+ * at the end of the archive, possibly followed by a comment. Zip64 archives and encrypted entries are not supported.
+ */
+static DFBResult
+DocumentProvider_Image_ScanArchive( DocumentProvider_Image_data *data )
+{
+     DFBResult       ret;
+     const u8       *end = NULL;
+     const u8       *p;
+     unsigned long   offset;
+     int             i;
+     int             count;
+     const u8       *map  = data->map;
+     size_t          size = data->map_size;
+
+     if (size < 22)
+          return DFB_UNSUPPORTED;
+
+     for (p = map + size - 22; p >= map && p + 0xffff + 22 >= map + size; p--) {
+          if (DocumentProvider_Image_Get32( p ) == 0x06054b50) {
+               end = p;
+               break;
+          }
+     }
+
+     if (!end)
+          return DFB_UNSUPPORTED;
+
+     count  = DocumentProvider_Image_Get16( end + 10 );
+     offset = DocumentProvider_Image_Get32( end + 16 );
+
+     for (i = 0; i < count; i++) {
+          ImageEntry  entry;
+          int         name_length;
+          int         local_length;
+          const char *name;
+
+          if (offset + 46 > size || DocumentProvider_Image_Get32( map + offset ) != 0x02014b50)
+               return DFB_FAILURE;
+
+          p           = map + offset;
+          name        = (const char*) p + 46;
+          name_length = DocumentProvider_Image_Get16( p + 28 );
+
+          offset += 46 + name_length + DocumentProvider_Image_Get16( p + 30 ) + DocumentProvider_Image_Get16( p + 32 );
+          if (offset > size)
+               return DFB_FAILURE;
+
+          memset( &entry, 0, sizeof(entry) );
+
+          entry.method = DocumentProvider_Image_Get16( p + 10 );
+          entry.crc    = DocumentProvider_Image_Get32( p + 16 );
+          entry.size   = DocumentProvider_Image_Get32( p + 20 );
+          entry.length = DocumentProvider_Image_Get32( p + 24 );
+          entry.offset = DocumentProvider_Image_Get32( p + 42 );
+
+          if (DocumentProvider_Image_Get16( p + 8 ) & 1)
+               continue;
+
+#ifdef HAVE_ZLIB
+          if (entry.method != 0 && entry.method != 8)
+#else
+          if (entry.method != 0)
+#endif
+               continue;
+
+          if (name_length >= PATH_MAX || entry.length > IMAGE_MAX_LENGTH)
+               continue;
+
+          {
+               char buffer[PATH_MAX];
+
+               snprintf( buffer, sizeof(buffer), "%.*s", name_length, name );
+
+               if (!DocumentProvider_Image_IsImage( buffer ))
+                    continue;
+          }
+
+          /* The data follows the local header, its extra field may differ from the central one. */
+          if (entry.offset + 30 > size || DocumentProvider_Image_Get32( map + entry.offset ) != 0x04034b50)
+               continue;
+
+          local_length = 30 + DocumentProvider_Image_Get16( map + entry.offset + 26 ) +
+                         DocumentProvider_Image_Get16( map + entry.offset + 28 );
+
+          entry.offset += local_length;
+
+          if (entry.offset + entry.size > size)
+               continue;
+
+          ret = DocumentProvider_Image_AddEntry( data, &entry, name, name_length );
+          if (ret)
+               return ret;
+     }
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Image_ScanDirectory( DocumentProvider_Image_data *data )
+{
+     DFBResult      ret = DFB_OK;
+     DIR           *dir;
+     struct dirent *entry;
+
+     dir = opendir( data->path );
+     if (!dir)
+          return DFB_FILENOTFOUND;
+
+     while ((entry = readdir( dir )) != NULL) {
+          ImageEntry  image;
+          struct stat st;
+          char        path[PATH_MAX];
+
+          if (!DocumentProvider_Image_IsImage( entry->d_name ))
+               continue;
+
+          snprintf( path, sizeof(path), "%s/%s", data->path, entry->d_name );
+
+          if (stat( path, &st ) || !S_ISREG( st.st_mode ) || st.st_size > IMAGE_MAX_LENGTH)
+               continue;
+
+          memset( &image, 0, sizeof(image) );
+
+          image.size   = st.st_size;
+          image.length = st.st_size;
+          image.mtime  = st.st_mtime;
+
+          ret = DocumentProvider_Image_AddEntry( data, &image, entry->d_name, strlen( entry->d_name ) );
+          if (ret)
+               break;
+     }
+
+     closedir( dir );
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Image_GetBytes( DocumentProvider_Image_data *data,
+                                 const ImageEntry            *entry,
+                                 ImageBytes                  *bytes )
+{
+     memset( bytes, 0, sizeof(ImageBytes) );
+
+     if (data->directory) {
+          int  fd;
+          char path[PATH_MAX];
+
+          snprintf( path, sizeof(path), "%s/%s", data->path, entry->name );
+
+          fd = open( path, O_RDONLY );
+          if (fd < 0)
+               return DFB_FILENOTFOUND;
+
+          bytes->map = mmap( NULL, entry->length, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+          close( fd );
+
+          if (bytes->map == MAP_FAILED) {
+               bytes->map = NULL;
+               return DFB_IO;
+          }
+
+          bytes->ptr    = bytes->map;
+          bytes->length = entry->length;
+
+          return DFB_OK;
+     }
+
+     if (entry->method == 0) {
+          bytes->ptr    = data->map + entry->offset;
+          bytes->length = MIN( entry->size, entry->length );
+
+          return DFB_OK;
+     }
+
+#ifdef HAVE_ZLIB
+     {
+          z_stream stream;
+          int      err;
+
+          bytes->buffer = D_MALLOC( entry->length ?: 1 );
+          if (!bytes->buffer)
+               return D_OOM();
+
+          memset( &stream, 0, sizeof(stream) );
+
+          if (inflateInit2( &stream, -MAX_WBITS ) != Z_OK) {
+               D_FREE( bytes->buffer );
+               bytes->buffer = NULL;
+               return DFB_FAILURE;
+          }
+
+          stream.next_in   = data->map + entry->offset;
+          stream.avail_in  = entry->size;
+          stream.next_out  = bytes->buffer;
+          stream.avail_out = entry->length;
+
+          err = inflate( &stream, Z_FINISH );
+
+          inflateEnd( &stream );
+
+          if (err != Z_STREAM_END) {
+               D_FREE( bytes->buffer );
+               bytes->buffer = NULL;
+               return DFB_FAILURE;
+          }
+
+          bytes->ptr    = bytes->buffer;
+          bytes->length = entry->length;
+
+          return DFB_OK;
+     }
+#else
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+static void
+DocumentProvider_Image_PutBytes( ImageBytes *bytes )
+{
+     if (bytes->map)
+          munmap( bytes->map, bytes->length );
+
+     if (bytes->buffer)
+          D_FREE( bytes->buffer );
+}
+
+/*
+ * Bring a decoded image to the page size and pixel format.
+ */
+static DFBResult
+DocumentProvider_Image_Finish( DocumentProvider_Image_data  *data,
+                               IDirectFBSurface             *decoded,
+                               int                           width,
+                               int                           height,
+                               IDirectFBSurface            **ret_surface )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     int                    decoded_width;
+     int                    decoded_height;
+     IDirectFBSurface      *scaled;
+     IDirectFBSurface      *surface;
+
+     decoded->GetSize( decoded, &decoded_width, &decoded_height );
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = width;
+     desc.height      = height;
+     desc.pixelformat = DSPF_RGB24;
+
+     if (decoded_width != width || decoded_height != height) {
+          ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &scaled );
+          if (ret) {
+               decoded->Release( decoded );
+               return ret;
+          }
+
+          scaled->SetRenderOptions( scaled, DSRO_SMOOTH_DOWNSCALE );
+          scaled->StretchBlit( scaled, decoded, NULL, NULL );
+
+          decoded->Release( decoded );
+     }
+     else
+          scaled = decoded;
+
+     if (data->format == DSPF_RGB16) {
+          void *src;
+          void *dst;
+          int   src_pitch;
+          int   dst_pitch;
+
+          desc.pixelformat = DSPF_RGB16;
+
+          ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+          if (ret) {
+               scaled->Release( scaled );
+               return ret;
+          }
+
+          scaled->Lock( scaled, DSLF_READ, &src, &src_pitch );
+          surface->Lock( surface, DSLF_WRITE, &dst, &dst_pitch );
+
+          Dither_RGB16( src, src_pitch, DSPF_RGB24, dst, dst_pitch, width, height );
+
+          surface->Unlock( surface );
+          scaled->Unlock( scaled );
+
+          scaled->Release( scaled );
+     }
+     else
+          surface = scaled;
+
+     *ret_surface = surface;
+
+     return DFB_OK;
+}
+
+static void
+DocumentProvider_Image_Size( int    image_width,
+                             int    image_height,
+                             float  zoom,
+                             int   *ret_width,
+                             int   *ret_height )
+{
+     *ret_width  = MAX( 1, image_width  * zoom * 72 / IMAGE_DPI + 0.5f );
+     *ret_height = MAX( 1, image_height * zoom * 72 / IMAGE_DPI + 0.5f );
+}
+
+#ifdef HAVE_JPEG
+typedef struct {
+     struct jpeg_error_mgr pub;
+     jmp_buf               jmp;
+} ImageJPEGError;
+
+static void
+DocumentProvider_Image_JPEGError( j_common_ptr cinfo )
+{
+     ImageJPEGError *error = (ImageJPEGError*) cinfo->err;
+
+     longjmp( error->jmp, 1 );
+}
+
+/*
+ * The DCT is scaled down by up to 8 while the decoded image stays larger than the page, a large photo is not decoded
+ * at full resolution to be scaled down afterwards.
+ */
+static DFBResult
+DocumentProvider_Image_DecodeJPEG( DocumentProvider_Image_data  *data,
+                                   const ImageBytes             *bytes,
+                                   float                         zoom,
+                                   IDirectFBSurface            **ret_surface )
+{
+     DFBResult                      ret;
+     DFBSurfaceDescription          desc;
+     struct jpeg_decompress_struct  cinfo;
+     ImageJPEGError                 error;
+     int                            width;
+     int                            height;
+     int                            pitch;
+     unsigned int                   x;
+     IDirectFBSurface     *volatile surface = NULL;
+     u8                   *volatile ptr     = NULL;
+
+     cinfo.err = jpeg_std_error( &error.pub );
+
+     error.pub.error_exit = DocumentProvider_Image_JPEGError;
+
+     if (setjmp( error.jmp )) {
+          if (ptr)
+               surface->Unlock( surface );
+
+          if (surface)
+               surface->Release( surface );
+
+          jpeg_destroy_decompress( &cinfo );
+
+          return DFB_FAILURE;
+     }
+
+     jpeg_create_decompress( &cinfo );
+
+     jpeg_mem_src( &cinfo, (unsigned char*) bytes->ptr, bytes->length );
+
+     jpeg_read_header( &cinfo, TRUE );
+
+     DocumentProvider_Image_Size( cinfo.image_width, cinfo.image_height, zoom, &width, &height );
+
+     cinfo.scale_num       = 1;
+     cinfo.scale_denom     = 1;
+     cinfo.out_color_space = JCS_RGB;
+
+     while (cinfo.scale_denom < 8 &&
+            cinfo.image_width  / (cinfo.scale_denom * 2) >= width &&
+            cinfo.image_height / (cinfo.scale_denom * 2) >= height)
+          cinfo.scale_denom *= 2;
+
+     jpeg_start_decompress( &cinfo );
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = cinfo.output_width;
+     desc.height      = cinfo.output_height;
+     desc.pixelformat = DSPF_RGB24;
+
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, (IDirectFBSurface**) &surface );
+     if (ret) {
+          jpeg_destroy_decompress( &cinfo );
+          return ret;
+     }
+
+     surface->Lock( surface, DSLF_WRITE, (void**) &ptr, &pitch );
+
+     /* Scanlines are RGB, RGB24 pixels are stored as BGR. */
+     while (cinfo.output_scanline < cinfo.output_height) {
+          JSAMPROW row = ptr + cinfo.output_scanline * pitch;
+
+          jpeg_read_scanlines( &cinfo, &row, 1 );
+
+          for (x = 0; x < cinfo.output_width; x++) {
+               u8 r = row[x * 3];
+
+               row[x * 3]     = row[x * 3 + 2];
+               row[x * 3 + 2] = r;
+          }
+     }
+
+     surface->Unlock( surface );
+     ptr = NULL;
+
+     jpeg_finish_decompress( &cinfo );
+     jpeg_destroy_decompress( &cinfo );
+
+     return DocumentProvider_Image_Finish( data, surface, width, height, ret_surface );
+}
+#endif
+
+/*
+ * Other formats, and JPEG images libjpeg cannot convert to RGB, are rendered at the page size by a DirectFB image
+ * provider.
+ */
+static DFBResult
+DocumentProvider_Image_DecodeProvider( DocumentProvider_Image_data  *data,
+                                       const ImageBytes             *bytes,
+                                       float                         zoom,
+                                       IDirectFBSurface            **ret_surface )
+{
+     DFBResult                 ret;
+     DFBDataBufferDescription  ddesc;
+     DFBSurfaceDescription     desc;
+     int                       width;
+     int                       height;
+     IDirectFBDataBuffer      *buffer;
+     IDirectFBImageProvider   *provider = NULL;
+     IDirectFBSurface         *surface  = NULL;
+
+     ddesc.flags         = DBDESC_MEMORY;
+     ddesc.memory.data   = bytes->ptr;
+     ddesc.memory.length = bytes->length;
+
+     ret = data->idirectfb->CreateDataBuffer( data->idirectfb, &ddesc, &buffer );
+     if (ret)
+          return ret;
+
+     ret = buffer->CreateImageProvider( buffer, &provider );
+     if (ret)
+          goto out;
+
+     ret = provider->GetSurfaceDescription( provider, &desc );
+     if (ret)
+          goto out;
+
+     DocumentProvider_Image_Size( desc.width, desc.height, zoom, &width, &height );
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = width;
+     desc.height      = height;
+     desc.pixelformat = DSPF_RGB24;
+
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+     if (ret)
+          goto out;
+
+     /* Transparent images are shown on a white page. */
+     surface->Clear( surface, 0xff, 0xff, 0xff, 0xff );
+
+     ret = provider->RenderTo( provider, surface, NULL );
+     if (ret) {
+          surface->Release( surface );
+          goto out;
+     }
+
+     ret = DocumentProvider_Image_Finish( data, surface, width, height, ret_surface );
+
+out:
+     if (provider)
+          provider->Release( provider );
+
+     buffer->Release( buffer );
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Image_Decode( DocumentProvider_Image_data  *data,
+                               int                           pageno,
+                               float                         zoom,
+                               IDirectFBSurface            **ret_surface )
+{
+     DFBResult  ret;
+     ImageBytes bytes;
+
+     ret = DocumentProvider_Image_GetBytes( data, &data->entries[pageno - 1], &bytes );
+     if (ret)
+          return ret;
+
+     ret = DFB_UNSUPPORTED;
+
+#ifdef HAVE_JPEG
+     if (bytes.length >= 3 && !memcmp( bytes.ptr, "\xff\xd8\xff", 3 ))
+          ret = DocumentProvider_Image_DecodeJPEG( data, &bytes, zoom, ret_surface );
+#endif
+
+     if (ret)
+          ret = DocumentProvider_Image_DecodeProvider( data, &bytes, zoom, ret_surface );
+
+     DocumentProvider_Image_PutBytes( &bytes );
+
+     return ret;
+}
+
+/**********************************************************************************************************************/
+
+static void *
+DocumentProvider_Image_Worker( DirectThread *thread,
+                               void         *arg )
+{
+     DocumentProvider_Image_data *data = arg;
+
+     direct_mutex_lock( &data->lock );
+
+     while (!data->quit) {
+          int               i;
+          DFBResult         result;
+          IDirectFBSurface *surface = NULL;
+          ImageSlot        *slot    = NULL;
+
+          for (i = 0; i < IMAGE_SLOTS && !slot; i++) {
+               if (data->slots[i].state == IMAGE_SLOT_PENDING)
+                    slot = &data->slots[i];
+          }
+
+          if (!slot) {
+               direct_waitqueue_wait( &data->cond, &data->lock );
+               continue;
+          }
+
+          slot->state = IMAGE_SLOT_DECODING;
+
+          direct_mutex_unlock( &data->lock );
+
+          result = DocumentProvider_Image_Decode( data, slot->pageno, slot->zoom, &surface );
+
+          direct_mutex_lock( &data->lock );
+
+          slot->state   = IMAGE_SLOT_DONE;
+          slot->result  = result;
+          slot->surface = surface;
+
+          if (!result) {
+               int width, height;
+
+               surface->GetSize( surface, &width, &height );
+
+               data->page_size = (unsigned long) width * height * DFB_BYTES_PER_PIXEL( data->format == DSPF_RGB16 ?
+                                                                                       DSPF_RGB16 : DSPF_RGB24 );
+          }
+
+          direct_waitqueue_broadcast( &data->cond );
+     }
+
+     direct_mutex_unlock( &data->lock );
+
+     return NULL;
+}
+
+static void
+DocumentProvider_Image_ReleaseSlot( ImageSlot *slot )
+{
+     if (slot->surface)
+          slot->surface->Release( slot->surface );
+
+     memset( slot, 0, sizeof(ImageSlot) );
+}
+
+/*
+ * Schedule the next pages in the direction of travel and the previous one, within the memory limit. Called with the
+ * lock held, slots of other pages or another zoom factor are released.
+ */
+static void
+DocumentProvider_Image_Schedule( DocumentProvider_Image_data *data,
+                                 int                          pageno,
+                                 float                        zoom,
+                                 int                          direction )
+{
+     int i, n;
+     int ahead = IMAGE_AHEAD;
+     int pages[IMAGE_AHEAD + 1];
+     int num   = 0;
+
+     if (data->limit && data->page_size)
+          ahead = MIN( ahead, data->limit / data->page_size );
+
+     for (i = 1; i <= ahead; i++)
+          pages[num++] = pageno + i * direction;
+
+     if (ahead)
+          pages[num++] = pageno - direction;
+
+     for (i = 0; i < IMAGE_SLOTS; i++) {
+          ImageSlot *slot = &data->slots[i];
+
+          if (slot->state != IMAGE_SLOT_PENDING && slot->state != IMAGE_SLOT_DONE)
+               continue;
+
+          for (n = 0; n < num; n++) {
+               if (slot->pageno == pages[n] && slot->zoom == zoom)
+                    break;
+          }
+
+          if (n == num)
+               DocumentProvider_Image_ReleaseSlot( slot );
+     }
+
+     for (n = 0; n < num; n++) {
+          ImageSlot *free = NULL;
+
+          if (pages[n] < 1 || pages[n] > data->num_entries)
+               continue;
+
+          for (i = 0; i < IMAGE_SLOTS; i++) {
+               ImageSlot *slot = &data->slots[i];
+
+               if (slot->state == IMAGE_SLOT_FREE) {
+                    if (!free)
+                         free = slot;
+               }
+               else if (slot->pageno == pages[n] && slot->zoom == zoom)
+                    break;
+          }
+
+          if (i < IMAGE_SLOTS || !free)
+               continue;
+
+          free->state  = IMAGE_SLOT_PENDING;
+          free->pageno = pages[n];
+          free->zoom   = zoom;
+     }
+
+     /* Workers are started on first use, instances opened for probing or metadata never render. */
+     for (i = 0; i < IMAGE_WORKERS; i++) {
+          if (!data->workers[i])
+               data->workers[i] = direct_thread_create( DTT_DEFAULT, DocumentProvider_Image_Worker, data, "Image" );
+     }
+
+     direct_waitqueue_broadcast( &data->cond );
+}
+
+/**********************************************************************************************************************/
+
+static int
+DocumentProvider_Image_Probe( DocumentProvider *thiz,
+                              const u8         *header,
+                              unsigned int      length )
+{
+     if (DocumentProvider_Image_IsSignature( header, length ))
+          return 100;
+
+     if (length >= 4 && !memcmp( header, "PK\003\004", 4 ))
+          return 75;
+
+     /* Directories of images have no header. */
+     if (!length)
+          return 10;
+
+     return 0;
+}
+
+static DFBResult
+DocumentProvider_Image_Init( DocumentProvider      *thiz,
+                             const char            *filename,
+                             IDirectFB             *idirectfb,
+                             DFBSurfacePixelFormat  format )
+{
+     DFBResult                    ret = DFB_UNSUPPORTED;
+     struct stat                  st;
+     int                          fd;
+     const char                  *base;
+     DocumentProvider_Image_data *data;
+
+     data = D_CALLOC( 1, sizeof(DocumentProvider_Image_data) );
+     if (!data)
+          return D_OOM();
+
+     data->idirectfb = idirectfb;
+     data->format    = format;
+
+     snprintf( data->path, sizeof(data->path), "%s", filename );
+
+     /* Without the trailing slashes of a directory name. */
+     while (strlen( data->path ) > 1 && data->path[strlen( data->path ) - 1] == '/')
+          data->path[strlen( data->path ) - 1] = 0;
+
+     if (stat( data->path, &st )) {
+          ret = DFB_FILENOTFOUND;
+          goto error;
+     }
+
+     if (S_ISDIR( st.st_mode )) {
+          data->directory = true;
+
+          ret = DocumentProvider_Image_ScanDirectory( data );
+          if (ret)
+               goto error;
+     }
+     else {
+          if (!st.st_size)
+               goto error;
+
+          fd = open( data->path, O_RDONLY );
+          if (fd < 0) {
+               ret = DFB_FILENOTFOUND;
+               goto error;
+          }
+
+          data->map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+          close( fd );
+
+          if (data->map == MAP_FAILED) {
+               data->map = NULL;
+               ret = DFB_IO;
+               goto error;
+          }
+
+          data->map_size = st.st_size;
+
+          if (DocumentProvider_Image_IsSignature( data->map, data->map_size )) {
+               ImageEntry entry;
+
+               memset( &entry, 0, sizeof(entry) );
+
+               entry.size   = data->map_size;
+               entry.length = data->map_size;
+
+               ret = DocumentProvider_Image_AddEntry( data, &entry, "", 0 );
+          }
+          else
+               ret = DocumentProvider_Image_ScanArchive( data );
+
+          if (ret)
+               goto error;
+     }
+
+     if (!data->num_entries) {
+          ret = DFB_UNSUPPORTED;
+          goto error;
+     }
+
+     qsort( data->entries, data->num_entries, sizeof(ImageEntry), DocumentProvider_Image_Compare );
+
+     base = strrchr( data->path, '/' ) ? strrchr( data->path, '/' ) + 1 : data->path;
+
+     snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, "%s", base );
+
+     data->desc.num_pages = data->num_entries;
+
+     direct_mutex_init( &data->lock );
+     direct_waitqueue_init( &data->cond );
+
+     thiz->priv = data;
+
+     return DFB_OK;
+
+error:
+     while (data->num_entries--)
+          D_FREE( data->entries[data->num_entries].name );
+
+     if (data->entries)
+          D_FREE( data->entries );
+
+     if (data->map)
+          munmap( data->map, data->map_size );
+
+     D_FREE( data );
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Image_Term( DocumentProvider *thiz )
+{
+     int                          i;
+     DocumentProvider_Image_data *data = thiz->priv;
+
+     direct_mutex_lock( &data->lock );
+
+     data->quit = true;
+
+     direct_waitqueue_broadcast( &data->cond );
+
+     direct_mutex_unlock( &data->lock );
+
+     for (i = 0; i < IMAGE_WORKERS; i++) {
+          if (data->workers[i]) {
+               direct_thread_join( data->workers[i] );
+               direct_thread_destroy( data->workers[i] );
+          }
+     }
+
+     for (i = 0; i < IMAGE_SLOTS; i++)
+          DocumentProvider_Image_ReleaseSlot( &data->slots[i] );
+
+     direct_waitqueue_deinit( &data->cond );
+     direct_mutex_deinit( &data->lock );
+
+     for (i = 0; i < data->num_entries; i++)
+          D_FREE( data->entries[i].name );
+
+     D_FREE( data->entries );
+
+     if (data->map)
+          munmap( data->map, data->map_size );
+
+     D_FREE( data );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Image_GetDescription( DocumentProvider    *thiz,
+                                       DocumentDescription *ret_desc )
+{
+     DocumentProvider_Image_data *data = thiz->priv;
+
+     if (!ret_desc)
+          return DFB_INVARG;
+
+     *ret_desc = data->desc;
+
+     return DFB_OK;
+}
+
+/*
+ * A page decoded ahead is taken, a page being decoded is waited for, and a page still pending is decoded here.
+ */
+static DFBResult
+DocumentProvider_Image_RenderPage( DocumentProvider  *thiz,
+                                   int                pageno,
+                                   float              zoom,
+                                   IDirectFBSurface **ret_surface )
+{
+     DFBResult                    ret;
+     int                          i;
+     int                          delta;
+     IDirectFBSurface            *surface = NULL;
+     DocumentProvider_Image_data *data    = thiz->priv;
+
+     if (pageno < 1 || pageno > data->num_entries)
+          return DFB_INVARG;
+
+     direct_mutex_lock( &data->lock );
+
+     for (i = 0; i < IMAGE_SLOTS; i++) {
+          ImageSlot *slot = &data->slots[i];
+
+          if (slot->state == IMAGE_SLOT_FREE || slot->pageno != pageno || slot->zoom != zoom)
+               continue;
+
+          while (slot->state == IMAGE_SLOT_DECODING)
+               direct_waitqueue_wait( &data->cond, &data->lock );
+
+          if (slot->state == IMAGE_SLOT_DONE && !slot->result) {
+               surface       = slot->surface;
+               slot->surface = NULL;
+          }
+
+          DocumentProvider_Image_ReleaseSlot( slot );
+          break;
+     }
+
+     /* Pages are read one after the other, or by spreads, anything else is a jump or a stride of export workers. */
+     delta = pageno - data->last_pageno;
+
+     if (!data->last_pageno || (delta && abs( delta ) <= 2))
+          DocumentProvider_Image_Schedule( data, pageno, zoom, delta < 0 ? -1 : 1 );
+
+     data->last_pageno = pageno;
+
+     direct_mutex_unlock( &data->lock );
+
+     if (surface) {
+          *ret_surface = surface;
+          return DFB_OK;
+     }
+
+     ret = DocumentProvider_Image_Decode( data, pageno, zoom, &surface );
+     if (ret)
+          return ret;
+
+     *ret_surface = surface;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Image_SetMemoryLimit( DocumentProvider *thiz,
+                                       unsigned long     size )
+{
+     int                          i;
+     DocumentProvider_Image_data *data = thiz->priv;
+
+     direct_mutex_lock( &data->lock );
+
+     /* Pages decoded ahead are released when the limit is lowered, they are scheduled again within the new one. */
+     if (!data->limit || size < data->limit) {
+          for (i = 0; i < IMAGE_SLOTS; i++) {
+               if (data->slots[i].state == IMAGE_SLOT_PENDING || data->slots[i].state == IMAGE_SLOT_DONE)
+                    DocumentProvider_Image_ReleaseSlot( &data->slots[i] );
+          }
+     }
+
+     data->limit = size;
+
+     direct_mutex_unlock( &data->lock );
+
+     return DFB_OK;
+}
+
+/*
+ * Images of an archive are unchanged if their checksum is, images of a directory if their file is not modified.
+ */
+static DFBResult
+DocumentProvider_Image_GetFingerprints( DocumentProvider *thiz,
+                                        u64              *ret_fingerprints )
+{
+     int                          i;
+     DocumentProvider_Image_data *data = thiz->priv;
+
+     for (i = 0; i < data->num_entries; i++) {
+          const ImageEntry *entry = &data->entries[i];
+          u64               hash  = DOCUMENT_FINGERPRINT_INIT;
+
+          if (!data->directory && !data->entries[i].name[0])
+               hash = DocumentFingerprint( hash, data->map, data->map_size );
+
+          hash = DocumentFingerprint( hash, entry->name, strlen( entry->name ) );
+          hash = DocumentFingerprint( hash, &entry->crc, sizeof(entry->crc) );
+          hash = DocumentFingerprint( hash, &entry->length, sizeof(entry->length) );
+          hash = DocumentFingerprint( hash, &entry->mtime, sizeof(entry->mtime) );
+
+          ret_fingerprints[i] = hash;
+     }
+
+     return DFB_OK;
+}
+
+static DocumentProvider image_provider = {
+     .impl            = "Image",
+     .Probe           = DocumentProvider_Image_Probe,
+     .Init            = DocumentProvider_Image_Init,
+     .Term            = DocumentProvider_Image_Term,
+     .GetDescription  = DocumentProvider_Image_GetDescription,
+     .RenderPage      = DocumentProvider_Image_RenderPage,
+     .SetMemoryLimit  = DocumentProvider_Image_SetMemoryLimit,
+     .GetFingerprints = DocumentProvider_Image_GetFingerprints,
+};
+
+__attribute__((constructor))
+static void
+DocumentProvider_Image_ctor()
+{
+     direct_list_append( &documentproviders, &image_provider.link );
+}
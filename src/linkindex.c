@@ -0,0 +1,240 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#include "linkindex.h"
+#include <direct/mem.h>
+#include <direct/util.h>
+
+/* Links per cell aimed at, and maximum cells per axis. */
+#define LINK_INDEX_DENSITY   4
+#define LINK_INDEX_MAX_CELLS 64
+
+struct _LinkIndex {
+     DocumentLink *links;
+     int           num_links;
+
+     float         x, y;                             /* grid origin */
+     float         cell_w, cell_h;
+     int           cols, rows;
+
+     int          *cell_start;                       /* first entry of each cell, and end of the last one */
+     int          *cell_links;                       /* link positions, grouped by cell */
+};
+
+/**********************************************************************************************************************/
+
+static int
+LinkIndex_Compare( const void *a,
+                   const void *b )
+{
+     const DocumentLink *link_a = a;
+     const DocumentLink *link_b = b;
+
+     if (link_a->y1 != link_b->y1)
+          return link_a->y1 < link_b->y1 ? -1 : 1;
+
+     if (link_a->x1 != link_b->x1)
+          return link_a->x1 < link_b->x1 ? -1 : 1;
+
+     return 0;
+}
+
+static inline int
+LinkIndex_Col( const LinkIndex *index,
+               float            x )
+{
+     int col = (x - index->x) / index->cell_w;
+
+     return CLAMP( col, 0, index->cols - 1 );
+}
+
+static inline int
+LinkIndex_Row( const LinkIndex *index,
+               float            y )
+{
+     int row = (y - index->y) / index->cell_h;
+
+     return CLAMP( row, 0, index->rows - 1 );
+}
+
+DFBResult
+LinkIndexCreate( const DocumentLink  *links,
+                 int                  num_links,
+                 LinkIndex          **ret_index )
+{
+     int        i, col, row;
+     int        num_cells;
+     float      x2, y2;
+     int       *fill;
+     LinkIndex *index;
+
+     index = D_CALLOC( 1, sizeof(LinkIndex) );
+     if (!index)
+          return D_OOM();
+
+     index->num_links = num_links;
+     index->cols      = 1;
+     index->rows      = 1;
+
+     if (num_links) {
+          index->links = D_MALLOC( num_links * sizeof(DocumentLink) );
+          if (!index->links)
+               goto error;
+
+          memcpy( index->links, links, num_links * sizeof(DocumentLink) );
+
+          qsort( index->links, num_links, sizeof(DocumentLink), LinkIndex_Compare );
+
+          /* Grid bounds. */
+          index->x = links[0].x1;
+          index->y = links[0].y1;
+          x2       = links[0].x2;
+          y2       = links[0].y2;
+
+          for (i = 1; i < num_links; i++) {
+               index->x = MIN( index->x, links[i].x1 );
+               index->y = MIN( index->y, links[i].y1 );
+               x2       = MAX( x2, links[i].x2 );
+               y2       = MAX( y2, links[i].y2 );
+          }
+
+          /* Square-ish grid with a few links per cell. */
+          while (index->cols * index->rows * LINK_INDEX_DENSITY < num_links && index->cols < LINK_INDEX_MAX_CELLS) {
+               index->cols++;
+               index->rows++;
+          }
+
+          index->cell_w = MAX( x2 - index->x, 1.0f ) / index->cols;
+          index->cell_h = MAX( y2 - index->y, 1.0f ) / index->rows;
+     }
+     else {
+          index->cell_w = 1.0f;
+          index->cell_h = 1.0f;
+     }
+
+     num_cells = index->cols * index->rows;
+
+     index->cell_start = D_CALLOC( num_cells + 1, sizeof(int) );
+     if (!index->cell_start)
+          goto error;
+
+     /* Count the links overlapping each cell. */
+     for (i = 0; i < num_links; i++) {
+          const DocumentLink *link = &index->links[i];
+
+          for (row = LinkIndex_Row( index, link->y1 ); row <= LinkIndex_Row( index, link->y2 ); row++) {
+               for (col = LinkIndex_Col( index, link->x1 ); col <= LinkIndex_Col( index, link->x2 ); col++)
+                    index->cell_start[row * index->cols + col + 1]++;
+          }
+     }
+
+     for (i = 0; i < num_cells; i++)
+          index->cell_start[i+1] += index->cell_start[i];
+
+     index->cell_links = D_MALLOC( (index->cell_start[num_cells] ?: 1) * sizeof(int) );
+     if (!index->cell_links)
+          goto error;
+
+     fill = D_MALLOC( num_cells * sizeof(int) );
+     if (!fill)
+          goto error;
+
+     memcpy( fill, index->cell_start, num_cells * sizeof(int) );
+
+     /* Fill the cells, links stay in reading order within a cell. */
+     for (i = 0; i < num_links; i++) {
+          const DocumentLink *link = &index->links[i];
+
+          for (row = LinkIndex_Row( index, link->y1 ); row <= LinkIndex_Row( index, link->y2 ); row++) {
+               for (col = LinkIndex_Col( index, link->x1 ); col <= LinkIndex_Col( index, link->x2 ); col++)
+                    index->cell_links[fill[row * index->cols + col]++] = i;
+          }
+     }
+
+     D_FREE( fill );
+
+     *ret_index = index;
+
+     return DFB_OK;
+
+error:
+     LinkIndexDestroy( index );
+
+     return D_OOM();
+}
+
+void
+LinkIndexDestroy( LinkIndex *index )
+{
+     if (index->links)
+          D_FREE( index->links );
+
+     if (index->cell_start)
+          D_FREE( index->cell_start );
+
+     if (index->cell_links)
+          D_FREE( index->cell_links );
+
+     D_FREE( index );
+}
+
+int
+LinkIndexCount( const LinkIndex *index )
+{
+     return index->num_links;
+}
+
+const DocumentLink *
+LinkIndexGet( const LinkIndex *index,
+              int              n )
+{
+     if (n < 0 || n >= index->num_links)
+          return NULL;
+
+     return &index->links[n];
+}
+
+int
+LinkIndexHit( const LinkIndex *index,
+              float            x,
+              float            y )
+{
+     int   i, cell;
+     int   ret  = -1;
+     float area = 0;
+
+     if (!index->num_links || x < index->x || y < index->y ||
+         x > index->x + index->cols * index->cell_w || y > index->y + index->rows * index->cell_h)
+          return -1;
+
+     cell = LinkIndex_Row( index, y ) * index->cols + LinkIndex_Col( index, x );
+
+     for (i = index->cell_start[cell]; i < index->cell_start[cell+1]; i++) {
+          const DocumentLink *link = &index->links[index->cell_links[i]];
+
+          if (x >= link->x1 && x <= link->x2 && y >= link->y1 && y <= link->y2) {
+               float a = (link->x2 - link->x1) * (link->y2 - link->y1);
+
+               if (ret < 0 || a < area) {
+                    ret  = index->cell_links[i];
+                    area = a;
+               }
+          }
+     }
+
+     return ret;
+}
@@ -0,0 +1,54 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#ifndef __LINKINDEX_H__
+#define __LINKINDEX_H__
+
+#include "documentprovider.h"
+
+/*
+ * Spatial index of the links of a page: links are kept in reading order and assigned to the cells of a uniform grid
+ * covering their bounds, so that hit testing only looks at the links overlapping a cell.
+ */
+
+typedef struct _LinkIndex LinkIndex;
+
+/*
+ * Create an index of links, the links are copied.
+ */
+DFBResult           LinkIndexCreate ( const DocumentLink  *links,
+                                      int                  num_links,
+                                      LinkIndex          **ret_index );
+
+void                LinkIndexDestroy( LinkIndex           *index );
+
+int                 LinkIndexCount  ( const LinkIndex     *index );
+
+/*
+ * Get a link by its position in reading order.
+ */
+const DocumentLink *LinkIndexGet    ( const LinkIndex     *index,
+                                      int                  n );
+
+/*
+ * Return the position of the smallest link containing a point in page coordinates, or -1.
+ */
+int                 LinkIndexHit    ( const LinkIndex     *index,
+                                      float                x,
+                                      float                y );
+
+#endif
@@ -0,0 +1,458 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "metadata.h"
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/util.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define METADATA_HASH_SIZE (64 * 1024)              /* hashed at the beginning and at the end of the file */
+
+typedef struct {
+     float     width;                                /* 0 if unknown */
+     float     height;
+     long long time;
+} MetadataPage;
+
+struct _Metadata {
+     char                  path[PATH_MAX];            /* of the index */
+
+     char                  filename[PATH_MAX];
+     long long             size;
+     long long             mtime;
+     unsigned long long    hash;
+
+     bool                  modified;
+
+     DocumentDescription   desc;
+     bool                  has_desc;
+
+     MetadataPage         *pages;                    /* desc.num_pages entries */
+
+     DocumentOutlineEntry *outline;
+     int                   num_outline;
+     bool                  has_outline;
+
+     int                   pageno;                   /* 0 if unknown */
+     float                 zoom;
+};
+
+/**********************************************************************************************************************/
+
+static unsigned long long
+Metadata_HashFile( const char *filename,
+                   long long   size )
+{
+     int                 fd;
+     ssize_t             length;
+     u8                 *buffer;
+     unsigned long long  hash = DOCUMENT_FINGERPRINT_INIT;
+
+     buffer = D_MALLOC( METADATA_HASH_SIZE );
+     if (!buffer)
+          return 0;
+
+     fd = open( filename, O_RDONLY );
+     if (fd < 0) {
+          D_FREE( buffer );
+          return 0;
+     }
+
+     length = pread( fd, buffer, METADATA_HASH_SIZE, 0 );
+     if (length > 0)
+          hash = DocumentFingerprint( hash, buffer, length );
+
+     if (size > METADATA_HASH_SIZE) {
+          length = pread( fd, buffer, METADATA_HASH_SIZE, MAX( size - METADATA_HASH_SIZE, METADATA_HASH_SIZE ) );
+          if (length > 0)
+               hash = DocumentFingerprint( hash, buffer, length );
+     }
+
+     close( fd );
+
+     D_FREE( buffer );
+
+     return hash;
+}
+
+/*
+ * Titles are stored up to the end of the line.
+ */
+static void
+Metadata_ReadTitle( char       *dst,
+                    size_t      size,
+                    const char *line )
+{
+     size_t length = strcspn( line, "\n" );
+
+     snprintf( dst, size, "%.*s", (int) length, line );
+}
+
+static void
+Metadata_WriteTitle( FILE       *file,
+                     const char *title )
+{
+     for (; *title; title++)
+          fputc( (*title == '\n' || *title == '\r') ? ' ' : *title, file );
+
+     fputc( '\n', file );
+}
+
+static DFBResult
+Metadata_SetPages( Metadata *metadata,
+                   int       num_pages )
+{
+     if (metadata->pages)
+          D_FREE( metadata->pages );
+
+     metadata->pages = D_CALLOC( MAX( num_pages, 1 ), sizeof(MetadataPage) );
+     if (!metadata->pages)
+          return D_OOM();
+
+     return DFB_OK;
+}
+
+static void
+Metadata_Read( Metadata *metadata )
+{
+     FILE               *file;
+     char                line[PATH_MAX + 64];
+     int                 n;
+     long long           size, mtime;
+     unsigned long long  hash;
+     int                 pageno, level;
+     float               width, height, zoom;
+     long long           time;
+
+     file = fopen( metadata->path, "r" );
+     if (!file)
+          return;
+
+     /* The index is ignored if the file has changed. */
+     if (!fgets( line, sizeof(line), file ) ||
+         sscanf( line, "file %lld %lld %llx %n", &size, &mtime, &hash, &n ) != 3 ||
+         size != metadata->size || mtime != metadata->mtime || hash != metadata->hash ||
+         strcspn( line + n, "\n" ) != strlen( metadata->filename ) ||
+         strncmp( line + n, metadata->filename, strlen( metadata->filename ) )) {
+          fclose( file );
+          return;
+     }
+
+     while (fgets( line, sizeof(line), file )) {
+          if (sscanf( line, "pages %d", &pageno ) == 1 && pageno > 0 && !metadata->has_desc) {
+               if (Metadata_SetPages( metadata, pageno ))
+                    break;
+
+               metadata->desc.num_pages = pageno;
+               metadata->has_desc       = true;
+          }
+          else if (!strncmp( line, "title ", 6 )) {
+               Metadata_ReadTitle( metadata->desc.title, sizeof(metadata->desc.title), line + 6 );
+          }
+          else if (sscanf( line, "page %d %f %f %lld", &pageno, &width, &height, &time ) == 4) {
+               if (metadata->has_desc && pageno > 0 && pageno <= metadata->desc.num_pages) {
+                    metadata->pages[pageno-1].width  = width;
+                    metadata->pages[pageno-1].height = height;
+                    metadata->pages[pageno-1].time   = time;
+               }
+          }
+          else if (sscanf( line, "outline %d %d %n", &level, &pageno, &n ) == 2) {
+               if (DocumentOutlineAppend( &metadata->outline, &metadata->num_outline, level, pageno, NULL ))
+                    break;
+
+               Metadata_ReadTitle( metadata->outline[metadata->num_outline-1].title, DOCUMENT_OUTLINE_TITLE_LENGTH,
+                                   line + n );
+
+               metadata->has_outline = true;
+          }
+          else if (!strcmp( line, "outline\n" )) {
+               /* No outline in the document. */
+               metadata->has_outline = true;
+          }
+          else if (sscanf( line, "position %d %f", &pageno, &zoom ) == 2) {
+               metadata->pageno = pageno;
+               metadata->zoom   = zoom;
+          }
+     }
+
+     fclose( file );
+}
+
+static void
+Metadata_Write( Metadata *metadata )
+{
+     FILE *file;
+     int   i;
+     char *slash;
+     char  tmp[PATH_MAX + 4];
+
+     /* Create the cache directories. */
+     for (slash = strchr( metadata->path + 1, '/' ); slash; slash = strchr( slash + 1, '/' )) {
+          *slash = 0;
+          mkdir( metadata->path, 0755 );
+          *slash = '/';
+     }
+
+     snprintf( tmp, sizeof(tmp), "%s.new", metadata->path );
+
+     file = fopen( tmp, "w" );
+     if (!file)
+          return;
+
+     fprintf( file, "file %lld %lld %llx %s\n", metadata->size, metadata->mtime, metadata->hash, metadata->filename );
+
+     if (metadata->has_desc) {
+          fprintf( file, "pages %d\n", metadata->desc.num_pages );
+          fprintf( file, "title " );
+          Metadata_WriteTitle( file, metadata->desc.title );
+
+          for (i = 0; i < metadata->desc.num_pages; i++) {
+               const MetadataPage *page = &metadata->pages[i];
+
+               if (page->width)
+                    fprintf( file, "page %d %.2f %.2f %lld\n", i + 1, page->width, page->height, page->time );
+          }
+     }
+
+     if (metadata->has_outline) {
+          if (!metadata->num_outline)
+               fprintf( file, "outline\n" );
+
+          for (i = 0; i < metadata->num_outline; i++) {
+               fprintf( file, "outline %d %d ", metadata->outline[i].level, metadata->outline[i].pageno );
+               Metadata_WriteTitle( file, metadata->outline[i].title );
+          }
+     }
+
+     if (metadata->pageno)
+          fprintf( file, "position %d %.3f\n", metadata->pageno, metadata->zoom );
+
+     /* Replace the index at once. */
+     if (fclose( file ) || rename( tmp, metadata->path ))
+          unlink( tmp );
+}
+
+/**********************************************************************************************************************/
+
+DFBResult
+MetadataOpen( const char  *filename,
+              Metadata   **ret_metadata )
+{
+     Metadata           *metadata;
+     struct stat         st;
+     unsigned long long  key;
+     const char         *cache = getenv( "XDG_CACHE_HOME" );
+
+     metadata = D_CALLOC( 1, sizeof(Metadata) );
+     if (!metadata)
+          return D_OOM();
+
+     if (!realpath( filename, metadata->filename ) || stat( metadata->filename, &st )) {
+          D_FREE( metadata );
+          return DFB_FILENOTFOUND;
+     }
+
+     metadata->size  = st.st_size;
+     metadata->mtime = st.st_mtime;
+     metadata->hash  = Metadata_HashFile( metadata->filename, metadata->size );
+
+     /* One index per path. */
+     key = DocumentFingerprint( DOCUMENT_FINGERPRINT_INIT, metadata->filename, strlen( metadata->filename ) );
+
+     if (cache)
+          snprintf( metadata->path, sizeof(metadata->path), "%s/projektor/metadata/%016llx", cache, key );
+     else
+          snprintf( metadata->path, sizeof(metadata->path), "%s/.cache/projektor/metadata/%016llx",
+                    getenv( "HOME" ) ?: ".", key );
+
+     Metadata_Read( metadata );
+
+     *ret_metadata = metadata;
+
+     return DFB_OK;
+}
+
+void
+MetadataClose( Metadata *metadata )
+{
+     if (metadata->modified)
+          Metadata_Write( metadata );
+
+     if (metadata->pages)
+          D_FREE( metadata->pages );
+
+     if (metadata->outline)
+          D_FREE( metadata->outline );
+
+     D_FREE( metadata );
+}
+
+DFBResult
+MetadataGetDescription( Metadata            *metadata,
+                        DocumentDescription *ret_desc )
+{
+     if (!metadata->has_desc)
+          return DFB_ITEMNOTFOUND;
+
+     *ret_desc = metadata->desc;
+
+     return DFB_OK;
+}
+
+void
+MetadataSetDescription( Metadata                  *metadata,
+                        const DocumentDescription *desc )
+{
+     if (metadata->has_desc && metadata->desc.num_pages == desc->num_pages &&
+         !strcmp( metadata->desc.title, desc->title ))
+          return;
+
+     if (desc->num_pages < 1 || Metadata_SetPages( metadata, desc->num_pages ))
+          return;
+
+     metadata->desc     = *desc;
+     metadata->has_desc = true;
+     metadata->modified = true;
+}
+
+DFBResult
+MetadataGetPageSize( Metadata *metadata,
+                     int       pageno,
+                     float    *ret_width,
+                     float    *ret_height )
+{
+     if (!metadata->has_desc || pageno < 1 || pageno > metadata->desc.num_pages || !metadata->pages[pageno-1].width)
+          return DFB_ITEMNOTFOUND;
+
+     *ret_width  = metadata->pages[pageno-1].width;
+     *ret_height = metadata->pages[pageno-1].height;
+
+     return DFB_OK;
+}
+
+long long
+MetadataGetRenderTime( Metadata *metadata,
+                       int       pageno )
+{
+     if (!metadata->has_desc || pageno < 1 || pageno > metadata->desc.num_pages)
+          return 0;
+
+     return metadata->pages[pageno-1].time;
+}
+
+void
+MetadataSetPage( Metadata  *metadata,
+                 int        pageno,
+                 float      width,
+                 float      height,
+                 long long  time )
+{
+     MetadataPage *page;
+
+     if (!metadata->has_desc || pageno < 1 || pageno > metadata->desc.num_pages)
+          return;
+
+     page = &metadata->pages[pageno-1];
+
+     page->width  = width;
+     page->height = height;
+
+     if (time)
+          page->time = time;
+
+     metadata->modified = true;
+}
+
+DFBResult
+MetadataGetOutline( Metadata              *metadata,
+                    DocumentOutlineEntry **ret_entries,
+                    int                   *ret_num )
+{
+     DocumentOutlineEntry *entries = NULL;
+
+     if (!metadata->has_outline)
+          return DFB_ITEMNOTFOUND;
+
+     if (metadata->num_outline) {
+          entries = D_MALLOC( metadata->num_outline * sizeof(DocumentOutlineEntry) );
+          if (!entries)
+               return D_OOM();
+
+          memcpy( entries, metadata->outline, metadata->num_outline * sizeof(DocumentOutlineEntry) );
+     }
+
+     *ret_entries = entries;
+     *ret_num     = metadata->num_outline;
+
+     return DFB_OK;
+}
+
+void
+MetadataSetOutline( Metadata                   *metadata,
+                    const DocumentOutlineEntry *entries,
+                    int                         num )
+{
+     DocumentOutlineEntry *outline = NULL;
+
+     if (num) {
+          outline = D_MALLOC( num * sizeof(DocumentOutlineEntry) );
+          if (!outline)
+               return;
+
+          memcpy( outline, entries, num * sizeof(DocumentOutlineEntry) );
+     }
+
+     if (metadata->outline)
+          D_FREE( metadata->outline );
+
+     metadata->outline     = outline;
+     metadata->num_outline = num;
+     metadata->has_outline = true;
+     metadata->modified    = true;
+}
+
+DFBResult
+MetadataGetPosition( Metadata *metadata,
+                     int      *ret_pageno,
+                     float    *ret_zoom )
+{
+     if (!metadata->pageno)
+          return DFB_ITEMNOTFOUND;
+
+     *ret_pageno = metadata->pageno;
+     *ret_zoom   = metadata->zoom;
+
+     return DFB_OK;
+}
+
+void
+MetadataSetPosition( Metadata *metadata,
+                     int       pageno,
+                     float     zoom )
+{
+     if (metadata->pageno == pageno && metadata->zoom == zoom)
+          return;
+
+     metadata->pageno   = pageno;
+     metadata->zoom     = zoom;
+     metadata->modified = true;
+}
@@ -0,0 +1,90 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#ifndef __METADATA_H__
+#define __METADATA_H__
+
+#include "documentprovider.h"
+
+/*
+ * Metadata index of a document, kept in the cache directory across runs: description, page geometry and render time,
+ * outline, and the last position. The index is identified by the path, size, modification time and a hash of the
+ * beginning and the end of the file, it is ignored once the file changes.
+ */
+
+typedef struct _Metadata Metadata;
+
+/*
+ * Open the index of a document, an empty one if there is none yet.
+ */
+DFBResult MetadataOpen           ( const char                  *filename,
+                                   Metadata                   **ret_metadata );
+
+/*
+ * Write the index if it has changed, and free it.
+ */
+void      MetadataClose          ( Metadata                    *metadata );
+
+DFBResult MetadataGetDescription ( Metadata                    *metadata,
+                                   DocumentDescription         *ret_desc );
+
+void      MetadataSetDescription ( Metadata                    *metadata,
+                                   const DocumentDescription   *desc );
+
+/*
+ * Page size at zoom factor 1, DFB_ITEMNOTFOUND if the page has not been rendered yet.
+ */
+DFBResult MetadataGetPageSize    ( Metadata                    *metadata,
+                                   int                          pageno,
+                                   float                       *ret_width,
+                                   float                       *ret_height );
+
+/*
+ * Render time in microseconds, 0 if unknown.
+ */
+long long MetadataGetRenderTime  ( Metadata                    *metadata,
+                                   int                          pageno );
+
+/*
+ * Record the size of a rendered page, and its render time unless zero.
+ */
+void      MetadataSetPage        ( Metadata                    *metadata,
+                                   int                          pageno,
+                                   float                        width,
+                                   float                        height,
+                                   long long                    time );
+
+/*
+ * The array returned is freed by the caller with D_FREE.
+ */
+DFBResult MetadataGetOutline     ( Metadata                    *metadata,
+                                   DocumentOutlineEntry       **ret_entries,
+                                   int                         *ret_num );
+
+void      MetadataSetOutline     ( Metadata                    *metadata,
+                                   const DocumentOutlineEntry  *entries,
+                                   int                          num );
+
+DFBResult MetadataGetPosition    ( Metadata                    *metadata,
+                                   int                         *ret_pageno,
+                                   float                       *ret_zoom );
+
+void      MetadataSetPosition    ( Metadata                    *metadata,
+                                   int                          pageno,
+                                   float                        zoom );
+
+#endif
@@ -16,31 +16,124 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#include "dither.h"
 #include "documentprovider.h"
+#include "pool.h"
 #include <direct/memcpy.h>
 #include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
 
 extern DirectLink *documentproviders;
 
 /**********************************************************************************************************************/
 
 typedef struct {
-     IDirectFB           *idirectfb;
+     IDirectFB             *idirectfb;
+     DFBSurfacePixelFormat  format;
 
-     fz_context          *ctx;
-     fz_document         *doc;
+     Pool                  *pool;
+     fz_alloc_context       alloc;
+     unsigned long          limit;                   /* 0 for unlimited */
 
-     DocumentDescription  desc;
+     fz_context            *ctx;
+     fz_document           *doc;
+
+     DocumentRenderFlags    flags;
+
+     DocumentProgressFunc   progress;
+     void                  *progress_ctx;
+
+     DocumentDescription    desc;
 } DocumentProvider_MuPDF_data;
 
 /**********************************************************************************************************************/
 
+static int
+DocumentProvider_MuPDF_Probe( DocumentProvider *thiz,
+                              const u8         *header,
+                              unsigned int      length )
+{
+     unsigned int i;
+
+     if (length >= 5 && !memcmp( header, "%PDF-", 5 ))
+          return 100;
+
+     /* Leading garbage is tolerated. */
+     for (i = 1; i + 5 <= length; i++) {
+          if (!memcmp( header + i, "%PDF-", 5 ))
+               return 50;
+     }
+
+     /* XPS, EPUB and CBZ archives, and images. */
+     if (length >= 4 && (!memcmp( header, "PK\x03\x04", 4 ) || !memcmp( header, "\x89PNG", 4 ) ||
+                         !memcmp( header, "\xff\xd8\xff", 3 )))
+          return 50;
+
+     return 0;
+}
+
+static void *
+DocumentProvider_MuPDF_Malloc( void   *user,
+                               size_t  size )
+{
+     return PoolAlloc( user, size );
+}
+
+static void *
+DocumentProvider_MuPDF_Realloc( void   *user,
+                                void   *ptr,
+                                size_t  size )
+{
+     return PoolRealloc( user, ptr, size );
+}
+
+static void
+DocumentProvider_MuPDF_Free( void *user,
+                             void *ptr )
+{
+     PoolFree( user, ptr );
+}
+
+/*
+ * Give back the pool chunks left empty once a page is rendered. Beyond the memory limit, the resource store is shrunk
+ * in proportion. The working set of a render is never limited.
+ */
+static void
+DocumentProvider_MuPDF_Trim( DocumentProvider_MuPDF_data *data )
+{
+     PoolStats stats;
+
+     PoolGetStats( data->pool, &stats );
+
+     if (data->limit && stats.size > data->limit)
+          fz_shrink_store( data->ctx, 100ULL * data->limit / stats.size );
+
+     PoolTrim( data->pool );
+}
+
+/*
+ * Errors caught when MuPDF runs out of memory are reported as such, so that memory is released and rendering retried.
+ */
+static DFBResult
+DocumentProvider_MuPDF_Caught( fz_context *ctx )
+{
+#ifdef MUPDF_FITZ_UTIL_H /*** mupdf >= 1.8 */
+     if (fz_caught( ctx ) == FZ_ERROR_MEMORY)
+          return DFB_NOSYSTEMMEMORY;
+#endif
+
+     return DFB_FAILURE;
+}
+
 static DFBResult
-DocumentProvider_MuPDF_Init( DocumentProvider *thiz,
-                             const char       *filename,
-                             IDirectFB        *idirectfb )
+DocumentProvider_MuPDF_Init( DocumentProvider      *thiz,
+                             const char            *filename,
+                             IDirectFB             *idirectfb,
+                             DFBSurfacePixelFormat  format )
 {
      DFBResult                    ret = DFB_FAILURE;
+     const char                  *store;
+     size_t                       store_size = FZ_STORE_DEFAULT;
      DocumentProvider_MuPDF_data *data;
 
      data = D_CALLOC( 1, sizeof(DocumentProvider_MuPDF_data) );
@@ -48,8 +141,26 @@ DocumentProvider_MuPDF_Init( DocumentProvider *thiz,
           return D_OOM();;
 
      data->idirectfb = idirectfb;
+     data->format    = format;
+
+     /* Small allocations are served by a size-class pool. */
+     ret = PoolCreate( &data->pool );
+     if (ret) {
+          D_FREE( data );
+          return ret;
+     }
 
-     data->ctx = fz_new_context( NULL, NULL, FZ_STORE_DEFAULT );
+     ret = DFB_FAILURE;
+
+     data->alloc = (fz_alloc_context) { data->pool, DocumentProvider_MuPDF_Malloc, DocumentProvider_MuPDF_Realloc,
+                                        DocumentProvider_MuPDF_Free };
+
+     /* Resource store limit in megabytes, 0 for unlimited. */
+     store = getenv( "PROJEKTOR_MUPDF_STORE" );
+     if (store)
+          store_size = atoi( store ) * 1024 * 1024UL;
+
+     data->ctx = fz_new_context( &data->alloc, NULL, store_size );
      if (!data->ctx)
           goto error;
 
@@ -86,6 +197,8 @@ error:
           fz_free_context( data->ctx );
 #endif
 
+     PoolDestroy( data->pool );
+
      D_FREE( data );
 
      return ret;
@@ -94,6 +207,7 @@ error:
 static DFBResult
 DocumentProvider_MuPDF_Term( DocumentProvider *thiz )
 {
+     PoolStats                    stats;
      DocumentProvider_MuPDF_data *data = thiz->priv;
 
 #ifdef FZ_META_FORMAT /****** mupdf >= 1.7 */
@@ -104,6 +218,14 @@ DocumentProvider_MuPDF_Term( DocumentProvider *thiz )
      fz_free_context( data->ctx );
 #endif
 
+     PoolGetStats( data->pool, &stats );
+
+     if (stats.allocs)
+          D_INFO( "Projektor/MuPDF: %llu allocations, %llu%% pooled, %llu malloc calls, %lu kB peak\n", stats.allocs,
+                  100 * stats.pooled / stats.allocs, stats.mallocs, stats.peak_size / 1024 );
+
+     PoolDestroy( data->pool );
+
      D_FREE( data );
 
      return DFB_OK;
@@ -123,20 +245,270 @@ DocumentProvider_MuPDF_GetDescription( DocumentProvider    *thiz,
      return DFB_OK;
 }
 
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+/*
+ * Images are left out by the draw device, they are not even decoded.
+ */
+static void
+DocumentProvider_MuPDF_FillImage( fz_context             *ctx,
+                                  fz_device              *device,
+                                  fz_image               *image,
+                                  fz_matrix               matrix,
+                                  float                   alpha,
+# if FZ_VERSION_MINOR >= 16 /******* mupdf >= 1.16 */
+                                  fz_color_params         params )
+# else /************************** mupdf <= 1.15 */
+                                  const fz_color_params  *params )
+# endif
+{
+}
+
+/*
+ * As fz_new_pixmap_from_page_number() on white, leaving out the annotations and widgets, or the images, and clipped
+ * to a region if not NULL. With alpha, the samples are laid out as DSPF_ABGR. NULL is returned if the region is empty.
+ */
+static fz_pixmap *
+DocumentProvider_MuPDF_RenderContents( DocumentProvider_MuPDF_data *data,
+                                       int                          pageno,
+                                       float                        zoom,
+                                       const DocumentBox           *region )
+{
+     fz_page      *page;
+     fz_irect      bbox;
+     DFBRectangle  rect;
+     fz_matrix     matrix = fz_scale( zoom, zoom );
+     fz_device    *device = NULL;
+     fz_pixmap    *pixmap = NULL;
+
+     page = fz_load_page( data->ctx, data->doc, pageno - 1 );
+
+     fz_try( data->ctx ) {
+          bbox = fz_round_rect( fz_transform_rect( fz_bound_page( data->ctx, page ), matrix ) );
+
+          rect.w = bbox.x1 - bbox.x0;
+          rect.h = bbox.y1 - bbox.y0;
+
+          if (region) {
+               DocumentBoxToRectangle( region, zoom, rect.w, rect.h, &rect );
+
+               bbox.x0 += rect.x;
+               bbox.y0 += rect.y;
+               bbox.x1  = bbox.x0 + rect.w;
+               bbox.y1  = bbox.y0 + rect.h;
+          }
+
+          if (rect.w > 0 && rect.h > 0) {
+               pixmap = fz_new_pixmap_with_bbox( data->ctx, fz_device_rgb( data->ctx ), bbox, NULL, 1 );
+
+               fz_clear_pixmap_with_value( data->ctx, pixmap, 0xff );
+
+               device = fz_new_draw_device( data->ctx, fz_identity, pixmap );
+
+               if (data->flags & DOCUMENT_RENDER_NO_IMAGES)
+                    device->fill_image = DocumentProvider_MuPDF_FillImage;
+
+               if (data->flags & DOCUMENT_RENDER_NO_ANNOTATIONS)
+                    fz_run_page_contents( data->ctx, page, device, matrix, NULL );
+               else
+                    fz_run_page( data->ctx, page, device, matrix, NULL );
+
+               fz_close_device( data->ctx, device );
+          }
+     }
+     fz_always( data->ctx ) {
+          fz_drop_device( data->ctx, device );
+          fz_drop_page( data->ctx, page );
+     }
+     fz_catch( data->ctx ) {
+          fz_drop_pixmap( data->ctx, pixmap );
+          fz_rethrow( data->ctx );
+     }
+
+     return pixmap;
+}
+
+/*
+ * Render a page band by band, reporting the progress after each band. The page is interpreted once into a display
+ * list, each band only rasterizes the part of the list within it.
+ */
 static DFBResult
-DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
-                                   int                pageno,
-                                   float              zoom,
-                                   IDirectFBSurface **ret_surface )
+DocumentProvider_MuPDF_RenderBands( DocumentProvider_MuPDF_data  *data,
+                                    int                           pageno,
+                                    float                         zoom,
+                                    const DocumentBox            *region,
+                                    IDirectFBSurface            **ret_surface )
+{
+     DFBResult              ret = DFB_FAILURE;
+     DFBSurfaceDescription  desc;
+     DFBRectangle           rect;
+     DFBRectangle           band;
+     fz_irect               bbox;
+     fz_irect               clip;
+     int                    y;
+     int                    pitch;
+     u8                    *ptr;
+     unsigned char         *src;
+     fz_matrix              matrix  = fz_scale( zoom, zoom );
+     fz_page               *page    = NULL;
+     fz_display_list       *list    = NULL;
+     fz_device             *device  = NULL;
+     fz_pixmap             *pixmap  = NULL;
+     IDirectFBSurface      *surface = NULL;
+
+     fz_var( page );
+     fz_var( list );
+     fz_var( device );
+     fz_var( pixmap );
+
+     fz_try( data->ctx ) {
+          page = fz_load_page( data->ctx, data->doc, pageno - 1 );
+          bbox = fz_round_rect( fz_transform_rect( fz_bound_page( data->ctx, page ), matrix ) );
+
+          if (data->flags & DOCUMENT_RENDER_NO_ANNOTATIONS)
+               list = fz_new_display_list_from_page_contents( data->ctx, page );
+          else
+               list = fz_new_display_list_from_page( data->ctx, page );
+     }
+     fz_catch( data->ctx ) {
+          ret = DocumentProvider_MuPDF_Caught( data->ctx );
+          goto out;
+     }
+
+     if (region) {
+          DocumentBoxToRectangle( region, zoom, bbox.x1 - bbox.x0, bbox.y1 - bbox.y0, &rect );
+
+          if (rect.w < 1 || rect.h < 1) {
+               ret = DFB_INVARG;
+               goto out;
+          }
+
+          bbox.x0 += rect.x;
+          bbox.y0 += rect.y;
+          bbox.x1  = bbox.x0 + rect.w;
+          bbox.y1  = bbox.y0 + rect.h;
+     }
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = bbox.x1 - bbox.x0;
+     desc.height      = bbox.y1 - bbox.y0;
+     desc.pixelformat = data->format == DSPF_RGB16 ? DSPF_RGB16 : DSPF_ABGR;
+
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+     if (ret) {
+          surface = NULL;
+          goto out;
+     }
+
+     ret = DFB_FAILURE;
+
+     band.x = 0;
+     band.w = desc.width;
+
+     for (band.y = 0; band.y < desc.height; band.y += band.h) {
+          band.h = DocumentProgressBand( band.y, desc.height );
+
+          clip.x0 = bbox.x0;
+          clip.y0 = bbox.y0 + band.y;
+          clip.x1 = bbox.x1;
+          clip.y1 = clip.y0 + band.h;
+
+          /* With alpha, the samples are laid out as DSPF_ABGR. */
+          fz_try( data->ctx ) {
+               pixmap = fz_new_pixmap_with_bbox( data->ctx, fz_device_rgb( data->ctx ), clip, NULL, 1 );
+
+               fz_clear_pixmap_with_value( data->ctx, pixmap, 0xff );
+
+               device = fz_new_draw_device( data->ctx, fz_identity, pixmap );
+
+               if (data->flags & DOCUMENT_RENDER_NO_IMAGES)
+                    device->fill_image = DocumentProvider_MuPDF_FillImage;
+
+               fz_run_display_list( data->ctx, list, device, matrix, fz_rect_from_irect( clip ), NULL );
+
+               fz_close_device( data->ctx, device );
+          }
+          fz_always( data->ctx ) {
+               fz_drop_device( data->ctx, device );
+               device = NULL;
+          }
+          fz_catch( data->ctx ) {
+               ret = DocumentProvider_MuPDF_Caught( data->ctx );
+               goto out;
+          }
+
+          surface->Lock( surface, DSLF_WRITE, (void**) &ptr, &pitch );
+
+          ptr += band.y * pitch;
+          src  = fz_pixmap_samples( data->ctx, pixmap );
+
+          if (desc.pixelformat == DSPF_RGB16) {
+               Dither_RGB16( src, fz_pixmap_stride( data->ctx, pixmap ), DSPF_ABGR, ptr, pitch, band.w, band.h );
+          }
+          else {
+               for (y = 0; y < band.h; y++) {
+                    direct_memcpy( ptr, src, band.w * 4 );
+
+                    src += fz_pixmap_stride( data->ctx, pixmap );
+                    ptr += pitch;
+               }
+          }
+
+          surface->Unlock( surface );
+
+          fz_drop_pixmap( data->ctx, pixmap );
+          pixmap = NULL;
+
+          if (data->progress)
+               data->progress( data->progress_ctx, surface, &band );
+     }
+
+     *ret_surface = surface;
+
+     surface = NULL;
+     ret     = DFB_OK;
+
+out:
+     if (surface)
+          surface->Release( surface );
+
+     if (pixmap)
+          fz_drop_pixmap( data->ctx, pixmap );
+
+     if (list)
+          fz_drop_display_list( data->ctx, list );
+
+     if (page)
+          fz_drop_page( data->ctx, page );
+
+     DocumentProvider_MuPDF_Trim( data );
+
+     return ret;
+}
+#endif
+
+/*
+ * Render a page, or the part of it within a region with MuPDF 1.14 or later. With a progress function, the page is
+ * rendered band by band.
+ */
+static DFBResult
+DocumentProvider_MuPDF_Render( DocumentProvider   *thiz,
+                               int                 pageno,
+                               float               zoom,
+                               const DocumentBox  *region,
+                               IDirectFBSurface  **ret_surface )
 {
      DFBResult                    ret = DFB_FAILURE;
      DFBSurfaceDescription        desc;
      int                          y;
-     fz_matrix                    matrix;
      int                          pitch;
      void                        *ptr;
      unsigned char               *src;
      IDirectFBSurface            *surface;
+#if FZ_VERSION_MAJOR != 1 || \
+    FZ_VERSION_MINOR < 14 /****** mupdf <= 1.13 */
+     fz_matrix                    matrix;
+#endif
 #ifndef MUPDF_FITZ_UTIL_H /** mupdf <= 1.7 */
      fz_rect                      rect;
      fz_irect                     irect;
@@ -146,12 +518,17 @@ DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
      fz_pixmap                   *pixmap = NULL;
      DocumentProvider_MuPDF_data *data   = thiz->priv;
 
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     if (data->progress)
+          return DocumentProvider_MuPDF_RenderBands( data, pageno, zoom, region, ret_surface );
+#endif
+
 #ifdef MUPDF_FITZ_UTIL_H /*** mupdf >= 1.8 */
      fz_try( data->ctx ) {
 # if FZ_VERSION_MAJOR == 1 && \
      FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
-          matrix = fz_scale( zoom, zoom );
-          pixmap = fz_new_pixmap_from_page_number( data->ctx, data->doc, pageno - 1, matrix, fz_device_rgb( data->ctx ), 0 );
+          pixmap = DocumentProvider_MuPDF_RenderContents( data, pageno, zoom, region );
 # else /************************** mupdf <= 1.13 */
           fz_scale( &matrix, zoom, zoom );
 #  ifdef FZ_CONFIG_H /***************** mupdf >= 1.10 */
@@ -162,6 +539,7 @@ DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
 # endif
      }
      fz_catch( data->ctx ) {
+          ret = DocumentProvider_MuPDF_Caught( data->ctx );
           goto out;
      }
 #else /********************** mupdf <= 1.7 */
@@ -173,6 +551,7 @@ DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
 # endif
      }
      fz_catch( data->ctx ) {
+          ret = DocumentProvider_MuPDF_Caught( data->ctx );
           goto out;
      }
 
@@ -202,14 +581,21 @@ DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
 # endif
      }
      fz_catch( data->ctx ) {
+          ret = DocumentProvider_MuPDF_Caught( data->ctx );
           goto out;
      }
 #endif
 
+     /* Nothing within an empty region. */
+     if (!pixmap) {
+          ret = DFB_INVARG;
+          goto out;
+     }
+
      desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
      desc.width       = fz_pixmap_width( data->ctx, pixmap );
      desc.height      = fz_pixmap_height( data->ctx, pixmap );
-     desc.pixelformat = DSPF_ABGR;
+     desc.pixelformat = data->format == DSPF_RGB16 ? DSPF_RGB16 : DSPF_ABGR;
 
      ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
      if (ret)
@@ -219,11 +605,16 @@ DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
 
      src = fz_pixmap_samples( data->ctx, pixmap );
 
-     for (y = 0; y < desc.height; y++) {
-          direct_memcpy( ptr, src, desc.width * 4 );
+     if (desc.pixelformat == DSPF_RGB16) {
+          Dither_RGB16( src, desc.width * 4, DSPF_ABGR, ptr, pitch, desc.width, desc.height );
+     }
+     else {
+          for (y = 0; y < desc.height; y++) {
+               direct_memcpy( ptr, src, desc.width * 4 );
 
-          src += desc.width * 4;
-          ptr += pitch;
+               src += desc.width * 4;
+               ptr += pitch;
+          }
      }
 
      surface->Unlock( surface );
@@ -250,15 +641,522 @@ out:
      if (pixmap)
           fz_drop_pixmap( data->ctx, pixmap );
 
+     /* Page allocations are released, give back the chunks left empty. */
+     DocumentProvider_MuPDF_Trim( data );
+
      return ret;
 }
 
+static DFBResult
+DocumentProvider_MuPDF_RenderPage( DocumentProvider  *thiz,
+                                   int                pageno,
+                                   float              zoom,
+                                   IDirectFBSurface **ret_surface )
+{
+     return DocumentProvider_MuPDF_Render( thiz, pageno, zoom, NULL, ret_surface );
+}
+
+static DFBResult
+DocumentProvider_MuPDF_RenderRegion( DocumentProvider   *thiz,
+                                     int                 pageno,
+                                     float               zoom,
+                                     const DocumentBox  *region,
+                                     IDirectFBSurface  **ret_surface )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     return DocumentProvider_MuPDF_Render( thiz, pageno, zoom, region, ret_surface );
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+/*
+ * Bounding box of the marks made by the page contents, as found by the bbox device without rendering.
+ */
+static DFBResult
+DocumentProvider_MuPDF_GetContentBox( DocumentProvider *thiz,
+                                      int               pageno,
+                                      DocumentBox      *ret_box )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DFBResult                    ret    = DFB_OK;
+     fz_rect                      bounds;
+     fz_rect                      rect   = fz_empty_rect;
+     fz_device                   *device = NULL;
+     fz_page                     *page   = NULL;
+     DocumentProvider_MuPDF_data *data   = thiz->priv;
+
+     fz_try( data->ctx ) {
+          page   = fz_load_page( data->ctx, data->doc, pageno - 1 );
+          bounds = fz_bound_page( data->ctx, page );
+          device = fz_new_bbox_device( data->ctx, &rect );
+
+          if (data->flags & DOCUMENT_RENDER_NO_ANNOTATIONS)
+               fz_run_page_contents( data->ctx, page, device, fz_identity, NULL );
+          else
+               fz_run_page( data->ctx, page, device, fz_identity, NULL );
+
+          fz_close_device( data->ctx, device );
+     }
+     fz_always( data->ctx ) {
+          fz_drop_device( data->ctx, device );
+          fz_drop_page( data->ctx, page );
+     }
+     fz_catch( data->ctx ) {
+          ret = DFB_FAILURE;
+     }
+
+     DocumentProvider_MuPDF_Trim( data );
+
+     if (ret)
+          return ret;
+
+     rect = fz_intersect_rect( rect, bounds );
+
+     if (fz_is_empty_rect( rect ))
+          return DFB_ITEMNOTFOUND;
+
+     ret_box->x1 = rect.x0 - bounds.x0;
+     ret_box->y1 = rect.y0 - bounds.y0;
+     ret_box->x2 = rect.x1 - bounds.x0;
+     ret_box->y2 = rect.y1 - bounds.y0;
+
+     return DFB_OK;
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+static int
+DocumentProvider_MuPDF_PageNumber( DocumentProvider_MuPDF_data *data,
+                                   const char                  *uri )
+{
+     int   pageno = 0;
+     float x, y;
+
+     if (!uri || fz_is_external_link( data->ctx, uri ))
+          return 0;
+
+     fz_try( data->ctx ) {
+# if FZ_VERSION_MINOR >= 17 /******* mupdf >= 1.17 */
+          pageno = fz_page_number_from_location( data->ctx, data->doc,
+                                                 fz_resolve_link( data->ctx, data->doc, uri, &x, &y ) ) + 1;
+# else /************************** mupdf <= 1.16 */
+          pageno = fz_resolve_link( data->ctx, data->doc, uri, &x, &y ) + 1;
+# endif
+     }
+     fz_catch( data->ctx ) {
+          pageno = 0;
+     }
+
+     return pageno;
+}
+
+static DFBResult
+DocumentProvider_MuPDF_AddOutline( DocumentProvider_MuPDF_data  *data,
+                                   fz_outline                   *outline,
+                                   int                           level,
+                                   DocumentOutlineEntry        **entries,
+                                   int                          *num )
+{
+     DFBResult ret = DFB_OK;
+
+     for (; outline && !ret; outline = outline->next) {
+          ret = DocumentOutlineAppend( entries, num, level, DocumentProvider_MuPDF_PageNumber( data, outline->uri ),
+                                       outline->title );
+          if (ret)
+               break;
+
+          ret = DocumentProvider_MuPDF_AddOutline( data, outline->down, level + 1, entries, num );
+     }
+
+     return ret;
+}
+#endif
+
+static DFBResult
+DocumentProvider_MuPDF_GetOutline( DocumentProvider      *thiz,
+                                   DocumentOutlineEntry **ret_entries,
+                                   int                   *ret_num )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DFBResult                    ret;
+     fz_outline                  *outline = NULL;
+     DocumentOutlineEntry        *entries = NULL;
+     int                          num     = 0;
+     DocumentProvider_MuPDF_data *data    = thiz->priv;
+
+     fz_try( data->ctx ) {
+          outline = fz_load_outline( data->ctx, data->doc );
+     }
+     fz_catch( data->ctx ) {
+          return DFB_FAILURE;
+     }
+
+     ret = DocumentProvider_MuPDF_AddOutline( data, outline, 0, &entries, &num );
+
+     fz_drop_outline( data->ctx, outline );
+
+     if (ret) {
+          if (entries)
+               D_FREE( entries );
+
+          return ret;
+     }
+
+     *ret_entries = entries;
+     *ret_num     = num;
+
+     return DFB_OK;
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+static DFBResult
+DocumentProvider_MuPDF_GetLinks( DocumentProvider  *thiz,
+                                 int                pageno,
+                                 DocumentLink     **ret_links,
+                                 int               *ret_num )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DFBResult                    ret   = DFB_OK;
+     fz_rect                      bounds;
+     fz_page                     *page  = NULL;
+     fz_link                     *links = NULL;
+     fz_link                     *link;
+     DocumentLink                *array = NULL;
+     int                          num   = 0;
+     DocumentProvider_MuPDF_data *data  = thiz->priv;
+
+     fz_try( data->ctx ) {
+          page   = fz_load_page( data->ctx, data->doc, pageno - 1 );
+          bounds = fz_bound_page( data->ctx, page );
+          links  = fz_load_links( data->ctx, page );
+     }
+     fz_catch( data->ctx ) {
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
+     /* Rendered pages start at the page bounds. */
+     for (link = links; link && !ret; link = link->next) {
+          int target = DocumentProvider_MuPDF_PageNumber( data, link->uri );
+
+          if (target)
+               ret = DocumentLinkAppend( &array, &num, link->rect.x0 - bounds.x0, link->rect.y0 - bounds.y0,
+                                         link->rect.x1 - bounds.x0, link->rect.y1 - bounds.y0, target );
+     }
+
+out:
+     if (links)
+          fz_drop_links( data->ctx, links );
+
+     if (page)
+          fz_drop_page( data->ctx, page );
+
+     if (ret) {
+          if (array)
+               D_FREE( array );
+
+          return ret;
+     }
+
+     *ret_links = array;
+     *ret_num   = num;
+
+     return DFB_OK;
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+/*
+ * Objects are hashed once, objects shared by pages like fonts and images are looked up by number.
+ */
+typedef struct {
+     int  len;
+     u8  *state;                                     /* 1 while hashed, 2 once hashed */
+     u64 *hashes;
+} DocumentProvider_MuPDF_hash;
+
+static u64
+DocumentProvider_MuPDF_HashObject( fz_context                  *ctx,
+                                   DocumentProvider_MuPDF_hash *objects,
+                                   pdf_obj                     *obj )
+{
+     int         i, n;
+     u64         hash = DOCUMENT_FINGERPRINT_INIT;
+     u64         value;
+     fz_buffer  *buffer;
+     const char *str;
+
+     if (!obj)
+          return hash;
+
+     if (pdf_is_indirect( ctx, obj )) {
+          int num = pdf_to_num( ctx, obj );
+
+          if (num <= 0 || num >= objects->len || objects->state[num] == 1)
+               return hash;
+
+          if (objects->state[num] == 2)
+               return objects->hashes[num];
+
+          objects->state[num] = 1;
+
+          hash = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_resolve_indirect( ctx, obj ) );
+
+          if (pdf_is_stream( ctx, obj )) {
+               unsigned char *bytes;
+               size_t         length;
+
+               buffer = pdf_load_raw_stream( ctx, obj );
+               length = fz_buffer_storage( ctx, buffer, &bytes );
+               hash   = DocumentFingerprint( hash, bytes, length );
+
+               fz_drop_buffer( ctx, buffer );
+          }
+
+          objects->state[num]  = 2;
+          objects->hashes[num] = hash;
+
+          return hash;
+     }
+
+     if (pdf_is_dict( ctx, obj )) {
+          n = pdf_dict_len( ctx, obj );
+
+          for (i = 0; i < n; i++) {
+               str   = pdf_to_name( ctx, pdf_dict_get_key( ctx, obj, i ) );
+               hash  = DocumentFingerprint( hash, str, strlen( str ) + 1 );
+               value = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_dict_get_val( ctx, obj, i ) );
+               hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+          }
+     }
+     else if (pdf_is_array( ctx, obj )) {
+          n = pdf_array_len( ctx, obj );
+
+          for (i = 0; i < n; i++) {
+               value = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_array_get( ctx, obj, i ) );
+               hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+          }
+     }
+     else if (pdf_is_name( ctx, obj )) {
+          str  = pdf_to_name( ctx, obj );
+          hash = DocumentFingerprint( hash, str, strlen( str ) + 1 );
+     }
+     else if (pdf_is_string( ctx, obj )) {
+          hash = DocumentFingerprint( hash, pdf_to_str_buf( ctx, obj ), pdf_to_str_len( ctx, obj ) );
+     }
+     else if (pdf_is_int( ctx, obj ) || pdf_is_real( ctx, obj )) {
+          float real = pdf_to_real( ctx, obj );
+
+          hash = DocumentFingerprint( hash, &real, sizeof(real) );
+     }
+     else if (pdf_is_bool( ctx, obj )) {
+          hash = DocumentFingerprint( hash, pdf_to_bool( ctx, obj ) ? "t" : "f", 1 );
+     }
+
+     return hash;
+}
+
+/*
+ * Hash what a page looks like: its contents, resources and geometry, and the appearance of its annotations. Other
+ * entries may refer to other pages.
+ */
+static u64
+DocumentProvider_MuPDF_HashPage( fz_context                  *ctx,
+                                 DocumentProvider_MuPDF_hash *objects,
+                                 pdf_obj                     *page )
+{
+     int      i, n;
+     pdf_obj *annots;
+     u64      value;
+     u64      hash = DOCUMENT_FINGERPRINT_INIT;
+     pdf_obj *entries[] = {
+          pdf_dict_get_inheritable( ctx, page, PDF_NAME(MediaBox) ),
+          pdf_dict_get_inheritable( ctx, page, PDF_NAME(CropBox) ),
+          pdf_dict_get_inheritable( ctx, page, PDF_NAME(Rotate) ),
+          pdf_dict_get_inheritable( ctx, page, PDF_NAME(Resources) ),
+          pdf_dict_get( ctx, page, PDF_NAME(Contents) ),
+          pdf_dict_get( ctx, page, PDF_NAME(Group) )
+     };
+
+     for (i = 0; i < D_ARRAY_SIZE(entries); i++) {
+          value = DocumentProvider_MuPDF_HashObject( ctx, objects, entries[i] );
+          hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+     }
+
+     annots = pdf_dict_get( ctx, page, PDF_NAME(Annots) );
+     n      = pdf_array_len( ctx, annots );
+
+     for (i = 0; i < n; i++) {
+          pdf_obj *annot = pdf_array_get( ctx, annots, i );
+
+          value = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_dict_get( ctx, annot, PDF_NAME(AP) ) );
+          hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+          value = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_dict_get( ctx, annot, PDF_NAME(Rect) ) );
+          hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+          value = DocumentProvider_MuPDF_HashObject( ctx, objects, pdf_dict_get( ctx, annot, PDF_NAME(F) ) );
+          hash  = DocumentFingerprint( hash, &value, sizeof(value) );
+     }
+
+     return hash;
+}
+#endif
+
+static DFBResult
+DocumentProvider_MuPDF_GetFingerprints( DocumentProvider *thiz,
+                                        u64              *ret_fingerprints )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DFBResult                    ret     = DFB_OK;
+     int                          i;
+     pdf_document                *pdf;
+     DocumentProvider_MuPDF_hash  objects = { 0, NULL, NULL };
+     DocumentProvider_MuPDF_data *data    = thiz->priv;
+
+     /* Only PDF documents have page contents to look at. */
+     pdf = pdf_specifics( data->ctx, data->doc );
+     if (!pdf)
+          return DFB_UNSUPPORTED;
+
+     objects.len    = pdf_xref_len( data->ctx, pdf );
+     objects.state  = D_CALLOC( objects.len, 1 );
+     objects.hashes = D_CALLOC( objects.len, sizeof(u64) );
+     if (!objects.state || !objects.hashes) {
+          ret = D_OOM();
+          goto out;
+     }
+
+     fz_try( data->ctx ) {
+          for (i = 0; i < data->desc.num_pages; i++)
+               ret_fingerprints[i] = DocumentProvider_MuPDF_HashPage( data->ctx, &objects,
+                                                                      pdf_lookup_page_obj( data->ctx, pdf, i ) );
+     }
+     fz_catch( data->ctx ) {
+          ret = DFB_FAILURE;
+     }
+
+out:
+     if (objects.state)
+          D_FREE( objects.state );
+
+     if (objects.hashes)
+          D_FREE( objects.hashes );
+
+     return ret;
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+static DFBResult
+DocumentProvider_MuPDF_SetMemoryLimit( DocumentProvider *thiz,
+                                       unsigned long     size )
+{
+     DocumentProvider_MuPDF_data *data = thiz->priv;
+
+     data->limit = size;
+
+     DocumentProvider_MuPDF_Trim( data );
+
+     return DFB_OK;
+}
+
+/*
+ * Optional content is shown as in the default configuration of the document, less the hidden layers.
+ */
+static DFBResult
+DocumentProvider_MuPDF_SetRenderFlags( DocumentProvider    *thiz,
+                                       DocumentRenderFlags  flags,
+                                       const char          *layers )
+{
+     DocumentProvider_MuPDF_data *data = thiz->priv;
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DFBResult                    ret  = DFB_OK;
+     int                          i;
+     pdf_document                *pdf;
+     pdf_layer_config_ui          info;
+
+     pdf = pdf_specifics( data->ctx, data->doc );
+
+     if (pdf && ((flags ^ data->flags) & DOCUMENT_RENDER_HIDE_LAYERS)) {
+          fz_try( data->ctx ) {
+               pdf_select_layer_config( data->ctx, pdf, 0 );
+
+               if (flags & DOCUMENT_RENDER_HIDE_LAYERS) {
+                    for (i = 0; i < pdf_count_layer_config_ui( data->ctx, pdf ); i++) {
+                         pdf_layer_config_ui_info( data->ctx, pdf, i, &info );
+
+                         if (info.type != PDF_LAYER_UI_LABEL && info.selected && !info.locked &&
+                             DocumentLayerHidden( layers, info.text ))
+                              pdf_deselect_layer_config_ui( data->ctx, pdf, i );
+                    }
+               }
+          }
+          fz_catch( data->ctx ) {
+               ret = DFB_FAILURE;
+          }
+     }
+
+     data->flags = flags;
+
+     return ret;
+#else /********************** mupdf <= 1.13 */
+     data->flags = flags;
+
+     return DFB_UNSUPPORTED;
+#endif
+}
+
+/*
+ * Renders are reported band by band with MuPDF 1.14 or later.
+ */
+static DFBResult
+DocumentProvider_MuPDF_SetProgressFunc( DocumentProvider     *thiz,
+                                        DocumentProgressFunc  func,
+                                        void                 *ctx )
+{
+#if FZ_VERSION_MAJOR == 1 && \
+    FZ_VERSION_MINOR >= 14 /***** mupdf >= 1.14 */
+     DocumentProvider_MuPDF_data *data = thiz->priv;
+
+     data->progress     = func;
+     data->progress_ctx = ctx;
+
+     return DFB_OK;
+#else /********************** mupdf <= 1.13 */
+     return DFB_UNSUPPORTED;
+#endif
+}
+
 static DocumentProvider mupdf_provider = {
-     .impl           = "MuPDF",
-     .Init           = DocumentProvider_MuPDF_Init,
-     .Term           = DocumentProvider_MuPDF_Term,
-     .GetDescription = DocumentProvider_MuPDF_GetDescription,
-     .RenderPage     = DocumentProvider_MuPDF_RenderPage,
+     .impl            = "MuPDF",
+     .Probe           = DocumentProvider_MuPDF_Probe,
+     .Init            = DocumentProvider_MuPDF_Init,
+     .Term            = DocumentProvider_MuPDF_Term,
+     .GetDescription  = DocumentProvider_MuPDF_GetDescription,
+     .RenderPage      = DocumentProvider_MuPDF_RenderPage,
+     .SetMemoryLimit  = DocumentProvider_MuPDF_SetMemoryLimit,
+     .GetOutline      = DocumentProvider_MuPDF_GetOutline,
+     .GetLinks        = DocumentProvider_MuPDF_GetLinks,
+     .GetFingerprints = DocumentProvider_MuPDF_GetFingerprints,
+     .SetRenderFlags  = DocumentProvider_MuPDF_SetRenderFlags,
+     .GetContentBox   = DocumentProvider_MuPDF_GetContentBox,
+     .RenderRegion    = DocumentProvider_MuPDF_RenderRegion,
+     .SetProgressFunc = DocumentProvider_MuPDF_SetProgressFunc,
 };
 
 __attribute__((constructor))
@@ -0,0 +1,155 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "playlist.h"
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/util.h>
+#include <ctype.h>
+#include <limits.h>
+
+/**********************************************************************************************************************/
+
+static DFBResult
+Playlist_ParseLine( Playlist   *playlist,
+                    const char *dir,
+                    char       *line,
+                    int         lineno )
+{
+     PlaylistEntry *entries;
+     PlaylistEntry  entry = { .first = 1 };
+     char          *end;
+     char           path[PATH_MAX];
+
+     end = line + strlen( line );
+     while (end > line && isspace( (unsigned char) end[-1] ))
+          *--end = 0;
+
+     while (isspace( (unsigned char) *line ))
+          line++;
+
+     if (!*line || *line == '#')
+          return DFB_OK;
+
+     /* Settings, up to the file name. */
+     while (true) {
+          float dwell;
+          int   n = 0;
+
+          if (sscanf( line, "dwell=%f %n", &dwell, &n ) == 1 && n && dwell > 0)
+               entry.dwell = dwell * 1000;
+          else if (sscanf( line, "pages=%d-%d %n", &entry.first, &entry.last, &n ) != 2 || !n ||
+                   entry.first < 1 || entry.last < entry.first)
+               break;
+
+          line += n;
+     }
+
+     if (!*line || !strncmp( line, "dwell=", 6 ) || !strncmp( line, "pages=", 6 )) {
+          D_ERROR( "Projektor/Playlist: Invalid entry in line %d!\n", lineno );
+          return DFB_INVARG;
+     }
+
+     if (*line != '/' && dir)
+          snprintf( path, sizeof(path), "%s/%s", dir, line );
+     else
+          snprintf( path, sizeof(path), "%s", line );
+
+     entry.filename = D_STRDUP( path );
+     if (!entry.filename)
+          return D_OOM();
+
+     entries = D_REALLOC( playlist->entries, (playlist->num_entries + 1) * sizeof(PlaylistEntry) );
+     if (!entries) {
+          D_FREE( entry.filename );
+          return D_OOM();
+     }
+
+     entries[playlist->num_entries++] = entry;
+
+     playlist->entries = entries;
+
+     return DFB_OK;
+}
+
+/**********************************************************************************************************************/
+
+DFBResult
+PlaylistLoad( const char  *filename,
+              Playlist   **ret_playlist )
+{
+     DFBResult   ret    = DFB_OK;
+     int         lineno = 0;
+     FILE       *file;
+     Playlist   *playlist;
+     char        dir[PATH_MAX];
+     char        line[PATH_MAX + 64];
+     const char *slash  = strrchr( filename, '/' );
+
+     file = fopen( filename, "r" );
+     if (!file) {
+          D_ERROR( "Projektor/Playlist: Cannot open '%s'!\n", filename );
+          return DFB_FILENOTFOUND;
+     }
+
+     playlist = D_CALLOC( 1, sizeof(Playlist) );
+     if (!playlist) {
+          fclose( file );
+          return D_OOM();
+     }
+
+     /* Documents are relative to the directory of the playlist. */
+     if (slash)
+          snprintf( dir, sizeof(dir), "%.*s", (int) (slash - filename), filename );
+
+     while (fgets( line, sizeof(line), file )) {
+          ret = Playlist_ParseLine( playlist, slash ? dir : NULL, line, ++lineno );
+          if (ret)
+               break;
+     }
+
+     fclose( file );
+
+     if (!ret && !playlist->num_entries) {
+          D_ERROR( "Projektor/Playlist: No document in '%s'!\n", filename );
+          ret = DFB_ITEMNOTFOUND;
+     }
+
+     if (ret) {
+          PlaylistFree( playlist );
+          return ret;
+     }
+
+     *ret_playlist = playlist;
+
+     return DFB_OK;
+}
+
+void
+PlaylistFree( Playlist *playlist )
+{
+     int i;
+
+     for (i = 0; i < playlist->num_entries; i++)
+          D_FREE( playlist->entries[i].filename );
+
+     if (playlist->entries)
+          D_FREE( playlist->entries );
+
+     D_FREE( playlist );
+}
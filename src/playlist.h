@@ -0,0 +1,50 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __PLAYLIST_H__
+#define __PLAYLIST_H__
+
+#include <directfb.h>
+
+/*
+ * Playlist of documents, shown in turn. A playlist file has a document per line, its name relative to the playlist,
+ * with optional settings before it:
+ *
+ *   [dwell=<seconds>] [pages=<first>-<last>] <filename>
+ *
+ * Empty lines and lines starting with '#' are ignored.
+ */
+
+typedef struct {
+     char *filename;
+     int   dwell;                                    /* in milliseconds, 0 for the default */
+     int   first;
+     int   last;                                     /* 0 for the last page */
+} PlaylistEntry;
+
+typedef struct {
+     PlaylistEntry *entries;
+     int            num_entries;
+} Playlist;
+
+DFBResult PlaylistLoad( const char  *filename,
+                        Playlist   **ret_playlist );
+
+void      PlaylistFree( Playlist    *playlist );
+
+#endif
@@ -0,0 +1,288 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "pool.h"
+#include <direct/list.h>
+#include <direct/mem.h>
+#include <direct/util.h>
+
+#define POOL_CHUNK_SIZE  (64 * 1024)
+#define POOL_GRANULARITY 16
+#define POOL_NUM_CLASSES 32                          /* up to 512 bytes */
+
+/* Block header, keeping the alignment of malloc. */
+typedef union {
+     struct {
+          struct _PoolChunk *chunk;                  /* NULL for large blocks */
+          size_t             size;
+     };
+     long double             align;
+} PoolHeader;
+
+typedef struct _PoolChunk {
+     DirectLink    link;
+
+     int           cls;
+     unsigned int  live;                             /* allocated blocks */
+     bool          full;
+
+     void         *free;                             /* free blocks */
+     u8           *next;                             /* blocks never allocated */
+     u8           *end;
+} PoolChunk;
+
+struct _Pool {
+     DirectLink   *partial[POOL_NUM_CLASSES];        /* chunks with blocks available */
+     DirectLink   *full[POOL_NUM_CLASSES];
+
+     PoolStats     stats;
+};
+
+/**********************************************************************************************************************/
+
+static inline size_t
+Pool_BlockSize( int cls )
+{
+     return sizeof(PoolHeader) + (cls + 1) * POOL_GRANULARITY;
+}
+
+static PoolChunk *
+Pool_NewChunk( Pool *pool,
+               int   cls )
+{
+     PoolChunk *chunk;
+
+     chunk = malloc( POOL_CHUNK_SIZE );
+     if (!chunk)
+          return NULL;
+
+     memset( chunk, 0, sizeof(PoolChunk) );
+
+     chunk->cls  = cls;
+     chunk->next = (u8*) chunk + ((sizeof(PoolChunk) + sizeof(PoolHeader) - 1) & ~(sizeof(PoolHeader) - 1));
+     chunk->end  = (u8*) chunk + POOL_CHUNK_SIZE;
+
+     direct_list_prepend( &pool->partial[cls], &chunk->link );
+
+     pool->stats.mallocs++;
+     pool->stats.chunks++;
+
+     return chunk;
+}
+
+static void
+Pool_FreeChunk( Pool      *pool,
+                PoolChunk *chunk )
+{
+     direct_list_remove( chunk->full ? &pool->full[chunk->cls] : &pool->partial[chunk->cls], &chunk->link );
+
+     free( chunk );
+
+     pool->stats.chunks--;
+}
+
+/**********************************************************************************************************************/
+
+DFBResult
+PoolCreate( Pool **ret_pool )
+{
+     Pool *pool;
+
+     pool = D_CALLOC( 1, sizeof(Pool) );
+     if (!pool)
+          return D_OOM();
+
+     *ret_pool = pool;
+
+     return DFB_OK;
+}
+
+void
+PoolDestroy( Pool *pool )
+{
+     int        cls;
+     PoolChunk *chunk, *next;
+
+     for (cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+          direct_list_foreach_safe (chunk, next, pool->partial[cls])
+               free( chunk );
+
+          direct_list_foreach_safe (chunk, next, pool->full[cls])
+               free( chunk );
+     }
+
+     D_FREE( pool );
+}
+
+void *
+PoolAlloc( Pool   *pool,
+           size_t  size )
+{
+     int         cls;
+     PoolHeader *header;
+     PoolChunk  *chunk;
+
+     pool->stats.allocs++;
+
+     if (size > POOL_NUM_CLASSES * POOL_GRANULARITY) {
+          header = malloc( sizeof(PoolHeader) + size );
+          if (!header)
+               return NULL;
+
+          header->chunk = NULL;
+          header->size  = size;
+
+          pool->stats.mallocs++;
+     }
+     else {
+          cls = size ? (size - 1) / POOL_GRANULARITY : 0;
+
+          chunk = (PoolChunk*) pool->partial[cls];
+          if (!chunk) {
+               chunk = Pool_NewChunk( pool, cls );
+               if (!chunk)
+                    return NULL;
+          }
+
+          if (chunk->free) {
+               header      = chunk->free;
+               chunk->free = *(void**) header;
+          }
+          else {
+               header       = (PoolHeader*) chunk->next;
+               chunk->next += Pool_BlockSize( cls );
+          }
+
+          header->chunk = chunk;
+          header->size  = size;
+
+          chunk->live++;
+
+          /* No block left in the chunk. */
+          if (!chunk->free && chunk->next + Pool_BlockSize( cls ) > chunk->end) {
+               direct_list_remove( &pool->partial[cls], &chunk->link );
+               direct_list_prepend( &pool->full[cls], &chunk->link );
+               chunk->full = true;
+          }
+
+          pool->stats.pooled++;
+     }
+
+     pool->stats.size += size;
+
+     if (pool->stats.size > pool->stats.peak_size)
+          pool->stats.peak_size = pool->stats.size;
+
+     return header + 1;
+}
+
+void
+PoolFree( Pool *pool,
+          void *ptr )
+{
+     PoolHeader *header;
+     PoolChunk  *chunk;
+
+     if (!ptr)
+          return;
+
+     header = (PoolHeader*) ptr - 1;
+     chunk  = header->chunk;
+
+     pool->stats.size -= header->size;
+
+     if (!chunk) {
+          free( header );
+          return;
+     }
+
+     *(void**) header = chunk->free;
+     chunk->free      = header;
+
+     chunk->live--;
+
+     if (chunk->full) {
+          direct_list_remove( &pool->full[chunk->cls], &chunk->link );
+          direct_list_prepend( &pool->partial[chunk->cls], &chunk->link );
+          chunk->full = false;
+     }
+}
+
+void *
+PoolRealloc( Pool   *pool,
+             void   *ptr,
+             size_t  size )
+{
+     PoolHeader *header;
+     void       *new_ptr;
+
+     if (!ptr)
+          return PoolAlloc( pool, size );
+
+     header = (PoolHeader*) ptr - 1;
+
+     /* Still fits in the block. */
+     if (header->chunk && size && (size - 1) / POOL_GRANULARITY == header->chunk->cls) {
+          pool->stats.size += size - header->size;
+
+          if (pool->stats.size > pool->stats.peak_size)
+               pool->stats.peak_size = pool->stats.size;
+
+          header->size = size;
+
+          return ptr;
+     }
+
+     new_ptr = PoolAlloc( pool, size );
+     if (!new_ptr)
+          return NULL;
+
+     memcpy( new_ptr, ptr, MIN( size, header->size ) );
+
+     PoolFree( pool, ptr );
+
+     return new_ptr;
+}
+
+void
+PoolTrim( Pool *pool )
+{
+     int        cls;
+     PoolChunk *chunk, *next;
+
+     for (cls = 0; cls < POOL_NUM_CLASSES; cls++) {
+          bool spare = false;
+
+          direct_list_foreach_safe (chunk, next, pool->partial[cls]) {
+               if (chunk->live)
+                    continue;
+
+               if (spare)
+                    Pool_FreeChunk( pool, chunk );
+               else
+                    spare = true;
+          }
+     }
+}
+
+void
+PoolGetStats( Pool      *pool,
+              PoolStats *ret_stats )
+{
+     *ret_stats = pool->stats;
+}
@@ -0,0 +1,62 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <directfb.h>
+
+/*
+ * Size-class allocator for the many small allocations of rendering libraries. Small blocks are carved from chunks
+ * dedicated to a size class, large ones are passed to malloc. A pool is not thread safe.
+ */
+
+typedef struct _Pool Pool;
+
+typedef struct {
+     unsigned long long allocs;                      /* allocations */
+     unsigned long long pooled;                      /* allocations served from chunks */
+     unsigned long long mallocs;                     /* calls to malloc */
+     unsigned long      chunks;                      /* chunks held */
+     unsigned long      size;                        /* bytes allocated */
+     unsigned long      peak_size;
+} PoolStats;
+
+DFBResult PoolCreate  ( Pool       **ret_pool );
+
+void      PoolDestroy ( Pool        *pool );
+
+void     *PoolAlloc   ( Pool        *pool,
+                        size_t       size );
+
+void     *PoolRealloc ( Pool        *pool,
+                        void        *ptr,
+                        size_t       size );
+
+void      PoolFree    ( Pool        *pool,
+                        void        *ptr );
+
+/*
+ * Give back the chunks without allocated blocks, keeping one spare chunk per size class.
+ */
+void      PoolTrim    ( Pool        *pool );
+
+void      PoolGetStats( Pool        *pool,
+                        PoolStats   *ret_stats );
+
+#endif
@@ -16,6 +16,7 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#include "dither.h"
 #include "documentprovider.h"
 #include <direct/memcpy.h>
 #include <poppler.h>
@@ -25,19 +26,46 @@ extern DirectLink *documentproviders;
 /**********************************************************************************************************************/
 
 typedef struct {
-     IDirectFB           *idirectfb;
+     IDirectFB             *idirectfb;
+     DFBSurfacePixelFormat  format;
 
-     PopplerDocument     *doc;
+     PopplerDocument       *doc;
 
-     DocumentDescription  desc;
+     DocumentRenderFlags    flags;
+     GList                 *hidden;                  /* layers hidden by the render flags */
+
+     DocumentProgressFunc   progress;
+     void                  *progress_ctx;
+
+     DocumentDescription    desc;
 } DocumentProvider_Poppler_data;
 
 /**********************************************************************************************************************/
 
+static int
+DocumentProvider_Poppler_Probe( DocumentProvider *thiz,
+                                const u8         *header,
+                                unsigned int      length )
+{
+     unsigned int i;
+
+     if (length >= 5 && !memcmp( header, "%PDF-", 5 ))
+          return 100;
+
+     /* Leading garbage is tolerated. */
+     for (i = 1; i + 5 <= length; i++) {
+          if (!memcmp( header + i, "%PDF-", 5 ))
+               return 50;
+     }
+
+     return 0;
+}
+
 static DFBResult
-DocumentProvider_Poppler_Init( DocumentProvider *thiz,
-                               const char       *filename,
-                               IDirectFB        *idirectfb )
+DocumentProvider_Poppler_Init( DocumentProvider      *thiz,
+                               const char            *filename,
+                               IDirectFB             *idirectfb,
+                               DFBSurfacePixelFormat  format )
 {
      DFBResult                      ret = DFB_FAILURE;
      char                           uri[PATH_MAX];
@@ -48,6 +76,7 @@ DocumentProvider_Poppler_Init( DocumentProvider *thiz,
           return D_OOM();;
 
      data->idirectfb = idirectfb;
+     data->format    = format;
 
      if (g_strstr_len( filename, -1, "://" )) {
           g_strlcpy( uri, filename, sizeof(uri) );
@@ -85,6 +114,8 @@ DocumentProvider_Poppler_Term( DocumentProvider *thiz )
 {
      DocumentProvider_Poppler_data *data = thiz->priv;
 
+     g_list_free_full( data->hidden, g_object_unref );
+
      g_object_unref( data->doc );
 
      D_FREE( data );
@@ -106,26 +137,33 @@ DocumentProvider_Poppler_GetDescription( DocumentProvider    *thiz,
      return DFB_OK;
 }
 
+/*
+ * Render a page, or the part of it within a region. With a progress function, the page is rendered in two bands, the
+ * top half shown early. Each band interprets the whole page again, clipped so that only its rows are rasterized.
+ */
 static DFBResult
-DocumentProvider_Poppler_RenderPage( DocumentProvider  *thiz,
-                                     int                pageno,
-                                     float              zoom,
-                                     IDirectFBSurface **ret_surface )
+DocumentProvider_Poppler_Render( DocumentProvider   *thiz,
+                                 int                 pageno,
+                                 float               zoom,
+                                 const DocumentBox  *region,
+                                 IDirectFBSurface  **ret_surface )
 {
      DFBResult                      ret = DFB_FAILURE;
      DFBSurfaceDescription          desc;
+     DFBRectangle                   rect;
+     DFBRectangle                   band;
      int                            y;
      double                         width;
      double                         height;
      cairo_status_t                 status;
      int                            pitch;
-     void                          *ptr;
+     u8                            *ptr;
      unsigned char                 *src;
-     IDirectFBSurface              *surface;
-     cairo_t                       *cairo  = NULL;
-     PopplerPage                   *page   = NULL;
-     cairo_surface_t               *pixmap = NULL;
-     DocumentProvider_Poppler_data *data   = thiz->priv;
+     IDirectFBSurface              *surface = NULL;
+     cairo_t                       *cairo   = NULL;
+     PopplerPage                   *page    = NULL;
+     cairo_surface_t               *pixmap  = NULL;
+     DocumentProvider_Poppler_data *data    = thiz->priv;
 
      page = poppler_document_get_page( data->doc, pageno - 1 );
      if (!page)
@@ -133,43 +171,193 @@ DocumentProvider_Poppler_RenderPage( DocumentProvider  *thiz,
 
      poppler_page_get_size( page, &width, &height );
 
+     rect.x = 0;
+     rect.y = 0;
+     rect.w = width  * zoom + 0.5f;
+     rect.h = height * zoom + 0.5f;
+
+     if (region) {
+          DocumentBoxToRectangle( region, zoom, rect.w, rect.h, &rect );
+
+          if (rect.w < 1 || rect.h < 1) {
+               ret = DFB_INVARG;
+               goto out;
+          }
+     }
+
      desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
-     desc.width       = width  * zoom + 0.5f;
-     desc.height      = height * zoom + 0.5f;
-     desc.pixelformat = DSPF_ARGB;
+     desc.width       = rect.w;
+     desc.height      = rect.h;
+     desc.pixelformat = data->format == DSPF_RGB16 ? DSPF_RGB16 : DSPF_ARGB;
 
-     pixmap = cairo_image_surface_create( CAIRO_FORMAT_ARGB32, desc.width, desc.height );
-     status = cairo_surface_status( pixmap );
-     if (status)
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+     if (ret) {
+          surface = NULL;
           goto out;
+     }
+
+     ret = DFB_FAILURE;
+
+     band.x = 0;
+     band.w = desc.width;
+
+     for (band.y = 0; band.y < desc.height; band.y += band.h) {
+          if (data->progress && !band.y)
+               band.h = (desc.height / 2) & ~3 ?: desc.height;
+          else
+               band.h = desc.height - band.y;
+
+          pixmap = cairo_image_surface_create( CAIRO_FORMAT_ARGB32, band.w, band.h );
+          status = cairo_surface_status( pixmap );
+          if (status) {
+               ret = status == CAIRO_STATUS_NO_MEMORY ? DFB_NOSYSTEMMEMORY : DFB_FAILURE;
+               goto out;
+          }
+
+          cairo  = cairo_create( pixmap );
+          status = cairo_status( cairo );
+          if (status) {
+               ret = status == CAIRO_STATUS_NO_MEMORY ? DFB_NOSYSTEMMEMORY : DFB_FAILURE;
+               goto out;
+          }
+
+          cairo_rectangle( cairo, 0, 0, band.w, band.h );
+          cairo_clip( cairo );
+
+          cairo_translate( cairo, -rect.x, -rect.y - band.y );
+          cairo_scale( cairo, zoom, zoom );
+
+          /* Printing the document alone leaves out the annotations and form fields. */
+          if (data->flags & DOCUMENT_RENDER_NO_ANNOTATIONS)
+               poppler_page_render_for_printing_with_options( page, cairo, POPPLER_PRINT_DOCUMENT );
+          else
+               poppler_page_render( page, cairo );
+
+          surface->Lock( surface, DSLF_WRITE, (void**) &ptr, &pitch );
+
+          ptr += band.y * pitch;
+          src  = cairo_image_surface_get_data( pixmap );
+
+          if (desc.pixelformat == DSPF_RGB16) {
+               Dither_RGB16( src, band.w * 4, DSPF_ARGB, ptr, pitch, band.w, band.h );
+          }
+          else {
+               for (y = 0; y < band.h; y++) {
+                    direct_memcpy( ptr, src, band.w * 4 );
+
+                    src += band.w * 4;
+                    ptr += pitch;
+               }
+          }
 
-     cairo  = cairo_create( pixmap );
-     status = cairo_status( cairo );
-     if (status)
+          surface->Unlock( surface );
+
+          cairo_destroy( cairo );
+          cairo_surface_destroy( pixmap );
+
+          cairo  = NULL;
+          pixmap = NULL;
+
+          if (data->progress)
+               data->progress( data->progress_ctx, surface, &band );
+     }
+
+     *ret_surface = surface;
+
+     surface = NULL;
+     ret     = DFB_OK;
+
+out:
+     if (surface)
+          surface->Release( surface );
+
+     if (cairo)
+          cairo_destroy( cairo );
+
+     if (pixmap)
+          cairo_surface_destroy( pixmap );
+
+     if (page)
+          g_object_unref( page );
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Poppler_RenderPage( DocumentProvider  *thiz,
+                                     int                pageno,
+                                     float              zoom,
+                                     IDirectFBSurface **ret_surface )
+{
+     return DocumentProvider_Poppler_Render( thiz, pageno, zoom, NULL, ret_surface );
+}
+
+static DFBResult
+DocumentProvider_Poppler_RenderRegion( DocumentProvider   *thiz,
+                                       int                 pageno,
+                                       float               zoom,
+                                       const DocumentBox  *region,
+                                       IDirectFBSurface  **ret_surface )
+{
+     return DocumentProvider_Poppler_Render( thiz, pageno, zoom, region, ret_surface );
+}
+
+/*
+ * Scan the page rendered at a low resolution, over white as the pages are transparent.
+ */
+static DFBResult
+DocumentProvider_Poppler_GetContentBox( DocumentProvider *thiz,
+                                        int               pageno,
+                                        DocumentBox      *ret_box )
+{
+     DFBResult                      ret = DFB_FAILURE;
+     double                         width;
+     double                         height;
+     DFBRegion                      region;
+     cairo_t                       *cairo  = NULL;
+     PopplerPage                   *page   = NULL;
+     cairo_surface_t               *pixmap = NULL;
+     DocumentProvider_Poppler_data *data   = thiz->priv;
+
+     page = poppler_document_get_page( data->doc, pageno - 1 );
+     if (!page)
           goto out;
 
-     cairo_scale( cairo, zoom, zoom );
+     poppler_page_get_size( page, &width, &height );
 
-     poppler_page_render( page, cairo );
+     pixmap = cairo_image_surface_create( CAIRO_FORMAT_RGB24, width * DOCUMENT_CONTENT_ZOOM + 0.5f,
+                                          height * DOCUMENT_CONTENT_ZOOM + 0.5f );
+     if (cairo_surface_status( pixmap ))
+          goto out;
 
-     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
-     if (ret)
+     cairo = cairo_create( pixmap );
+     if (cairo_status( cairo ))
           goto out;
 
-     surface->Lock( surface, DSLF_WRITE, &ptr, &pitch );
+     cairo_set_source_rgb( cairo, 1, 1, 1 );
+     cairo_paint( cairo );
 
-     src = cairo_image_surface_get_data( pixmap );
+     cairo_scale( cairo, DOCUMENT_CONTENT_ZOOM, DOCUMENT_CONTENT_ZOOM );
 
-     for (y = 0; y < desc.height; y++) {
-          direct_memcpy( ptr, src, desc.width * 4 );
+     if (data->flags & DOCUMENT_RENDER_NO_ANNOTATIONS)
+          poppler_page_render_for_printing_with_options( page, cairo, POPPLER_PRINT_DOCUMENT );
+     else
+          poppler_page_render( page, cairo );
 
-          src += desc.width * 4;
-          ptr += pitch;
-     }
+     cairo_surface_flush( pixmap );
 
-     surface->Unlock( surface );
+     ret = DFB_ITEMNOTFOUND;
 
-     *ret_surface = surface;
+     if (DocumentScanContent( cairo_image_surface_get_data( pixmap ), cairo_image_surface_get_stride( pixmap ),
+                              cairo_image_surface_get_width( pixmap ), cairo_image_surface_get_height( pixmap ), 4,
+                              &region )) {
+          ret_box->x1 = region.x1 / DOCUMENT_CONTENT_ZOOM;
+          ret_box->y1 = region.y1 / DOCUMENT_CONTENT_ZOOM;
+          ret_box->x2 = (region.x2 + 1) / DOCUMENT_CONTENT_ZOOM;
+          ret_box->y2 = (region.y2 + 1) / DOCUMENT_CONTENT_ZOOM;
+
+          ret = DFB_OK;
+     }
 
 out:
      if (cairo)
@@ -184,12 +372,243 @@ out:
      return ret;
 }
 
+static int
+DocumentProvider_Poppler_DestPage( DocumentProvider_Poppler_data *data,
+                                   PopplerAction                 *action )
+{
+     int          pageno;
+     PopplerDest *dest;
+
+     if (!action || action->type != POPPLER_ACTION_GOTO_DEST || !action->goto_dest.dest)
+          return 0;
+
+     dest = action->goto_dest.dest;
+
+     if (dest->type != POPPLER_DEST_NAMED)
+          return dest->page_num;
+
+     dest = poppler_document_find_dest( data->doc, dest->named_dest );
+     if (!dest)
+          return 0;
+
+     pageno = dest->page_num;
+
+     poppler_dest_free( dest );
+
+     return pageno;
+}
+
+static DFBResult
+DocumentProvider_Poppler_AddOutline( DocumentProvider_Poppler_data  *data,
+                                     PopplerIndexIter               *iter,
+                                     int                             level,
+                                     DocumentOutlineEntry          **entries,
+                                     int                            *num )
+{
+     DFBResult         ret = DFB_OK;
+     PopplerAction    *action;
+     PopplerIndexIter *child;
+
+     do {
+          action = poppler_index_iter_get_action( iter );
+          if (!action)
+               continue;
+
+          ret = DocumentOutlineAppend( entries, num, level, DocumentProvider_Poppler_DestPage( data, action ),
+                                       action->any.title );
+
+          poppler_action_free( action );
+
+          if (ret)
+               break;
+
+          child = poppler_index_iter_get_child( iter );
+          if (child) {
+               ret = DocumentProvider_Poppler_AddOutline( data, child, level + 1, entries, num );
+
+               poppler_index_iter_free( child );
+
+               if (ret)
+                    break;
+          }
+     } while (poppler_index_iter_next( iter ));
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Poppler_GetOutline( DocumentProvider      *thiz,
+                                     DocumentOutlineEntry **ret_entries,
+                                     int                   *ret_num )
+{
+     DFBResult                      ret     = DFB_OK;
+     PopplerIndexIter              *iter;
+     DocumentOutlineEntry          *entries = NULL;
+     int                            num     = 0;
+     DocumentProvider_Poppler_data *data    = thiz->priv;
+
+     iter = poppler_index_iter_new( data->doc );
+     if (iter) {
+          ret = DocumentProvider_Poppler_AddOutline( data, iter, 0, &entries, &num );
+
+          poppler_index_iter_free( iter );
+     }
+
+     if (ret) {
+          if (entries)
+               D_FREE( entries );
+
+          return ret;
+     }
+
+     *ret_entries = entries;
+     *ret_num     = num;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Poppler_GetLinks( DocumentProvider  *thiz,
+                                   int                pageno,
+                                   DocumentLink     **ret_links,
+                                   int               *ret_num )
+{
+     DFBResult                      ret   = DFB_OK;
+     double                         width;
+     double                         height;
+     GList                         *list;
+     GList                         *mapping;
+     PopplerPage                   *page;
+     DocumentLink                  *links = NULL;
+     int                            num   = 0;
+     DocumentProvider_Poppler_data *data  = thiz->priv;
+
+     page = poppler_document_get_page( data->doc, pageno - 1 );
+     if (!page)
+          return DFB_FAILURE;
+
+     poppler_page_get_size( page, &width, &height );
+
+     mapping = poppler_page_get_link_mapping( page );
+
+     /* Link areas have their origin at the bottom of the page. */
+     for (list = mapping; list && !ret; list = list->next) {
+          PopplerLinkMapping *link   = list->data;
+          int                 target = DocumentProvider_Poppler_DestPage( data, link->action );
+
+          if (target)
+               ret = DocumentLinkAppend( &links, &num, link->area.x1, height - link->area.y2,
+                                         link->area.x2, height - link->area.y1, target );
+     }
+
+     poppler_page_free_link_mapping( mapping );
+
+     g_object_unref( page );
+
+     if (ret) {
+          if (links)
+               D_FREE( links );
+
+          return ret;
+     }
+
+     *ret_links = links;
+     *ret_num   = num;
+
+     return DFB_OK;
+}
+
+static void
+DocumentProvider_Poppler_HideLayers( DocumentProvider_Poppler_data *data,
+                                     PopplerLayersIter             *iter,
+                                     const char                    *layers )
+{
+     do {
+          PopplerLayer      *layer = poppler_layers_iter_get_layer( iter );
+          PopplerLayersIter *child;
+
+          /* Titles of layer groups have no layer. */
+          if (layer) {
+               if (poppler_layer_is_visible( layer ) && poppler_layer_get_title( layer ) &&
+                   DocumentLayerHidden( layers, poppler_layer_get_title( layer ) )) {
+                    poppler_layer_hide( layer );
+
+                    data->hidden = g_list_prepend( data->hidden, layer );
+               }
+               else
+                    g_object_unref( layer );
+          }
+
+          child = poppler_layers_iter_get_child( iter );
+          if (child) {
+               DocumentProvider_Poppler_HideLayers( data, child, layers );
+
+               poppler_layers_iter_free( child );
+          }
+     } while (poppler_layers_iter_next( iter ));
+}
+
+/*
+ * Layers hidden are shown again when the flag is cleared. Images cannot be left out.
+ */
+static DFBResult
+DocumentProvider_Poppler_SetRenderFlags( DocumentProvider    *thiz,
+                                         DocumentRenderFlags  flags,
+                                         const char          *layers )
+{
+     GList                         *list;
+     PopplerLayersIter             *iter;
+     DocumentProvider_Poppler_data *data = thiz->priv;
+
+     if ((flags ^ data->flags) & DOCUMENT_RENDER_HIDE_LAYERS) {
+          for (list = data->hidden; list; list = list->next)
+               poppler_layer_show( list->data );
+
+          g_list_free_full( data->hidden, g_object_unref );
+
+          data->hidden = NULL;
+
+          if (flags & DOCUMENT_RENDER_HIDE_LAYERS) {
+               iter = poppler_layers_iter_new( data->doc );
+               if (iter) {
+                    DocumentProvider_Poppler_HideLayers( data, iter, layers );
+
+                    poppler_layers_iter_free( iter );
+               }
+          }
+     }
+
+     data->flags = flags;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Poppler_SetProgressFunc( DocumentProvider     *thiz,
+                                          DocumentProgressFunc  func,
+                                          void                 *ctx )
+{
+     DocumentProvider_Poppler_data *data = thiz->priv;
+
+     data->progress     = func;
+     data->progress_ctx = ctx;
+
+     return DFB_OK;
+}
+
 static DocumentProvider poppler_provider = {
-     .impl           = "Poppler",
-     .Init           = DocumentProvider_Poppler_Init,
-     .Term           = DocumentProvider_Poppler_Term,
-     .GetDescription = DocumentProvider_Poppler_GetDescription,
-     .RenderPage     = DocumentProvider_Poppler_RenderPage,
+     .impl            = "Poppler",
+     .Probe           = DocumentProvider_Poppler_Probe,
+     .Init            = DocumentProvider_Poppler_Init,
+     .Term            = DocumentProvider_Poppler_Term,
+     .GetDescription  = DocumentProvider_Poppler_GetDescription,
+     .RenderPage      = DocumentProvider_Poppler_RenderPage,
+     .GetOutline      = DocumentProvider_Poppler_GetOutline,
+     .GetLinks        = DocumentProvider_Poppler_GetLinks,
+     .SetRenderFlags  = DocumentProvider_Poppler_SetRenderFlags,
+     .GetContentBox   = DocumentProvider_Poppler_GetContentBox,
+     .RenderRegion    = DocumentProvider_Poppler_RenderRegion,
+     .SetProgressFunc = DocumentProvider_Poppler_SetProgressFunc,
 };
 
 __attribute__((constructor))
@@ -0,0 +1,88 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#include "pressure.h"
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#define PRESSURE_WINDOW 2000000
+
+struct _Pressure {
+     int fd;
+};
+
+/**********************************************************************************************************************/
+
+DFBResult
+PressureOpen( unsigned int   stall,
+              Pressure     **ret_pressure )
+{
+     Pressure *pressure;
+     char      trigger[64];
+
+     pressure = D_CALLOC( 1, sizeof(Pressure) );
+     if (!pressure)
+          return D_OOM();
+
+     /* Not available before Linux 5.2, or without CONFIG_PSI. */
+     pressure->fd = open( "/proc/pressure/memory", O_RDWR | O_NONBLOCK );
+     if (pressure->fd < 0) {
+          D_FREE( pressure );
+          return DFB_UNSUPPORTED;
+     }
+
+     /* Unprivileged triggers need a window multiple of two seconds. */
+     snprintf( trigger, sizeof(trigger), "some %u %u", stall * 1000, PRESSURE_WINDOW );
+
+     if (write( pressure->fd, trigger, strlen( trigger ) + 1 ) < 0) {
+          D_WARN( "cannot set memory pressure trigger" );
+          close( pressure->fd );
+          D_FREE( pressure );
+          return DFB_UNSUPPORTED;
+     }
+
+     *ret_pressure = pressure;
+
+     return DFB_OK;
+}
+
+void
+PressureClose( Pressure *pressure )
+{
+     close( pressure->fd );
+
+     D_FREE( pressure );
+}
+
+bool
+PressureCheck( Pressure *pressure )
+{
+     struct pollfd pfd = { .fd = pressure->fd, .events = POLLPRI };
+
+     if (poll( &pfd, 1, 0 ) <= 0)
+          return false;
+
+     return !!(pfd.revents & POLLPRI);
+}
+
+int
+PressureGetFd( Pressure *pressure )
+{
+     return pressure->fd;
+}
@@ -0,0 +1,46 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#ifndef __PRESSURE_H__
+#define __PRESSURE_H__
+
+#include <directfb.h>
+
+/*
+ * Memory pressure notifications, from the Linux pressure stall information. A notification is raised when tasks are
+ * stalled on memory for longer than the given time within a window of two seconds.
+ */
+
+typedef struct _Pressure Pressure;
+
+DFBResult PressureOpen ( unsigned int   stall,
+                         Pressure     **ret_pressure );
+
+void      PressureClose( Pressure      *pressure );
+
+/*
+ * Return whether a notification has been raised since the last check, without blocking.
+ */
+bool      PressureCheck( Pressure      *pressure );
+
+/*
+ * File descriptor raising POLLPRI on notifications, to be polled with other ones. A notification seen by poll() is not
+ * returned by PressureCheck() anymore.
+ */
+int       PressureGetFd( Pressure      *pressure );
+
+#endif
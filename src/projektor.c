@@ -16,7 +16,21 @@
    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
 */
 
+#include "benchmark.h"
 #include "documentprovider.h"
+#include "eventloop.h"
+#include "export.h"
+#include "filter.h"
+#include "linkindex.h"
+#include "metadata.h"
+#include "playlist.h"
+#include "pressure.h"
+#include "remote.h"
+#include "trace.h"
+#include "watch.h"
+#include <direct/clock.h>
+#include <direct/thread.h>
+#include <direct/util.h>
 #include <lite/label.h>
 #include <lite/lite.h>
 #include <lite/progressbar.h>
@@ -117,11 +131,15 @@ StatusBarSetProgress( StatusBar *statusbar,
 static DFBResult
 StatusBarSetPage( StatusBar *statusbar,
                   int        pageno,
+                  int        last,
                   int        num_pages )
 {
-     char text[16];
+     char text[24];
 
-     snprintf( text, sizeof(text), "%d/%d", pageno, num_pages );
+     if (last > pageno)
+          snprintf( text, sizeof(text), "%d-%d/%d", pageno, last, num_pages );
+     else
+          snprintf( text, sizeof(text), "%d/%d", pageno, num_pages );
 
      return lite_set_label_text( statusbar->label_page, text );
 }
@@ -146,6 +164,18 @@ StatusBarSetTitle( StatusBar  *statusbar,
 
 /**********************************************************************************************************************/
 
+/*
+ * Page view: a page, or the two pages of a spread side by side, each one centered vertically. Clicks are reported in
+ * the pixels of the page clicked.
+ *
+ * With a display filter the visible part of the pages is filtered when drawn, tile by tile through a scratch surface,
+ * so the pages given stay valid for caching.
+ */
+
+#define PAGE_VIEW_TILE 256
+
+typedef void (*PageViewClickFunc)( void *ctx, bool right, int x, int y );
+
 typedef struct {
      LiteBox           box;
 
@@ -153,9 +183,136 @@ typedef struct {
      DFBPoint          offset;
      DFBPoint          offset_max;
      DFBRectangle      image_rect;
+     DFBDimension      image_size;
      IDirectFBSurface *image;
+     DFBPoint          image_position;
+     IDirectFBSurface *right;
+     DFBPoint          right_position;
+
+     DFBPoint          fade_position;
+     IDirectFBSurface *fade_image;
+     DFBPoint          fade_right_position;
+     IDirectFBSurface *fade_right;
+     u8                fade_alpha;
+
+     bool              painted;                      /* a page is shown while it is rendered */
+     IDirectFBSurface *shown;                        /* pages it replaced, NULL for none */
+     IDirectFBSurface *shown_right;
+
+     DFBRectangle      highlight;                    /* in spread coordinates, empty for none */
+
+     Filter           *filter;                       /* NULL for none */
+     IDirectFBSurface *tile;
+
+     PageViewClickFunc click;
+     void             *click_ctx;
+
+     unsigned int      draws;
+     long long         draw_time;
 } PageView;
 
+/*
+ * Scratch surface for filtering, in the pixel format of the pages.
+ */
+static DFBResult
+PageView_Tile( PageView              *pageview,
+               DFBSurfacePixelFormat  format )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     DFBSurfacePixelFormat  tile_format;
+     IDirectFB             *idirectfb = lite_get_dfb_interface();
+
+     if (pageview->tile) {
+          pageview->tile->GetPixelFormat( pageview->tile, &tile_format );
+          if (tile_format == format)
+               return DFB_OK;
+
+          pageview->tile->Release( pageview->tile );
+          pageview->tile = NULL;
+     }
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = PAGE_VIEW_TILE;
+     desc.height      = PAGE_VIEW_TILE;
+     desc.pixelformat = format;
+
+     ret = idirectfb->CreateSurface( idirectfb, &desc, &pageview->tile );
+     if (ret)
+          pageview->tile = NULL;
+
+     return ret;
+}
+
+/*
+ * Draw a page, through the display filter within the region drawn.
+ */
+static void
+PageView_DrawPage( PageView         *pageview,
+                   const DFBRegion  *region,
+                   IDirectFBSurface *image,
+                   int               x,
+                   int               y )
+{
+     IDirectFBSurface      *surface = pageview->box.surface;
+     DFBSurfacePixelFormat  format;
+     DFBRegion              clip;
+     int                    width, height;
+     int                    tx, ty, th;
+     void                  *src, *dst;
+     int                    src_pitch, dst_pitch;
+
+     image->GetPixelFormat( image, &format );
+
+     if (!pageview->filter || !FilterSupports( format ) || PageView_Tile( pageview, format )) {
+          surface->Blit( surface, image, NULL, x, y );
+          return;
+     }
+
+     image->GetSize( image, &width, &height );
+
+     /* Visible part of the page. */
+     clip.x1 = MAX( x, 0 );
+     clip.y1 = MAX( y, 0 );
+     clip.x2 = MIN( x + width,  pageview->box.rect.w ) - 1;
+     clip.y2 = MIN( y + height, pageview->box.rect.h ) - 1;
+
+     if (region) {
+          clip.x1 = MAX( clip.x1, region->x1 );
+          clip.y1 = MAX( clip.y1, region->y1 );
+          clip.x2 = MIN( clip.x2, region->x2 );
+          clip.y2 = MIN( clip.y2, region->y2 );
+     }
+
+     if (clip.x2 < clip.x1 || clip.y2 < clip.y1)
+          return;
+
+     if (image->Lock( image, DSLF_READ, &src, &src_pitch ))
+          return;
+
+     for (ty = clip.y1; ty <= clip.y2; ty += PAGE_VIEW_TILE) {
+          th = MIN( clip.y2 - ty + 1, PAGE_VIEW_TILE );
+
+          for (tx = clip.x1; tx <= clip.x2; tx += PAGE_VIEW_TILE) {
+               DFBRectangle rect = { 0, 0, MIN( clip.x2 - tx + 1, PAGE_VIEW_TILE ), th };
+
+               if (pageview->tile->Lock( pageview->tile, DSLF_WRITE, &dst, &dst_pitch ))
+                    goto out;
+
+               FilterApply( pageview->filter,
+                            (u8*) src + (ty - y) * src_pitch + (tx - x) * DFB_BYTES_PER_PIXEL( format ), src_pitch,
+                            dst, dst_pitch, format, rect.w, th );
+
+               pageview->tile->Unlock( pageview->tile );
+
+               surface->Blit( surface, pageview->tile, &rect, tx, ty );
+          }
+     }
+
+out:
+     image->Unlock( image );
+}
+
 static DFBResult
 PageView_Draw( LiteBox         *box,
                const DFBRegion *region,
@@ -164,15 +321,76 @@ PageView_Draw( LiteBox         *box,
      PageView         *pageview = (PageView*) box;
      IDirectFBSurface *surface  = box->surface;
 
+     /* Crossfade from the previous page. */
+     if (pageview->fade_image) {
+          PageView_DrawPage( pageview, region, pageview->fade_image,
+                             pageview->fade_position.x, pageview->fade_position.y );
+
+          if (pageview->fade_right)
+               PageView_DrawPage( pageview, region, pageview->fade_right,
+                                  pageview->fade_right_position.x, pageview->fade_right_position.y );
+
+          surface->SetBlittingFlags( surface, DSBLIT_BLEND_COLORALPHA );
+          surface->SetColor( surface, 0, 0, 0, pageview->fade_alpha );
+     }
+
      if (pageview->image) {
-          surface->Blit( surface, pageview->image, NULL,
-                         pageview->image_rect.x - pageview->offset.x,
-                         pageview->image_rect.y - pageview->offset.y );
+          PageView_DrawPage( pageview, region, pageview->image,
+                             pageview->image_rect.x - pageview->offset.x + pageview->image_position.x,
+                             pageview->image_rect.y - pageview->offset.y + pageview->image_position.y );
      }
 
+     if (pageview->right) {
+          PageView_DrawPage( pageview, region, pageview->right,
+                             pageview->image_rect.x - pageview->offset.x + pageview->right_position.x,
+                             pageview->image_rect.y - pageview->offset.y + pageview->right_position.y );
+     }
+
+     if (pageview->fade_image)
+          surface->SetBlittingFlags( surface, DSBLIT_NOFX );
+
+     /* Selected link. */
+     if (pageview->highlight.w) {
+          int x = pageview->image_rect.x - pageview->offset.x + pageview->highlight.x;
+          int y = pageview->image_rect.y - pageview->offset.y + pageview->highlight.y;
+
+          surface->SetColor( surface, 0xff, 0x80, 0x00, 0xff );
+          surface->DrawRectangle( surface, x - 2, y - 2, pageview->highlight.w + 4, pageview->highlight.h + 4 );
+          surface->DrawRectangle( surface, x - 1, y - 1, pageview->highlight.w + 2, pageview->highlight.h + 2 );
+     }
+
+     /* For key-to-pixels latency measurement. */
+     pageview->draws++;
+     pageview->draw_time = direct_clock_get_micros();
+
      return DFB_OK;
 }
 
+static int
+PageView_OnButtonDown( LiteBox                        *box,
+                       int                             x,
+                       int                             y,
+                       DFBInputDeviceButtonIdentifier  button )
+{
+     PageView *pageview = (PageView*) box;
+
+     if (!pageview->image || !pageview->click)
+          return 0;
+
+     /* Spread coordinates. */
+     x += pageview->offset.x - pageview->image_rect.x;
+     y += pageview->offset.y - pageview->image_rect.y;
+
+     if (pageview->right && x >= pageview->right_position.x)
+          pageview->click( pageview->click_ctx, true,
+                           x - pageview->right_position.x, y - pageview->right_position.y );
+     else
+          pageview->click( pageview->click_ctx, false,
+                           x - pageview->image_position.x, y - pageview->image_position.y );
+
+     return 1;
+}
+
 static DFBResult
 PageView_Destroy( LiteBox *box )
 {
@@ -181,6 +399,15 @@ PageView_Destroy( LiteBox *box )
      if (pageview->image)
           pageview->image->Release( pageview->image );
 
+     if (pageview->right)
+          pageview->right->Release( pageview->right );
+
+     if (pageview->tile)
+          pageview->tile->Release( pageview->tile );
+
+     if (pageview->filter)
+          FilterDestroy( pageview->filter );
+
      return lite_destroy_box( box );
 }
 
@@ -211,8 +438,9 @@ PageView_New( LiteBox       *parent,
      pageview->box.background = &pageview->background;
 
      /* Set callbacks. */
-     pageview->box.Draw    = PageView_Draw;
-     pageview->box.Destroy = PageView_Destroy;
+     pageview->box.Draw         = PageView_Draw;
+     pageview->box.Destroy      = PageView_Destroy;
+     pageview->box.OnButtonDown = PageView_OnButtonDown;
 
      *ret_pageview = pageview;
 
@@ -221,23 +449,56 @@ PageView_New( LiteBox       *parent,
 
 static DFBResult
 PageViewSetImage( PageView         *pageview,
-                  IDirectFBSurface *image )
+                  IDirectFBSurface *image,
+                  IDirectFBSurface *right )
 {
      DFBResult ret;
-     int       width;
-     int       height;
+     int       width,  height;
+     int       width2, height2;
 
      ret = image->AddRef( image );
      if (ret)
           return ret;
 
+     if (right)
+          right->AddRef( right );
+
      if (pageview->image)
           pageview->image->Release( pageview->image );
 
+     if (pageview->right)
+          pageview->right->Release( pageview->right );
+
      pageview->image = image;
+     pageview->right = right;
+
+     pageview->highlight.w = 0;
 
      image->GetSize( image, &width, &height );
 
+     pageview->image_position.x = 0;
+     pageview->image_position.y = 0;
+
+     /* Facing pages, the right one follows the left one. */
+     if (right) {
+          right->GetSize( right, &width2, &height2 );
+
+          pageview->right_position.x = width;
+          pageview->right_position.y = 0;
+
+          if (height2 > height) {
+               pageview->image_position.y = (height2 - height) / 2;
+               height = height2;
+          }
+          else
+               pageview->right_position.y = (height - height2) / 2;
+
+          width += width2;
+     }
+
+     pageview->image_size.w = width;
+     pageview->image_size.h = height;
+
      if (width > pageview->box.rect.w) {
           pageview->image_rect.x = 0;
           pageview->image_rect.w = pageview->box.rect.w;
@@ -271,12 +532,166 @@ PageViewSetImage( PageView         *pageview,
      return DFB_OK;
 }
 
+/*
+ * Fade from the pages shown to new ones in a number of flips. The time the first frame with the new pages is shown is
+ * returned, if they are not only set.
+ */
+static DFBResult
+PageViewCrossfade( PageView         *pageview,
+                   IDirectFBSurface *image,
+                   IDirectFBSurface *right,
+                   int               steps,
+                   long long        *ret_shown )
+{
+     DFBResult ret;
+     int       i;
+
+     if (!pageview->image)
+          return PageViewSetImage( pageview, image, right );
+
+     /* Keep the previous pages at their current position. */
+     pageview->fade_image      = pageview->image;
+     pageview->fade_position.x = pageview->image_rect.x - pageview->offset.x + pageview->image_position.x;
+     pageview->fade_position.y = pageview->image_rect.y - pageview->offset.y + pageview->image_position.y;
+
+     pageview->fade_image->AddRef( pageview->fade_image );
+
+     if (pageview->right) {
+          pageview->fade_right            = pageview->right;
+          pageview->fade_right_position.x = pageview->image_rect.x - pageview->offset.x + pageview->right_position.x;
+          pageview->fade_right_position.y = pageview->image_rect.y - pageview->offset.y + pageview->right_position.y;
+
+          pageview->fade_right->AddRef( pageview->fade_right );
+     }
+
+     ret = PageViewSetImage( pageview, image, right );
+
+     for (i = 1; i < steps && !ret; i++) {
+          pageview->fade_alpha = 0xff * i / steps;
+
+          ret = lite_draw_box( &pageview->box, NULL, DFB_TRUE );
+
+          if (i == 1 && !ret)
+               *ret_shown = direct_clock_get_micros();
+     }
+
+     pageview->fade_image->Release( pageview->fade_image );
+     pageview->fade_image = NULL;
+
+     if (pageview->fade_right) {
+          pageview->fade_right->Release( pageview->fade_right );
+          pageview->fade_right = NULL;
+     }
+
+     return ret;
+}
+
+/*
+ * Show a page while it is rendered, queuing an update of the part rendered so far. The pages replaced are kept until
+ * the render ends.
+ */
+static void
+PageViewProgress( PageView           *pageview,
+                  IDirectFBSurface   *image,
+                  const DFBRectangle *rect )
+{
+     DFBRectangle update;
+
+     if (pageview->image != image) {
+          if (!pageview->painted) {
+               pageview->painted     = true;
+               pageview->shown       = pageview->image;
+               pageview->shown_right = pageview->right;
+
+               if (pageview->shown)
+                    pageview->shown->AddRef( pageview->shown );
+
+               if (pageview->shown_right)
+                    pageview->shown_right->AddRef( pageview->shown_right );
+          }
+
+          PageViewSetImage( pageview, image, pageview->right );
+
+          return;
+     }
+
+     update.x = pageview->image_rect.x - pageview->offset.x + pageview->image_position.x + rect->x;
+     update.y = pageview->image_rect.y - pageview->offset.y + pageview->image_position.y + rect->y;
+     update.w = rect->w;
+     update.h = rect->h;
+
+     if (update.x + update.w <= 0 || update.y + update.h <= 0 ||
+         update.x >= pageview->box.rect.w || update.y >= pageview->box.rect.h)
+          return;
+
+     lite_update_box( &pageview->box, &update );
+}
+
+/*
+ * End a render shown with PageViewProgress(), showing the pages it replaced again if it failed.
+ */
+static void
+PageViewEndProgress( PageView *pageview,
+                     bool      failed )
+{
+     if (!pageview->painted)
+          return;
+
+     pageview->painted = false;
+
+     if (failed && pageview->shown)
+          PageViewSetImage( pageview, pageview->shown, pageview->shown_right );
+
+     if (pageview->shown) {
+          pageview->shown->Release( pageview->shown );
+          pageview->shown = NULL;
+     }
+
+     if (pageview->shown_right) {
+          pageview->shown_right->Release( pageview->shown_right );
+          pageview->shown_right = NULL;
+     }
+}
+
+/*
+ * Size of the displayed page, or of the spread.
+ */
 static DFBResult
 PageViewGetImageSize( PageView *pageview,
                       int      *ret_width,
                       int      *ret_height )
 {
-     return pageview->image->GetSize( pageview->image, ret_width, ret_height );
+     if (!pageview->image)
+          return DFB_BUFFEREMPTY;
+
+     *ret_width  = pageview->image_size.w;
+     *ret_height = pageview->image_size.h;
+
+     return DFB_OK;
+}
+
+/*
+ * Set the display filter, taking ownership of it, or remove it. The pages are drawn again at once.
+ */
+static void
+PageViewSetFilter( PageView *pageview,
+                   Filter   *filter )
+{
+     if (pageview->filter)
+          FilterDestroy( pageview->filter );
+
+     pageview->filter = filter;
+
+     lite_update_box( &pageview->box, NULL );
+}
+
+static void
+PageViewSetClickFunc( PageView          *pageview,
+                      PageViewClickFunc  click,
+                      void              *ctx )
+{
+     pageview->click     = click;
+     pageview->click_ctx = ctx;
 }
 
 static DFBResult
@@ -310,8 +725,160 @@ PageViewScroll( PageView *pageview,
      return DFB_OK;
 }
 
+/*
+ * Highlight an area of the left or right page, scrolling it into view, or remove the highlight.
+ */
+static DFBResult
+PageViewSetHighlight( PageView           *pageview,
+                      bool                right,
+                      const DFBRectangle *rect )
+{
+     int             dx       = 0;
+     int             dy       = 0;
+     const DFBPoint *position = right ? &pageview->right_position : &pageview->image_position;
+
+     if (!rect) {
+          if (pageview->highlight.w) {
+               pageview->highlight.w = 0;
+
+               lite_update_box( &pageview->box, NULL );
+          }
+
+          return DFB_OK;
+     }
+
+     pageview->highlight.x = position->x + rect->x;
+     pageview->highlight.y = position->y + rect->y;
+     pageview->highlight.w = MAX( rect->w, 1 );
+     pageview->highlight.h = MAX( rect->h, 1 );
+
+     if (pageview->highlight.x < pageview->offset.x)
+          dx = pageview->highlight.x - pageview->offset.x;
+     else if (pageview->highlight.x + pageview->highlight.w > pageview->offset.x + pageview->image_rect.w)
+          dx = pageview->highlight.x + pageview->highlight.w - pageview->offset.x - pageview->image_rect.w;
+
+     if (pageview->highlight.y < pageview->offset.y)
+          dy = pageview->highlight.y - pageview->offset.y;
+     else if (pageview->highlight.y + pageview->highlight.h > pageview->offset.y + pageview->image_rect.h)
+          dy = pageview->highlight.y + pageview->highlight.h - pageview->offset.y - pageview->image_rect.h;
+
+     lite_update_box( &pageview->box, NULL );
+
+     return PageViewScroll( pageview, dx, dy );
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Outline view: an overlay listing the outline entries around the selected one, indented by level.
+ */
+
+#define OUTLINE_VIEW_MAX_LINES 64
+
+typedef struct {
+     LiteBox                     box;
+
+     DFBColor                    background;
+     LiteLabel                  *labels[OUTLINE_VIEW_MAX_LINES];
+     int                         num_labels;
+
+     const DocumentOutlineEntry *entries;
+     int                         num_entries;
+     int                         first;
+     int                         selected;
+} OutlineView;
+
+static DFBResult
+OutlineView_New( LiteBox                     *parent,
+                 DFBRectangle                *rect,
+                 const DocumentOutlineEntry  *entries,
+                 int                          num_entries,
+                 OutlineView                **ret_outlineview )
+{
+     DFBResult    ret;
+     int          i;
+     OutlineView *outlineview;
+     DFBColor     white = { 0xff, 0xf0, 0xf0, 0xf0 };
+
+     outlineview = D_CALLOC( 1, sizeof(OutlineView) );
+     if (!outlineview)
+          return D_OOM();
+
+     /* Initialize the box. */
+     ret = lite_init_box_at( &outlineview->box, parent, rect );
+     if (ret) {
+          D_FREE( outlineview );
+          return ret;
+     }
+
+     /* Set background color. */
+     outlineview->background.a   = 0xe0;
+     outlineview->background.r   = 0x00;
+     outlineview->background.g   = 0x23;
+     outlineview->background.b   = 0x42;
+     outlineview->box.background = &outlineview->background;
+
+     outlineview->entries     = entries;
+     outlineview->num_entries = num_entries;
+     outlineview->num_labels  = MIN( (rect->h - 8) / 24, OUTLINE_VIEW_MAX_LINES );
+
+     /* Setup the line labels. */
+     for (i = 0; i < outlineview->num_labels; i++) {
+          DFBRectangle rect_line = { 8, 4 + i * 24, rect->w - 16, 24 };
+
+          ret = lite_new_label( &outlineview->box, &rect_line, liteNoLabelTheme, 20, &outlineview->labels[i] );
+          if (ret)
+               return ret;
+
+          lite_set_label_color( outlineview->labels[i], &white );
+     }
+
+     *ret_outlineview = outlineview;
+
+     return DFB_OK;
+}
+
+static void
+OutlineViewSelect( OutlineView *outlineview,
+                   int          selected )
+{
+     int      i;
+     DFBColor white  = { 0xff, 0xf0, 0xf0, 0xf0 };
+     DFBColor orange = { 0xff, 0xff, 0x80, 0x00 };
+
+     if (selected >= outlineview->num_entries)
+          selected = outlineview->num_entries - 1;
+
+     if (selected < 0)
+          selected = 0;
+
+     outlineview->selected = selected;
+
+     /* Keep the selected entry visible. */
+     if (selected < outlineview->first)
+          outlineview->first = selected;
+     else if (selected >= outlineview->first + outlineview->num_labels)
+          outlineview->first = selected - outlineview->num_labels + 1;
+
+     for (i = 0; i < outlineview->num_labels; i++) {
+          int  n = outlineview->first + i;
+          char text[DOCUMENT_OUTLINE_TITLE_LENGTH + 32];
+
+          if (n < outlineview->num_entries)
+               snprintf( text, sizeof(text), "%*s%s", MIN( outlineview->entries[n].level, 8 ) * 3, "",
+                         outlineview->entries[n].title );
+          else
+               text[0] = 0;
+
+          lite_set_label_color( outlineview->labels[i], n == selected ? &orange : &white );
+          lite_set_label_text( outlineview->labels[i], text );
+     }
+}
+
 /**********************************************************************************************************************/
 
+#define STATUS_BAR_HEIGHT 23
+
 typedef struct {
      LiteWindow *window;
 
@@ -320,17 +887,18 @@ typedef struct {
 } MainWindow;
 
 static DFBResult
-MainWindowInit( MainWindow *mainwin,
-                int         width,
-                int         height )
+MainWindowInit( MainWindow            *mainwin,
+                int                    width,
+                int                    height,
+                DFBWindowCapabilities  caps )
 {
      DFBResult    ret;
      DFBRectangle rect_window    = { 0,           0, width,      height };
-     DFBRectangle rect_pageview  = { 0,           0, width, height - 23 };
-     DFBRectangle rect_statusbar = { 0, height - 23, width,          23 };
+     DFBRectangle rect_pageview  = { 0,                          0, width, height - STATUS_BAR_HEIGHT };
+     DFBRectangle rect_statusbar = { 0, height - STATUS_BAR_HEIGHT, width,      STATUS_BAR_HEIGHT };
 
      /* Create a window. */
-     ret = lite_new_window( NULL, &rect_window, DWCAPS_NONE, liteNoWindowTheme, "Projektor", &mainwin->window );
+     ret = lite_new_window( NULL, &rect_window, caps, liteNoWindowTheme, "Projektor", &mainwin->window );
      if (ret)
           return ret;
 
@@ -352,443 +920,3943 @@ MainWindowInit( MainWindow *mainwin,
 
 /**********************************************************************************************************************/
 
+/*
+ * Page cache: the most recently used pages are kept as surfaces, older ones are kept row-RLE compressed, which suits
+ * the long runs of paper white in rendered pages.
+ */
+
 typedef struct {
-     MainWindow           mainwin;
+     DirectLink             link;
 
-     DocumentProvider    *provider;
+     int                    pageno;
+     float                  zoom;
+     DocumentRenderFlags    flags;
 
-     DocumentDescription  desc;
+     IDirectFBSurface      *surface;
 
-     bool                 error;
-     bool                 quit;
+     int                    width;
+     int                    height;
+     DFBSurfacePixelFormat  format;
+     u8                    *data;
+     unsigned int           size;
+} PageCacheEntry;
 
-     int                  pageno;
-     float                zoom;
-     float                zoom_prev;
+typedef struct {
+     IDirectFB          *idirectfb;
+     PageView           *pageview;
 
-     LiteTextLine        *textline;
-} Projektor;
+     DirectLink         *surfaces;
+     int                 num_surfaces;
+     int                 max_surfaces;
+     unsigned long       surface_size;
 
-static DFBResult ProjektorKeyboardFunc( DFBWindowEvent *evt, void *data );
+     DirectLink         *packed;
+     unsigned long       packed_size;
+     unsigned long       max_packed_size;
 
-static DFBResult
-ProjektorInit( Projektor  *projektor,
-               const char *renderer,
-               const char *filename,
-               int         width,
-               int         height,
-               float       zoom )
-{
-     DFBResult         ret;
-     DocumentProvider *provider;
+     unsigned long       max_size;                   /* memory budget of both tiers, 0 for unlimited */
 
-     /* Get the display layer size. */
-     if (!width || !height)
-          lite_get_layer_size( &width, &height );
+     u8                 *scratch;
+     unsigned int        scratch_size;
 
-     /* Create the main window. */
-     ret = MainWindowInit( &projektor->mainwin, width, height );
-     if (ret)
-          return ret;
+     unsigned int        lookups;
+     unsigned int        surface_hits;
+     unsigned int        packed_hits;
+     unsigned long long  raw_bytes;
+     unsigned long long  packed_bytes;
+} PageCache;
 
-     /* Install raw keyboard event callback. */
-     lite_on_raw_window_keyboard( projektor->mainwin.window, ProjektorKeyboardFunc, projektor );
+static void
+PageCache_Init( PageCache     *cache,
+                IDirectFB     *idirectfb,
+                PageView      *pageview,
+                int            max_surfaces,
+                unsigned long  max_packed_size,
+                unsigned long  max_size )
+{
+     memset( cache, 0, sizeof(PageCache) );
 
-     /* Select document provider. */
-     direct_list_foreach (provider, documentproviders) {
-          if (!strcasecmp( provider->impl, renderer )) {
-               projektor->provider = provider;
-               break;
-          }
-     }
+     cache->idirectfb       = idirectfb;
+     cache->pageview        = pageview;
+     cache->max_surfaces    = max_surfaces;
+     cache->max_packed_size = max_packed_size;
+     cache->max_size        = max_size;
+}
 
-     /* Initialize document provider. */
-     ret = provider->Init( provider, filename, lite_get_dfb_interface() );
-     if (ret) {
-          StatusBarSetTitle( projektor->mainwin.statusbar, "Cannot open file" );
-          return ret;
+static inline bool
+PageCache_SamePixel( const u8 *a,
+                     const u8 *b,
+                     int       bpp )
+{
+     switch (bpp) {
+          case 2:
+               return *(const u16*) a == *(const u16*) b;
+          case 4:
+               return *(const u32*) a == *(const u32*) b;
+          default:
+               return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
      }
+}
 
-     /* Get document description. */
-     provider->GetDescription( provider, &projektor->desc );
+static unsigned int
+PageCache_Pack( u8       *dst,
+                const u8 *src,
+                int       pitch,
+                int       width,
+                int       height,
+                int       bpp )
+{
+     int       x, y;
+     u8       *start = dst;
+     const u8 *prev  = NULL;
+
+     for (y = 0; y < height; y++, prev = src, src += pitch) {
+          /* Row identical to the previous one. */
+          if (prev && !memcmp( src, prev, width * bpp )) {
+               *dst++ = 1;
+               continue;
+          }
 
-     /* Set status bar. */
-     StatusBarSetTitle( projektor->mainwin.statusbar, projektor->desc.title );
-     StatusBarSetZoom( projektor->mainwin.statusbar, 100 * zoom );
+          *dst++ = 0;
 
-     projektor->error     = false;
-     projektor->quit      = false;
-     projektor->pageno    = 0;
-     projektor->zoom      = zoom;
-     projektor->zoom_prev = zoom;
+          for (x = 0; x < width;) {
+               int n = 1;
 
-     /* No goto page text line at startup. */
-     projektor->textline = NULL;
+               while (x + n < width && n < 128 && PageCache_SamePixel( src + (x + n) * bpp, src + x * bpp, bpp ))
+                    n++;
 
-     return DFB_OK;
-}
+               if (n > 1) {
+                    /* Run of n identical pixels. */
+                    *dst++ = 0x80 | (n - 1);
+                    memcpy( dst, src + x * bpp, bpp );
+                    dst += bpp;
+               }
+               else {
+                    /* Literal pixels up to the next run. */
+                    while (x + n < width && n < 128 &&
+                           (x + n + 1 == width || !PageCache_SamePixel( src + (x + n + 1) * bpp, src + (x + n) * bpp, bpp )))
+                         n++;
+
+                    *dst++ = n - 1;
+                    memcpy( dst, src + x * bpp, n * bpp );
+                    dst += n * bpp;
+               }
+
+               x += n;
+          }
+     }
+
+     return dst - start;
+}
+
+static void
+PageCache_Unpack( u8       *dst,
+                  const u8 *src,
+                  int       pitch,
+                  int       width,
+                  int       height,
+                  int       bpp )
+{
+     int x, y;
+     u8 *prev = NULL;
+
+     for (y = 0; y < height; y++, prev = dst, dst += pitch) {
+          if (*src++) {
+               memcpy( dst, prev, width * bpp );
+               continue;
+          }
+
+          for (x = 0; x < width;) {
+               int n = (*src & 0x7f) + 1;
+
+               if (*src++ & 0x80) {
+                    u8 *d = dst + x * bpp;
+                    int i;
+
+                    for (i = 0; i < n; i++, d += bpp)
+                         memcpy( d, src, bpp );
+
+                    src += bpp;
+               }
+               else {
+                    memcpy( dst + x * bpp, src, n * bpp );
+                    src += n * bpp;
+               }
+
+               x += n;
+          }
+     }
+}
+
+static inline unsigned long
+PageCache_SurfaceSize( const PageCacheEntry *entry )
+{
+     return (unsigned long) entry->width * entry->height * DFB_BYTES_PER_PIXEL( entry->format );
+}
+
+static void
+PageCache_Free( PageCacheEntry *entry )
+{
+     if (entry->surface)
+          entry->surface->Release( entry->surface );
+
+     if (entry->data)
+          D_FREE( entry->data );
+
+     D_FREE( entry );
+}
+
+static bool
+PageCache_InUse( PageCache        *cache,
+                 IDirectFBSurface *surface )
+{
+     return cache->pageview && (cache->pageview->image == surface || cache->pageview->right == surface);
+}
 
 static DFBResult
-ProjektorGotoPage( Projektor *projektor,
-                   int        pageno )
+PageCache_Compress( PageCache      *cache,
+                    PageCacheEntry *entry )
 {
-     DFBResult         ret;
-     IDirectFBSurface *image;
-     PageView         *pageview  = projektor->mainwin.pageview;
-     StatusBar        *statusbar = projektor->mainwin.statusbar;
-     DocumentProvider *provider  = projektor->provider;
+     DFBResult     ret;
+     int           pitch;
+     void         *ptr;
+     int           bpp   = DFB_BYTES_PER_PIXEL( entry->format );
+     unsigned int  bound = entry->height * (1 + entry->width * bpp + (entry->width + 127) / 128);
+
+     if (cache->scratch_size < bound) {
+          u8 *scratch = D_REALLOC( cache->scratch, bound );
+          if (!scratch)
+               return D_OOM();
+
+          cache->scratch      = scratch;
+          cache->scratch_size = bound;
+     }
 
-     if (pageno < 1)
-          pageno = 1;
+     ret = entry->surface->Lock( entry->surface, DSLF_READ, &ptr, &pitch );
+     if (ret)
+          return ret;
 
-     if (pageno > projektor->desc.num_pages)
-          pageno = projektor->desc.num_pages;
+     entry->size = PageCache_Pack( cache->scratch, ptr, pitch, entry->width, entry->height, bpp );
 
-     if (pageno == projektor->pageno)
-          return DFB_OK;
+     entry->surface->Unlock( entry->surface );
 
-     ret = provider->RenderPage( provider, pageno, projektor->zoom, &image );
+     entry->data = D_MALLOC( entry->size );
+     if (!entry->data)
+          return D_OOM();
+
+     memcpy( entry->data, cache->scratch, entry->size );
+
+     cache->packed_size  += entry->size;
+     cache->raw_bytes    += entry->width * entry->height * bpp;
+     cache->packed_bytes += entry->size;
+
+     return DFB_OK;
+}
+
+static DFBResult
+PageCache_Decompress( PageCache         *cache,
+                      PageCacheEntry    *entry,
+                      IDirectFBSurface **ret_surface )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     int                    pitch;
+     void                  *ptr;
+     IDirectFBSurface      *surface;
+
+     /*
+      * Always a new surface, the surfaces of evicted pages may still be referenced by the page view, a crossfade or a
+      * page being shown, and their contents must stay.
+      */
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = entry->width;
+     desc.height      = entry->height;
+     desc.pixelformat = entry->format;
+
+     ret = cache->idirectfb->CreateSurface( cache->idirectfb, &desc, &surface );
+     if (ret)
+          return ret;
+
+     ret = surface->Lock( surface, DSLF_WRITE, &ptr, &pitch );
      if (ret) {
-          StatusBarSetTitle( statusbar, "Cannot render page" );
-          projektor->error = true;
+          surface->Release( surface );
           return ret;
      }
 
-     if (projektor->error)
-          StatusBarSetTitle( statusbar, projektor->desc.title );
+     PageCache_Unpack( ptr, entry->data, pitch, entry->width, entry->height, DFB_BYTES_PER_PIXEL( entry->format ) );
 
-     PageViewSetImage( pageview, image );
+     surface->Unlock( surface );
 
-     image->Release( image );
+     *ret_surface = surface;
 
-     /* Update status bar. */
-     StatusBarSetProgress( statusbar, (float) (pageno - 1) / (projektor->desc.num_pages - 1) );
-     StatusBarSetPage( statusbar, pageno, projektor->desc.num_pages );
+     return DFB_OK;
+}
 
-     projektor->pageno = pageno;
+static bool
+PageCache_OverBudget( PageCache *cache )
+{
+     return cache->max_size && cache->surface_size + cache->packed_size > cache->max_size;
+}
 
-     return DFB_OK;
+static void
+PageCache_DropPacked( PageCache *cache )
+{
+     PageCacheEntry *entry = (PageCacheEntry*) direct_list_get_last( cache->packed );
+
+     direct_list_remove( &cache->packed, &entry->link );
+
+     cache->packed_size -= entry->size;
+
+     PageCache_Free( entry );
 }
 
-static DFBResult
-ProjektorSetZoom( Projektor *projektor,
-                  float      zoom )
+static void
+PageCache_Shrink( PageCache *cache )
 {
-     DFBResult         ret;
-     IDirectFBSurface *image;
-     PageView         *pageview  = projektor->mainwin.pageview;
-     StatusBar        *statusbar = projektor->mainwin.statusbar;
-     DocumentProvider *provider  = projektor->provider;
+     PageCacheEntry *entry;
 
-     if (zoom < 0.25f)
-          zoom = 0.25f;
+     /* Compressed pages are older than surfaces, drop them first when over the memory budget. */
+     while (cache->packed && PageCache_OverBudget( cache ))
+          PageCache_DropPacked( cache );
 
-     if (zoom > 2.5f)
-          zoom = 2.5f;
+     /* Move the least recently used surfaces to the compressed tier, the most recent one is kept in any case. */
+     while (cache->num_surfaces > cache->max_surfaces || (cache->num_surfaces > 1 && PageCache_OverBudget( cache ))) {
+          entry = (PageCacheEntry*) direct_list_get_last( cache->surfaces );
 
-     if (zoom == projektor->zoom)
-          return DFB_OK;
+          direct_list_remove( &cache->surfaces, &entry->link );
+          cache->num_surfaces--;
+          cache->surface_size -= PageCache_SurfaceSize( entry );
 
-     ret = provider->RenderPage( provider, projektor->pageno, zoom, &image );
-     if (ret) {
-          StatusBarSetTitle( statusbar, "Cannot render page" );
-          projektor->error = true;
-          return ret;
+          if (!entry->data && PageCache_Compress( cache, entry )) {
+               PageCache_Free( entry );
+               continue;
+          }
+
+          entry->surface->Release( entry->surface );
+          entry->surface = NULL;
+
+          direct_list_prepend( &cache->packed, &entry->link );
      }
 
-     if (projektor->error)
-          StatusBarSetTitle( statusbar, projektor->desc.title );
+     /* Drop the least recently used compressed pages. */
+     while (cache->packed && (cache->packed_size > cache->max_packed_size || PageCache_OverBudget( cache )))
+          PageCache_DropPacked( cache );
+}
+
+/*
+ * Release all cached pages but the displayed one, and the memory kept for compression.
+ */
+static void
+PageCacheEvict( PageCache *cache )
+{
+     PageCacheEntry *entry, *next;
 
-     PageViewSetImage( pageview, image );
+     while (cache->packed)
+          PageCache_DropPacked( cache );
 
-     image->Release( image );
+     direct_list_foreach_safe (entry, next, cache->surfaces) {
+          if (PageCache_InUse( cache, entry->surface ))
+               continue;
 
-     /* Update status bar. */
-     StatusBarSetZoom( statusbar, 100 * zoom );
+          direct_list_remove( &cache->surfaces, &entry->link );
+          cache->num_surfaces--;
+          cache->surface_size -= PageCache_SurfaceSize( entry );
 
-     projektor->zoom = zoom;
+          if (entry->data)
+               cache->packed_size -= entry->size;
 
-     return DFB_OK;
+          PageCache_Free( entry );
+     }
+
+     if (cache->scratch) {
+          D_FREE( cache->scratch );
+
+          cache->scratch      = NULL;
+          cache->scratch_size = 0;
+     }
+}
+
+static bool
+PageCacheHasSurface( PageCache           *cache,
+                     int                  pageno,
+                     float                zoom,
+                     DocumentRenderFlags  flags )
+{
+     PageCacheEntry *entry;
+
+     direct_list_foreach (entry, cache->surfaces) {
+          if (entry->pageno == pageno && entry->zoom == zoom && entry->flags == flags)
+               return true;
+     }
+
+     return false;
+}
+
+static bool
+PageCacheHasPage( PageCache           *cache,
+                  int                  pageno,
+                  float                zoom,
+                  DocumentRenderFlags  flags )
+{
+     PageCacheEntry *entry;
+
+     if (PageCacheHasSurface( cache, pageno, zoom, flags ))
+          return true;
+
+     direct_list_foreach (entry, cache->packed) {
+          if (entry->pageno == pageno && entry->zoom == zoom && entry->flags == flags)
+               return true;
+     }
+
+     return false;
 }
 
 static DFBResult
-ProjektorSetOptimal( Projektor *projektor )
+PageCacheLookup( PageCache            *cache,
+                 int                   pageno,
+                 float                 zoom,
+                 DocumentRenderFlags   flags,
+                 IDirectFBSurface    **ret_surface )
 {
-     DFBResult         ret;
-     int               width, height;
-     float             zw, zh;
-     float             zoom;
-     PageView         *pageview = projektor->mainwin.pageview;
-     DocumentProvider *provider = projektor->provider;
+     DFBResult       ret;
+     PageCacheEntry *entry;
 
-     /* Get document description. */
-     provider->GetDescription( provider, &projektor->desc );
+     cache->lookups++;
 
-     PageViewGetImageSize( pageview, &width, &height );
+     direct_list_foreach (entry, cache->surfaces) {
+          if (entry->pageno == pageno && entry->zoom == zoom && entry->flags == flags) {
+               direct_list_move_to_front( &cache->surfaces, &entry->link );
 
-     zw = (float) LITE_BOX(pageview)->rect.w / (width  / projektor->zoom);
-     zh = (float) LITE_BOX(pageview)->rect.h / (height / projektor->zoom);
+               cache->surface_hits++;
 
-     zoom = (zw < zh) ? zw : zh;
+               entry->surface->AddRef( entry->surface );
 
-     if ((int) (100 * zoom / 25 + 0.5f) != (int) (100 * projektor->zoom / 25 + 0.5f)) {
-          projektor->zoom_prev = projektor->zoom;
+               *ret_surface = entry->surface;
 
-          ret = ProjektorSetZoom( projektor, zoom );
+               return DFB_OK;
+          }
      }
-     else
-          ret = ProjektorSetZoom( projektor, projektor->zoom_prev );
 
-     return ret;
+     direct_list_foreach (entry, cache->packed) {
+          if (entry->pageno == pageno && entry->zoom == zoom && entry->flags == flags) {
+               ret = PageCache_Decompress( cache, entry, &entry->surface );
+               if (ret)
+                    return ret;
+
+               /* Promote to the surface tier, the compressed data is kept for the next eviction. */
+               direct_list_remove( &cache->packed, &entry->link );
+               direct_list_prepend( &cache->surfaces, &entry->link );
+               cache->num_surfaces++;
+               cache->surface_size += PageCache_SurfaceSize( entry );
+
+               cache->packed_hits++;
+
+               entry->surface->AddRef( entry->surface );
+
+               *ret_surface = entry->surface;
+
+               PageCache_Shrink( cache );
+
+               return DFB_OK;
+          }
+     }
+
+     return DFB_ITEMNOTFOUND;
 }
 
 static DFBResult
-ProjektorEventLoop( Projektor *projektor )
+PageCacheInsert( PageCache           *cache,
+                 int                  pageno,
+                 float                zoom,
+                 DocumentRenderFlags  flags,
+                 IDirectFBSurface    *surface )
 {
-     while (!projektor->quit) {
-          /* Run window event loop for 200 ms. */
-          lite_window_event_loop( projektor->mainwin.window, 200 );
+     DFBResult       ret;
+     PageCacheEntry *entry;
+
+     entry = D_CALLOC( 1, sizeof(PageCacheEntry) );
+     if (!entry)
+          return D_OOM();
+
+     ret = surface->AddRef( surface );
+     if (ret) {
+          D_FREE( entry );
+          return ret;
      }
 
+     entry->pageno  = pageno;
+     entry->zoom    = zoom;
+     entry->flags   = flags;
+     entry->surface = surface;
+
+     surface->GetSize( surface, &entry->width, &entry->height );
+     surface->GetPixelFormat( surface, &entry->format );
+
+     direct_list_prepend( &cache->surfaces, &entry->link );
+     cache->num_surfaces++;
+     cache->surface_size += PageCache_SurfaceSize( entry );
+
+     PageCache_Shrink( cache );
+
      return DFB_OK;
 }
 
-static DFBResult
-ProjektorKeyboardFunc( DFBWindowEvent *evt,
-                       void           *data )
+/*
+ * Drop the pages not marked to be kept, all of them without marks. Pages shown stay on screen until replaced.
+ */
+static void
+PageCacheRetain( PageCache  *cache,
+                 const bool *keep,
+                 int         num_pages )
 {
-     Projektor *projektor = data;
-     PageView  *pageview  = projektor->mainwin.pageview;
+     PageCacheEntry *entry, *next;
 
-     switch (evt->key_symbol) {
-          case DIKS_CURSOR_UP:
-               if (evt->type == DWET_KEYDOWN)
-                    PageViewScroll( pageview, 0, -LITE_BOX(pageview)->rect.h / 5 );
+     direct_list_foreach_safe (entry, next, cache->surfaces) {
+          if (keep && entry->pageno <= num_pages && keep[entry->pageno-1])
+               continue;
 
-               return DFB_BUSY;
+          direct_list_remove( &cache->surfaces, &entry->link );
+          cache->num_surfaces--;
+          cache->surface_size -= PageCache_SurfaceSize( entry );
 
-          case DIKS_CURSOR_DOWN:
-               if (evt->type == DWET_KEYDOWN)
-                    PageViewScroll( pageview, 0, LITE_BOX(pageview)->rect.h / 5 );
+          if (entry->data)
+               cache->packed_size -= entry->size;
 
-               return DFB_BUSY;
+          PageCache_Free( entry );
+     }
 
-          case DIKS_CURSOR_LEFT:
-               if (projektor->textline)
-                    return DFB_OK;
+     direct_list_foreach_safe (entry, next, cache->packed) {
+          if (keep && entry->pageno <= num_pages && keep[entry->pageno-1])
+               continue;
 
-               if (evt->type == DWET_KEYDOWN)
-                    PageViewScroll( pageview, -LITE_BOX(pageview)->rect.w / 5, 0 );
+          direct_list_remove( &cache->packed, &entry->link );
+          cache->packed_size -= entry->size;
 
-               return DFB_BUSY;
+          PageCache_Free( entry );
+     }
+}
 
-          case DIKS_CURSOR_RIGHT:
-               if (projektor->textline)
-                    return DFB_OK;
+/*
+ * Compress the least recently used surface before it has to move to the compressed tier, so that inserting the next
+ * page does not wait for it.
+ */
+static void
+PageCachePrecompress( PageCache *cache )
+{
+     PageCacheEntry *entry = (PageCacheEntry*) direct_list_get_last( cache->surfaces );
 
-               if (evt->type == DWET_KEYDOWN)
-                    PageViewScroll( pageview, LITE_BOX(pageview)->rect.w / 5, 0 );
+     if (!entry || entry->data || cache->num_surfaces < cache->max_surfaces || PageCache_OverBudget( cache ))
+          return;
 
-               return DFB_BUSY;
+     PageCache_Compress( cache, entry );
+}
 
-          case DIKS_PAGE_UP:
-          case DIKS_CHANNEL_UP:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorGotoPage( projektor, projektor->pageno - 1 );
+static void
+PageCache_Deinit( PageCache *cache )
+{
+     PageCacheEntry *entry, *next;
 
-               return DFB_BUSY;
+     if (cache->lookups)
+          D_INFO( "Projektor/PageCache: %u lookups, %u%% hit rate (%u surface, %u compressed)\n", cache->lookups,
+                  100 * (cache->surface_hits + cache->packed_hits) / cache->lookups,
+                  cache->surface_hits, cache->packed_hits );
 
-          case DIKS_PAGE_DOWN:
-          case DIKS_CHANNEL_DOWN:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorGotoPage( projektor, projektor->pageno + 1 );
+     if (cache->packed_bytes)
+          D_INFO( "Projektor/PageCache: %llu kB compressed to %llu kB (ratio %.1f)\n", cache->raw_bytes / 1024,
+                  cache->packed_bytes / 1024, (double) cache->raw_bytes / cache->packed_bytes );
 
-               return DFB_BUSY;
+     direct_list_foreach_safe (entry, next, cache->surfaces)
+          PageCache_Free( entry );
 
-          case DIKS_HOME:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorGotoPage( projektor, 1 );
+     direct_list_foreach_safe (entry, next, cache->packed)
+          PageCache_Free( entry );
 
-               return DFB_BUSY;
+     if (cache->scratch)
+          D_FREE( cache->scratch );
+}
 
-          case DIKS_END:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorGotoPage( projektor, projektor->desc.num_pages );
+/**********************************************************************************************************************/
 
-               return DFB_BUSY;
+typedef enum {
+     TRANSITION_CUT,
+     TRANSITION_CROSSFADE
+} Transition;
 
-          case DIKS_PLUS_SIGN:
-          case DIKS_VOLUME_UP:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorSetZoom( projektor, projektor->zoom + 0.25f );
+#define PROJEKTOR_LINK_PAGES 16
+#define PROJEKTOR_HISTORY    32
+
+/*
+ * Display modes, cycled by a key, applied by the page view without rendering the pages again.
+ */
+
+static const struct {
+     const char    *name;
+     FilterOptions  options;
+} projektor_views[] = {
+     { "normal",   { .contrast = 1.0f, .gamma = 1.0f, .tint = { 0xff, 0xff, 0xff, 0xff } } },
+     { "night",    { .invert = true, .contrast = 0.9f, .gamma = 1.0f, .tint = { 0xff, 0xff, 0xf0, 0xd8 } } },
+     { "contrast", { .contrast = 1.4f, .gamma = 1.5f, .tint = { 0xff, 0xff, 0xff, 0xff } } },
+     { "sepia",    { .contrast = 0.95f, .gamma = 1.1f, .tint = { 0xff, 0xff, 0xec, 0xc4 } } }
+};
+
+#define PROJEKTOR_NUM_VIEWS D_ARRAY_SIZE(projektor_views)
+
+/*
+ * Crop mode: pages are rendered within their content box, with a margin in page coordinates at zoom factor 1. The
+ * boxes are found once per page, pages without a content box are rendered whole.
+ */
+
+#define PROJEKTOR_CROP_MARGIN 8.0f
+
+typedef struct {
+     bool                 known;
+     DocumentBox          box;                /* empty to render the whole page */
+} ProjektorContent;
+
+/*
+ * Next document of the playlist, opened with its first page or spread rendered in the background.
+ */
+typedef struct {
+     DirectThread        *thread;
+     int                  entry;
+     DocumentProvider    *candidates[DOCUMENT_PROVIDER_MAX_CANDIDATES];
+     int                  num_candidates;
+     int                  candidate;
+     int                  width;              /* of the page view to fit the pages to, 0 to keep the zoom factor */
+     int                  height;
+     float                zoom;
+     DocumentRenderFlags  flags;
+     bool                 crop;
+
+     DocumentProvider    *provider;           /* NULL if the document cannot be opened */
+     DocumentDescription  desc;
+     int                  pageno;
+     IDirectFBSurface    *left;
+     IDirectFBSurface    *right;
+     ProjektorContent     contents[2];        /* of the left and right pages in crop mode */
+} ProjektorPreload;
+
+typedef struct {
+     MainWindow           mainwin;
+     EventLoop           *loop;
+
+     DocumentProvider    *provider;
+     int                  isolate;
+     int                  watchdog;
+
+     DocumentProvider    *candidates[DOCUMENT_PROVIDER_MAX_CANDIDATES];
+     int                  num_candidates;
+     int                  candidate;
+     const char          *filename;
+     DFBSurfacePixelFormat format;
+
+     IDirectFB           *idirectfb;
+     Metadata            *metadata;
+     int                  start_page;
+     DirectThread        *open_thread;
+     DFBResult            open_result;
+     IDirectFBSurface    *first_page;
+     ProjektorContent     first_content;
+
+     bool                 spread;
+     bool                 cover;
+     DocumentProvider    *partner;
+     int                  partner_candidate;
+     DirectThread        *partner_thread;
+     IDirectFBSurface    *second_page;
+     ProjektorContent     second_content;
+
+     PageCache            cache;
+     int                  prefetch;
+     int                  max_prefetch;
+
+     unsigned long        max_memory;
+     Pressure            *pressure;
+     long long            pressure_time;
+
+     bool                 presenter;
+     Transition           transition;
+     int                  budget;
+     int                  auto_advance;
+     long long            advance_time;
+
+     Trace               *record;
+     unsigned int         events;
+
+     DocumentDescription  desc;
+
+     bool                 error;
+     bool                 quit;
+
+     int                  pageno;
+     int                  pageno_right;
+     float                zoom;
+     float                zoom_prev;
+
+     DocumentRenderFlags  flags;
+     const char          *layers;             /* hidden with DOCUMENT_RENDER_HIDE_LAYERS, NULL for all */
+     bool                 draft;              /* show the pages without images first */
+     bool                 drafted;            /* the pages shown have no images yet */
+     bool                 crop;
+     ProjektorContent    *contents;           /* of the pages, NULL if out of memory */
+     int                  painting;           /* page painted as it is rendered, 0 for none */
+     long long            render_time;        /* of the last page rendered, in microseconds */
+     bool                 reloading;          /* the pages shown are replaced at once */
+     unsigned int         view;               /* display mode, normal first */
+
+     DirectLink          *links;              /* link indexes of the pages shown recently, most recent first */
+     int                  num_links;
+     bool                 link_right;
+     int                  link;               /* selected link, -1 for none */
+     int                  history[PROJEKTOR_HISTORY];
+     int                  num_history;
+
+     DocumentOutlineEntry *outline;           /* loaded on first use */
+     int                  num_outline;
+     bool                 outline_loaded;
+     OutlineView         *outlineview;
+
+     Watch               *watch;
+     u64                 *fingerprints;       /* of the pages, NULL if not supported by the provider */
+     long long            reload_time;        /* 0 if the file has not changed */
+
+     Playlist            *playlist;           /* NULL for a single document */
+     int                  entry;
+     int                  dwell;              /* default, in milliseconds */
+     bool                 optimal;            /* fit the documents to the page view */
+     DocumentProvider    *renderer;           /* set on the command line, NULL to rank the providers */
+     ProjektorPreload     preload;
+
+     LiteTextLine        *textline;
+} Projektor;
+
+static DFBResult ProjektorKeyboardFunc ( DFBWindowEvent *evt, void *data );
+static void      ProjektorClick        ( void *ctx, bool right, int x, int y );
+static void      ProjektorPressureEvent( void *ctx );
+static void      ProjektorScheduleIdle ( Projektor *projektor );
+
+/*
+ * The provider caches get a fraction of the memory budget, split with the partner provider in spread mode.
+ */
+static void
+ProjektorLimitProvider( Projektor        *projektor,
+                        DocumentProvider *provider,
+                        int               fraction )
+{
+     if (projektor->max_memory && provider && provider->SetMemoryLimit)
+          provider->SetMemoryLimit( provider, projektor->max_memory / fraction / (projektor->spread ? 2 : 1) );
+}
+
+/*
+ * Set the flags of the next pages rendered by a provider, which keeps its layer state while they do not change.
+ */
+static void
+ProjektorFlagProvider( Projektor           *projektor,
+                       DocumentProvider    *provider,
+                       DocumentRenderFlags  flags )
+{
+     if (provider->SetRenderFlags)
+          provider->SetRenderFlags( provider, flags, projektor->layers );
+}
+
+static void
+ProjektorProgress( void               *ctx,
+                   IDirectFBSurface   *surface,
+                   const DFBRectangle *rect )
+{
+     Projektor *projektor = ctx;
+
+     PageViewProgress( projektor->mainwin.pageview, surface, rect );
+
+     /* The main loop is busy rendering, keys pressed meanwhile are handled after the render. */
+     EventLoopFlush( projektor->loop );
+}
+
+/*
+ * Paint the page rendered next by a provider as it progresses, or stop.
+ */
+static void
+ProjektorPaintProvider( Projektor        *projektor,
+                        DocumentProvider *provider,
+                        bool              paint )
+{
+     if (provider->SetProgressFunc)
+          provider->SetProgressFunc( provider, paint ? ProjektorProgress : NULL, projektor );
+}
+
+/*
+ * Flags of the pages shown first, without images in draft mode.
+ */
+static inline DocumentRenderFlags
+ProjektorDraftFlags( const Projektor *projektor )
+{
+     return projektor->draft ? projektor->flags | DOCUMENT_RENDER_NO_IMAGES : projektor->flags;
+}
+
+/*
+ * Set the display mode, the pages shown are filtered again at once.
+ */
+static DFBResult
+ProjektorSetView( Projektor    *projektor,
+                  unsigned int  view )
+{
+     DFBResult  ret;
+     Filter    *filter = NULL;
+
+     if (view) {
+          ret = FilterCreate( &projektor_views[view].options, &filter );
+          if (ret)
+               return ret;
+     }
+
+     projektor->view = view;
+
+     PageViewSetFilter( projektor->mainwin.pageview, filter );
+
+     return DFB_OK;
+}
+
+/*
+ * Render a whole page, painted as it progresses on request.
+ */
+static DFBResult
+ProjektorRenderWhole( Projektor          *projektor,
+                      DocumentProvider   *provider,
+                      int                 pageno,
+                      float               zoom,
+                      bool                paint,
+                      IDirectFBSurface  **ret_surface )
+{
+     DFBResult ret;
+
+     if (!paint)
+          return provider->RenderPage( provider, pageno, zoom, ret_surface );
+
+     ProjektorPaintProvider( projektor, provider, true );
+
+     ret = provider->RenderPage( provider, pageno, zoom, ret_surface );
+
+     ProjektorPaintProvider( projektor, provider, false );
+
+     return ret;
+}
+
+/*
+ * Render a page within its content box, found first if not known yet, or the whole page without content. Only the
+ * final render is painted as it progresses, not the one finding the content box.
+ */
+static DFBResult
+ProjektorRenderContents( Projektor          *projektor,
+                         DocumentProvider   *provider,
+                         int                 pageno,
+                         float               zoom,
+                         ProjektorContent   *content,
+                         bool                paint,
+                         IDirectFBSurface  **ret_surface )
+{
+     DFBResult    ret;
+     DocumentBox *box;
+
+     if (!content)
+          return ProjektorRenderWhole( projektor, provider, pageno, zoom, paint, ret_surface );
+
+     box = &content->box;
+
+     if (!content->known) {
+          if (DocumentContentBox( provider, pageno, box ) == DFB_OK) {
+               box->x1  = MAX( box->x1 - PROJEKTOR_CROP_MARGIN, 0 );
+               box->y1  = MAX( box->y1 - PROJEKTOR_CROP_MARGIN, 0 );
+               box->x2 += PROJEKTOR_CROP_MARGIN;
+               box->y2 += PROJEKTOR_CROP_MARGIN;
+          }
+          else
+               memset( box, 0, sizeof(DocumentBox) );
+
+          content->known = true;
+     }
+
+     if (box->x2 <= box->x1 || box->y2 <= box->y1)
+          return ProjektorRenderWhole( projektor, provider, pageno, zoom, paint, ret_surface );
+
+     /* The fallback of DocumentRenderRegion() renders the whole page, it is not painted. */
+     if (paint && provider->RenderRegion) {
+          ProjektorPaintProvider( projektor, provider, true );
+
+          ret = provider->RenderRegion( provider, pageno, zoom, box, ret_surface );
+
+          ProjektorPaintProvider( projektor, provider, false );
+
+          if (ret != DFB_UNSUPPORTED)
+               return ret;
+     }
+
+     return DocumentRenderRegion( provider, projektor->idirectfb, pageno, zoom, box, ret_surface );
+}
+
+/*
+ * Content of a page of the document in crop mode, NULL to render the whole page.
+ */
+static ProjektorContent *
+ProjektorContentOf( Projektor *projektor,
+                    int        pageno )
+{
+     if (!projektor->crop || !projektor->contents || pageno < 1 || pageno > projektor->desc.num_pages)
+          return NULL;
+
+     return &projektor->contents[pageno-1];
+}
+
+/*
+ * Whether a page is rendered cropped to its content box.
+ */
+static inline bool
+ProjektorCropped( const ProjektorContent *content )
+{
+     return content && content->known && content->box.x2 > content->box.x1 && content->box.y2 > content->box.y1;
+}
+
+/*
+ * Offset of a page shown cropped, from the page origin, in pixels at the current zoom factor.
+ */
+static void
+ProjektorCropOffset( Projektor *projektor,
+                     int        pageno,
+                     int       *ret_x,
+                     int       *ret_y )
+{
+     const ProjektorContent *content = ProjektorContentOf( projektor, pageno );
+
+     *ret_x = 0;
+     *ret_y = 0;
+
+     if (ProjektorCropped( content )) {
+          *ret_x = content->box.x1 * projektor->zoom;
+          *ret_y = content->box.y1 * projektor->zoom;
+     }
+}
+
+/*
+ * Content boxes of a new document, keeping the ones of the pages marked to be kept.
+ */
+static void
+ProjektorResetContents( Projektor  *projektor,
+                        const bool *keep,
+                        int         num_pages )
+{
+     int               i;
+     ProjektorContent *contents;
+
+     contents = D_CALLOC( num_pages ?: 1, sizeof(ProjektorContent) );
+     if (!contents)
+          D_OOM();
+
+     for (i = 0; contents && keep && projektor->contents && i < MIN( num_pages, projektor->desc.num_pages ); i++) {
+          if (keep[i])
+               contents[i] = projektor->contents[i];
+     }
+
+     if (projektor->contents)
+          D_FREE( projektor->contents );
+
+     projektor->contents = contents;
+}
+
+static DFBResult
+ProjektorOpen( Projektor *projektor )
+{
+     DFBResult ret = DFB_NOIMPL;
+
+     /* Try the candidate providers in turn, run them in worker processes when isolated. */
+     for (; projektor->candidate < projektor->num_candidates; projektor->candidate++) {
+          DocumentProvider *provider = projektor->candidates[projektor->candidate];
+
+          if (projektor->isolate) {
+               ret = RemoteProviderNew( provider->impl, projektor->isolate, projektor->watchdog, &provider );
+               if (ret)
+                    return ret;
+          }
+
+          ret = provider->Init( provider, projektor->filename, projektor->idirectfb, projektor->format );
+          if (ret == DFB_OK) {
+               projektor->provider = provider;
+
+               /* A quarter of the memory budget goes to the provider caches. */
+               ProjektorLimitProvider( projektor, provider, 4 );
+
+               provider->GetDescription( provider, &projektor->desc );
+
+               return DFB_OK;
+          }
+
+          if (projektor->isolate)
+               RemoteProviderDestroy( provider );
+
+          if (projektor->candidate + 1 < projektor->num_candidates)
+               D_WARN( "%s cannot open the file, falling back to %s",
+                       projektor->candidates[projektor->candidate]->impl,
+                       projektor->candidates[projektor->candidate+1]->impl );
+     }
+
+     return ret;
+}
+
+static void
+ProjektorClose( Projektor        *projektor,
+                DocumentProvider *provider )
+{
+     int i;
+
+     provider->Term( provider );
+
+     if (projektor->isolate) {
+          RemoteProviderDestroy( provider );
+          return;
+     }
+
+     /* Instances opened for the partner or on reload are not candidates. */
+     for (i = 0; i < projektor->num_candidates; i++) {
+          if (provider == projektor->candidates[i])
+               return;
+     }
+
+     DocumentProviderDestroyInstance( provider );
+}
+
+/*
+ * Open a document with another instance of a provider, or with other worker processes when isolated.
+ */
+static DFBResult
+ProjektorOpenFile( Projektor         *projektor,
+                   DocumentProvider  *provider,
+                   const char        *filename,
+                   int                workers,
+                   DocumentProvider **ret_provider )
+{
+     DFBResult         ret;
+     DocumentProvider *instance;
+
+     if (projektor->isolate)
+          ret = RemoteProviderNew( provider->impl, workers, projektor->watchdog, &instance );
+     else
+          ret = DocumentProviderNewInstance( provider, &instance );
+
+     if (ret)
+          return ret;
+
+     ret = instance->Init( instance, filename, projektor->idirectfb, projektor->format );
+     if (ret) {
+          if (projektor->isolate)
+               RemoteProviderDestroy( instance );
+          else
+               DocumentProviderDestroyInstance( instance );
+
+          return ret;
+     }
+
+     *ret_provider = instance;
+
+     return DFB_OK;
+}
+
+/*
+ * Open the document with another instance of a candidate provider.
+ */
+static DFBResult
+ProjektorOpenInstance( Projektor         *projektor,
+                       int                candidate,
+                       int                workers,
+                       DocumentProvider **ret_provider )
+{
+     return ProjektorOpenFile( projektor, projektor->candidates[candidate], projektor->filename, workers,
+                               ret_provider );
+}
+
+/*
+ * Spread mode: the partner provider is a second instance of the provider, or a second worker process when isolated,
+ * rendering the right page while the left one is rendered.
+ */
+
+static DFBResult
+ProjektorOpenPartner( Projektor *projektor,
+                      int        candidate )
+{
+     DFBResult         ret;
+     DocumentProvider *partner;
+
+     ret = ProjektorOpenInstance( projektor, candidate, 1, &partner );
+     if (ret)
+          return ret;
+
+     ProjektorLimitProvider( projektor, partner, 4 );
+
+     projektor->partner           = partner;
+     projektor->partner_candidate = candidate;
+
+     return DFB_OK;
+}
+
+static void
+ProjektorClosePartner( Projektor *projektor )
+{
+     ProjektorClose( projektor, projektor->partner );
+
+     projektor->partner = NULL;
+}
+
+/*
+ * First page of the spread showing a page, with the first page alone in cover mode.
+ */
+static int
+ProjektorSpreadFirst( Projektor *projektor,
+                      int        pageno )
+{
+     if (!projektor->spread || pageno < 2)
+          return pageno;
+
+     if (projektor->cover)
+          return pageno & ~1;
+
+     return (pageno - 1) | 1;
+}
+
+/*
+ * Second page of the spread starting at a page, 0 if there is none.
+ */
+static int
+ProjektorSpreadSecond( Projektor *projektor,
+                       int        pageno )
+{
+     if (!projektor->spread || (projektor->cover && pageno == 1) || pageno >= projektor->desc.num_pages)
+          return 0;
+
+     return pageno + 1;
+}
+
+/*
+ * Keep the geometry of a rendered page, and its render time if measured, in the metadata index. A page rendered
+ * cropped keeps the geometry recorded from a whole render, if any.
+ */
+static void
+ProjektorRecordPage( Projektor        *projektor,
+                     int               pageno,
+                     float             zoom,
+                     IDirectFBSurface *surface,
+                     long long         time )
+{
+     int                     width, height;
+     float                   w, h;
+     const ProjektorContent *content = ProjektorContentOf( projektor, pageno );
+
+     if (!projektor->metadata)
+          return;
+
+     if (ProjektorCropped( content )) {
+          if (MetadataGetPageSize( projektor->metadata, pageno, &w, &h ) == DFB_OK)
+               MetadataSetPage( projektor->metadata, pageno, w, h, time );
+
+          return;
+     }
+
+     surface->GetSize( surface, &width, &height );
+
+     MetadataSetPage( projektor->metadata, pageno, width / zoom, height / zoom, time );
+}
+
+/*
+ * Start on the page shown last, at the zoom factor used then unless one is set. With an optimal zoom factor, the page
+ * is fitted from its geometry if known, so that it is rendered once. Returns whether it has been fitted.
+ */
+static bool
+ProjektorResume( Projektor *projektor,
+                 bool       keep_zoom,
+                 bool       optimal,
+                 int        width,
+                 int        height,
+                 float     *zoom )
+{
+     DocumentDescription desc;
+     int                 pageno;
+     int                 second;
+     float               last_zoom;
+     float               w, h;
+     float               w2, h2;
+
+     projektor->start_page = 1;
+
+     if (!projektor->metadata || MetadataGetDescription( projektor->metadata, &desc ))
+          return false;
+
+     if (MetadataGetPosition( projektor->metadata, &pageno, &last_zoom ) == DFB_OK) {
+          projektor->start_page = ProjektorSpreadFirst( projektor, CLAMP( pageno, 1, desc.num_pages ) );
+
+          if (!keep_zoom && last_zoom >= 0.25f && last_zoom <= 2.5f)
+               *zoom = last_zoom;
+     }
+
+     if (!optimal || !width || !height ||
+         MetadataGetPageSize( projektor->metadata, projektor->start_page, &w, &h ))
+          return false;
+
+     second = projektor->start_page + 1;
+
+     if (projektor->spread && !(projektor->cover && second == 2) && second <= desc.num_pages) {
+          if (MetadataGetPageSize( projektor->metadata, second, &w2, &h2 ))
+               return false;
+
+          w += w2;
+          h  = MAX( h, h2 );
+     }
+
+     /* As done by ProjektorSetOptimal() for the page view. */
+     *zoom = CLAMP( MIN( width / w, (height - STATUS_BAR_HEIGHT) / h ), 0.25f, 2.5f );
+
+     return true;
+}
+
+static void *
+ProjektorOpenThread( DirectThread *thread,
+                     void         *arg )
+{
+     Projektor        *projektor = arg;
+     DocumentProvider *provider;
+
+     projektor->open_result = ProjektorOpen( projektor );
+     if (projektor->open_result)
+          return NULL;
+
+     /* On failure, the first page is rendered again by the main thread, with provider fallback. */
+     provider = projektor->provider;
+
+     ProjektorFlagProvider( projektor, provider, ProjektorDraftFlags( projektor ) );
+
+     if (ProjektorRenderContents( projektor, provider, projektor->start_page, projektor->zoom,
+                                  projektor->crop ? &projektor->first_content : NULL, false, &projektor->first_page ))
+          projektor->first_page = NULL;
+
+     return NULL;
+}
+
+static void *
+ProjektorPartnerThread( DirectThread *thread,
+                        void         *arg )
+{
+     Projektor           *projektor = arg;
+     DocumentDescription  desc;
+     int                  second    = projektor->start_page + 1;
+
+     /* The first candidate, dropped later if it is not the provider that opens the document. */
+     if (ProjektorOpenPartner( projektor, 0 ))
+          return NULL;
+
+     projektor->partner->GetDescription( projektor->partner, &desc );
+
+     ProjektorFlagProvider( projektor, projektor->partner, ProjektorDraftFlags( projektor ) );
+
+     /* Second page of the first spread, rendered with the first page. */
+     if ((projektor->cover && second == 2) || second > desc.num_pages ||
+         ProjektorRenderContents( projektor, projektor->partner, second, projektor->zoom,
+                                  projektor->crop ? &projektor->second_content : NULL, false,
+                                  &projektor->second_page ))
+          projektor->second_page = NULL;
+
+     return NULL;
+}
+
+static DFBResult
+ProjektorStart( Projektor             *projektor,
+                IDirectFB             *idirectfb,
+                const char            *filename,
+                DFBSurfacePixelFormat  format,
+                float                  zoom )
+{
+     projektor->idirectfb  = idirectfb;
+     projektor->filename   = filename;
+     projektor->format     = format;
+     projektor->zoom       = zoom;
+     projektor->candidate  = 0;
+     projektor->first_page = NULL;
+     projektor->contents   = NULL;
+
+     projektor->partner        = NULL;
+     projektor->partner_thread = NULL;
+     projektor->second_page    = NULL;
+
+     memset( &projektor->first_content, 0, sizeof(ProjektorContent) );
+     memset( &projektor->second_content, 0, sizeof(ProjektorContent) );
+
+     /* Open the document and render the first page while LiTE and the main window are set up. */
+     projektor->open_thread = direct_thread_create( DTT_DEFAULT, ProjektorOpenThread, projektor, "Open" );
+     if (!projektor->open_thread)
+          ProjektorOpenThread( NULL, projektor );
+
+     /* The partner is opened later if it cannot be opened now. */
+     if (projektor->spread)
+          projektor->partner_thread = direct_thread_create( DTT_DEFAULT, ProjektorPartnerThread, projektor, "Partner" );
+
+     return DFB_OK;
+}
+
+static DFBResult
+ProjektorWaitOpen( Projektor *projektor )
+{
+     if (projektor->open_thread) {
+          direct_thread_join( projektor->open_thread );
+          direct_thread_destroy( projektor->open_thread );
+
+          projektor->open_thread = NULL;
+     }
+
+     if (projektor->partner_thread) {
+          direct_thread_join( projektor->partner_thread );
+          direct_thread_destroy( projektor->partner_thread );
+
+          projektor->partner_thread = NULL;
+     }
+
+     return projektor->open_result;
+}
+
+/*
+ * Close what the open threads opened and rendered, when the viewer cannot be initialized.
+ */
+static void
+ProjektorDiscardOpen( Projektor *projektor )
+{
+     if (ProjektorWaitOpen( projektor ) == DFB_OK)
+          ProjektorClose( projektor, projektor->provider );
+
+     if (projektor->partner)
+          ProjektorClosePartner( projektor );
+
+     if (projektor->first_page) {
+          projektor->first_page->Release( projektor->first_page );
+          projektor->first_page = NULL;
+     }
+
+     if (projektor->second_page) {
+          projektor->second_page->Release( projektor->second_page );
+          projektor->second_page = NULL;
+     }
+}
+
+static DFBResult
+ProjektorInit( Projektor *projektor,
+               int        width,
+               int        height,
+               float      zoom,
+               int        cache_size )
+{
+     DFBResult           ret;
+     DocumentDescription desc;
+
+     /* Get the display layer size. */
+     if (!width || !height)
+          lite_get_layer_size( &width, &height );
+
+     /* Create the main window, double buffered in presenter mode so that an advance is a single flip. */
+     ret = MainWindowInit( &projektor->mainwin, width, height,
+                           projektor->presenter ? DWCAPS_DOUBLEBUFFER : DWCAPS_NONE );
+     if (ret) {
+          ProjektorWaitOpen( projektor );
+          return ret;
+     }
+
+     ret = EventLoopCreate( projektor->mainwin.window, &projektor->loop );
+     if (ret) {
+          ProjektorWaitOpen( projektor );
+          return ret;
+     }
+
+     /* Keep the current and the prefetched pages as surfaces, the next spread is always prefetched. */
+     projektor->prefetch     = (projektor->presenter || projektor->spread) ? 1 : 0;
+     projektor->max_prefetch = projektor->prefetch;
+
+     /* Half of the memory budget goes to the page cache, the rest is left for rendering. */
+     PageCache_Init( &projektor->cache, lite_get_dfb_interface(), projektor->mainwin.pageview,
+                     (projektor->spread ? 8 : 4) + 2 * projektor->prefetch, cache_size * 1024 * 1024UL,
+                     projektor->max_memory / 2 );
+
+     /* Install raw keyboard event callback. */
+     lite_on_raw_window_keyboard( projektor->mainwin.window, ProjektorKeyboardFunc, projektor );
+
+     /* Follow the links clicked. */
+     PageViewSetClickFunc( projektor->mainwin.pageview, ProjektorClick, projektor );
+
+     if (projektor->view)
+          ProjektorSetView( projektor, projektor->view );
+
+     /* Show the description known from the metadata index while the document is opened. */
+     if (projektor->metadata && MetadataGetDescription( projektor->metadata, &desc ) == DFB_OK) {
+          StatusBarSetTitle( projektor->mainwin.statusbar, desc.title );
+          StatusBarSetPage( projektor->mainwin.statusbar, projektor->start_page, projektor->start_page,
+                            desc.num_pages );
+
+          lite_draw_box( LITE_BOX(projektor->mainwin.window), NULL, DFB_TRUE );
+     }
+
+     /* Wait for the document provider, the first page goes to the cache. */
+     ret = ProjektorWaitOpen( projektor );
+     if (ret) {
+          StatusBarSetTitle( projektor->mainwin.statusbar, "Cannot open file" );
+          return ret;
+     }
+
+     if (projektor->metadata)
+          MetadataSetDescription( projektor->metadata, &projektor->desc );
+
+     /* Content boxes found with the first pages. */
+     ProjektorResetContents( projektor, NULL, projektor->desc.num_pages );
+
+     if (projektor->contents && projektor->start_page < projektor->desc.num_pages) {
+          projektor->contents[projektor->start_page-1] = projektor->first_content;
+          projektor->contents[projektor->start_page]   = projektor->second_content;
+     }
+     else if (projektor->contents && projektor->start_page == projektor->desc.num_pages)
+          projektor->contents[projektor->start_page-1] = projektor->first_content;
+
+     if (projektor->first_page) {
+          ProjektorRecordPage( projektor, projektor->start_page, zoom, projektor->first_page, 0 );
+
+          PageCacheInsert( &projektor->cache, projektor->start_page, zoom, ProjektorDraftFlags( projektor ),
+                           projektor->first_page );
+
+          projektor->first_page->Release( projektor->first_page );
+          projektor->first_page = NULL;
+     }
+
+     /* Keep the partner if it uses the provider that opened the document. */
+     if (projektor->partner && projektor->partner_candidate != projektor->candidate) {
+          if (projektor->second_page) {
+               projektor->second_page->Release( projektor->second_page );
+               projektor->second_page = NULL;
+          }
+
+          ProjektorClosePartner( projektor );
+     }
+
+     if (projektor->second_page) {
+          ProjektorRecordPage( projektor, projektor->start_page + 1, zoom, projektor->second_page, 0 );
+
+          PageCacheInsert( &projektor->cache, projektor->start_page + 1, zoom, ProjektorDraftFlags( projektor ),
+                           projektor->second_page );
+
+          projektor->second_page->Release( projektor->second_page );
+          projektor->second_page = NULL;
+     }
+
+     /* Release memory when tasks stall on memory for 100 ms within two seconds. */
+     if (PressureOpen( 100, &projektor->pressure ))
+          projektor->pressure = NULL;
+     else
+          EventLoopAddFd( projektor->loop, PressureGetFd( projektor->pressure ), POLLPRI, ProjektorPressureEvent,
+                          projektor );
+
+     projektor->pressure_time = 0;
+
+     /* Set status bar. */
+     StatusBarSetTitle( projektor->mainwin.statusbar, projektor->desc.title );
+     StatusBarSetZoom( projektor->mainwin.statusbar, 100 * zoom );
+
+     projektor->error        = false;
+     projektor->quit         = false;
+     projektor->pageno       = 0;
+     projektor->pageno_right = 0;
+     projektor->zoom         = zoom;
+     projektor->zoom_prev    = zoom;
+     projektor->drafted      = false;
+     projektor->painting     = 0;
+     projektor->render_time  = 0;
+     projektor->reloading    = false;
+
+     /* Links and outline are loaded when needed. */
+     projektor->links          = NULL;
+     projektor->num_links      = 0;
+     projektor->link_right     = false;
+     projektor->link           = -1;
+     projektor->num_history    = 0;
+     projektor->outline        = NULL;
+     projektor->num_outline    = 0;
+     projektor->outline_loaded = false;
+     projektor->outlineview    = NULL;
+
+     /* The file is watched once the first page is shown. */
+     projektor->watch        = NULL;
+     projektor->fingerprints = NULL;
+     projektor->reload_time  = 0;
+
+     /* The next document of the playlist is preloaded once the first page is shown. */
+     memset( &projektor->preload, 0, sizeof(ProjektorPreload) );
+
+     /* No goto page text line at startup. */
+     projektor->textline = NULL;
+
+     return DFB_OK;
+}
+
+static DFBResult
+ProjektorRenderPage( Projektor            *projektor,
+                     int                   pageno,
+                     float                 zoom,
+                     DocumentRenderFlags   flags,
+                     IDirectFBSurface    **ret_surface )
+{
+     DFBResult         ret;
+     long long         start;
+     DocumentProvider *provider = projektor->provider;
+
+     if (PageCacheLookup( &projektor->cache, pageno, zoom, flags, ret_surface ) == DFB_OK)
+          return DFB_OK;
+
+     start = direct_clock_get_micros();
+
+     ProjektorFlagProvider( projektor, provider, flags );
+
+     ret = ProjektorRenderContents( projektor, provider, pageno, zoom, ProjektorContentOf( projektor, pageno ),
+                                    pageno == projektor->painting, ret_surface );
+
+     /* Fall back to the next candidate provider, the current one is kept if none can open the file. */
+     while (ret && projektor->candidate + 1 < projektor->num_candidates) {
+          D_WARN( "%s cannot render page %d, falling back to %s", provider->impl, pageno,
+                  projektor->candidates[projektor->candidate+1]->impl );
+
+          projektor->candidate++;
+
+          if (ProjektorOpen( projektor ))
+               break;
+
+          ProjektorClose( projektor, provider );
+
+          provider = projektor->provider;
+
+          start = direct_clock_get_micros();
+
+          ProjektorFlagProvider( projektor, provider, flags );
+
+          ret = ProjektorRenderContents( projektor, provider, pageno, zoom, ProjektorContentOf( projektor, pageno ),
+                                         pageno == projektor->painting, ret_surface );
+     }
+
+     if (ret)
+          return ret;
+
+     projektor->render_time = direct_clock_get_micros() - start;
+
+     ProjektorRecordPage( projektor, pageno, zoom, *ret_surface, projektor->render_time );
+
+     PageCacheInsert( &projektor->cache, pageno, zoom, flags, *ret_surface );
+
+     return DFB_OK;
+}
+
+typedef struct {
+     Projektor        *projektor;
+     DocumentProvider *provider;
+     int               pageno;
+     float             zoom;
+     ProjektorContent *content;
+     IDirectFBSurface *surface;
+     DFBResult         result;
+     long long         time;
+} ProjektorRenderJob;
+
+static void *
+ProjektorRenderThread( DirectThread *thread,
+                       void         *arg )
+{
+     ProjektorRenderJob *job   = arg;
+     long long           start = direct_clock_get_micros();
+
+     job->result = ProjektorRenderContents( job->projektor, job->provider, job->pageno, job->zoom, job->content,
+                                            false, &job->surface );
+     job->time   = direct_clock_get_micros() - start;
+
+     return NULL;
+}
+
+/*
+ * Render a page, or the two pages of a spread concurrently, the right one by the partner provider. The right page is
+ * NULL if there is none.
+ */
+static DFBResult
+ProjektorRenderSpread( Projektor            *projektor,
+                       int                   pageno,
+                       float                 zoom,
+                       DocumentRenderFlags   flags,
+                       IDirectFBSurface    **ret_left,
+                       IDirectFBSurface    **ret_right )
+{
+     DFBResult           ret;
+     DirectThread       *thread = NULL;
+     ProjektorRenderJob  job    = { .projektor = projektor, .pageno = ProjektorSpreadSecond( projektor, pageno ),
+                                    .zoom = zoom };
+
+     *ret_right = NULL;
+
+     if (job.pageno && PageCacheLookup( &projektor->cache, job.pageno, zoom, flags, ret_right )) {
+          /* The partner follows the fallbacks of the provider. */
+          if (projektor->partner && projektor->partner_candidate != projektor->candidate)
+               ProjektorClosePartner( projektor );
+
+          if (!projektor->partner)
+               ProjektorOpenPartner( projektor, projektor->candidate );
+
+          if (projektor->partner) {
+               job.provider = projektor->partner;
+               job.content  = ProjektorContentOf( projektor, job.pageno );
+
+               ProjektorFlagProvider( projektor, job.provider, flags );
+
+               thread = direct_thread_create( DTT_DEFAULT, ProjektorRenderThread, &job, "Spread" );
+          }
+     }
+
+     ret = ProjektorRenderPage( projektor, pageno, zoom, flags, ret_left );
+
+     if (thread) {
+          direct_thread_join( thread );
+          direct_thread_destroy( thread );
+
+          if (job.result == DFB_OK) {
+               ProjektorRecordPage( projektor, job.pageno, zoom, job.surface, job.time );
+
+               PageCacheInsert( &projektor->cache, job.pageno, zoom, flags, job.surface );
+
+               *ret_right = job.surface;
+          }
+     }
+
+     /* Not rendered concurrently, or failed on the partner, the left page is shown alone if it fails again. */
+     if (job.pageno && !*ret_right && !ret && ProjektorRenderPage( projektor, job.pageno, zoom, flags, ret_right ))
+          *ret_right = NULL;
+
+     if (ret && *ret_right) {
+          (*ret_right)->Release( *ret_right );
+          *ret_right = NULL;
+     }
+
+     return ret;
+}
+
+/*
+ * Release memory: cached pages first, then prefetching, then the provider caches. They are restored once memory has
+ * not been short for ten seconds.
+ */
+static void
+ProjektorRelieve( Projektor *projektor )
+{
+     PageCacheEvict( &projektor->cache );
+
+     projektor->prefetch = 0;
+
+     ProjektorLimitProvider( projektor, projektor->provider, 16 );
+     ProjektorLimitProvider( projektor, projektor->partner, 16 );
+
+     projektor->pressure_time = direct_clock_get_millis();
+}
+
+static void
+ProjektorRecover( Projektor *projektor )
+{
+     projektor->prefetch = projektor->max_prefetch;
+
+     ProjektorLimitProvider( projektor, projektor->provider, 4 );
+     ProjektorLimitProvider( projektor, projektor->partner, 4 );
+
+     projektor->pressure_time = 0;
+}
+
+static bool
+ProjektorOutOfMemory( DFBResult ret )
+{
+     return ret == DFB_NOSYSTEMMEMORY || ret == DFB_NOVIDEOMEMORY;
+}
+
+/*
+ * Render a page that ran out of memory within the memory budget, after releasing memory, then at lower zoom factors.
+ */
+static DFBResult
+ProjektorRenderDegraded( Projektor            *projektor,
+                         int                   pageno,
+                         float                *zoom,
+                         DocumentRenderFlags   flags,
+                         IDirectFBSurface    **ret_left,
+                         IDirectFBSurface    **ret_right )
+{
+     DFBResult ret;
+
+     ProjektorRelieve( projektor );
+
+     ret = ProjektorRenderSpread( projektor, pageno, *zoom, flags, ret_left, ret_right );
+
+     while (ProjektorOutOfMemory( ret ) && *zoom > 0.25f) {
+          *zoom = MAX( *zoom - 0.25f, 0.25f );
+
+          ret = ProjektorRenderSpread( projektor, pageno, *zoom, flags, ret_left, ret_right );
+     }
+
+     if (!ret)
+          D_WARN( "page %d rendered at zoom %.2f to fit the memory budget", pageno, *zoom );
+
+     return ret;
+}
+
+/*
+ * Bytes per pixel of the pages shown, in the pixel format they are rendered to.
+ */
+static int
+ProjektorPageBytes( Projektor *projektor )
+{
+     DFBSurfacePixelFormat  format;
+     IDirectFBSurface      *image = projektor->mainwin.pageview->image;
+
+     if (!image || image->GetPixelFormat( image, &format ))
+          return 4;
+
+     return DFB_BYTES_PER_PIXEL( format );
+}
+
+/*
+ * Lower a zoom factor until the page, rendered and converted to a surface, fits in the memory budget left beside the
+ * page cache. The page size is estimated from the displayed page, or spread.
+ */
+static float
+ProjektorCapZoom( Projektor *projektor,
+                  float      zoom )
+{
+     int       width, height;
+     int       bytes;
+     PageView *pageview = projektor->mainwin.pageview;
+
+     if (!projektor->max_memory || !pageview->image)
+          return zoom;
+
+     PageViewGetImageSize( pageview, &width, &height );
+
+     bytes = ProjektorPageBytes( projektor );
+
+     while (zoom > 0.25f) {
+          float scale = zoom / projektor->zoom;
+
+          /* Providers render 32 bits per pixel, converted to the pixel format of the pages. */
+          if ((4.0f + bytes) * width * height * scale * scale <= projektor->max_memory / 2)
+               break;
+
+          zoom = MAX( zoom - 0.25f, 0.25f );
+     }
+
+     return zoom;
+}
+
+/*
+ * Idle task rendering the neighbouring pages or spreads ahead of time, nearest first, one per step.
+ */
+static bool
+ProjektorPrefetch( void *ctx )
+{
+     int               i, n;
+     IDirectFBSurface *image;
+     IDirectFBSurface *right;
+     int               width, height;
+     Projektor        *projektor = ctx;
+     unsigned long     page_size = 0;
+     int               step      = projektor->spread ? 2 : 1;
+
+     if (projektor->cache.max_size && PageViewGetImageSize( projektor->mainwin.pageview, &width, &height ) == DFB_OK)
+          page_size = (unsigned long) width * height * ProjektorPageBytes( projektor );
+
+     for (i = 1; i <= projektor->prefetch; i++) {
+          const int pages[2] = { projektor->pageno + i * step, projektor->pageno - i * step };
+
+          /* The prefetched pages have to fit in the page cache with the current one. */
+          if (page_size && (2 * i + 1) * page_size > projektor->cache.max_size)
+               break;
+
+          for (n = 0; n < 2; n++) {
+               int first, second;
+
+               if (pages[n] < 1 || pages[n] > projektor->desc.num_pages)
+                    continue;
+
+               first  = ProjektorSpreadFirst( projektor, pages[n] );
+               second = ProjektorSpreadSecond( projektor, first );
+
+               if (PageCacheHasSurface( &projektor->cache, first, projektor->zoom, projektor->flags ) &&
+                   (!second || PageCacheHasSurface( &projektor->cache, second, projektor->zoom, projektor->flags )))
+                    continue;
+
+               /* Failed pages are tried again by the next steps, after the following ones. */
+               if (ProjektorRenderSpread( projektor, first, projektor->zoom, projektor->flags,
+                                          &image, &right ) == DFB_OK) {
+                    image->Release( image );
+
+                    if (right)
+                         right->Release( right );
+
+                    return true;
+               }
+          }
+     }
+
+     return false;
+}
+
+/*
+ * Pages expected to render for longer than PROJEKTOR_PAINT_TIME are painted band by band as they are rendered. The
+ * estimate is the render time recorded for the page, or that of the last page rendered.
+ */
+
+#define PROJEKTOR_PAINT_TIME 200000
+
+static bool
+ProjektorSlowPage( Projektor *projektor,
+                   int        pageno )
+{
+     long long time = 0;
+
+     if (projektor->metadata)
+          time = MetadataGetRenderTime( projektor->metadata, pageno );
+
+     if (!time)
+          time = projektor->render_time;
+
+     return time > PROJEKTOR_PAINT_TIME;
+}
+
+/*
+ * Draft mode: a spread not rendered yet is shown without images first, the complete one replaces it when idle.
+ */
+static DocumentRenderFlags
+ProjektorShowFlags( Projektor *projektor,
+                    int        pageno,
+                    float      zoom )
+{
+     int second = ProjektorSpreadSecond( projektor, pageno );
+
+     if (!projektor->draft || (PageCacheHasPage( &projektor->cache, pageno, zoom, projektor->flags ) &&
+                               (!second || PageCacheHasPage( &projektor->cache, second, zoom, projektor->flags ))))
+          return projektor->flags;
+
+     return ProjektorDraftFlags( projektor );
+}
+
+static DFBResult
+ProjektorGotoPage( Projektor *projektor,
+                   int        pageno )
+{
+     DFBResult            ret;
+     IDirectFBSurface    *image;
+     IDirectFBSurface    *right;
+     long long            start;
+     long long            shown     = 0;
+     DocumentRenderFlags  flags;
+     float                zoom      = projektor->zoom;
+     PageView            *pageview  = projektor->mainwin.pageview;
+     StatusBar           *statusbar = projektor->mainwin.statusbar;
+
+     if (pageno < 1)
+          pageno = 1;
+
+     if (pageno > projektor->desc.num_pages)
+          pageno = projektor->desc.num_pages;
+
+     pageno = ProjektorSpreadFirst( projektor, pageno );
+
+     if (pageno == projektor->pageno)
+          return DFB_OK;
+
+     start = direct_clock_get_micros();
+
+     flags = ProjektorShowFlags( projektor, pageno, zoom );
+
+     /* Slow pages are painted while they are rendered, unless the pages shown are replaced at once. */
+     if (projektor->transition != TRANSITION_CROSSFADE && !projektor->reloading &&
+         ProjektorSlowPage( projektor, pageno ))
+          projektor->painting = pageno;
+
+     ret = ProjektorRenderSpread( projektor, pageno, zoom, flags, &image, &right );
+     if (ProjektorOutOfMemory( ret ) && projektor->max_memory)
+          ret = ProjektorRenderDegraded( projektor, pageno, &zoom, flags, &image, &right );
+
+     projektor->painting = 0;
+
+     PageViewEndProgress( pageview, ret != DFB_OK );
+
+     if (ret) {
+          StatusBarSetTitle( statusbar, "Cannot render page" );
+          projektor->error = true;
+          return ret;
+     }
+
+     if (projektor->error)
+          StatusBarSetTitle( statusbar, projektor->desc.title );
+
+     if (zoom != projektor->zoom) {
+          StatusBarSetZoom( statusbar, 100 * zoom );
+
+          projektor->zoom = zoom;
+     }
+
+     /* Update status bar. */
+     StatusBarSetProgress( statusbar, (float) (pageno - 1) / (projektor->desc.num_pages - 1) );
+     StatusBarSetPage( statusbar, pageno, right ? pageno + 1 : pageno, projektor->desc.num_pages );
+
+     if (projektor->transition == TRANSITION_CROSSFADE)
+          PageViewCrossfade( pageview, image, right, 8, &shown );
+     else
+          PageViewSetImage( pageview, image, right );
+
+     projektor->link = -1;
+
+     image->Release( image );
+
+     if (right)
+          right->Release( right );
+
+     /*
+      * In presenter mode, show the page now and check the advance against the latency budget, up to the first frame
+      * showing the new page when fading.
+      */
+     if (projektor->presenter) {
+          long long elapsed;
+
+          lite_draw_box( LITE_BOX(projektor->mainwin.window), NULL, DFB_TRUE );
+
+          elapsed = (shown ?: direct_clock_get_micros()) - start;
+
+          if (projektor->budget && elapsed > projektor->budget * 1000LL)
+               D_WARN( "advance to page %d took %lld.%03lld ms (budget %d ms)", pageno,
+                       elapsed / 1000, elapsed % 1000, projektor->budget );
+     }
+
+     projektor->pageno       = pageno;
+     projektor->pageno_right = right ? pageno + 1 : 0;
+     projektor->drafted      = flags != projektor->flags;
+
+     if (projektor->auto_advance)
+          projektor->advance_time = direct_clock_get_millis() + projektor->auto_advance;
+
+     /* Prefetching and the like once the page is shown. */
+     ProjektorScheduleIdle( projektor );
+
+     return DFB_OK;
+}
+
+static DFBResult
+ProjektorSetZoom( Projektor *projektor,
+                  float      zoom )
+{
+     DFBResult            ret;
+     IDirectFBSurface    *image;
+     IDirectFBSurface    *right;
+     DocumentRenderFlags  flags;
+     PageView            *pageview  = projektor->mainwin.pageview;
+     StatusBar           *statusbar = projektor->mainwin.statusbar;
+
+     if (zoom < 0.25f)
+          zoom = 0.25f;
+
+     if (zoom > 2.5f)
+          zoom = 2.5f;
+
+     zoom = ProjektorCapZoom( projektor, zoom );
+
+     if (zoom == projektor->zoom)
+          return DFB_OK;
+
+     flags = ProjektorShowFlags( projektor, projektor->pageno, zoom );
+
+     if (ProjektorSlowPage( projektor, projektor->pageno ))
+          projektor->painting = projektor->pageno;
+
+     ret = ProjektorRenderSpread( projektor, projektor->pageno, zoom, flags, &image, &right );
+     if (ProjektorOutOfMemory( ret ) && projektor->max_memory)
+          ret = ProjektorRenderDegraded( projektor, projektor->pageno, &zoom, flags, &image, &right );
+
+     projektor->painting = 0;
+
+     PageViewEndProgress( pageview, ret != DFB_OK );
+
+     if (ret) {
+          StatusBarSetTitle( statusbar, "Cannot render page" );
+          projektor->error = true;
+          return ret;
+     }
+
+     if (projektor->error)
+          StatusBarSetTitle( statusbar, projektor->desc.title );
+
+     PageViewSetImage( pageview, image, right );
+
+     projektor->link = -1;
+
+     image->Release( image );
+
+     if (right)
+          right->Release( right );
+
+     /* Update status bar. */
+     StatusBarSetZoom( statusbar, 100 * zoom );
+
+     projektor->zoom    = zoom;
+     projektor->drafted = flags != projektor->flags;
+
+     if (projektor->drafted)
+          ProjektorScheduleIdle( projektor );
+
+     return DFB_OK;
+}
+
+static DFBResult
+ProjektorSetOptimal( Projektor *projektor )
+{
+     DFBResult         ret;
+     int               width, height;
+     float             zw, zh;
+     float             zoom;
+     PageView         *pageview = projektor->mainwin.pageview;
+     DocumentProvider *provider = projektor->provider;
+
+     /* Get document description. */
+     provider->GetDescription( provider, &projektor->desc );
+
+     PageViewGetImageSize( pageview, &width, &height );
+
+     zw = (float) LITE_BOX(pageview)->rect.w / (width  / projektor->zoom);
+     zh = (float) LITE_BOX(pageview)->rect.h / (height / projektor->zoom);
+
+     zoom = (zw < zh) ? zw : zh;
+
+     if ((int) (100 * zoom / 25 + 0.5f) != (int) (100 * projektor->zoom / 25 + 0.5f)) {
+          projektor->zoom_prev = projektor->zoom;
+
+          ret = ProjektorSetZoom( projektor, zoom );
+     }
+     else
+          ret = ProjektorSetZoom( projektor, projektor->zoom_prev );
+
+     return ret;
+}
+
+/*
+ * Toggle render flags, the pages shown are rendered again with them. Pages cached with the previous flags are kept
+ * for toggling back.
+ */
+static DFBResult
+ProjektorToggleFlags( Projektor           *projektor,
+                      DocumentRenderFlags  flags )
+{
+     int pageno = projektor->pageno;
+
+     projektor->flags  ^= flags;
+     projektor->pageno  = 0;
+
+     return ProjektorGotoPage( projektor, pageno );
+}
+
+/*
+ * Toggle the crop mode, cached pages are cropped or not so they are released.
+ */
+static DFBResult
+ProjektorToggleCrop( Projektor *projektor )
+{
+     int pageno = projektor->pageno;
+
+     PageCacheRetain( &projektor->cache, NULL, 0 );
+
+     projektor->crop   = !projektor->crop;
+     projektor->pageno = 0;
+
+     return ProjektorGotoPage( projektor, pageno );
+}
+
+/*
+ * Links: the links of a page are queried from the provider when the page is first used for navigation, and kept in a
+ * spatial index for hit testing. Following a link goes through the page cache, a cached target is not rendered again.
+ */
+
+typedef struct {
+     DirectLink  link;
+
+     int         pageno;
+     LinkIndex  *index;                       /* NULL if the page has no links */
+} ProjektorLinks;
+
+static LinkIndex *
+ProjektorGetLinks( Projektor *projektor,
+                   int        pageno )
+{
+     ProjektorLinks   *links;
+     DocumentLink     *array    = NULL;
+     int               num      = 0;
+     DocumentProvider *provider = projektor->provider;
+
+     if (!pageno || !provider->GetLinks)
+          return NULL;
+
+     direct_list_foreach (links, projektor->links) {
+          if (links->pageno == pageno) {
+               direct_list_move_to_front( &projektor->links, &links->link );
+
+               return links->index;
+          }
+     }
+
+     links = D_CALLOC( 1, sizeof(ProjektorLinks) );
+     if (!links) {
+          D_OOM();
+          return NULL;
+     }
+
+     links->pageno = pageno;
+
+     if (provider->GetLinks( provider, pageno, &array, &num ) == DFB_OK) {
+          if (num && LinkIndexCreate( array, num, &links->index ))
+               links->index = NULL;
+
+          if (array)
+               D_FREE( array );
+     }
+
+     /* Drop the least recently used page. */
+     if (projektor->num_links == PROJEKTOR_LINK_PAGES) {
+          ProjektorLinks *last = (ProjektorLinks*) direct_list_get_last( projektor->links );
+
+          direct_list_remove( &projektor->links, &last->link );
+
+          if (last->index)
+               LinkIndexDestroy( last->index );
+
+          D_FREE( last );
+     }
+     else
+          projektor->num_links++;
+
+     direct_list_prepend( &projektor->links, &links->link );
+
+     return links->index;
+}
+
+static void
+ProjektorSelectLink( Projektor *projektor,
+                     bool       right,
+                     int        n )
+{
+     const DocumentLink *link;
+     DFBRectangle        rect;
+     int                 ox, oy;
+     int                 pageno;
+     float               zoom = projektor->zoom;
+
+     projektor->link_right = right;
+     projektor->link       = n;
+
+     if (n < 0) {
+          PageViewSetHighlight( projektor->mainwin.pageview, false, NULL );
+          return;
+     }
+
+     pageno = right ? projektor->pageno_right : projektor->pageno;
+     link   = LinkIndexGet( ProjektorGetLinks( projektor, pageno ), n );
+
+     ProjektorCropOffset( projektor, pageno, &ox, &oy );
+
+     rect.x = link->x1 * zoom;
+     rect.y = link->y1 * zoom;
+     rect.w = link->x2 * zoom - rect.x;
+     rect.h = link->y2 * zoom - rect.y;
+     rect.x -= ox;
+     rect.y -= oy;
+
+     PageViewSetHighlight( projektor->mainwin.pageview, right, &rect );
+}
+
+/*
+ * Select the next or previous link in reading order, going through the left page then the right one.
+ */
+static void
+ProjektorCycleLink( Projektor *projektor,
+                    int        dir )
+{
+     LinkIndex *index[2];
+     int        count[2];
+     bool       right = projektor->link_right;
+     int        n     = projektor->link;
+
+     index[0] = ProjektorGetLinks( projektor, projektor->pageno );
+     index[1] = ProjektorGetLinks( projektor, projektor->pageno_right );
+     count[0] = index[0] ? LinkIndexCount( index[0] ) : 0;
+     count[1] = index[1] ? LinkIndexCount( index[1] ) : 0;
+
+     if (!count[0] && !count[1])
+          return;
+
+     if (n < 0) {
+          right = dir < 0;
+          n     = dir > 0 ? -1 : count[right];
+     }
+
+     for (n += dir; n < 0 || n >= count[right];) {
+          right = !right;
+          n     = dir > 0 ? 0 : count[right] - 1;
+     }
+
+     ProjektorSelectLink( projektor, right, n );
+}
+
+/*
+ * Go to a page, remembering the current one for going back.
+ */
+static DFBResult
+ProjektorFollow( Projektor *projektor,
+                 int        pageno )
+{
+     /* Links within the pages shown are not kept in the history. */
+     if (ProjektorSpreadFirst( projektor, pageno ) == projektor->pageno)
+          return DFB_OK;
+
+     if (projektor->num_history == PROJEKTOR_HISTORY) {
+          memmove( projektor->history, projektor->history + 1, (PROJEKTOR_HISTORY - 1) * sizeof(int) );
+          projektor->num_history--;
+     }
+
+     projektor->history[projektor->num_history++] = projektor->pageno;
+
+     return ProjektorGotoPage( projektor, pageno );
+}
+
+static DFBResult
+ProjektorBack( Projektor *projektor )
+{
+     if (!projektor->num_history)
+          return DFB_OK;
+
+     return ProjektorGotoPage( projektor, projektor->history[--projektor->num_history] );
+}
+
+static void
+ProjektorClick( void *ctx,
+                bool  right,
+                int   x,
+                int   y )
+{
+     Projektor *projektor = ctx;
+     LinkIndex *index;
+     int        n;
+     int        ox, oy;
+     int        pageno;
+
+     /* The links are those of the pages replaced while a page is painted. */
+     if (projektor->outlineview || projektor->textline || projektor->painting)
+          return;
+
+     pageno = right ? projektor->pageno_right : projektor->pageno;
+
+     index = ProjektorGetLinks( projektor, pageno );
+     if (!index)
+          return;
+
+     /* Shown cropped, from the content box. */
+     ProjektorCropOffset( projektor, pageno, &ox, &oy );
+
+     n = LinkIndexHit( index, (x + ox) / projektor->zoom, (y + oy) / projektor->zoom );
+     if (n >= 0)
+          ProjektorFollow( projektor, LinkIndexGet( index, n )->pageno );
+}
+
+/*
+ * Release the link indexes and the outline, they are loaded again when needed.
+ */
+static void
+ProjektorForgetLinks( Projektor *projektor )
+{
+     ProjektorLinks *links, *next;
+
+     direct_list_foreach_safe (links, next, projektor->links) {
+          if (links->index)
+               LinkIndexDestroy( links->index );
+
+          D_FREE( links );
+     }
+
+     projektor->links     = NULL;
+     projektor->num_links = 0;
+     projektor->link      = -1;
+
+     if (projektor->outline)
+          D_FREE( projektor->outline );
+
+     projektor->outline        = NULL;
+     projektor->num_outline    = 0;
+     projektor->outline_loaded = false;
+}
+
+/*
+ * Outline overlay, with the section of the current page selected.
+ */
+static void
+ProjektorLoadOutline( Projektor *projektor )
+{
+     DocumentProvider *provider = projektor->provider;
+
+     if (projektor->outline_loaded)
+          return;
+
+     projektor->outline_loaded = true;
+
+     /* From the metadata index if the outline has been loaded before. */
+     if (!projektor->metadata ||
+         MetadataGetOutline( projektor->metadata, &projektor->outline, &projektor->num_outline )) {
+          if (provider->GetOutline &&
+              provider->GetOutline( provider, &projektor->outline, &projektor->num_outline ) == DFB_OK) {
+               if (projektor->metadata)
+                    MetadataSetOutline( projektor->metadata, projektor->outline, projektor->num_outline );
+          }
+          else {
+               projektor->outline     = NULL;
+               projektor->num_outline = 0;
+          }
+     }
+}
+
+static void
+ProjektorShowOutline( Projektor *projektor )
+{
+     int           i;
+     int           selected = 0;
+     LiteBox      *window   = LITE_BOX(projektor->mainwin.window);
+     DFBRectangle  rect     = {
+          window->rect.w / 8,
+          window->rect.h / 8,
+          window->rect.w * 3 / 4,
+          window->rect.h * 3 / 4
+     };
+
+     ProjektorLoadOutline( projektor );
+
+     if (!projektor->num_outline)
+          return;
+
+     for (i = 0; i < projektor->num_outline; i++) {
+          if (projektor->outline[i].pageno && projektor->outline[i].pageno <= projektor->pageno)
+               selected = i;
+     }
+
+     if (OutlineView_New( window, &rect, projektor->outline, projektor->num_outline, &projektor->outlineview ))
+          return;
+
+     OutlineViewSelect( projektor->outlineview, selected );
+}
+
+static void
+ProjektorHideOutline( Projektor *projektor )
+{
+     lite_destroy_box( LITE_BOX(projektor->outlineview) );
+     projektor->outlineview = NULL;
+}
+
+static DFBResult
+ProjektorOutlineKey( Projektor      *projektor,
+                     DFBWindowEvent *evt )
+{
+     int          pageno;
+     OutlineView *outlineview = projektor->outlineview;
+
+     if (evt->type != DWET_KEYDOWN)
+          return DFB_BUSY;
+
+     switch (evt->key_symbol) {
+          case DIKS_CURSOR_UP:
+               OutlineViewSelect( outlineview, outlineview->selected - 1 );
+               break;
+
+          case DIKS_CURSOR_DOWN:
+               OutlineViewSelect( outlineview, outlineview->selected + 1 );
+               break;
+
+          case DIKS_PAGE_UP:
+          case DIKS_CHANNEL_UP:
+               OutlineViewSelect( outlineview, outlineview->selected - outlineview->num_labels );
+               break;
+
+          case DIKS_PAGE_DOWN:
+          case DIKS_CHANNEL_DOWN:
+               OutlineViewSelect( outlineview, outlineview->selected + outlineview->num_labels );
+               break;
+
+          case DIKS_HOME:
+               OutlineViewSelect( outlineview, 0 );
+               break;
+
+          case DIKS_END:
+               OutlineViewSelect( outlineview, outlineview->num_entries - 1 );
+               break;
+
+          case DIKS_ENTER:
+          case DIKS_OK:
+               pageno = outlineview->entries[outlineview->selected].pageno;
+
+               ProjektorHideOutline( projektor );
+
+               if (pageno)
+                    ProjektorFollow( projektor, pageno );
+               break;
+
+          case DIKS_ESCAPE:
+          case DIKS_MUTE:
+          case DIKS_SMALL_O:
+          case DIKS_EPG:
+               ProjektorHideOutline( projektor );
+               break;
+
+          default:
+               break;
+     }
+
+     return DFB_BUSY;
+}
+
+/*
+ * Idle tasks, run by the event loop while no event is pending: completing the pages shown in draft mode, prefetching,
+ * indexing the links and the outline of the document, and compressing the page cache ahead of time. A step renders a
+ * page or a spread at most, input waits for it.
+ */
+
+#define PROJEKTOR_COMPLETE_BUDGET 20000
+#define PROJEKTOR_PREFETCH_BUDGET 20000
+#define PROJEKTOR_INDEX_BUDGET     5000
+#define PROJEKTOR_MAINTAIN_BUDGET  5000
+
+static bool
+ProjektorComplete( void *ctx )
+{
+     IDirectFBSurface *image;
+     IDirectFBSurface *right;
+     Projektor        *projektor = ctx;
+
+     if (!projektor->drafted)
+          return false;
+
+     projektor->drafted = false;
+
+     if (ProjektorRenderSpread( projektor, projektor->pageno, projektor->zoom, projektor->flags, &image, &right ))
+          return false;
+
+     PageViewSetImage( projektor->mainwin.pageview, image, right );
+
+     projektor->link = -1;
+
+     image->Release( image );
+
+     if (right)
+          right->Release( right );
+
+     return false;
+}
+
+static bool
+ProjektorIndex( void *ctx )
+{
+     Projektor *projektor = ctx;
+
+     ProjektorGetLinks( projektor, projektor->pageno );
+     ProjektorGetLinks( projektor, projektor->pageno_right );
+
+     ProjektorLoadOutline( projektor );
+
+     return false;
+}
+
+static bool
+ProjektorMaintain( void *ctx )
+{
+     Projektor *projektor = ctx;
+
+     PageCachePrecompress( &projektor->cache );
+
+     return false;
+}
+
+static void
+ProjektorScheduleIdle( Projektor *projektor )
+{
+     EventLoopAddIdle( projektor->loop, ProjektorComplete, projektor, PROJEKTOR_COMPLETE_BUDGET );
+     EventLoopAddIdle( projektor->loop, ProjektorPrefetch, projektor, PROJEKTOR_PREFETCH_BUDGET );
+     EventLoopAddIdle( projektor->loop, ProjektorIndex,    projektor, PROJEKTOR_INDEX_BUDGET );
+     EventLoopAddIdle( projektor->loop, ProjektorMaintain, projektor, PROJEKTOR_MAINTAIN_BUDGET );
+}
+
+/*
+ * Live reload: the document is opened again once it has not changed for half a second, and replaces the current one
+ * when open. Cached pages are kept if their fingerprint is unchanged, the pages shown stay on screen until the new
+ * ones are rendered.
+ */
+
+static u64 *
+ProjektorFingerprints( DocumentProvider *provider,
+                       int               num_pages )
+{
+     u64 *fingerprints;
+
+     if (!provider->GetFingerprints)
+          return NULL;
+
+     fingerprints = D_MALLOC( num_pages * sizeof(u64) );
+     if (!fingerprints)
+          return NULL;
+
+     if (provider->GetFingerprints( provider, fingerprints )) {
+          D_FREE( fingerprints );
+          return NULL;
+     }
+
+     return fingerprints;
+}
+
+static void
+ProjektorWatchEvent( void *ctx )
+{
+     Projektor *projektor = ctx;
+
+     if (WatchCheck( projektor->watch ))
+          projektor->reload_time = direct_clock_get_millis() + 500;
+}
+
+static void
+ProjektorWatch( Projektor *projektor )
+{
+     if (WatchOpen( projektor->filename, &projektor->watch )) {
+          projektor->watch = NULL;
+          return;
+     }
+
+     EventLoopAddFd( projektor->loop, WatchGetFd( projektor->watch ), POLLIN, ProjektorWatchEvent, projektor );
+
+     projektor->fingerprints = ProjektorFingerprints( projektor->provider, projektor->desc.num_pages );
+}
+
+static void
+ProjektorUnwatch( Projektor *projektor )
+{
+     EventLoopRemoveFd( projektor->loop, WatchGetFd( projektor->watch ) );
+
+     WatchClose( projektor->watch );
+
+     if (projektor->fingerprints)
+          D_FREE( projektor->fingerprints );
+
+     projektor->watch        = NULL;
+     projektor->fingerprints = NULL;
+     projektor->reload_time  = 0;
+}
+
+static DFBResult
+ProjektorReload( Projektor *projektor )
+{
+     DFBResult            ret;
+     int                  i;
+     DocumentProvider    *provider;
+     DocumentDescription  desc;
+     u64                 *fingerprints;
+     bool                *keep   = NULL;
+     int                  kept   = 0;
+     int                  pageno = projektor->pageno;
+
+     /* The current document is kept if the new one cannot be opened, until the next change. */
+     ret = ProjektorOpenInstance( projektor, projektor->candidate, projektor->isolate, &provider );
+     if (ret) {
+          D_WARN( "cannot reload %s", projektor->filename );
+          return ret;
+     }
+
+     provider->GetDescription( provider, &desc );
+
+     fingerprints = ProjektorFingerprints( provider, desc.num_pages );
+
+     if (fingerprints && projektor->fingerprints) {
+          keep = D_CALLOC( desc.num_pages, sizeof(bool) );
+
+          for (i = 0; keep && i < MIN( desc.num_pages, projektor->desc.num_pages ); i++) {
+               keep[i] = fingerprints[i] == projektor->fingerprints[i];
+               if (keep[i])
+                    kept++;
+          }
+     }
+
+     PageCacheRetain( &projektor->cache, keep, keep ? desc.num_pages : 0 );
+
+     /* Unchanged pages are kept cropped. */
+     ProjektorResetContents( projektor, keep, desc.num_pages );
+
+     D_INFO( "Projektor: Reloaded %s, %d of %d pages unchanged\n", projektor->filename, kept, desc.num_pages );
+
+     if (keep)
+          D_FREE( keep );
+
+     /* Swap the providers, the partner is opened again when needed. */
+     if (projektor->partner)
+          ProjektorClosePartner( projektor );
+
+     ProjektorClose( projektor, projektor->provider );
+
+     projektor->provider = provider;
+     projektor->desc     = desc;
+
+     ProjektorLimitProvider( projektor, provider, 4 );
+
+     if (projektor->fingerprints)
+          D_FREE( projektor->fingerprints );
+
+     projektor->fingerprints = fingerprints;
+
+     /* Links, outline and metadata may have changed with the contents. */
+     if (projektor->outlineview)
+          ProjektorHideOutline( projektor );
+
+     ProjektorForgetLinks( projektor );
+
+     if (projektor->metadata) {
+          MetadataClose( projektor->metadata );
+
+          if (MetadataOpen( projektor->filename, &projektor->metadata ))
+               projektor->metadata = NULL;
+          else
+               MetadataSetDescription( projektor->metadata, &desc );
+     }
+
+     StatusBarSetTitle( projektor->mainwin.statusbar, desc.title );
+
+     projektor->pageno = 0;
+
+     /* The changed pages replace the previous ones once rendered. */
+     projektor->reloading = true;
+
+     ret = ProjektorGotoPage( projektor, pageno );
+
+     projektor->reloading = false;
+
+     return ret;
+}
+
+/*
+ * Playlist: documents are shown in turn, for the dwell time of their entry on each page of their range. The next
+ * document is opened by another provider instance and its first page rendered in the background, so that switching
+ * to it is a page flip.
+ */
+
+static void
+ProjektorPreloadDocument( Projektor *projektor )
+{
+     ProjektorPreload *preload   = &projektor->preload;
+     PlaylistEntry    *entry     = &projektor->playlist->entries[preload->entry];
+     DocumentProvider *provider  = NULL;
+     int               second;
+     int               width, height;
+     int               width2, height2;
+     float             zoom;
+
+     for (; preload->candidate < preload->num_candidates; preload->candidate++) {
+          if (ProjektorOpenFile( projektor, preload->candidates[preload->candidate], entry->filename,
+                                 projektor->isolate, &provider ) == DFB_OK)
+               break;
+     }
+
+     if (!provider)
+          return;
+
+     ProjektorLimitProvider( projektor, provider, 4 );
+
+     provider->GetDescription( provider, &preload->desc );
+
+     preload->provider = provider;
+     preload->pageno   = ProjektorSpreadFirst( projektor, MIN( entry->first, preload->desc.num_pages ) );
+
+     /* As ProjektorSpreadSecond(), for the next document. */
+     second = preload->pageno + 1;
+
+     if (!projektor->spread || (projektor->cover && second == 2) || second > preload->desc.num_pages)
+          second = 0;
+
+     ProjektorFlagProvider( projektor, provider, preload->flags );
+
+     while (true) {
+          if (ProjektorRenderContents( projektor, provider, preload->pageno, preload->zoom,
+                                       preload->crop ? &preload->contents[0] : NULL, false, &preload->left )) {
+               preload->left = NULL;
+               return;
+          }
+
+          if (second && ProjektorRenderContents( projektor, provider, second, preload->zoom,
+                                                 preload->crop ? &preload->contents[1] : NULL, false,
+                                                 &preload->right ))
+               preload->right = NULL;
+
+          if (!preload->width || !preload->height)
+               break;
+
+          /* Fit the pages to the page view, as done by ProjektorSetOptimal(). */
+          preload->left->GetSize( preload->left, &width, &height );
+
+          if (preload->right) {
+               preload->right->GetSize( preload->right, &width2, &height2 );
+
+               width  += width2;
+               height  = MAX( height, height2 );
+          }
+
+          zoom = CLAMP( MIN( preload->width  / (width  / preload->zoom),
+                             preload->height / (height / preload->zoom) ), 0.25f, 2.5f );
+
+          preload->width  = 0;
+          preload->height = 0;
+
+          if ((int) (100 * zoom + 0.5f) == (int) (100 * preload->zoom + 0.5f))
+               break;
+
+          preload->zoom = zoom;
+
+          preload->left->Release( preload->left );
+          preload->left = NULL;
+
+          if (preload->right) {
+               preload->right->Release( preload->right );
+               preload->right = NULL;
+          }
+     }
+
+     return;
+}
+
+static void
+ProjektorJoinPreload( Projektor *projektor )
+{
+     ProjektorPreload *preload = &projektor->preload;
+
+     if (preload->thread) {
+          direct_thread_join( preload->thread );
+          direct_thread_destroy( preload->thread );
+
+          preload->thread = NULL;
+     }
+}
+
+static void
+ProjektorPreloaded( void *ctx )
+{
+     ProjektorJoinPreload( ctx );
+}
+
+static void *
+ProjektorPreloadThread( DirectThread *thread,
+                        void         *arg )
+{
+     Projektor *projektor = arg;
+
+     ProjektorPreloadDocument( projektor );
+
+     /* Joined by the main loop once done. */
+     if (thread)
+          EventLoopPost( projektor->loop, ProjektorPreloaded, projektor );
+
+     return NULL;
+}
+
+/*
+ * Release the preloaded document, if not switched to.
+ */
+static void
+ProjektorDropPreload( Projektor *projektor )
+{
+     ProjektorPreload *preload = &projektor->preload;
+
+     ProjektorJoinPreload( projektor );
+
+     EventLoopCancel( projektor->loop, ProjektorPreloaded, projektor );
+
+     if (preload->left)
+          preload->left->Release( preload->left );
+
+     if (preload->right)
+          preload->right->Release( preload->right );
+
+     if (preload->provider)
+          ProjektorClose( projektor, preload->provider );
+
+     memset( preload, 0, sizeof(ProjektorPreload) );
+}
+
+static void
+ProjektorPreloadEntry( Projektor *projektor,
+                       int        entry )
+{
+     ProjektorPreload *preload  = &projektor->preload;
+     const char       *filename = projektor->playlist->entries[entry].filename;
+
+     ProjektorDropPreload( projektor );
+
+     preload->entry = entry;
+     preload->zoom  = projektor->zoom;
+     preload->flags = projektor->flags;
+     preload->crop  = projektor->crop;
+
+     memset( preload->contents, 0, sizeof(preload->contents) );
+
+     if (projektor->optimal) {
+          preload->width  = LITE_BOX(projektor->mainwin.pageview)->rect.w;
+          preload->height = LITE_BOX(projektor->mainwin.pageview)->rect.h;
+     }
+
+     /* Providers are ranked here, as modules may be loaded. */
+     if (projektor->renderer) {
+          preload->candidates[0]  = projektor->renderer;
+          preload->num_candidates = 1;
+     }
+     else if (DocumentProviderRank( filename, preload->candidates, &preload->num_candidates ))
+          return;
+
+     preload->thread = direct_thread_create( DTT_DEFAULT, ProjektorPreloadThread, projektor, "Preload" );
+     if (!preload->thread)
+          ProjektorPreloadThread( NULL, projektor );
+}
+
+/*
+ * Switch to the preloaded document, or skip it if it cannot be opened.
+ */
+static DFBResult
+ProjektorSwitch( Projektor *projektor )
+{
+     ProjektorPreload *preload   = &projektor->preload;
+     PlaylistEntry    *entry     = &projektor->playlist->entries[preload->entry];
+     StatusBar        *statusbar = projektor->mainwin.statusbar;
+     int               next      = (preload->entry + 1) % projektor->playlist->num_entries;
+
+     ProjektorJoinPreload( projektor );
+
+     EventLoopCancel( projektor->loop, ProjektorPreloaded, projektor );
+
+     if (!preload->provider || !preload->left) {
+          D_WARN( "cannot open %s, skipping it", entry->filename );
+
+          ProjektorPreloadEntry( projektor, next != projektor->entry ? next : preload->entry );
+
+          projektor->pageno = 0;
+
+          return ProjektorGotoPage( projektor, projektor->playlist->entries[projektor->entry].first );
+     }
+
+     /* Swap the providers, the partner is opened again when needed. */
+     if (projektor->partner)
+          ProjektorClosePartner( projektor );
+
+     ProjektorClose( projektor, projektor->provider );
+
+     memcpy( projektor->candidates, preload->candidates, sizeof(projektor->candidates) );
+
+     projektor->num_candidates = preload->num_candidates;
+     projektor->candidate      = preload->candidate;
+     projektor->provider       = preload->provider;
+     projektor->desc           = preload->desc;
+     projektor->filename       = entry->filename;
+     projektor->entry          = preload->entry;
+     projektor->auto_advance   = entry->dwell ?: projektor->dwell;
+
+     /* Pages, links and outline of the previous document. */
+     PageCacheRetain( &projektor->cache, NULL, 0 );
+
+     if (projektor->outlineview)
+          ProjektorHideOutline( projektor );
+
+     ProjektorForgetLinks( projektor );
+
+     ProjektorResetContents( projektor, NULL, projektor->desc.num_pages );
+
+     /* The first pages come from the cache, unless the crop mode was toggled meanwhile. */
+     if (preload->crop == projektor->crop) {
+          PageCacheInsert( &projektor->cache, preload->pageno, preload->zoom, preload->flags, preload->left );
+
+          if (preload->right)
+               PageCacheInsert( &projektor->cache, preload->pageno + 1, preload->zoom, preload->flags,
+                                preload->right );
+
+          if (projektor->contents) {
+               projektor->contents[preload->pageno-1] = preload->contents[0];
+
+               if (preload->right)
+                    projektor->contents[preload->pageno] = preload->contents[1];
+          }
+     }
+
+     preload->left->Release( preload->left );
+
+     if (preload->right)
+          preload->right->Release( preload->right );
+
+     if (preload->zoom != projektor->zoom) {
+          StatusBarSetZoom( statusbar, 100 * preload->zoom );
+
+          projektor->zoom = preload->zoom;
+     }
+
+     StatusBarSetTitle( statusbar, projektor->desc.title );
+
+     projektor->pageno = 0;
+
+     ProjektorGotoPage( projektor, preload->pageno );
+
+     memset( preload, 0, sizeof(ProjektorPreload) );
+
+     /* Watch the new file instead. */
+     if (projektor->watch) {
+          ProjektorUnwatch( projektor );
+          ProjektorWatch( projektor );
+     }
+
+     if (next != projektor->entry)
+          ProjektorPreloadEntry( projektor, next );
+
+     return DFB_OK;
+}
+
+/*
+ * Advance to the next page of the range, or to the next document at the end of it.
+ */
+static DFBResult
+ProjektorPlaylistAdvance( Projektor *projektor )
+{
+     PlaylistEntry *entry = &projektor->playlist->entries[projektor->entry];
+     int            last  = entry->last ? MIN( entry->last, projektor->desc.num_pages ) : projektor->desc.num_pages;
+
+     if ((projektor->pageno_right ?: projektor->pageno) < last)
+          return ProjektorGotoPage( projektor, projektor->pageno + (projektor->spread ? 2 : 1) );
+
+     if (projektor->preload.thread || projektor->preload.provider || projektor->preload.entry != projektor->entry)
+          return ProjektorSwitch( projektor );
+
+     /* Alone in the playlist. */
+     return ProjektorGotoPage( projektor, entry->first );
+}
+
+static void
+ProjektorPressureEvent( void *ctx )
+{
+     ProjektorRelieve( ctx );
+}
+
+static DFBResult
+ProjektorEventLoop( Projektor *projektor )
+{
+     while (!projektor->quit) {
+          long long now      = direct_clock_get_millis();
+          long long deadline = 0;
+
+          /* Advance to the next page, or back to the first one, when the page has been shown long enough. */
+          if (projektor->auto_advance) {
+               if (projektor->advance_time <= now) {
+                    if (projektor->playlist)
+                         ProjektorPlaylistAdvance( projektor );
+                    else if ((projektor->pageno_right ?: projektor->pageno) < projektor->desc.num_pages)
+                         ProjektorGotoPage( projektor, projektor->pageno + (projektor->spread ? 2 : 1) );
+                    else
+                         ProjektorGotoPage( projektor, 1 );
+
+                    projektor->advance_time = direct_clock_get_millis() + projektor->auto_advance;
+
+                    EventLoopFlush( projektor->loop );
+
+                    continue;
+               }
+
+               deadline = projektor->advance_time;
+          }
+
+          /* Reload the document once it has not changed for half a second. */
+          if (projektor->reload_time) {
+               if (projektor->reload_time <= now) {
+                    projektor->reload_time = 0;
+
+                    ProjektorReload( projektor );
+
+                    EventLoopFlush( projektor->loop );
+
+                    continue;
+               }
+
+               if (!deadline || projektor->reload_time < deadline)
+                    deadline = projektor->reload_time;
+          }
+
+          /* Restore the caches once memory has not been short for a while. */
+          if (projektor->pressure_time) {
+               if (now - projektor->pressure_time > 10000) {
+                    ProjektorRecover( projektor );
+                    continue;
+               }
+
+               if (!deadline || projektor->pressure_time + 10000 < deadline)
+                    deadline = projektor->pressure_time + 10000;
+          }
+
+          /* Wait for window events, file changes, memory pressure and completions until the next deadline. */
+          EventLoopIterate( projektor->loop, deadline * 1000 );
+     }
+
+     return DFB_OK;
+}
+
+static DFBResult
+ProjektorReplay( Projektor *projektor,
+                 Trace     *trace,
+                 float      speed )
+{
+     DFBWindowEvent   evt;
+     DFBWindowID      id;
+     long long        time;
+     long long        start;
+     IDirectFBWindow *window   = projektor->mainwin.window->window;
+     PageView        *pageview = projektor->mainwin.pageview;
+
+     window->GetID( window, &id );
+
+     start = direct_clock_get_micros();
+
+     while (!projektor->quit && TraceRead( trace, &time, &evt ) == DFB_OK) {
+          long long    sent;
+          unsigned int draws  = pageview->draws;
+          unsigned int events = projektor->events;
+
+          /* Keep the recorded pace scaled by the speed factor, or replay as fast as possible with a zero speed. */
+          if (speed) {
+               long long due = start + time / speed;
+
+               while (direct_clock_get_micros() < due)
+                    EventLoopIterate( projektor->loop, due );
+
+               /* An event arriving while the previous one is handled waits in the queue. */
+               sent = due;
+          }
+          else
+               sent = direct_clock_get_micros();
+
+          evt.window_id = id;
+
+          window->SendEvent( window, &evt );
+
+          /* Dispatch the event, then let pending updates be drawn. */
+          while (projektor->events == events && !projektor->quit &&
+                 direct_clock_get_micros() - sent < 1000000)
+               lite_window_event_loop( projektor->mainwin.window, 1 );
+
+          lite_window_event_loop( projektor->mainwin.window, 1 );
+
+          if (pageview->draws != draws)
+               TraceLatency( trace, pageview->draw_time - sent );
+     }
+
+     TraceHistogram( trace );
+
+     return DFB_OK;
+}
+
+/*
+ * Keys pressed while a page is painted are dispatched by the updates drawn during its render. They are handled once
+ * the main loop runs again.
+ */
+
+typedef struct {
+     Projektor      *projektor;
+     DFBWindowEvent  evt;
+} ProjektorKey;
+
+static void
+ProjektorDeferredKey( void *ctx )
+{
+     ProjektorKey *key = ctx;
+
+     ProjektorKeyboardFunc( &key->evt, key->projektor );
+
+     D_FREE( key );
+}
+
+static DFBResult
+ProjektorDeferKey( Projektor      *projektor,
+                   DFBWindowEvent *evt )
+{
+     ProjektorKey *key;
+
+     key = D_MALLOC( sizeof(ProjektorKey) );
+     if (!key)
+          return D_OOM();
+
+     key->projektor = projektor;
+     key->evt       = *evt;
+
+     if (EventLoopPost( projektor->loop, ProjektorDeferredKey, key ))
+          D_FREE( key );
+
+     return DFB_BUSY;
+}
+
+static DFBResult
+ProjektorKeyboardFunc( DFBWindowEvent *evt,
+                       void           *data )
+{
+     Projektor *projektor = data;
+     PageView  *pageview  = projektor->mainwin.pageview;
+
+     if (projektor->painting)
+          return ProjektorDeferKey( projektor, evt );
+
+     if (projektor->record)
+          TraceRecord( projektor->record, evt );
+
+     projektor->events++;
+
+     if (projektor->outlineview)
+          return ProjektorOutlineKey( projektor, evt );
+
+     switch (evt->key_symbol) {
+          case DIKS_CURSOR_UP:
+               if (evt->type == DWET_KEYDOWN)
+                    PageViewScroll( pageview, 0, -LITE_BOX(pageview)->rect.h / 5 );
+
+               return DFB_BUSY;
+
+          case DIKS_CURSOR_DOWN:
+               if (evt->type == DWET_KEYDOWN)
+                    PageViewScroll( pageview, 0, LITE_BOX(pageview)->rect.h / 5 );
+
+               return DFB_BUSY;
+
+          case DIKS_CURSOR_LEFT:
+               if (projektor->textline)
+                    return DFB_OK;
+
+               if (evt->type == DWET_KEYDOWN)
+                    PageViewScroll( pageview, -LITE_BOX(pageview)->rect.w / 5, 0 );
+
+               return DFB_BUSY;
+
+          case DIKS_CURSOR_RIGHT:
+               if (projektor->textline)
+                    return DFB_OK;
+
+               if (evt->type == DWET_KEYDOWN)
+                    PageViewScroll( pageview, LITE_BOX(pageview)->rect.w / 5, 0 );
+
+               return DFB_BUSY;
+
+          case DIKS_PAGE_UP:
+          case DIKS_CHANNEL_UP:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorGotoPage( projektor, projektor->pageno - (projektor->spread ? 2 : 1) );
+
+               return DFB_BUSY;
+
+          case DIKS_PAGE_DOWN:
+          case DIKS_CHANNEL_DOWN:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorGotoPage( projektor, projektor->pageno + (projektor->spread ? 2 : 1) );
+
+               return DFB_BUSY;
+
+          case DIKS_HOME:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorGotoPage( projektor, 1 );
+
+               return DFB_BUSY;
+
+          case DIKS_END:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorGotoPage( projektor, projektor->desc.num_pages );
+
+               return DFB_BUSY;
+
+          case DIKS_PLUS_SIGN:
+          case DIKS_VOLUME_UP:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorSetZoom( projektor, projektor->zoom + 0.25f );
+
+               return DFB_BUSY;
+
+          case DIKS_MINUS_SIGN:
+          case DIKS_VOLUME_DOWN:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorSetZoom( projektor, projektor->zoom - 0.25f );
+
+               return DFB_BUSY;
+
+          case DIKS_SPACE:
+          case DIKS_MENU:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorSetOptimal( projektor );
+
+               return DFB_BUSY;
+
+          case DIKS_0:
+          case DIKS_1:
+          case DIKS_2:
+          case DIKS_3:
+          case DIKS_4:
+          case DIKS_5:
+          case DIKS_6:
+          case DIKS_7:
+          case DIKS_8:
+          case DIKS_9:
+               if (projektor->textline)
+                    return DFB_OK;
+
+               if (evt->type == DWET_KEYDOWN) {
+                    DFBResult    ret;
+                    char         initial_text[2] = { evt->key_symbol, 0 };
+                    DFBRectangle rect            = {
+                         (projektor->mainwin.window->box.rect.w - 54) / 2,
+                         (projektor->mainwin.window->box.rect.h - 27) / 2,
+                         54,
+                         27
+                    };
+
+                    ret = lite_new_textline( LITE_BOX(projektor->mainwin.window), &rect, liteNoTextLineTheme,
+                                             &projektor->textline );
+                    if (ret)
+                         break;
+
+                    lite_set_textline_text( projektor->textline, initial_text );
+
+                    lite_focus_box( LITE_BOX(projektor->textline) );
+               }
+
+               return DFB_BUSY;
+
+          case DIKS_BACKSPACE:
+          case DIKS_DELETE:
+               if (projektor->textline)
+                    return DFB_OK;
+
+               if (evt->type == DWET_KEYDOWN && evt->key_symbol == DIKS_BACKSPACE)
+                    ProjektorBack( projektor );
+
+               return DFB_BUSY;
+
+          case DIKS_BACK:
+               if (evt->type == DWET_KEYDOWN)
+                    ProjektorBack( projektor );
+
+               return DFB_BUSY;
+
+          case DIKS_TAB:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorCycleLink( projektor, (evt->modifiers & DIMM_SHIFT) ? -1 : 1 );
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_O:
+          case DIKS_EPG:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorShowOutline( projektor );
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_A:
+          case DIKS_RED:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorToggleFlags( projektor, DOCUMENT_RENDER_NO_ANNOTATIONS );
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_L:
+          case DIKS_GREEN:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorToggleFlags( projektor, DOCUMENT_RENDER_HIDE_LAYERS );
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_I:
+          case DIKS_YELLOW:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    projektor->draft = !projektor->draft;
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_V:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorSetView( projektor, (projektor->view + 1) % PROJEKTOR_NUM_VIEWS );
+
+               return DFB_BUSY;
+
+          case DIKS_SMALL_M:
+          case DIKS_BLUE:
+               if (evt->type == DWET_KEYDOWN && !projektor->textline)
+                    ProjektorToggleCrop( projektor );
+
+               return DFB_BUSY;
+
+          case DIKS_ENTER:
+          case DIKS_OK:
+               if (projektor->textline) {
+                    char *text;
+
+                    lite_get_textline_text( projektor->textline, &text );
+
+                    lite_destroy_box( LITE_BOX(projektor->textline) );
+                    projektor->textline = NULL;
+
+                    ProjektorGotoPage( projektor, atoi( text ) );
+
+                    D_FREE( text );
+               }
+               else if (evt->type == DWET_KEYDOWN && projektor->link >= 0) {
+                    LinkIndex *index = ProjektorGetLinks( projektor, projektor->link_right ?
+                                                                     projektor->pageno_right : projektor->pageno );
+
+                    ProjektorFollow( projektor, LinkIndexGet( index, projektor->link )->pageno );
+               }
+
+               return DFB_BUSY;
+
+          case DIKS_ESCAPE:
+          case DIKS_MUTE:
+               if (projektor->textline) {
+                    lite_destroy_box( LITE_BOX(projektor->textline) );
+                    projektor->textline = NULL;
+               }
+               else if (evt->type == DWET_KEYDOWN) {
+                    /* Clear the link selection first. */
+                    if (projektor->link >= 0)
+                         ProjektorSelectLink( projektor, false, -1 );
+                    else
+                         projektor->quit = true;
+               }
+
+               return DFB_BUSY;
+
+          default:
+               break;
+     }
+
+     /* Prevent non-numeric characters. */
+     if (projektor->textline)
+          return DFB_BUSY;
+
+     return DFB_OK;
+}
+
+static void
+ProjektorTerm( Projektor *projektor )
+{
+     /* Release cached pages. */
+     PageCache_Deinit( &projektor->cache );
+
+     /* Release link indexes and outline. */
+     ProjektorForgetLinks( projektor );
+
+     if (projektor->contents)
+          D_FREE( projektor->contents );
+
+     if (projektor->watch)
+          ProjektorUnwatch( projektor );
+
+     /* Remember the position for the next time. */
+     if (projektor->metadata) {
+          if (projektor->pageno)
+               MetadataSetPosition( projektor->metadata, projektor->pageno, projektor->zoom );
+
+          MetadataClose( projektor->metadata );
+     }
+
+     if (projektor->pressure)
+          PressureClose( projektor->pressure );
+
+     /* Release the next document of the playlist. */
+     ProjektorDropPreload( projektor );
+
+     EventLoopDestroy( projektor->loop );
+
+     /* Deinitialize document provider. */
+     ProjektorClose( projektor, projektor->provider );
+
+     if (projektor->partner)
+          ProjektorClosePartner( projektor );
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+ProjektorBenchmark( Benchmark             *bench,
+                    DocumentProvider      *provider,
+                    const char            *filename,
+                    IDirectFB             *idirectfb,
+                    DFBSurfacePixelFormat  format,
+                    float                  zoom,
+                    int                    width,
+                    int                    height )
+{
+     DFBResult            ret;
+     DocumentDescription  desc;
+     PageCache            cache;
+     int                  pageno;
+     int                  num_pages;
+     int                  runs;
+     int                  page_width, page_height;
+     long long            start, stop;
+     long long            insert = 0;
+     IDirectFBSurface    *surface;
+     IDirectFBSurface    *page = NULL;
+
+     ret = BenchmarkRender( bench, provider, filename, idirectfb, zoom, format );
+     if (ret)
+          return ret;
+
+     ret = provider->Init( provider, filename, idirectfb, format );
+     if (ret)
+          return ret;
+
+     provider->GetDescription( provider, &desc );
+
+     /* Two pages in the surface tier, the others compressed. */
+     num_pages = MIN( desc.num_pages, 8 );
+
+     PageCache_Init( &cache, idirectfb, NULL, 2, 256 * 1024 * 1024UL, 0 );
+
+     for (pageno = 1; pageno <= num_pages; pageno++) {
+          ret = provider->RenderPage( provider, pageno, zoom, &surface );
+          if (ret)
+               goto out;
+
+          start = direct_clock_get_micros();
+
+          ret = PageCacheInsert( &cache, pageno, zoom, DOCUMENT_RENDER_DEFAULT, surface );
+
+          insert += direct_clock_get_micros() - start;
+
+          if (!page)
+               page = surface;
+          else
+               surface->Release( surface );
+
+          if (ret)
+               goto out;
+     }
+
+     BenchmarkReport( bench, "cache.insert", insert / 1000.0 / num_pages, "ms", false );
+
+     start = direct_clock_get_micros();
+
+     for (runs = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; runs++) {
+          ret = PageCacheLookup( &cache, num_pages, zoom, DOCUMENT_RENDER_DEFAULT, &surface );
+          if (ret)
+               goto out;
+
+          surface->Release( surface );
+
+          stop = direct_clock_get_micros();
+     }
+
+     BenchmarkReport( bench, "cache.hit", (double) (stop - start) / runs, "us", false );
+
+     if (num_pages > 2) {
+          start = direct_clock_get_micros();
+
+          /* Each lookup decompresses a page evicted from the surface tier. */
+          for (runs = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; runs++) {
+               ret = PageCacheLookup( &cache, runs % (num_pages - 2) + 1, zoom, DOCUMENT_RENDER_DEFAULT, &surface );
+               if (ret)
+                    goto out;
+
+               surface->Release( surface );
+
+               stop = direct_clock_get_micros();
+          }
+
+          BenchmarkReport( bench, "cache.unpack", (stop - start) / 1000.0 / runs, "ms", false );
+     }
+
+     start = direct_clock_get_micros();
+
+     for (runs = 0, stop = start; stop - start < BENCHMARK_MIN_MICROS; runs++) {
+          if (PageCacheLookup( &cache, num_pages + 1, zoom, DOCUMENT_RENDER_DEFAULT, &surface ) != DFB_ITEMNOTFOUND) {
+               ret = DFB_BUG;
+               goto out;
+          }
+
+          stop = direct_clock_get_micros();
+     }
+
+     BenchmarkReport( bench, "cache.miss", (double) (stop - start) / runs, "us", false );
+
+     page->GetSize( page, &page_width, &page_height );
+
+     ret = BenchmarkConvert( bench, page_width, page_height );
+     if (ret)
+          goto out;
+
+     ret = BenchmarkScroll( bench, idirectfb, page, width, height );
+
+out:
+     PageCache_Deinit( &cache );
+
+     if (page)
+          page->Release( page );
+
+     provider->Term( provider );
+
+     return ret;
+}
+
+/**********************************************************************************************************************/
+
+static void print_usage()
+{
+     DocumentProvider *provider;
+
+     printf( "DirectFB Document Viewer\n\n" );
+     printf( "Usage: projektor [options] filename\n" );
+     printf( "       projektor [options] --playlist playlist\n\n" );
+     printf( "Options:\n\n" );
+     printf( "  -a, --auto-advance <seconds>         Advance to the next page periodically.\n" );
+     printf( "  -A, --no-annotations                 Hide annotations and form fields.\n" );
+     printf( "  -b, --budget       <milliseconds>    Set presenter advance latency budget.\n" );
+     printf( "  -B, --benchmark    <results>         Run benchmarks and write the results to a JSON file.\n" );
+     printf( "  -c, --cache        <megabytes>       Set compressed page cache size.\n" );
+     printf( "  -C, --compare      <baseline>        Compare benchmark results with a JSON baseline.\n" );
+     printf( "  -d, --dpi          <dpi>[,<dpi>...]  Set export resolutions (72 dpi at zoom factor 1).\n" );
+     printf( "  -D, --draft                          Show pages without images first, then complete them.\n" );
+     printf( "  -e, --export       <directory>       Export pages to a directory instead of viewing them.\n" );
+     printf( "  -f, --format       <png|dfiff>       Set export file format.\n" );
+     printf( "  -H, --hide-layers  <all|name,...>    Hide optional content layers, all or the ones named.\n" );
+     printf( "  -i, --isolate      <workers>         Render pages in worker processes.\n" );
+     printf( "  -j, --jobs         <jobs>            Set number of export threads (one per CPU by default).\n" );
+     printf( "  -k, --record       <trace>           Record keyboard events to a trace file.\n" );
+     printf( "  -l, --playlist     <playlist>        Show the documents of a playlist in turn.\n" );
+     printf( "  -K, --replay       <trace>           Replay a trace file and report key-to-pixels latencies.\n" );
+     printf( "  -m, --max-memory   <megabytes>       Set memory budget of page cache, renderer and prefetching.\n" );
+     printf( "  -M, --crop-margins                   Crop the pages to their contents.\n" );
+     printf( "  -n, --pages        <first>-<last>    Set exported page range.\n" );
+     printf( "  -o, --optimal                        Use optimal zoom factor.\n" );
+     printf( "  -p, --pixelformat  <pixelformat>     Set page pixel format (RGB16 or native).\n" );
+     printf( "  -P, --presenter                      Use presenter mode.\n" );
+     printf( "  -r, --renderer     <renderer>        Set document renderer.\n" );
+     printf( "  -s, --size         <width>x<height>  Set viewer size.\n" );
+     printf( "  -S, --spread       <cover|nocover>   Show facing pages, the first page alone with cover.\n" );
+     printf( "  -t, --transition   <cut|crossfade>   Set page transition.\n" );
+     printf( "  -T, --threshold    <percent>         Set tolerated benchmark regression (10%% by default).\n" );
+     printf( "  -v, --view         <mode>            Set display mode (normal, night, contrast or sepia).\n" );
+     printf( "  -w, --watchdog     <seconds>         Restart worker processes not answering in time.\n" );
+     printf( "  -W, --watch                          Reload the document when the file changes.\n" );
+     printf( "  -x, --speed        <factor>          Set trace replay speed (0 for as fast as possible).\n" );
+     printf( "  -z, --zoom         <zoom>            Set zoom factor (several for export).\n" );
+     printf( "  -h, --help                           Print usage information.\n\n" );
+     printf( "Supported renderers:\n\n" );
+     DocumentProviderLoadAll();
+     direct_list_foreach (provider, documentproviders) {
+          printf( "  %s\n", provider->impl );
+     }
+     printf( "\n" );
+}
+
+static bool parse_zooms( const char *arg, float scale, ExportOptions *options )
+{
+     char *end;
+
+     options->num_zooms = 0;
+
+     do {
+          float zoom = strtof( arg, &end ) * scale;
+
+          if (end == arg || zoom <= 0 || options->num_zooms == EXPORT_MAX_ZOOMS)
+               return false;
+
+          options->zooms[options->num_zooms++] = zoom;
+
+          arg = end + 1;
+     } while (*end == ',');
+
+     return *end == 0;
+}
+
+int main( int argc, char *argv[] )
+{
+     DFBResult              ret;
+     Projektor              projektor;
+     int                    n;
+     int                    width       = 0;
+     int                    height      = 0;
+     float                  zoom        = 1.0f;
+     float                  base_zoom   = 1.0f;
+     bool                   zoom_set    = false;
+     bool                   optimal     = false;
+     bool                   fitted      = false;
+     int                    cache_size  = 64;
+     DocumentRenderFlags    flags       = DOCUMENT_RENDER_DEFAULT;
+     const char            *layers      = NULL;
+     bool                   draft       = false;
+     bool                   crop        = false;
+     unsigned int           view        = 0;
+     int                    max_memory  = 0;
+     bool                   presenter   = false;
+     bool                   watch       = false;
+     int                    spread      = 0;
+     Transition             transition  = TRANSITION_CUT;
+     float                  advance     = 0.0f;
+     int                    budget      = 16;
+     int                    isolate     = 0;
+     int                    watchdog    = 10;
+     const char            *benchmark   = NULL;
+     const char            *baseline    = NULL;
+     float                  threshold   = 10.0f;
+     const char            *record      = NULL;
+     const char            *replay      = NULL;
+     float                  speed       = 1.0f;
+     Trace                 *trace       = NULL;
+     IDirectFB             *idirectfb;
+     long long              start       = direct_clock_get_micros();
+     DFBSurfacePixelFormat  format      = DSPF_UNKNOWN;
+     const char            *pixelformat = NULL;
+     DocumentProvider      *renderer    = NULL;
+     const char            *filename    = NULL;
+     Playlist              *playlist    = NULL;
+     ExportOptions          export      = { .format = EXPORT_FORMAT_PNG, .zooms = { 1.0f }, .num_zooms = 1 };
+
+     /* Worker process. */
+     if (argc > 1 && strcmp( argv[1], REMOTE_WORKER_OPTION ) == 0)
+          return RemoteWorkerMain( argc, argv );
+
+     /* Parse command line. */
+     for (n = 1; n < argc; n++) {
+          if (strcmp( argv[n], "-h" ) == 0 || strcmp( argv[n], "--help" ) == 0) {
+               print_usage();
+               return 0;
+          }
+
+          if (strcmp( argv[n], "-B" ) == 0 || strcmp( argv[n], "--benchmark" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               benchmark = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-C" ) == 0 || strcmp( argv[n], "--compare" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               baseline = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-T" ) == 0 || strcmp( argv[n], "--threshold" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%f", &threshold ) != 1 || threshold < 0) {
+                    DirectFBError( "Invalid threshold", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-c" ) == 0 || strcmp( argv[n], "--cache" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%d", &cache_size ) != 1 || cache_size < 0) {
+                    DirectFBError( "Invalid cache size", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-m" ) == 0 || strcmp( argv[n], "--max-memory" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%d", &max_memory ) != 1 || max_memory < 1) {
+                    DirectFBError( "Invalid memory budget", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-d" ) == 0 || strcmp( argv[n], "--dpi" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (!parse_zooms( argv[n], 1.0f / 72, &export )) {
+                    DirectFBError( "Invalid resolution", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-e" ) == 0 || strcmp( argv[n], "--export" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               export.directory = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-f" ) == 0 || strcmp( argv[n], "--format" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (!strcasecmp( argv[n], "png" ))
+                    export.format = EXPORT_FORMAT_PNG;
+               else if (!strcasecmp( argv[n], "dfiff" ))
+                    export.format = EXPORT_FORMAT_DFIFF;
+               else {
+                    DirectFBError( "Invalid export format", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-j" ) == 0 || strcmp( argv[n], "--jobs" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%d", &export.jobs ) != 1 || export.jobs < 1) {
+                    DirectFBError( "Invalid number of jobs", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-i" ) == 0 || strcmp( argv[n], "--isolate" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%d", &isolate ) != 1 || isolate < 1) {
+                    DirectFBError( "Invalid number of workers", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-k" ) == 0 || strcmp( argv[n], "--record" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               record = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-K" ) == 0 || strcmp( argv[n], "--replay" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               replay = argv[n];
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-l" ) == 0 || strcmp( argv[n], "--playlist" ) == 0) {
+               if (++n == argc || playlist) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (PlaylistLoad( argv[n], &playlist )) {
+                    DirectFBError( "Invalid playlist", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
 
-               return DFB_BUSY;
+          if (strcmp( argv[n], "-n" ) == 0 || strcmp( argv[n], "--pages" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-          case DIKS_MINUS_SIGN:
-          case DIKS_VOLUME_DOWN:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorSetZoom( projektor, projektor->zoom - 0.25f );
+               if (sscanf( argv[n], "%d-%d", &export.first, &export.last ) != 2 || export.first < 1 ||
+                   export.last < export.first) {
+                    DirectFBError( "Invalid page range", DFB_FAILURE );
+                    return 1;
+               }
 
-               return DFB_BUSY;
+               continue;
+          }
 
-          case DIKS_SPACE:
-          case DIKS_MENU:
-               if (evt->type == DWET_KEYDOWN)
-                    ProjektorSetOptimal( projektor );
+          if (strcmp( argv[n], "-o" ) == 0 || strcmp( argv[n], "--optimal" ) == 0) {
+               optimal = true;
+               continue;
+          }
 
-               return DFB_BUSY;
+          if (strcmp( argv[n], "-A" ) == 0 || strcmp( argv[n], "--no-annotations" ) == 0) {
+               flags |= DOCUMENT_RENDER_NO_ANNOTATIONS;
+               continue;
+          }
 
-          case DIKS_0:
-          case DIKS_1:
-          case DIKS_2:
-          case DIKS_3:
-          case DIKS_4:
-          case DIKS_5:
-          case DIKS_6:
-          case DIKS_7:
-          case DIKS_8:
-          case DIKS_9:
-               if (projektor->textline)
-                    return DFB_OK;
+          if (strcmp( argv[n], "-D" ) == 0 || strcmp( argv[n], "--draft" ) == 0) {
+               draft = true;
+               continue;
+          }
 
-               if (evt->type == DWET_KEYDOWN) {
-                    DFBResult    ret;
-                    char         initial_text[2] = { evt->key_symbol, 0 };
-                    DFBRectangle rect            = {
-                         (projektor->mainwin.window->box.rect.w - 54) / 2,
-                         (projektor->mainwin.window->box.rect.h - 27) / 2,
-                         54,
-                         27
-                    };
+          if (strcmp( argv[n], "-v" ) == 0 || strcmp( argv[n], "--view" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-                    ret = lite_new_textline( LITE_BOX(projektor->mainwin.window), &rect, liteNoTextLineTheme,
-                                             &projektor->textline );
-                    if (ret)
+               for (view = 0; view < PROJEKTOR_NUM_VIEWS; view++) {
+                    if (!strcasecmp( argv[n], projektor_views[view].name ))
                          break;
+               }
 
-                    lite_set_textline_text( projektor->textline, initial_text );
-
-                    lite_focus_box( LITE_BOX(projektor->textline) );
+               if (view == PROJEKTOR_NUM_VIEWS) {
+                    DirectFBError( "Invalid display mode", DFB_FAILURE );
+                    return 1;
                }
 
-               return DFB_BUSY;
+               continue;
+          }
 
-          case DIKS_BACKSPACE:
-          case DIKS_DELETE:
-               if (projektor->textline)
-                    return DFB_OK;
+          if (strcmp( argv[n], "-M" ) == 0 || strcmp( argv[n], "--crop-margins" ) == 0) {
+               crop = true;
+               continue;
+          }
 
-               return DFB_BUSY;
+          if (strcmp( argv[n], "-H" ) == 0 || strcmp( argv[n], "--hide-layers" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-          case DIKS_ENTER:
-          case DIKS_OK:
-               if (projektor->textline) {
-                    char *text;
+               flags  |= DOCUMENT_RENDER_HIDE_LAYERS;
+               layers  = strcasecmp( argv[n], "all" ) ? argv[n] : NULL;
 
-                    lite_get_textline_text( projektor->textline, &text );
+               continue;
+          }
 
-                    lite_destroy_box( LITE_BOX(projektor->textline) );
-                    projektor->textline = NULL;
+          if (strcmp( argv[n], "-P" ) == 0 || strcmp( argv[n], "--presenter" ) == 0) {
+               presenter = true;
+               continue;
+          }
 
-                    ProjektorGotoPage( projektor, atoi( text ) );
+          if (strcmp( argv[n], "-S" ) == 0 || strcmp( argv[n], "--spread" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-                    D_FREE( text );
+               if (!strcasecmp( argv[n], "cover" ))
+                    spread = 2;
+               else if (!strcasecmp( argv[n], "nocover" ))
+                    spread = 1;
+               else {
+                    DirectFBError( "Invalid spread mode", DFB_FAILURE );
+                    return 1;
                }
 
-               return DFB_BUSY;
+               continue;
+          }
 
-          case DIKS_ESCAPE:
-          case DIKS_MUTE:
-               if (projektor->textline) {
-                    lite_destroy_box( LITE_BOX(projektor->textline) );
-                    projektor->textline = NULL;
+          if (strcmp( argv[n], "-t" ) == 0 || strcmp( argv[n], "--transition" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
                }
-               else
-                    projektor->quit = true;
 
-               return DFB_BUSY;
+               if (!strcasecmp( argv[n], "cut" ))
+                    transition = TRANSITION_CUT;
+               else if (!strcasecmp( argv[n], "crossfade" ))
+                    transition = TRANSITION_CROSSFADE;
+               else {
+                    DirectFBError( "Invalid transition", DFB_FAILURE );
+                    return 1;
+               }
 
-          default:
-               break;
-     }
+               continue;
+          }
 
-     /* Prevent non-numeric characters. */
-     if (projektor->textline)
-          return DFB_BUSY;
+          if (strcmp( argv[n], "-a" ) == 0 || strcmp( argv[n], "--auto-advance" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-     return DFB_OK;
-}
+               if (sscanf( argv[n], "%f", &advance ) != 1 || advance <= 0) {
+                    DirectFBError( "Invalid auto advance delay", DFB_FAILURE );
+                    return 1;
+               }
 
-static void
-ProjektorTerm( Projektor *projektor )
-{
-     DocumentProvider *provider = projektor->provider;
+               continue;
+          }
 
-     /* Deinitialize document provider. */
-     provider->Term( provider );
-}
+          if (strcmp( argv[n], "-b" ) == 0 || strcmp( argv[n], "--budget" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-/**********************************************************************************************************************/
+               if (sscanf( argv[n], "%d", &budget ) != 1 || budget < 0) {
+                    DirectFBError( "Invalid latency budget", DFB_FAILURE );
+                    return 1;
+               }
 
-static void print_usage()
-{
-     DocumentProvider *provider;
+               continue;
+          }
 
-     printf( "DirectFB Document Viewer\n\n" );
-     printf( "Usage: projektor [options] filename\n\n" );
-     printf( "Options:\n\n" );
-     printf( "  -o, --optimal                    Use optimal zoom factor.\n" );
-     printf( "  -r, --renderer <renderer>        Set document renderer.\n" );
-     printf( "  -s, --size     <width>x<height>  Set viewer size.\n" );
-     printf( "  -z, --zoom     <zoom>            Set zoom factor.\n" );
-     printf( "  -h, --help                       Print usage information.\n\n" );
-     printf( "Supported renderers:\n\n" );
-     direct_list_foreach (provider, documentproviders) {
-          printf( "  %s\n", provider->impl );
-     }
-     printf( "\n" );
-}
+          if (strcmp( argv[n], "-p" ) == 0 || strcmp( argv[n], "--pixelformat" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
 
-int main( int argc, char *argv[] )
-{
-     DFBResult   ret;
-     Projektor   projektor;
-     int         n;
-     int         width    = 0;
-     int         height   = 0;
-     float       zoom     = 1.0f;
-     bool        optimal  = false;
-     const char *renderer = NULL;
-     const char *filename = NULL;
+               if (!strcasecmp( argv[n], "RGB16" ))
+                    format = DSPF_RGB16;
+               else if (strcasecmp( argv[n], "native" )) {
+                    DirectFBError( "Invalid pixel format", DFB_FAILURE );
+                    return 1;
+               }
 
-     /* Parse command line. */
-     for (n = 1; n < argc; n++) {
-          if (strcmp( argv[n], "-h" ) == 0 || strcmp( argv[n], "--help" ) == 0) {
-               print_usage();
-               return 0;
-          }
+               pixelformat = argv[n];
 
-          if (strcmp( argv[n], "-o" ) == 0 || strcmp( argv[n], "--optimal" ) == 0) {
-               optimal = true;
                continue;
           }
 
           if (strcmp( argv[n], "-r" ) == 0 || strcmp( argv[n], "--renderer" ) == 0) {
-               DocumentProvider *provider;
-
                if (++n == argc) {
                     print_usage (argv[0]);
                     return 1;
                }
 
-               direct_list_foreach (provider, documentproviders) {
-                    if (!strcasecmp( provider->impl, argv[n] )) {
-                         renderer = argv[n];
-                         break;
-                    }
-               }
-
-               if (!renderer) {
+               if (DocumentProviderLoad( argv[n], &renderer )) {
                     DirectFBError( "Invalid renderer", DFB_FAILURE );
                     return 1;
                }
@@ -810,17 +4878,53 @@ int main( int argc, char *argv[] )
                continue;
           }
 
+          if (strcmp( argv[n], "-w" ) == 0 || strcmp( argv[n], "--watchdog" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%d", &watchdog ) != 1 || watchdog < 1) {
+                    DirectFBError( "Invalid watchdog timeout", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
+          if (strcmp( argv[n], "-W" ) == 0 || strcmp( argv[n], "--watch" ) == 0) {
+               watch = true;
+               continue;
+          }
+
+          if (strcmp( argv[n], "-x" ) == 0 || strcmp( argv[n], "--speed" ) == 0) {
+               if (++n == argc) {
+                    print_usage();
+                    return 1;
+               }
+
+               if (sscanf( argv[n], "%f", &speed ) != 1 || speed < 0) {
+                    DirectFBError( "Invalid replay speed", DFB_FAILURE );
+                    return 1;
+               }
+
+               continue;
+          }
+
           if (strcmp( argv[n], "-z" ) == 0 || strcmp( argv[n], "--zoom" ) == 0) {
                if (++n == argc) {
                     print_usage();
                     return DFB_FALSE;
                }
 
-               if (sscanf( argv[n], "%f", &zoom ) != 1 || zoom < 0.25 || zoom > 2.5f) {
+               if (!parse_zooms( argv[n], 1.0f, &export )) {
                     DirectFBError( "Invalid zoom factor", DFB_FAILURE );
                     return 1;
                }
 
+               zoom     = export.zooms[0];
+               zoom_set = true;
+
                continue;
           }
 
@@ -832,37 +4936,216 @@ int main( int argc, char *argv[] )
           filename = argv[n];
      }
 
+     /* The first document of the playlist is opened as a single one. */
+     if (playlist) {
+          if (filename) {
+               print_usage();
+               return 1;
+          }
+
+          filename = playlist->entries[0].filename;
+     }
+
      if (!filename) {
           print_usage();
           return 1;
      }
 
-     if (!renderer)
-          renderer = ((DocumentProvider*) documentproviders)->impl;
+     if (!export.directory && (zoom < 0.25 || zoom > 2.5f)) {
+          DirectFBError( "Invalid zoom factor", DFB_FAILURE );
+          return 1;
+     }
+
+     /* A trace file is either recorded or replayed. */
+     if (record && replay) {
+          DirectFBError( "Cannot record and replay traces at once", DFB_INVARG );
+          return 1;
+     }
+
+     /* Rank the providers able to open the file, unless a renderer is set. */
+     if (renderer) {
+          projektor.candidates[0]  = renderer;
+          projektor.num_candidates = 1;
+     }
+     else if (DocumentProviderRank( filename, projektor.candidates, &projektor.num_candidates )) {
+          DirectFBError( "No renderer found", DFB_NOIMPL );
+          return 1;
+     }
+
+     /* Headless export. */
+     if (export.directory) {
+          if (DirectFBInit( &argc, &argv ) || DirectFBCreate( &idirectfb ))
+               return 1;
+
+          export.pixelformat = format;
+          export.flags       = flags;
+          export.layers      = layers;
+
+          ret = ProjektorExport( projektor.candidates[0], filename, idirectfb, &export );
+          if (ret)
+               DirectFBError( "Export failed", ret );
+
+          idirectfb->Release( idirectfb );
+
+          return !ret ? 0 : 1;
+     }
+
+     /* Headless benchmarks. */
+     if (benchmark) {
+          Benchmark bench;
+
+          if (DirectFBInit( &argc, &argv ) || DirectFBCreate( &idirectfb ))
+               return 1;
+
+          BenchmarkInit( &bench, strcmp( benchmark, "-" ) ? benchmark : NULL, baseline, threshold );
+
+          ret = ProjektorBenchmark( &bench, projektor.candidates[0], filename, idirectfb, format, zoom,
+                                    width ?: 1280, height ?: 720 );
+          if (ret)
+               DirectFBError( "Benchmark failed", ret );
+          else
+               ret = BenchmarkFinish( &bench );
+
+          idirectfb->Release( idirectfb );
+
+          return !ret ? 0 : 1;
+     }
+
+     /* Input traces. */
+     if (record || replay) {
+          ret = TraceOpen( record ?: replay, !!record, &trace );
+          if (ret)
+               return 1;
+     }
+
+     /* Initialization, DirectFB first so that the document is opened while LiTE is set up. */
+     if (DirectFBInit( &argc, &argv ) || DirectFBCreate( &idirectfb )) {
+          if (trace)
+               TraceClose( trace );
 
-     /* Initialization. */
-     if (lite_open( &argc, &argv ))
           return 1;
+     }
+
+     /* Render pages in RGB16 when the primary layer uses it, unless a pixel format is set. */
+     if (!pixelformat) {
+          DFBDisplayLayerConfig  config;
+          IDirectFBDisplayLayer *layer;
+
+          if (idirectfb->GetDisplayLayer( idirectfb, DLID_PRIMARY, &layer ) == DFB_OK) {
+               if (layer->GetConfiguration( layer, &config ) == DFB_OK && config.pixelformat == DSPF_RGB16)
+                    format = DSPF_RGB16;
+
+               layer->Release( layer );
+          }
+     }
+
+     /* Presenter settings. */
+     projektor.presenter    = presenter;
+     projektor.transition   = transition;
+     projektor.budget       = budget;
+     projektor.auto_advance = advance * 1000;
+
+     /* Worker processes. */
+     projektor.isolate      = isolate;
+     projektor.watchdog     = watchdog;
+
+     projektor.record       = record ? trace : NULL;
+     projektor.events       = 0;
+
+     /* Memory budget. */
+     projektor.max_memory   = max_memory * 1024 * 1024UL;
+
+     /* Spread mode. */
+     projektor.spread       = spread != 0;
+     projektor.cover        = spread == 2;
+
+     /* Render flags, toggled by keys. */
+     projektor.flags        = flags;
+     projektor.layers       = layers;
+     projektor.draft        = draft;
+     projektor.crop         = crop;
+     projektor.view         = view;
+
+     /* Playlist, advancing every ten seconds unless set. */
+     projektor.playlist     = playlist;
+     projektor.entry        = 0;
+     projektor.dwell        = projektor.auto_advance ?: 10000;
+     projektor.optimal      = optimal;
+     projektor.renderer     = renderer;
+
+     if (playlist)
+          projektor.auto_advance = playlist->entries[0].dwell ?: projektor.dwell;
+
+     /* Metadata index, not used with traces so that they are replayed from the first page, nor with a playlist. */
+     if (record || replay || playlist || getenv( "PROJEKTOR_NO_METADATA" ) ||
+         MetadataOpen( filename, &projektor.metadata ))
+          projektor.metadata = NULL;
+
+     /* Resume on the last page shown, fitted to the layer size if the page geometry is known. */
+     if (projektor.metadata) {
+          DFBDisplayLayerConfig  config = { .width = width, .height = height };
+          IDirectFBDisplayLayer *layer;
+
+          if (optimal && (!width || !height) &&
+              idirectfb->GetDisplayLayer( idirectfb, DLID_PRIMARY, &layer ) == DFB_OK) {
+               layer->GetConfiguration( layer, &config );
+               layer->Release( layer );
+          }
 
-     ret = ProjektorInit( &projektor, renderer, filename, width, height, zoom );
+          base_zoom = zoom;
+
+          fitted = ProjektorResume( &projektor, zoom_set, optimal, config.width, config.height, &zoom );
+     }
+     else
+          projektor.start_page = playlist ? playlist->entries[0].first : 1;
+
+     ProjektorStart( &projektor, idirectfb, filename, format, zoom );
+
+     /* LiTE uses the DirectFB instance already created. */
+     if (lite_open( &argc, &argv )) {
+          ProjektorDiscardOpen( &projektor );
+          ret = DFB_INIT;
+          goto error;
+     }
+
+     ret = ProjektorInit( &projektor, width, height, zoom, cache_size );
      if (ret) {
+          ProjektorDiscardOpen( &projektor );
           lite_close();
-          return 1;
+          goto error;
      }
 
-     /* Render first page. */
-     ret = ProjektorGotoPage( &projektor, 1 );
+     /* Show first page, rendered during initialization. */
+     ret = ProjektorGotoPage( &projektor, projektor.start_page );
      if (ret)
           goto out;
 
-     if (optimal) {
+     lite_draw_box( LITE_BOX(projektor.mainwin.window), NULL, DFB_TRUE );
+
+     D_INFO( "Projektor: First page shown after %lld ms\n", (direct_clock_get_micros() - start) / 1000 );
+
+     /* Watch the file for changes, with the fingerprints of the pages as shown. */
+     if (watch)
+          ProjektorWatch( &projektor );
+
+     /* Open the next document of the playlist in the background. */
+     if (playlist && playlist->num_entries > 1)
+          ProjektorPreloadEntry( &projektor, 1 );
+
+     /* Already fitted, switching back goes to the zoom factor set. */
+     if (fitted)
+          projektor.zoom_prev = base_zoom;
+     else if (optimal) {
           ret = ProjektorSetOptimal( &projektor );
           if (ret)
                goto out;
      }
 
-     /* Run the window event loop. */
-     ProjektorEventLoop( &projektor );
+     /* Run the window event loop, or replay a trace. */
+     if (replay)
+          ProjektorReplay( &projektor, trace, speed );
+     else
+          ProjektorEventLoop( &projektor );
 
 out:
      /* Deinitialization. */
@@ -870,5 +5153,14 @@ out:
 
      lite_close();
 
+error:
+     if (trace)
+          TraceClose( trace );
+
+     if (playlist)
+          PlaylistFree( playlist );
+
+     idirectfb->Release( idirectfb );
+
      return !ret ? 0 : 1;
 }
@@ -0,0 +1,1290 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#define _GNU_SOURCE
+
+#include "remote.h"
+#include <direct/thread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/**********************************************************************************************************************/
+
+typedef enum {
+     REMOTE_INIT,
+     REMOTE_RENDER,
+     REMOTE_CONTENT_BOX,
+     REMOTE_LINKS,
+     REMOTE_OUTLINE,
+     REMOTE_FINGERPRINTS
+} RemoteRequestType;
+
+typedef struct {
+     RemoteRequestType      type;
+     unsigned long          memory_limit;            /* of the worker caches, 0 for the default */
+
+     /* REMOTE_INIT */
+     char                   impl[32];
+     char                   filename[PATH_MAX];
+     DFBSurfacePixelFormat  format;
+
+     /* REMOTE_RENDER, with the render flags and the hidden layers, all of them if none are given */
+     int                    pageno;
+     float                  zoom;
+     DocumentRenderFlags    flags;
+     char                   layers[256];
+     DocumentBox            region;                  /* empty for the whole page */
+     bool                   progress;                /* report the progress with partial replies */
+} RemoteRequest;
+
+typedef struct {
+     DFBResult              result;
+
+     /* REMOTE_INIT */
+     DocumentDescription    desc;
+
+     /* REMOTE_RENDER, pixels are passed in a memfd, once per surface with partial replies */
+     bool                   partial;                 /* progress of the render, more replies follow */
+     DFBRectangle           rect;                    /* rendered so far */
+     unsigned int           surface_id;              /* in the worker */
+     int                    width;
+     int                    height;
+     int                    pitch;
+     DFBSurfacePixelFormat  format;
+
+     /* REMOTE_CONTENT_BOX */
+     DocumentBox            box;
+
+     /* REMOTE_LINKS, REMOTE_OUTLINE and REMOTE_FINGERPRINTS, the array is passed in a memfd */
+     size_t                 size;
+} RemoteReply;
+
+typedef struct {
+     pid_t                  pid;
+     int                    fd;
+     bool                   busy;
+} RemoteWorker;
+
+typedef struct {
+     DirectLink             link;
+
+     unsigned int           surface_id;
+     void                  *ptr;
+     size_t                 size;
+     int                    memfd;                   /* kept by the worker, -1 once mapped by the viewer */
+     bool                   shared;                  /* with the viewer during the current request */
+} RemoteMapping;
+
+typedef struct {
+     char                   impl[32];
+     int                    num_workers;
+     int                    timeout;
+
+     IDirectFB             *idirectfb;
+     char                   filename[PATH_MAX];
+     DFBSurfacePixelFormat  format;
+
+     DocumentDescription    desc;
+
+     DocumentRenderFlags    flags;
+     char                   layers[256];
+     unsigned long          memory_limit;
+     DocumentProgressFunc   progress;
+     void                  *progress_ctx;
+
+     RemoteWorker          *workers;
+
+     IDirectFBEventBuffer  *events;
+     DirectLink            *mappings;
+
+     DirectMutex            lock;
+     DirectWaitQueue        cond;
+} DocumentProvider_Remote_data;
+
+/**********************************************************************************************************************/
+
+static DFBResult
+Remote_Send( int                  fd,
+             const RemoteRequest *request )
+{
+     if (send( fd, request, sizeof(RemoteRequest), MSG_NOSIGNAL ) != sizeof(RemoteRequest))
+          return DFB_IO;
+
+     return DFB_OK;
+}
+
+static DFBResult
+Remote_Receive( int          fd,
+                int          timeout,
+                RemoteReply *reply,
+                int         *ret_memfd )
+{
+     struct pollfd    pfd = { .fd = fd, .events = POLLIN };
+     struct msghdr    msg;
+     struct iovec     iov = { .iov_base = reply, .iov_len = sizeof(RemoteReply) };
+     struct cmsghdr  *cmsg;
+     char             control[CMSG_SPACE(sizeof(int))];
+
+     /* Watchdog. */
+     if (poll( &pfd, 1, timeout * 1000 ) != 1)
+          return DFB_TIMEOUT;
+
+     memset( &msg, 0, sizeof(msg) );
+
+     msg.msg_iov        = &iov;
+     msg.msg_iovlen     = 1;
+     msg.msg_control    = control;
+     msg.msg_controllen = sizeof(control);
+
+     if (recvmsg( fd, &msg, MSG_CMSG_CLOEXEC ) != sizeof(RemoteReply))
+          return DFB_DEAD;
+
+     if (ret_memfd) {
+          *ret_memfd = -1;
+
+          for (cmsg = CMSG_FIRSTHDR( &msg ); cmsg; cmsg = CMSG_NXTHDR( &msg, cmsg )) {
+               if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                    memcpy( ret_memfd, CMSG_DATA( cmsg ), sizeof(int) );
+          }
+     }
+
+     return DFB_OK;
+}
+
+static DFBResult
+Remote_StartWorker( DocumentProvider_Remote_data *data,
+                    RemoteWorker                 *worker )
+{
+     DFBResult     ret;
+     int           fds[2];
+     char          arg[16];
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     if (socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds ))
+          return DFB_IO;
+
+     worker->pid = fork();
+     if (worker->pid < 0) {
+          close( fds[0] );
+          close( fds[1] );
+          return DFB_FAILURE;
+     }
+
+     if (!worker->pid) {
+          /* Keep the worker end open across exec. */
+          snprintf( arg, sizeof(arg), "%d", dup( fds[1] ) );
+
+          execl( "/proc/self/exe", "projektor", REMOTE_WORKER_OPTION, arg, NULL );
+          _exit( 1 );
+     }
+
+     close( fds[1] );
+
+     worker->fd   = fds[0];
+     worker->busy = false;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type   = REMOTE_INIT;
+     request.format = data->format;
+
+     snprintf( request.impl, sizeof(request.impl), "%s", data->impl );
+     snprintf( request.filename, sizeof(request.filename), "%s", data->filename );
+
+     ret = Remote_Send( worker->fd, &request );
+     if (!ret)
+          ret = Remote_Receive( worker->fd, data->timeout, &reply, NULL );
+     if (!ret)
+          ret = reply.result;
+
+     if (ret) {
+          kill( worker->pid, SIGKILL );
+          waitpid( worker->pid, NULL, 0 );
+          close( worker->fd );
+          worker->pid = 0;
+          worker->fd  = -1;
+          return ret;
+     }
+
+     data->desc = reply.desc;
+
+     return DFB_OK;
+}
+
+static void
+Remote_StopWorker( RemoteWorker *worker )
+{
+     if (!worker->pid)
+          return;
+
+     close( worker->fd );
+
+     kill( worker->pid, SIGKILL );
+     waitpid( worker->pid, NULL, 0 );
+
+     worker->pid = 0;
+     worker->fd  = -1;
+}
+
+/*
+ * Pitch of the pixels shared in a memfd.
+ */
+static inline int
+Remote_Pitch( DFBSurfacePixelFormat format,
+              int                   width )
+{
+     return (DFB_BYTES_PER_LINE( format, width ) + 7) & ~7;
+}
+
+static RemoteMapping *
+Remote_FindMapping( DirectLink   *mappings,
+                    unsigned int  surface_id )
+{
+     RemoteMapping *mapping;
+
+     direct_list_foreach (mapping, mappings) {
+          if (mapping->surface_id == surface_id)
+               return mapping;
+     }
+
+     return NULL;
+}
+
+static void
+Remote_ReleaseMappings( IDirectFBEventBuffer  *events,
+                        DirectLink           **mappings )
+{
+     DFBEvent       event;
+     RemoteMapping *mapping;
+
+     /* Unmap the pixels of destroyed surfaces. */
+     while (events->GetEvent( events, &event ) == DFB_OK) {
+          if (event.clazz != DFEC_SURFACE || event.surface.type != DSEVT_DESTROYED)
+               continue;
+
+          mapping = Remote_FindMapping( *mappings, event.surface.surface_id );
+          if (!mapping)
+               continue;
+
+          direct_list_remove( mappings, &mapping->link );
+
+          munmap( mapping->ptr, mapping->size );
+
+          if (mapping->memfd >= 0)
+               close( mapping->memfd );
+
+          D_FREE( mapping );
+     }
+}
+
+/**********************************************************************************************************************/
+
+static DFBResult
+DocumentProvider_Remote_Init( DocumentProvider      *thiz,
+                              const char            *filename,
+                              IDirectFB             *idirectfb,
+                              DFBSurfacePixelFormat  format )
+{
+     DFBResult                     ret;
+     int                           i;
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     data->idirectfb = idirectfb;
+     data->format    = format;
+
+     snprintf( data->filename, sizeof(data->filename), "%s", filename );
+
+     data->workers = D_CALLOC( data->num_workers, sizeof(RemoteWorker) );
+     if (!data->workers)
+          return D_OOM();
+
+     ret = idirectfb->CreateEventBuffer( idirectfb, &data->events );
+     if (ret)
+          goto error;
+
+     for (i = 0; i < data->num_workers; i++) {
+          ret = Remote_StartWorker( data, &data->workers[i] );
+          if (ret)
+               goto error;
+     }
+
+     direct_mutex_init( &data->lock );
+     direct_waitqueue_init( &data->cond );
+
+     return DFB_OK;
+
+error:
+     for (i = 0; i < data->num_workers; i++)
+          Remote_StopWorker( &data->workers[i] );
+
+     if (data->events) {
+          data->events->Release( data->events );
+          data->events = NULL;
+     }
+
+     D_FREE( data->workers );
+     data->workers = NULL;
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Remote_Term( DocumentProvider *thiz )
+{
+     int                           i;
+     RemoteMapping                *mapping, *next;
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     for (i = 0; i < data->num_workers; i++)
+          Remote_StopWorker( &data->workers[i] );
+
+     Remote_ReleaseMappings( data->events, &data->mappings );
+
+     /* Pixels of surfaces still alive stay mapped until exit. */
+     direct_list_foreach_safe (mapping, next, data->mappings)
+          D_FREE( mapping );
+
+     data->mappings = NULL;
+
+     data->events->Release( data->events );
+
+     direct_waitqueue_deinit( &data->cond );
+     direct_mutex_deinit( &data->lock );
+
+     D_FREE( data->workers );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_GetDescription( DocumentProvider    *thiz,
+                                        DocumentDescription *ret_desc )
+{
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     if (!ret_desc)
+          return DFB_INVARG;
+
+     *ret_desc = data->desc;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_SetRenderFlags( DocumentProvider    *thiz,
+                                        DocumentRenderFlags  flags,
+                                        const char          *layers )
+{
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     if (layers && strlen( layers ) >= sizeof(data->layers))
+          return DFB_LIMITEXCEEDED;
+
+     direct_mutex_lock( &data->lock );
+
+     data->flags = flags;
+
+     snprintf( data->layers, sizeof(data->layers), "%s", layers ?: "" );
+
+     direct_mutex_unlock( &data->lock );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_SetMemoryLimit( DocumentProvider *thiz,
+                                        unsigned long     size )
+{
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     direct_mutex_lock( &data->lock );
+
+     /* Split between the workers, each one applies it with its next request. */
+     data->memory_limit = MAX( size / data->num_workers, 1 );
+
+     direct_mutex_unlock( &data->lock );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_SetProgressFunc( DocumentProvider     *thiz,
+                                         DocumentProgressFunc  func,
+                                         void                 *ctx )
+{
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     direct_mutex_lock( &data->lock );
+
+     data->progress     = func;
+     data->progress_ctx = ctx;
+
+     direct_mutex_unlock( &data->lock );
+
+     return DFB_OK;
+}
+
+/*
+ * Wrap pixels shared by a worker in a preallocated surface, unmapped once the surface is destroyed.
+ */
+static DFBResult
+Remote_MapSurface( DocumentProvider_Remote_data  *data,
+                   const RemoteReply             *reply,
+                   int                            memfd,
+                   IDirectFBSurface             **ret_surface )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  desc;
+     RemoteMapping         *mapping;
+     IDirectFBSurface      *surface;
+
+     if (memfd < 0)
+          return DFB_FAILURE;
+
+     mapping = D_CALLOC( 1, sizeof(RemoteMapping) );
+     if (!mapping)
+          return D_OOM();
+
+     mapping->size  = (size_t) reply->pitch * reply->height;
+     mapping->memfd = -1;
+
+     mapping->ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0 );
+     if (mapping->ptr == MAP_FAILED) {
+          D_FREE( mapping );
+          return DFB_FAILURE;
+     }
+
+     /* Wrap the shared pixels without copying. */
+     desc.flags                    = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT | DSDESC_PREALLOCATED;
+     desc.width                    = reply->width;
+     desc.height                   = reply->height;
+     desc.pixelformat              = reply->format;
+     desc.preallocated[0].data     = mapping->ptr;
+     desc.preallocated[0].pitch    = reply->pitch;
+     desc.preallocated[1].data     = NULL;
+     desc.preallocated[1].pitch    = 0;
+
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+     if (ret) {
+          munmap( mapping->ptr, mapping->size );
+          D_FREE( mapping );
+          return ret;
+     }
+
+     surface->GetID( surface, &mapping->surface_id );
+     surface->AttachEventBuffer( surface, data->events );
+
+     direct_mutex_lock( &data->lock );
+     direct_list_append( &data->mappings, &mapping->link );
+     direct_mutex_unlock( &data->lock );
+
+     *ret_surface = surface;
+
+     return DFB_OK;
+}
+
+/*
+ * Run a request on an idle worker, with the current render flags and memory limit. Rendered pages are returned as
+ * surfaces, arrays are returned allocated, or NULL if empty.
+ */
+static DFBResult
+DocumentProvider_Remote_Call( DocumentProvider  *thiz,
+                              RemoteRequest     *request,
+                              RemoteReply       *reply,
+                              IDirectFBSurface **ret_surface,
+                              void             **ret_data )
+{
+     DFBResult                     ret;
+     int                           i;
+     DocumentProgressFunc          progress;
+     void                         *progress_ctx;
+     int                           memfd      = -1;
+     RemoteWorker                 *worker     = NULL;
+     IDirectFBSurface             *partial    = NULL;
+     unsigned int                  partial_id = 0;
+     DocumentProvider_Remote_data *data       = thiz->priv;
+
+     /* Take an idle worker. */
+     direct_mutex_lock( &data->lock );
+
+     while (!worker) {
+          for (i = 0; i < data->num_workers; i++) {
+               if (!data->workers[i].busy) {
+                    worker       = &data->workers[i];
+                    worker->busy = true;
+                    break;
+               }
+          }
+
+          if (!worker)
+               direct_waitqueue_wait( &data->cond, &data->lock );
+     }
+
+     Remote_ReleaseMappings( data->events, &data->mappings );
+
+     progress     = request->type == REMOTE_RENDER ? data->progress : NULL;
+     progress_ctx = data->progress_ctx;
+
+     request->flags        = data->flags;
+     request->memory_limit = data->memory_limit;
+     request->progress     = progress != NULL;
+
+     memcpy( request->layers, data->layers, sizeof(request->layers) );
+
+     direct_mutex_unlock( &data->lock );
+
+     /* Restart a worker that could not be restarted before. */
+     if (!worker->pid) {
+          ret = Remote_StartWorker( data, worker );
+          if (ret)
+               goto out;
+     }
+
+     ret = Remote_Send( worker->fd, request );
+
+     /* Partial replies report the progress, the page is shown in the pixels shared by the worker while it renders. */
+     while (!ret) {
+          ret = Remote_Receive( worker->fd, data->timeout, reply, &memfd );
+          if (ret || !reply->partial)
+               break;
+
+          if (memfd >= 0) {
+               if (partial)
+                    partial->Release( partial );
+
+               if (Remote_MapSurface( data, reply, memfd, &partial ))
+                    partial = NULL;
+
+               partial_id = reply->surface_id;
+
+               close( memfd );
+               memfd = -1;
+          }
+
+          if (partial && progress && reply->surface_id == partial_id)
+               progress( progress_ctx, partial, &reply->rect );
+     }
+
+     if (ret) {
+          /* Hung or crashed worker. */
+          D_ERROR( "Projektor/Remote: Worker %d %s on page %d, restarting it!\n", worker->pid,
+                   ret == DFB_TIMEOUT ? "timed out" : "died", request->pageno );
+
+          Remote_StopWorker( worker );
+          Remote_StartWorker( data, worker );
+          goto out;
+     }
+
+     ret = reply->result;
+     if (ret)
+          goto out;
+
+     if (ret_data) {
+          *ret_data = NULL;
+
+          if (!reply->size)
+               goto out;
+
+          if (memfd < 0) {
+               ret = DFB_FAILURE;
+               goto out;
+          }
+
+          *ret_data = D_MALLOC( reply->size );
+          if (!*ret_data) {
+               ret = D_OOM();
+               goto out;
+          }
+
+          if (pread( memfd, *ret_data, reply->size, 0 ) != (ssize_t) reply->size) {
+               D_FREE( *ret_data );
+               *ret_data = NULL;
+               ret = DFB_IO;
+          }
+
+          goto out;
+     }
+
+     if (!ret_surface)
+          goto out;
+
+     /* The page shown while it was rendered is the page rendered. */
+     if (partial && reply->surface_id == partial_id) {
+          *ret_surface = partial;
+          partial      = NULL;
+     }
+     else
+          ret = Remote_MapSurface( data, reply, memfd, ret_surface );
+
+out:
+     if (partial)
+          partial->Release( partial );
+
+     if (memfd >= 0)
+          close( memfd );
+
+     direct_mutex_lock( &data->lock );
+
+     worker->busy = false;
+
+     direct_waitqueue_signal( &data->cond );
+
+     direct_mutex_unlock( &data->lock );
+
+     return ret;
+}
+
+static DFBResult
+DocumentProvider_Remote_RenderPage( DocumentProvider  *thiz,
+                                    int                pageno,
+                                    float              zoom,
+                                    IDirectFBSurface **ret_surface )
+{
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type   = REMOTE_RENDER;
+     request.pageno = pageno;
+     request.zoom   = zoom;
+
+     return DocumentProvider_Remote_Call( thiz, &request, &reply, ret_surface, NULL );
+}
+
+static DFBResult
+DocumentProvider_Remote_RenderRegion( DocumentProvider   *thiz,
+                                      int                 pageno,
+                                      float               zoom,
+                                      const DocumentBox  *region,
+                                      IDirectFBSurface  **ret_surface )
+{
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type   = REMOTE_RENDER;
+     request.pageno = pageno;
+     request.zoom   = zoom;
+     request.region = *region;
+
+     return DocumentProvider_Remote_Call( thiz, &request, &reply, ret_surface, NULL );
+}
+
+static DFBResult
+DocumentProvider_Remote_GetContentBox( DocumentProvider *thiz,
+                                       int               pageno,
+                                       DocumentBox      *ret_box )
+{
+     DFBResult     ret;
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type   = REMOTE_CONTENT_BOX;
+     request.pageno = pageno;
+
+     ret = DocumentProvider_Remote_Call( thiz, &request, &reply, NULL, NULL );
+     if (ret)
+          return ret;
+
+     *ret_box = reply.box;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_GetLinks( DocumentProvider  *thiz,
+                                  int                pageno,
+                                  DocumentLink     **ret_links,
+                                  int               *ret_num )
+{
+     DFBResult     ret;
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type   = REMOTE_LINKS;
+     request.pageno = pageno;
+
+     ret = DocumentProvider_Remote_Call( thiz, &request, &reply, NULL, (void**) ret_links );
+     if (ret)
+          return ret;
+
+     *ret_num = reply.size / sizeof(DocumentLink);
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_GetOutline( DocumentProvider      *thiz,
+                                    DocumentOutlineEntry **ret_entries,
+                                    int                   *ret_num )
+{
+     DFBResult     ret;
+     RemoteRequest request;
+     RemoteReply   reply;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type = REMOTE_OUTLINE;
+
+     ret = DocumentProvider_Remote_Call( thiz, &request, &reply, NULL, (void**) ret_entries );
+     if (ret)
+          return ret;
+
+     *ret_num = reply.size / sizeof(DocumentOutlineEntry);
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Remote_GetFingerprints( DocumentProvider *thiz,
+                                         u64              *ret_fingerprints )
+{
+     DFBResult                     ret;
+     RemoteRequest                 request;
+     RemoteReply                   reply;
+     u64                          *fingerprints;
+     DocumentProvider_Remote_data *data = thiz->priv;
+
+     memset( &request, 0, sizeof(request) );
+
+     request.type = REMOTE_FINGERPRINTS;
+
+     ret = DocumentProvider_Remote_Call( thiz, &request, &reply, NULL, (void**) &fingerprints );
+     if (ret)
+          return ret;
+
+     if (reply.size != data->desc.num_pages * sizeof(u64)) {
+          if (fingerprints)
+               D_FREE( fingerprints );
+
+          return DFB_FAILURE;
+     }
+
+     if (fingerprints) {
+          memcpy( ret_fingerprints, fingerprints, reply.size );
+
+          D_FREE( fingerprints );
+     }
+
+     return DFB_OK;
+}
+
+DFBResult
+RemoteProviderNew( const char        *impl,
+                   int                num_workers,
+                   int                timeout,
+                   DocumentProvider **ret_provider )
+{
+     DocumentProvider             *provider;
+     DocumentProvider_Remote_data *data;
+
+     provider = D_CALLOC( 1, sizeof(DocumentProvider) );
+     if (!provider)
+          return D_OOM();
+
+     data = D_CALLOC( 1, sizeof(DocumentProvider_Remote_data) );
+     if (!data) {
+          D_FREE( provider );
+          return D_OOM();
+     }
+
+     snprintf( data->impl, sizeof(data->impl), "%s", impl );
+
+     data->num_workers = num_workers;
+     data->timeout     = timeout;
+
+     provider->impl            = "Remote";
+     provider->priv            = data;
+     provider->Init            = DocumentProvider_Remote_Init;
+     provider->Term            = DocumentProvider_Remote_Term;
+     provider->GetDescription  = DocumentProvider_Remote_GetDescription;
+     provider->RenderPage      = DocumentProvider_Remote_RenderPage;
+     provider->SetMemoryLimit  = DocumentProvider_Remote_SetMemoryLimit;
+     provider->GetOutline      = DocumentProvider_Remote_GetOutline;
+     provider->GetLinks        = DocumentProvider_Remote_GetLinks;
+     provider->GetFingerprints = DocumentProvider_Remote_GetFingerprints;
+     provider->SetRenderFlags  = DocumentProvider_Remote_SetRenderFlags;
+     provider->GetContentBox   = DocumentProvider_Remote_GetContentBox;
+     provider->RenderRegion    = DocumentProvider_Remote_RenderRegion;
+     provider->SetProgressFunc = DocumentProvider_Remote_SetProgressFunc;
+
+     *ret_provider = provider;
+
+     return DFB_OK;
+}
+
+void
+RemoteProviderDestroy( DocumentProvider *provider )
+{
+     D_FREE( provider->priv );
+     D_FREE( provider );
+}
+
+/**********************************************************************************************************************/
+
+/*
+ * Worker process. Surfaces are created in memfds, so that the pages are rendered in memory shared with the viewer, and
+ * shown while they are rendered.
+ */
+
+typedef struct {
+     int                    fd;                      /* to the viewer */
+     IDirectFBEventBuffer  *events;                  /* of the surfaces in memfds */
+     DirectLink            *mappings;
+
+     DFBResult            (*CreateSurface)( IDirectFB *thiz, const DFBSurfaceDescription *desc,
+                                            IDirectFBSurface **ret_interface );
+} RemoteWorkerState;
+
+static RemoteWorkerState remote_worker;
+
+static DFBResult
+RemoteWorker_CreateSurface( IDirectFB                    *thiz,
+                            const DFBSurfaceDescription  *desc,
+                            IDirectFBSurface            **ret_interface )
+{
+     DFBResult              ret;
+     DFBSurfaceDescription  shared;
+     RemoteMapping         *mapping;
+     int                    pitch;
+     RemoteWorkerState     *worker = &remote_worker;
+
+     /* Plain surfaces only, as created by the providers. */
+     if (desc->flags != (DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT) || desc->width < 1 || desc->height < 1)
+          return worker->CreateSurface( thiz, desc, ret_interface );
+
+     mapping = D_CALLOC( 1, sizeof(RemoteMapping) );
+     if (!mapping)
+          return D_OOM();
+
+     pitch = Remote_Pitch( desc->pixelformat, desc->width );
+
+     mapping->size  = (size_t) pitch * desc->height;
+     mapping->ptr   = MAP_FAILED;
+     mapping->memfd = memfd_create( "projektor-page", MFD_CLOEXEC );
+     if (mapping->memfd < 0) {
+          ret = DFB_FAILURE;
+          goto error;
+     }
+
+     if (ftruncate( mapping->memfd, mapping->size )) {
+          ret = DFB_NOSYSTEMMEMORY;
+          goto error;
+     }
+
+     mapping->ptr = mmap( NULL, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, mapping->memfd, 0 );
+     if (mapping->ptr == MAP_FAILED) {
+          ret = DFB_NOSYSTEMMEMORY;
+          goto error;
+     }
+
+     shared                       = *desc;
+     shared.flags                |= DSDESC_PREALLOCATED;
+     shared.preallocated[0].data  = mapping->ptr;
+     shared.preallocated[0].pitch = pitch;
+     shared.preallocated[1].data  = NULL;
+     shared.preallocated[1].pitch = 0;
+
+     ret = worker->CreateSurface( thiz, &shared, ret_interface );
+     if (ret)
+          goto error;
+
+     (*ret_interface)->GetID( *ret_interface, &mapping->surface_id );
+     (*ret_interface)->AttachEventBuffer( *ret_interface, worker->events );
+
+     direct_list_append( &worker->mappings, &mapping->link );
+
+     return DFB_OK;
+
+error:
+     if (mapping->ptr != MAP_FAILED)
+          munmap( mapping->ptr, mapping->size );
+
+     if (mapping->memfd >= 0)
+          close( mapping->memfd );
+
+     D_FREE( mapping );
+
+     return ret;
+}
+
+static DFBResult
+RemoteWorker_Reply( int                fd,
+                    const RemoteReply *reply,
+                    int                memfd )
+{
+     struct msghdr   msg;
+     struct iovec    iov;
+     struct cmsghdr *cmsg;
+     char            control[CMSG_SPACE(sizeof(int))];
+
+     memset( &msg, 0, sizeof(msg) );
+
+     iov.iov_base   = (void*) reply;
+     iov.iov_len    = sizeof(RemoteReply);
+     msg.msg_iov    = &iov;
+     msg.msg_iovlen = 1;
+
+     if (memfd >= 0) {
+          msg.msg_control    = control;
+          msg.msg_controllen = sizeof(control);
+
+          cmsg             = CMSG_FIRSTHDR( &msg );
+          cmsg->cmsg_level = SOL_SOCKET;
+          cmsg->cmsg_type  = SCM_RIGHTS;
+          cmsg->cmsg_len   = CMSG_LEN( sizeof(int) );
+
+          memcpy( CMSG_DATA( cmsg ), &memfd, sizeof(int) );
+     }
+
+     if (sendmsg( fd, &msg, MSG_NOSIGNAL ) != sizeof(RemoteReply))
+          return DFB_IO;
+
+     return DFB_OK;
+}
+
+/*
+ * Report the progress of a page rendered in a memfd with a partial reply, passing the memfd with the first one.
+ */
+static void
+RemoteWorker_Progress( void               *ctx,
+                       IDirectFBSurface   *surface,
+                       const DFBRectangle *rect )
+{
+     RemoteReply        reply;
+     RemoteMapping     *mapping;
+     RemoteWorkerState *worker = ctx;
+
+     memset( &reply, 0, sizeof(reply) );
+
+     surface->GetID( surface, &reply.surface_id );
+
+     mapping = Remote_FindMapping( worker->mappings, reply.surface_id );
+     if (!mapping)
+          return;
+
+     reply.partial = true;
+     reply.rect    = *rect;
+
+     surface->GetSize( surface, &reply.width, &reply.height );
+     surface->GetPixelFormat( surface, &reply.format );
+
+     reply.pitch = Remote_Pitch( reply.format, reply.width );
+
+     if (RemoteWorker_Reply( worker->fd, &reply, mapping->shared ? -1 : mapping->memfd ) == DFB_OK)
+          mapping->shared = true;
+}
+
+/*
+ * Pass an array in a memfd, replies are limited in size.
+ */
+static DFBResult
+RemoteWorker_Share( const void  *ptr,
+                    size_t       size,
+                    int         *ret_memfd )
+{
+     int memfd;
+
+     memfd = memfd_create( "projektor-data", MFD_CLOEXEC );
+     if (memfd < 0)
+          return DFB_FAILURE;
+
+     if (write( memfd, ptr, size ) != (ssize_t) size) {
+          close( memfd );
+          return DFB_IO;
+     }
+
+     *ret_memfd = memfd;
+
+     return DFB_OK;
+}
+
+static DFBResult
+RemoteWorker_GetArray( DocumentProvider    *provider,
+                       const RemoteRequest *request,
+                       RemoteReply         *reply,
+                       int                 *ret_memfd )
+{
+     DFBResult            ret;
+     DocumentDescription  desc;
+     void                *array = NULL;
+     int                  num   = 0;
+
+     switch (request->type) {
+          case REMOTE_LINKS:
+               if (!provider->GetLinks)
+                    return DFB_UNSUPPORTED;
+
+               ret = provider->GetLinks( provider, request->pageno, (DocumentLink**) &array, &num );
+
+               reply->size = num * sizeof(DocumentLink);
+               break;
+
+          case REMOTE_OUTLINE:
+               if (!provider->GetOutline)
+                    return DFB_UNSUPPORTED;
+
+               ret = provider->GetOutline( provider, (DocumentOutlineEntry**) &array, &num );
+
+               reply->size = num * sizeof(DocumentOutlineEntry);
+               break;
+
+          case REMOTE_FINGERPRINTS:
+               if (!provider->GetFingerprints)
+                    return DFB_UNSUPPORTED;
+
+               provider->GetDescription( provider, &desc );
+
+               array = D_CALLOC( desc.num_pages ?: 1, sizeof(u64) );
+               if (!array)
+                    return D_OOM();
+
+               ret = provider->GetFingerprints( provider, array );
+
+               reply->size = desc.num_pages * sizeof(u64);
+               break;
+
+          default:
+               return DFB_UNSUPPORTED;
+     }
+
+     if (!ret && reply->size)
+          ret = RemoteWorker_Share( array, reply->size, ret_memfd );
+
+     if (array)
+          D_FREE( array );
+
+     return ret;
+}
+
+static DFBResult
+RemoteWorker_Render( DocumentProvider    *provider,
+                     IDirectFB           *idirectfb,
+                     const RemoteRequest *request,
+                     RemoteReply         *reply,
+                     int                 *ret_memfd )
+{
+     DFBResult          ret;
+     int                y;
+     int                pitch;
+     void              *src;
+     void              *dst;
+     int                memfd;
+     RemoteMapping     *mapping;
+     IDirectFBSurface  *surface;
+
+     /* The flags travel with each request, a restarted worker picks them up again. */
+     if (provider->SetRenderFlags)
+          provider->SetRenderFlags( provider, request->flags, request->layers[0] ? request->layers : NULL );
+
+     if (request->region.x2 > request->region.x1 && request->region.y2 > request->region.y1)
+          ret = DocumentRenderRegion( provider, idirectfb, request->pageno, request->zoom, &request->region,
+                                      &surface );
+     else
+          ret = provider->RenderPage( provider, request->pageno, request->zoom, &surface );
+
+     if (ret)
+          return ret;
+
+     surface->GetID( surface, &reply->surface_id );
+     surface->GetSize( surface, &reply->width, &reply->height );
+     surface->GetPixelFormat( surface, &reply->format );
+
+     reply->pitch = Remote_Pitch( reply->format, reply->width );
+
+     /* Rendered in a memfd already. */
+     mapping = Remote_FindMapping( remote_worker.mappings, reply->surface_id );
+     if (mapping) {
+          *ret_memfd = dup( mapping->memfd );
+          if (*ret_memfd < 0)
+               ret = DFB_FAILURE;
+
+          goto out;
+     }
+
+     /* Other surfaces are copied. */
+     memfd = memfd_create( "projektor-page", MFD_CLOEXEC );
+     if (memfd < 0) {
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
+     if (ftruncate( memfd, reply->pitch * reply->height )) {
+          close( memfd );
+          ret = DFB_NOSYSTEMMEMORY;
+          goto out;
+     }
+
+     dst = mmap( NULL, reply->pitch * reply->height, PROT_WRITE, MAP_SHARED, memfd, 0 );
+     if (dst == MAP_FAILED) {
+          close( memfd );
+          ret = DFB_NOSYSTEMMEMORY;
+          goto out;
+     }
+
+     surface->Lock( surface, DSLF_READ, &src, &pitch );
+
+     for (y = 0; y < reply->height; y++)
+          memcpy( (u8*) dst + y * reply->pitch, (u8*) src + y * pitch,
+                  DFB_BYTES_PER_LINE( reply->format, reply->width ) );
+
+     surface->Unlock( surface );
+
+     munmap( dst, reply->pitch * reply->height );
+
+     *ret_memfd = memfd;
+
+out:
+     surface->Release( surface );
+
+     return ret;
+}
+
+int
+RemoteWorkerMain( int   argc,
+                  char *argv[] )
+{
+     DFBResult          ret;
+     int                fd;
+     RemoteRequest      request;
+     unsigned long      memory_limit = 0;
+     IDirectFB         *idirectfb    = NULL;
+     DocumentProvider  *provider     = NULL;
+
+     if (argc < 3 || sscanf( argv[2], "%d", &fd ) != 1)
+          return 1;
+
+     /* The worker does not touch the display, only system memory surfaces are created. */
+     if (DirectFBInit( &argc, &argv ))
+          return 1;
+
+     DirectFBSetOption( "system", "dummy" );
+
+     remote_worker.fd = fd;
+
+     while (recv( fd, &request, sizeof(request), 0 ) == sizeof(request)) {
+          int            memfd = -1;
+          RemoteReply    reply;
+          RemoteMapping *mapping;
+
+          memset( &reply, 0, sizeof(reply) );
+
+          if (remote_worker.events) {
+               Remote_ReleaseMappings( remote_worker.events, &remote_worker.mappings );
+
+               direct_list_foreach (mapping, remote_worker.mappings)
+                    mapping->shared = false;
+          }
+
+          if (provider && provider->SetProgressFunc)
+               provider->SetProgressFunc( provider, request.progress ? RemoteWorker_Progress : NULL, &remote_worker );
+
+          if (provider && provider->SetMemoryLimit && request.memory_limit != memory_limit) {
+               provider->SetMemoryLimit( provider, request.memory_limit );
+
+               memory_limit = request.memory_limit;
+          }
+
+          switch (request.type) {
+               case REMOTE_INIT:
+                    ret = DFB_UNSUPPORTED;
+
+                    if (!idirectfb) {
+                         if (DirectFBCreate( &idirectfb )) {
+                              idirectfb = NULL;
+                              break;
+                         }
+
+                         /* Surfaces of the providers are created in memfds. */
+                         if (idirectfb->CreateEventBuffer( idirectfb, &remote_worker.events ) == DFB_OK) {
+                              remote_worker.CreateSurface = idirectfb->CreateSurface;
+                              idirectfb->CreateSurface    = RemoteWorker_CreateSurface;
+                         }
+                         else
+                              remote_worker.events = NULL;
+                    }
+
+                    if (DocumentProviderLoad( request.impl, &provider )) {
+                         provider = NULL;
+                         break;
+                    }
+
+                    ret = provider->Init( provider, request.filename, idirectfb, request.format );
+                    if (ret) {
+                         provider = NULL;
+                         break;
+                    }
+
+                    provider->GetDescription( provider, &reply.desc );
+                    break;
+
+               case REMOTE_RENDER:
+                    ret = provider ? RemoteWorker_Render( provider, idirectfb, &request, &reply, &memfd ) :
+                                     DFB_NOCONTEXT;
+                    break;
+
+               case REMOTE_CONTENT_BOX:
+                    if (provider && provider->SetRenderFlags)
+                         provider->SetRenderFlags( provider, request.flags, request.layers[0] ? request.layers : NULL );
+
+                    ret = provider ? DocumentContentBox( provider, request.pageno, &reply.box ) : DFB_NOCONTEXT;
+                    break;
+
+               case REMOTE_LINKS:
+               case REMOTE_OUTLINE:
+               case REMOTE_FINGERPRINTS:
+                    ret = provider ? RemoteWorker_GetArray( provider, &request, &reply, &memfd ) : DFB_NOCONTEXT;
+                    break;
+
+               default:
+                    ret = DFB_UNSUPPORTED;
+                    break;
+          }
+
+          reply.result = ret;
+
+          ret = RemoteWorker_Reply( fd, &reply, memfd );
+
+          if (memfd >= 0)
+               close( memfd );
+
+          if (ret)
+               break;
+     }
+
+     if (provider)
+          provider->Term( provider );
+
+     if (remote_worker.events)
+          remote_worker.events->Release( remote_worker.events );
+
+     if (idirectfb)
+          idirectfb->Release( idirectfb );
+
+     return 0;
+}
@@ -0,0 +1,44 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __REMOTE_H__
+#define __REMOTE_H__
+
+#include "documentprovider.h"
+
+#define REMOTE_WORKER_OPTION "--render-worker"
+
+/*
+ * Create a document provider running the named provider in worker processes. Pages are rendered by the workers in
+ * shared memory, wrapped in preallocated surfaces, and shown while they are rendered with a progress function. A worker
+ * not answering within the timeout (in seconds) is killed and restarted.
+ */
+DFBResult RemoteProviderNew    ( const char        *impl,
+                                 int                num_workers,
+                                 int                timeout,
+                                 DocumentProvider **ret_provider );
+
+void      RemoteProviderDestroy( DocumentProvider  *provider );
+
+/*
+ * Main loop of a worker process, started as "projektor --render-worker <fd>".
+ */
+int       RemoteWorkerMain     ( int                argc,
+                                 char              *argv[] );
+
+#endif
@@ -0,0 +1,439 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "dither.h"
+#include "documentprovider.h"
+#include <direct/clock.h>
+#include <direct/memcpy.h>
+#include <ctype.h>
+
+extern DirectLink *documentproviders;
+
+/*
+ * Synthetic documents are described by a text file starting with a "# Synthetic" line, followed by "key = value"
+ * lines:
+ *
+ *   title        = <title>                          (file name by default)
+ *   pages        = <number of pages>                (10 by default)
+ *   size         = <width>x<height>                 (page size at zoom factor 1, 595x842 by default)
+ *   pattern      = solid|gradient|checker|noise     (page contents, gradient by default)
+ *   cost         = <milliseconds>                   (mean render cost at zoom factor 1, 0 by default)
+ *   distribution = constant|uniform|spiky           (per page render cost distribution, constant by default)
+ *   load         = sleep|spin                       (idle or busy render cost, sleep by default)
+ *   fail         = <n>                              (fail rendering every nth page, never by default)
+ *   seed         = <seed>                           (seed of costs and noise, 0 by default)
+ *
+ * The render cost scales with the page area. With the uniform distribution, page costs are spread between zero and
+ * twice the mean cost. With the spiky distribution, one page out of ten costs ten times more than the others.
+ */
+
+/**********************************************************************************************************************/
+
+typedef enum {
+     SYNTHETIC_PATTERN_SOLID,
+     SYNTHETIC_PATTERN_GRADIENT,
+     SYNTHETIC_PATTERN_CHECKER,
+     SYNTHETIC_PATTERN_NOISE
+} SyntheticPattern;
+
+typedef enum {
+     SYNTHETIC_DISTRIBUTION_CONSTANT,
+     SYNTHETIC_DISTRIBUTION_UNIFORM,
+     SYNTHETIC_DISTRIBUTION_SPIKY
+} SyntheticDistribution;
+
+typedef struct {
+     IDirectFB             *idirectfb;
+     DFBSurfacePixelFormat  format;
+
+     int                    width;
+     int                    height;
+     SyntheticPattern       pattern;
+     float                  cost;
+     SyntheticDistribution  distribution;
+     bool                   spin;
+     int                    fail;
+     unsigned int           seed;
+
+     DocumentDescription    desc;
+} DocumentProvider_Synthetic_data;
+
+/**********************************************************************************************************************/
+
+static inline u32
+Synthetic_Hash( u32 a,
+                u32 b,
+                u32 c )
+{
+     u32 h = a * 0x9e3779b1 ^ b * 0x85ebca77 ^ c * 0xc2b2ae3d;
+
+     h ^= h >> 15;
+     h *= 0x2c1b3c6d;
+     h ^= h >> 12;
+     h *= 0x297a2d39;
+     h ^= h >> 15;
+
+     return h;
+}
+
+static DFBResult
+Synthetic_ParseLine( DocumentProvider_Synthetic_data *data,
+                     char                            *line )
+{
+     char *key;
+     char *value;
+     char *end;
+
+     /* Strip comments and trailing spaces. */
+     end = strchr( line, '#' );
+     if (end)
+          *end = 0;
+
+     end = line + strlen( line );
+     while (end > line && isspace( (unsigned char) end[-1] ))
+          *--end = 0;
+
+     key = line;
+     while (isspace( (unsigned char) *key ))
+          key++;
+
+     if (!*key)
+          return DFB_OK;
+
+     value = strchr( key, '=' );
+     if (!value)
+          return DFB_INVARG;
+
+     end = value;
+     while (end > key && isspace( (unsigned char) end[-1] ))
+          end--;
+     *end = 0;
+
+     value++;
+     while (isspace( (unsigned char) *value ))
+          value++;
+
+     if (!strcmp( key, "title" )) {
+          snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, "%s", value );
+     }
+     else if (!strcmp( key, "pages" )) {
+          if (sscanf( value, "%d", &data->desc.num_pages ) != 1 || data->desc.num_pages < 1)
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "size" )) {
+          if (sscanf( value, "%dx%d", &data->width, &data->height ) != 2 || data->width < 1 || data->height < 1)
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "pattern" )) {
+          if (!strcmp( value, "solid" ))
+               data->pattern = SYNTHETIC_PATTERN_SOLID;
+          else if (!strcmp( value, "gradient" ))
+               data->pattern = SYNTHETIC_PATTERN_GRADIENT;
+          else if (!strcmp( value, "checker" ))
+               data->pattern = SYNTHETIC_PATTERN_CHECKER;
+          else if (!strcmp( value, "noise" ))
+               data->pattern = SYNTHETIC_PATTERN_NOISE;
+          else
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "cost" )) {
+          if (sscanf( value, "%f", &data->cost ) != 1 || data->cost < 0)
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "distribution" )) {
+          if (!strcmp( value, "constant" ))
+               data->distribution = SYNTHETIC_DISTRIBUTION_CONSTANT;
+          else if (!strcmp( value, "uniform" ))
+               data->distribution = SYNTHETIC_DISTRIBUTION_UNIFORM;
+          else if (!strcmp( value, "spiky" ))
+               data->distribution = SYNTHETIC_DISTRIBUTION_SPIKY;
+          else
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "load" )) {
+          if (!strcmp( value, "sleep" ))
+               data->spin = false;
+          else if (!strcmp( value, "spin" ))
+               data->spin = true;
+          else
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "fail" )) {
+          if (sscanf( value, "%d", &data->fail ) != 1 || data->fail < 0)
+               return DFB_INVARG;
+     }
+     else if (!strcmp( key, "seed" )) {
+          if (sscanf( value, "%u", &data->seed ) != 1)
+               return DFB_INVARG;
+     }
+     else
+          return DFB_INVARG;
+
+     return DFB_OK;
+}
+
+static long long
+Synthetic_Cost( DocumentProvider_Synthetic_data *data,
+                int                              pageno,
+                float                            zoom )
+{
+     float cost = data->cost * zoom * zoom;
+     u32   h    = Synthetic_Hash( data->seed, pageno, 0 );
+
+     switch (data->distribution) {
+          case SYNTHETIC_DISTRIBUTION_UNIFORM:
+               cost *= 2.0f * (h & 0xffff) / 0xffff;
+               break;
+
+          case SYNTHETIC_DISTRIBUTION_SPIKY:
+               cost *= h % 10 ? 1.0f : 10.0f;
+               break;
+
+          default:
+               break;
+     }
+
+     return cost * 1000;
+}
+
+static void
+Synthetic_Generate( DocumentProvider_Synthetic_data *data,
+                    int                              pageno,
+                    float                            zoom,
+                    u32                             *pixels,
+                    int                              width,
+                    int                              height )
+{
+     int x, y;
+     u32 h   = Synthetic_Hash( data->seed, pageno, 1 );
+     u32 rgb = 0xff000000 | (h & 0x7f7f7f) | 0x404040;
+
+     for (y = 0; y < height; y++) {
+          /* Coordinates at zoom factor 1. */
+          int py = y / zoom;
+
+          for (x = 0; x < width; x++) {
+               int px = x / zoom;
+
+               switch (data->pattern) {
+                    case SYNTHETIC_PATTERN_SOLID:
+                         pixels[x] = rgb;
+                         break;
+
+                    case SYNTHETIC_PATTERN_GRADIENT:
+                         pixels[x] = 0xff000000 | (px * 255 / data->width) << 16 | (py * 255 / data->height) << 8 |
+                                     (rgb & 0xff);
+                         break;
+
+                    case SYNTHETIC_PATTERN_CHECKER:
+                         pixels[x] = ((px >> 4) ^ (py >> 4)) & 1 ? rgb : 0xffffffff;
+                         break;
+
+                    case SYNTHETIC_PATTERN_NOISE:
+                         pixels[x] = 0xff000000 | Synthetic_Hash( h, px, py );
+                         break;
+               }
+          }
+
+          pixels += width;
+     }
+}
+
+/**********************************************************************************************************************/
+
+static int
+DocumentProvider_Synthetic_Probe( DocumentProvider *thiz,
+                                  const u8         *header,
+                                  unsigned int      length )
+{
+     return length >= 11 && !memcmp( header, "# Synthetic", 11 ) ? 100 : 0;
+}
+
+static DFBResult
+DocumentProvider_Synthetic_Init( DocumentProvider      *thiz,
+                                 const char            *filename,
+                                 IDirectFB             *idirectfb,
+                                 DFBSurfacePixelFormat  format )
+{
+     DFBResult                        ret = DFB_OK;
+     FILE                            *file;
+     char                             line[256];
+     DocumentProvider_Synthetic_data *data;
+
+     file = fopen( filename, "r" );
+     if (!file)
+          return DFB_FILENOTFOUND;
+
+     data = D_CALLOC( 1, sizeof(DocumentProvider_Synthetic_data) );
+     if (!data) {
+          fclose( file );
+          return D_OOM();
+     }
+
+     data->idirectfb      = idirectfb;
+     data->format         = format;
+     data->width          = 595;
+     data->height         = 842;
+     data->pattern        = SYNTHETIC_PATTERN_GRADIENT;
+     data->distribution   = SYNTHETIC_DISTRIBUTION_CONSTANT;
+     data->desc.num_pages = 10;
+
+     if (strrchr( filename, '/' ))
+          snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, "%s", strrchr( filename, '/' ) + 1 );
+     else
+          snprintf( data->desc.title, DOCUMENT_DESC_TITLE_LENGTH, "%s", filename );
+
+     while (fgets( line, sizeof(line), file )) {
+          ret = Synthetic_ParseLine( data, line );
+          if (ret) {
+               D_ERROR( "Projektor/Synthetic: Invalid line '%s' in '%s'!\n", line, filename );
+               break;
+          }
+     }
+
+     fclose( file );
+
+     if (ret) {
+          D_FREE( data );
+          return ret;
+     }
+
+     thiz->priv = data;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Synthetic_Term( DocumentProvider *thiz )
+{
+     DocumentProvider_Synthetic_data *data = thiz->priv;
+
+     D_FREE( data );
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Synthetic_GetDescription( DocumentProvider    *thiz,
+                                           DocumentDescription *ret_desc )
+{
+     DocumentProvider_Synthetic_data *data = thiz->priv;
+
+     if (!ret_desc)
+          return DFB_INVARG;
+
+     *ret_desc = data->desc;
+
+     return DFB_OK;
+}
+
+static DFBResult
+DocumentProvider_Synthetic_RenderPage( DocumentProvider  *thiz,
+                                       int                pageno,
+                                       float              zoom,
+                                       IDirectFBSurface **ret_surface )
+{
+     DFBResult                        ret;
+     DFBSurfaceDescription            desc;
+     int                              y;
+     int                              pitch;
+     void                            *ptr;
+     unsigned char                   *src;
+     long long                        deadline;
+     IDirectFBSurface                *surface;
+     u32                             *pixmap;
+     DocumentProvider_Synthetic_data *data = thiz->priv;
+
+     if (pageno < 1 || pageno > data->desc.num_pages)
+          return DFB_INVARG;
+
+     deadline = direct_clock_get_micros() + Synthetic_Cost( data, pageno, zoom );
+
+     desc.flags       = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+     desc.width       = data->width  * zoom + 0.5f;
+     desc.height      = data->height * zoom + 0.5f;
+     desc.pixelformat = data->format == DSPF_RGB16 ? DSPF_RGB16 : DSPF_ARGB;
+
+     pixmap = D_MALLOC( desc.width * desc.height * 4 );
+     if (!pixmap)
+          return D_OOM();
+
+     Synthetic_Generate( data, pageno, zoom, pixmap, desc.width, desc.height );
+
+     /* Render cost. */
+     if (data->spin) {
+          while (direct_clock_get_micros() < deadline)
+               ;
+     }
+     else {
+          long long remaining = deadline - direct_clock_get_micros();
+
+          if (remaining > 0)
+               usleep( remaining );
+     }
+
+     if (data->fail && pageno % data->fail == 0) {
+          ret = DFB_FAILURE;
+          goto out;
+     }
+
+     ret = data->idirectfb->CreateSurface( data->idirectfb, &desc, &surface );
+     if (ret)
+          goto out;
+
+     surface->Lock( surface, DSLF_WRITE, &ptr, &pitch );
+
+     src = (unsigned char*) pixmap;
+
+     if (desc.pixelformat == DSPF_RGB16) {
+          Dither_RGB16( src, desc.width * 4, DSPF_ARGB, ptr, pitch, desc.width, desc.height );
+     }
+     else {
+          for (y = 0; y < desc.height; y++) {
+               direct_memcpy( ptr, src, desc.width * 4 );
+
+               src += desc.width * 4;
+               ptr += pitch;
+          }
+     }
+
+     surface->Unlock( surface );
+
+     *ret_surface = surface;
+
+out:
+     D_FREE( pixmap );
+
+     return ret;
+}
+
+static DocumentProvider synthetic_provider = {
+     .impl           = "Synthetic",
+     .Probe          = DocumentProvider_Synthetic_Probe,
+     .Init           = DocumentProvider_Synthetic_Init,
+     .Term           = DocumentProvider_Synthetic_Term,
+     .GetDescription = DocumentProvider_Synthetic_GetDescription,
+     .RenderPage     = DocumentProvider_Synthetic_RenderPage,
+};
+
+__attribute__((constructor))
+static void
+DocumentProvider_Synthetic_ctor()
+{
+     direct_list_append( &documentproviders, &synthetic_provider.link );
+}
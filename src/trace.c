@@ -0,0 +1,200 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "trace.h"
+#include <direct/clock.h>
+#include <direct/mem.h>
+#include <direct/messages.h>
+
+/* Upper bounds of the histogram buckets in milliseconds, the last bucket is unbounded. */
+static const int trace_buckets[] = { 1, 2, 4, 8, 16, 33, 66, 100, 250, 500, 1000 };
+
+#define TRACE_NUM_BUCKETS (D_ARRAY_SIZE(trace_buckets) + 1)
+
+struct _Trace {
+     FILE         *file;
+     bool          record;
+     long long     start;
+
+     long long    *latencies;
+     int           num_latencies;
+     int           max_latencies;
+};
+
+/**********************************************************************************************************************/
+
+DFBResult
+TraceOpen( const char  *filename,
+           bool         record,
+           Trace      **ret_trace )
+{
+     Trace *trace;
+
+     trace = D_CALLOC( 1, sizeof(Trace) );
+     if (!trace)
+          return D_OOM();
+
+     trace->file = fopen( filename, record ? "w" : "r" );
+     if (!trace->file) {
+          D_ERROR( "Projektor/Trace: Cannot open '%s'!\n", filename );
+          D_FREE( trace );
+          return DFB_FILENOTFOUND;
+     }
+
+     trace->record = record;
+
+     *ret_trace = trace;
+
+     return DFB_OK;
+}
+
+void
+TraceClose( Trace *trace )
+{
+     fclose( trace->file );
+
+     if (trace->latencies)
+          D_FREE( trace->latencies );
+
+     D_FREE( trace );
+}
+
+DFBResult
+TraceRecord( Trace                *trace,
+             const DFBWindowEvent *evt )
+{
+     long long now = direct_clock_get_micros();
+
+     if (!trace->start)
+          trace->start = now;
+
+     fprintf( trace->file, "%lld %d %d %d %d %d %d\n", now - trace->start, evt->type, evt->key_symbol, evt->key_id,
+              evt->key_code, evt->modifiers, evt->locks );
+
+     /* Keep the trace of a session that crashes. */
+     fflush( trace->file );
+
+     return DFB_OK;
+}
+
+DFBResult
+TraceRead( Trace          *trace,
+           long long      *ret_time,
+           DFBWindowEvent *ret_evt )
+{
+     char line[128];
+     int  type, key_symbol, key_id, key_code, modifiers, locks;
+
+     while (fgets( line, sizeof(line), trace->file )) {
+          if (sscanf( line, "%lld %d %d %d %d %d %d", ret_time, &type, &key_symbol, &key_id, &key_code, &modifiers,
+                      &locks ) != 7)
+               continue;
+
+          memset( ret_evt, 0, sizeof(DFBWindowEvent) );
+
+          ret_evt->clazz      = DFEC_WINDOW;
+          ret_evt->type       = type;
+          ret_evt->key_symbol = key_symbol;
+          ret_evt->key_id     = key_id;
+          ret_evt->key_code   = key_code;
+          ret_evt->modifiers  = modifiers;
+          ret_evt->locks      = locks;
+
+          return DFB_OK;
+     }
+
+     return DFB_EOF;
+}
+
+void
+TraceLatency( Trace     *trace,
+              long long  micros )
+{
+     if (trace->num_latencies == trace->max_latencies) {
+          int        max       = trace->max_latencies ? 2 * trace->max_latencies : 256;
+          long long *latencies = D_REALLOC( trace->latencies, max * sizeof(long long) );
+
+          if (!latencies) {
+               D_OOM();
+               return;
+          }
+
+          trace->latencies     = latencies;
+          trace->max_latencies = max;
+     }
+
+     trace->latencies[trace->num_latencies++] = micros;
+}
+
+static int
+compare_latencies( const void *a,
+                   const void *b )
+{
+     long long la = *(const long long*) a;
+     long long lb = *(const long long*) b;
+
+     return (la > lb) - (la < lb);
+}
+
+void
+TraceHistogram( Trace *trace )
+{
+     int        i;
+     size_t     n;
+     int        counts[TRACE_NUM_BUCKETS] = { 0 };
+     int        max_count = 0;
+     long long *latencies = trace->latencies;
+     int        num       = trace->num_latencies;
+
+     if (!num) {
+          printf( "No key-to-pixels latency measured.\n" );
+          return;
+     }
+
+     qsort( latencies, num, sizeof(long long), compare_latencies );
+
+     for (i = 0; i < num; i++) {
+          for (n = 0; n < D_ARRAY_SIZE(trace_buckets); n++) {
+               if (latencies[i] < trace_buckets[n] * 1000LL)
+                    break;
+          }
+
+          if (++counts[n] > max_count)
+               max_count = counts[n];
+     }
+
+     printf( "Key-to-pixels latency over %d events (ms):\n\n", num );
+
+     for (n = 0; n < TRACE_NUM_BUCKETS; n++) {
+          int width = (counts[n] * 50 + max_count - 1) / max_count;
+
+          if (n < D_ARRAY_SIZE(trace_buckets))
+               printf( "  < %4d %6d ", trace_buckets[n], counts[n] );
+          else
+               printf( "  >=%4d %6d ", trace_buckets[n - 1], counts[n] );
+
+          while (width--)
+               putchar( '#' );
+
+          putchar( '\n' );
+     }
+
+     printf( "\n  min %.1f  median %.1f  p95 %.1f  p99 %.1f  max %.1f\n",
+             latencies[0] / 1000.0, latencies[num / 2] / 1000.0, latencies[num * 95 / 100] / 1000.0,
+             latencies[num * 99 / 100] / 1000.0, latencies[num - 1] / 1000.0 );
+}
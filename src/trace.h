@@ -0,0 +1,54 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <directfb.h>
+
+/*
+ * Input traces: window keyboard events with their time relative to the first event, one event per line.
+ */
+
+typedef struct _Trace Trace;
+
+DFBResult TraceOpen     ( const char           *filename,
+                          bool                  record,
+                          Trace               **ret_trace );
+
+void      TraceClose    ( Trace                *trace );
+
+DFBResult TraceRecord   ( Trace                *trace,
+                          const DFBWindowEvent *evt );
+
+/*
+ * Read the next event of a trace being replayed, returns DFB_EOF at the end of the trace.
+ */
+DFBResult TraceRead     ( Trace                *trace,
+                          long long            *ret_time,
+                          DFBWindowEvent       *ret_evt );
+
+/*
+ * Add a key-to-pixels latency measured during replay, and print the histogram of all latencies.
+ */
+void      TraceLatency  ( Trace                *trace,
+                          long long             micros );
+
+void      TraceHistogram( Trace                *trace );
+
+#endif
@@ -0,0 +1,109 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+
+#include "watch.h"
+#include <direct/mem.h>
+#include <direct/messages.h>
+#include <direct/util.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+struct _Watch {
+     int  fd;
+     char name[NAME_MAX + 1];                        /* of the file in the directory watched */
+};
+
+/**********************************************************************************************************************/
+
+DFBResult
+WatchOpen( const char  *filename,
+           Watch      **ret_watch )
+{
+     Watch      *watch;
+     char        dir[PATH_MAX];
+     const char *slash = strrchr( filename, '/' );
+
+     watch = D_CALLOC( 1, sizeof(Watch) );
+     if (!watch)
+          return D_OOM();
+
+     if (slash) {
+          snprintf( dir, sizeof(dir), "%.*s", (int) (slash - filename), filename );
+          snprintf( watch->name, sizeof(watch->name), "%s", slash + 1 );
+     }
+     else {
+          snprintf( dir, sizeof(dir), "." );
+          snprintf( watch->name, sizeof(watch->name), "%s", filename );
+     }
+
+     watch->fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+     if (watch->fd < 0) {
+          D_ERROR( "Projektor/Watch: Cannot initialize inotify!\n" );
+          D_FREE( watch );
+          return DFB_UNSUPPORTED;
+     }
+
+     if (inotify_add_watch( watch->fd, dir[0] ? dir : "/", IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0) {
+          D_ERROR( "Projektor/Watch: Cannot watch '%s'!\n", dir[0] ? dir : "/" );
+          close( watch->fd );
+          D_FREE( watch );
+          return DFB_FAILURE;
+     }
+
+     *ret_watch = watch;
+
+     return DFB_OK;
+}
+
+void
+WatchClose( Watch *watch )
+{
+     close( watch->fd );
+
+     D_FREE( watch );
+}
+
+bool
+WatchCheck( Watch *watch )
+{
+     ssize_t length;
+     bool    changed = false;
+     char    buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+     while ((length = read( watch->fd, buffer, sizeof(buffer) )) > 0) {
+          char *ptr = buffer;
+
+          while (ptr < buffer + length) {
+               const struct inotify_event *event = (const struct inotify_event*) ptr;
+
+               if (event->len && !strcmp( event->name, watch->name ))
+                    changed = true;
+
+               ptr += sizeof(struct inotify_event) + event->len;
+          }
+     }
+
+     return changed;
+}
+
+int
+WatchGetFd( Watch *watch )
+{
+     return watch->fd;
+}
@@ -0,0 +1,45 @@
+/*
+   This file is part of Projektor.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with this program; if not, write to the Free Software Foundation, Inc.,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+*/
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include <directfb.h>
+
+/*
+ * File change notifications, from inotify. The directory of the file is watched, so that a file replaced by renaming
+ * another one over it is followed.
+ */
+
+typedef struct _Watch Watch;
+
+DFBResult WatchOpen ( const char  *filename,
+                      Watch      **ret_watch );
+
+void      WatchClose( Watch       *watch );
+
+/*
+ * Return whether the file has been written or replaced since the last check, without blocking.
+ */
+bool      WatchCheck( Watch       *watch );
+
+/*
+ * File descriptor readable on changes in the directory, to be polled with other ones before checking.
+ */
+int       WatchGetFd( Watch       *watch );
+
+#endif